@@ -0,0 +1,177 @@
+#ifndef BAKED_TEXTURE_H
+#define BAKED_TEXTURE_H
+
+#include "DecodedImage.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Header at the start of a baked texture file. The layout is KTX-like: this header, then one
+// BakedTextureLevel per mip level, then the pixels of each level ready to pass to glTexImage2D.
+struct BakedTextureHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t internalFormat;
+	uint32_t format;
+	uint32_t type;
+	uint32_t compressed;
+	uint32_t components;
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+	// What the file was cooked from (see SourceStamp)
+	SourceStamp source;
+	// Hash of the load settings that affect the cooked pixels
+	uint64_t settingsHash;
+};
+
+struct BakedTextureLevel {
+	uint64_t offset;
+	uint64_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+// Reads and writes baked texture files. A texture is cooked the first time it is loaded, and later runs memory map
+// the file and upload every mip level straight from the mapping, skipping image decoding and glGenerateMipmap.
+class BakedTexture
+{
+public:
+	// Bump whenever the file layout or the cooking process changes, so old files are rebuilt
+	static const uint32_t Version = 2;
+
+	// The baked file for a source image and a set of settings. Different settings bake to different files,
+	// so loading one texture two ways doesn't keep invalidating a shared cache.
+	static std::string cachePath(const std::string &source, uint64_t settingsHash)
+	{
+		std::ostringstream name;
+		name << source << '.' << std::hex << settingsHash << ".baked";
+		return name.str();
+	}
+
+	// Maps the baked file for source and fills image with levels pointing into the mapping.
+	// Returns false if there is no file, or it was made by another version, from other settings or from an older source.
+	static bool load(const std::string &source, uint64_t settingsHash, DecodedImage &image)
+	{
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+		if (!file->open(cachePath(source, settingsHash)) || file->size() < sizeof(BakedTextureHeader))
+			return false;
+
+		BakedTextureHeader header;
+		std::memcpy(&header, file->data(), sizeof(header));
+		if (std::memcmp(header.magic, "BTEX", 4) != 0 || header.version != Version || header.settingsHash != settingsHash)
+			return false;
+		if (!header.source.current(source, cachePath(source, settingsHash), *file, offsetof(BakedTextureHeader, source)))
+			return false;
+
+		const size_t tableEnd = sizeof(header) + header.levelCount * sizeof(BakedTextureLevel);
+		if (header.levelCount == 0 || tableEnd > file->size())
+			return false;
+		std::vector<TextureLevel> levels(header.levelCount);
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			BakedTextureLevel level;
+			std::memcpy(&level, file->data() + sizeof(header) + i * sizeof(level), sizeof(level));
+			if (level.offset + level.size > file->size())
+				return false;
+			levels[i].pixels = file->data() + level.offset;
+			levels[i].size = (size_t)level.size;
+			levels[i].width = (int)level.width;
+			levels[i].height = (int)level.height;
+		}
+
+		image.internalFormat = (GLint)header.internalFormat;
+		image.format = header.format;
+		image.type = header.type;
+		image.compressed = header.compressed != 0;
+		image.components = (int)header.components;
+		image.levels = levels;
+		image.owner = file;
+		return true;
+	}
+
+	// Writes image to the baked file for source. The file is written under a temporary name and renamed into
+	// place, so a crash or a concurrent loader never sees a half written file.
+	static bool write(const std::string &source, uint64_t settingsHash, const DecodedImage &image)
+	{
+		if (!image.valid())
+			return false;
+		BakedTextureHeader header;
+		std::memcpy(header.magic, "BTEX", 4);
+		header.version = Version;
+		header.internalFormat = (uint32_t)image.internalFormat;
+		header.format = image.format;
+		header.type = image.type;
+		header.compressed = image.compressed ? 1 : 0;
+		header.components = (uint32_t)image.components;
+		header.width = (uint32_t)image.levels[0].width;
+		header.height = (uint32_t)image.levels[0].height;
+		header.levelCount = (uint32_t)image.levels.size();
+		header.source = SourceStamp::of(source);
+		header.settingsHash = settingsHash;
+
+		// Level data starts after the table, with each level aligned to 16 bytes
+		std::vector<BakedTextureLevel> table(image.levels.size());
+		uint64_t offset = align(sizeof(header) + table.size() * sizeof(BakedTextureLevel));
+		for (size_t i = 0; i < table.size(); i++)
+		{
+			table[i].offset = offset;
+			table[i].size = image.levels[i].size;
+			table[i].width = (uint32_t)image.levels[i].width;
+			table[i].height = (uint32_t)image.levels[i].height;
+			offset = align(offset + table[i].size);
+		}
+
+		std::ostringstream tempName;
+		tempName << cachePath(source, settingsHash) << '.' << std::this_thread::get_id() << ".tmp";
+		const std::string temp = tempName.str();
+		{
+			std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+			if (!out)
+				return false;
+			out.write((const char*)&header, sizeof(header));
+			out.write((const char*)table.data(), table.size() * sizeof(BakedTextureLevel));
+			static const char padding[16] = {};
+			for (size_t i = 0; i < table.size(); i++)
+			{
+				out.write(padding, (std::streamsize)(table[i].offset - (uint64_t)out.tellp()));
+				out.write((const char*)image.levels[i].pixels, (std::streamsize)image.levels[i].size);
+			}
+			if (!out)
+			{
+				out.close();
+				std::remove(temp.c_str());
+				return false;
+			}
+		}
+		const std::string target = cachePath(source, settingsHash);
+		std::remove(target.c_str());
+		if (std::rename(temp.c_str(), target.c_str()) != 0)
+		{
+			std::remove(temp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// 64-bit FNV-1a hash, used for source contents and settings
+	static uint64_t hash(const void *data, size_t size, uint64_t seed = 14695981039346656037ull)
+	{
+		return MappedFile::hash(data, size, seed);
+	}
+
+private:
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + 15) & ~(uint64_t)15;
+	}
+};
+#endif
@@ -0,0 +1,2142 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "BlockCompressor.h"
+#include "ConeStepBaker.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "Meshlet.h"
+#include "MipGenerator.h"
+#include "Model.h"
+#include "ProgramCache.h"
+#include "QTangent.h"
+#include "Shader.h"
+#include "ShaderCompiler.h"
+#include "ShaderVariants.h"
+#include "ParallaxVariant.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+#include "UploadQueue.h"
+#include "VertexQuantizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Benchmarks are run with "AdvancedShaders --bench <name> [count]". main() creates a hidden window,
+// so each benchmark runs on a real GL context, prints its timings and returns the process exit code.
+class Benchmark
+{
+public:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Runs the named benchmark, where count is the benchmark specific size (0 for its default)
+	static int run(const std::string &name, int count)
+	{
+		if (name == "textures")
+			return textureLoading(count > 0 ? count : 8);
+		if (name == "mips")
+			return mipGeneration(count > 0 ? count : 10);
+		if (name == "bc")
+			return blockCompression(count > 0 ? count : 5);
+		if (name == "formats")
+			return textureFormats();
+		if (name == "packed")
+			return packedHeight(count > 0 ? count : 100);
+		if (name == "upload")
+			return uploadStalls(count > 0 ? count : 8);
+		if (name == "streaming")
+			return streaming(count > 0 ? count : 200);
+		if (name == "uniforms")
+			return uniformCost(count > 0 ? count : 2000);
+		if (name == "programs")
+			return programStartup(count > 0 ? count : 10);
+		if (name == "compile")
+			return shaderCompilation(count > 0 ? count : 50);
+		if (name == "parallax")
+			return parallaxSweep(count > 0 ? count : 50);
+		if (name == "cones")
+			return coneBaking(count > 0 ? count : 1);
+		if (name == "tessellation")
+			return tessellationCost(count > 0 ? count : 50);
+		if (name == "vertices")
+			return vertexFormats(count > 0 ? count : 1024);
+		if (name == "frames")
+			return tangentFrames(count > 0 ? count : 50);
+		if (name == "import")
+			return meshImport(count > 0 ? count : 1000000);
+		if (name == "meshes")
+			return meshConversion(count > 0 ? count : 256);
+		if (name == "optimize")
+			return meshOptimization(count > 0 ? count : 50);
+		if (name == "lod")
+			return lodChain(count > 0 ? count : 50);
+		if (name == "meshlets")
+			return meshletCulling(count > 0 ? count : 60);
+
+		std::cout << "Unknown benchmark: " << name << std::endl;
+		std::cout << "Available benchmarks: textures, mips, bc, formats, packed, upload, streaming, uniforms, programs, compile, parallax, cones, tessellation, vertices, frames, import, meshes, optimize, lod, meshlets" << std::endl;
+		return 1;
+	}
+
+	// Milliseconds elapsed since the given time point
+	static double millisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+private:
+	// Copies a file byte for byte, returning false if either side couldn't be opened
+	static bool copyFile(const std::string &from, const std::string &to)
+	{
+		std::ifstream in(from, std::ios::binary);
+		std::ofstream out(to, std::ios::binary);
+		if (!in || !out)
+			return false;
+		out << in.rdbuf();
+		return true;
+	}
+
+	// Releases every texture in ids back to the cache
+	static void releaseAll(const std::vector<unsigned int> &ids)
+	{
+		for (size_t i = 0; i < ids.size(); i++)
+			TextureCache::instance().release(ids[i]);
+	}
+
+	// Startup texture loading: the bricks2 set is copied "copies" times under different names so the cache
+	// can't fold them together, then loaded one at a time, as a single parallel batch, and from baked files.
+	static int textureLoading(int copies)
+	{
+		const char *sources[] = { "textures/bricks2.jpg", "textures/bricks2_normal.jpg", "textures/bricks2_disp.jpg" };
+		std::vector<std::string> paths;
+		for (int c = 0; c < copies; c++)
+		{
+			for (int s = 0; s < 3; s++)
+			{
+				std::string path = "textures/bench_" + std::to_string(c) + "_" + std::to_string(s) + ".jpg";
+				if (!copyFile(sources[s], path))
+				{
+					std::cout << "Couldn't create benchmark texture " << path << std::endl;
+					return 1;
+				}
+				paths.push_back(path);
+			}
+		}
+
+		TextureCache &cache = TextureCache::instance();
+		// Decoding is compared with baking turned off, then the same batch is cooked and loaded again from the baked files
+		TextureSettings decoded;
+		decoded.baked = false;
+		TextureSettings baked;
+		std::vector<TextureRequest> requests(paths.size());
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			requests[i].path = paths[i];
+			requests[i].settings = decoded;
+		}
+
+		// Serial: decode and upload each texture in turn, as main() used to
+		std::vector<unsigned int> ids;
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < paths.size(); i++)
+			ids.push_back(cache.acquire(paths[i], decoded));
+		glFinish();
+		double serial = millisecondsSince(start);
+		releaseAll(ids);
+
+		// Parallel: decode everything on the pool, then upload on this thread
+		start = Clock::now();
+		ids = cache.acquireBatch(requests);
+		glFinish();
+		double parallel = millisecondsSince(start);
+		releaseAll(ids);
+
+		// Baked, first run: decode, build the mip chains on the CPU and write the baked files
+		for (size_t i = 0; i < requests.size(); i++)
+			requests[i].settings = baked;
+		start = Clock::now();
+		ids = cache.acquireBatch(requests);
+		glFinish();
+		double cooking = millisecondsSince(start);
+		releaseAll(ids);
+
+		// Baked, later runs: map the baked files and upload every level from the mapping
+		start = Clock::now();
+		ids = cache.acquireBatch(requests);
+		glFinish();
+		double mapped = millisecondsSince(start);
+		releaseAll(ids);
+
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			std::remove(paths[i].c_str());
+			std::remove(BakedTexture::cachePath(paths[i], TextureCache::bakeHash(baked)).c_str());
+		}
+
+		std::cout << "Texture loading, " << paths.size() << " textures, " << ThreadPool::shared().size() << " worker threads" << std::endl;
+		std::cout << "  serial decode:   " << serial << " ms" << std::endl;
+		std::cout << "  parallel decode: " << parallel << " ms (" << serial / parallel << "x)" << std::endl;
+		std::cout << "  baked, cooking:  " << cooking << " ms" << std::endl;
+		std::cout << "  baked, mapped:   " << mapped << " ms (" << serial / mapped << "x)" << std::endl;
+		return 0;
+	}
+
+	// Loads an image into a DecodedImage with the given channel count, without any caching
+	static DecodedImage loadImage(const char *path, int components)
+	{
+		DecodedImage image;
+		TextureLevel level;
+		int original;
+		unsigned char *data = stbi_load(path, &level.width, &level.height, &original, components);
+		if (!data)
+			return image;
+		image.owner = std::shared_ptr<void>(data, stbi_image_free);
+		image.components = components;
+		level.pixels = data;
+		level.size = (size_t)level.width * level.height * components;
+		image.levels.push_back(level);
+		return image;
+	}
+
+	// Largest difference between any two values of two mip chains of the same image
+	static int maxDifference(const DecodedImage &a, const DecodedImage &b)
+	{
+		const bool wide = a.type == GL_UNSIGNED_SHORT;
+		int result = 0;
+		for (size_t l = 0; l < a.levels.size() && l < b.levels.size(); l++)
+		{
+			const size_t count = a.levels[l].size / (wide ? 2 : 1);
+			for (size_t i = 0; i < count; i++)
+			{
+				int va = wide ? ((const uint16_t*)a.levels[l].pixels)[i] : a.levels[l].pixels[i];
+				int vb = wide ? ((const uint16_t*)b.levels[l].pixels)[i] : b.levels[l].pixels[i];
+				result = std::max(result, std::abs(va - vb));
+			}
+		}
+		return result;
+	}
+
+	// CPU mip chain generation: the SIMD, multithreaded generator against the scalar reference for each texture
+	// type and filter, averaged over "runs" runs
+	static int mipGeneration(int runs)
+	{
+		struct Case {
+			const char *name;
+			DecodedImage image;
+			MipSettings settings;
+		};
+		DecodedImage diffuseRGB = loadImage("textures/bricks2.jpg", 3);
+		DecodedImage diffuseRGBA = loadImage("textures/bricks2.jpg", 4);
+		DecodedImage normalRGB = loadImage("textures/bricks2_normal.jpg", 3);
+		DecodedImage heightR8 = loadImage("textures/bricks2_disp.jpg", 1);
+		if (!diffuseRGB.valid() || !diffuseRGBA.valid() || !normalRGB.valid() || !heightR8.valid())
+		{
+			std::cout << "Couldn't load the bricks2 textures" << std::endl;
+			return 1;
+		}
+		// R16 version of the height map, as a 16-bit PNG would load
+		DecodedImage heightR16 = heightR8;
+		std::shared_ptr<std::vector<uint16_t>> wide = std::make_shared<std::vector<uint16_t>>(heightR8.levels[0].size);
+		for (size_t i = 0; i < wide->size(); i++)
+			(*wide)[i] = (uint16_t)(heightR8.levels[0].pixels[i] * 257);
+		heightR16.type = GL_UNSIGNED_SHORT;
+		heightR16.owner = wide;
+		heightR16.levels[0].pixels = (const unsigned char*)wide->data();
+		heightR16.levels[0].size = wide->size() * 2;
+
+		MipSettings box, srgb, kaiser, normals, maxHeight, minHeight;
+		srgb.srgb = true;
+		kaiser.filter = MIP_FILTER_KAISER;
+		kaiser.srgb = true;
+		normals.normalMap = true;
+		maxHeight.filter = MIP_FILTER_MAX;
+		minHeight.filter = MIP_FILTER_MIN;
+		Case list[] = {
+			{ "RGB8 box", diffuseRGB, box },
+			{ "RGBA8 box", diffuseRGBA, box },
+			{ "RGB8 sRGB box", diffuseRGB, srgb },
+			{ "RGB8 sRGB Kaiser", diffuseRGB, kaiser },
+			{ "RGB8 normal", normalRGB, normals },
+			{ "R8 box", heightR8, box },
+			{ "R8 max", heightR8, maxHeight },
+			{ "R8 min", heightR8, minHeight },
+			{ "R16 box", heightR16, box },
+			{ "R16 min", heightR16, minHeight }
+		};
+
+		std::cout << "Mip generation, " << diffuseRGB.levels[0].width << "x" << diffuseRGB.levels[0].height << ", " << runs << " runs, "
+			<< ThreadPool::shared().size() << " worker threads, AVX2 " << (CpuFeatures::get().avx2 ? "on" : "off") << std::endl;
+		for (const Case &test : list)
+		{
+			DecodedImage fast, reference;
+			Clock::time_point start = Clock::now();
+			for (int r = 0; r < runs; r++)
+			{
+				fast = test.image;
+				MipGenerator::generate(fast, test.settings);
+			}
+			double fastTime = millisecondsSince(start) / runs;
+			start = Clock::now();
+			for (int r = 0; r < runs; r++)
+			{
+				reference = test.image;
+				MipGenerator::generateReference(reference, test.settings);
+			}
+			double referenceTime = millisecondsSince(start) / runs;
+			std::cout << "  " << test.name << ": " << fastTime << " ms, scalar " << referenceTime << " ms (" << referenceTime / fastTime
+				<< "x), max difference " << maxDifference(fast, reference) << std::endl;
+		}
+		return 0;
+	}
+
+	// Peak signal to noise ratio over the first "channels" channels of a level and its RGBA8 decode, in dB
+	static double psnr(const TextureLevel &original, int components, int channels, const unsigned char *decoded)
+	{
+		double squared = 0.0;
+		const size_t texels = (size_t)original.width * original.height;
+		for (size_t i = 0; i < texels; i++)
+		{
+			for (int c = 0; c < channels; c++)
+			{
+				double d = (double)original.pixels[i * components + c] - decoded[i * 4 + c];
+				squared += d * d;
+			}
+		}
+		const double mse = squared / ((double)texels * channels);
+		return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+	}
+
+	// Block compression of the bricks2 set: encode throughput (mip chain included, averaged over "runs" runs)
+	// and the PSNR of the top level once decoded again
+	static int blockCompression(int runs)
+	{
+		struct Case {
+			const char *name;
+			DecodedImage image;
+			BlockFormat format;
+			int channels;
+		};
+		DecodedImage diffuse = loadImage("textures/bricks2.jpg", 3);
+		DecodedImage diffuseRGBA = loadImage("textures/bricks2.jpg", 4);
+		DecodedImage normal = loadImage("textures/bricks2_normal.jpg", 3);
+		DecodedImage height = loadImage("textures/bricks2_disp.jpg", 1);
+		if (!diffuse.valid() || !diffuseRGBA.valid() || !normal.valid() || !height.valid())
+		{
+			std::cout << "Couldn't load the bricks2 textures" << std::endl;
+			return 1;
+		}
+		Case list[] = {
+			{ "diffuse BC1", diffuse, BLOCK_BC1, 3 },
+			{ "diffuse BC7", diffuseRGBA, BLOCK_BC7, 3 },
+			{ "normal BC5", normal, BLOCK_BC5, 2 },
+			{ "height BC4", height, BLOCK_BC4, 1 }
+		};
+
+		std::cout << "Block compression, " << diffuse.levels[0].width << "x" << diffuse.levels[0].height << " with mips, " << runs << " runs, "
+			<< ThreadPool::shared().size() << " worker threads" << std::endl;
+		for (Case &test : list)
+		{
+			MipGenerator::generate(test.image, MipSettings());
+			size_t texels = 0, original = 0;
+			for (size_t l = 0; l < test.image.levels.size(); l++)
+			{
+				texels += (size_t)test.image.levels[l].width * test.image.levels[l].height;
+				original += test.image.levels[l].size;
+			}
+
+			DecodedImage compressed;
+			Clock::time_point start = Clock::now();
+			for (int r = 0; r < runs; r++)
+			{
+				compressed = test.image;
+				BlockCompressor::compress(compressed, test.format, false);
+			}
+			const double time = millisecondsSince(start) / runs;
+			size_t size = 0;
+			for (size_t l = 0; l < compressed.levels.size(); l++)
+				size += compressed.levels[l].size;
+
+			const TextureLevel &top = test.image.levels[0];
+			std::vector<unsigned char> decoded((size_t)top.width * top.height * 4);
+			BlockCompressor::decompress(compressed.levels[0], test.format, decoded.data());
+			std::cout << "  " << test.name << ": " << time << " ms, " << texels / (time * 1000.0) << " MPix/s, PSNR "
+				<< psnr(top, test.image.components, test.channels, decoded.data()) << " dB, " << original / 1024 << " KB -> " << size / 1024 << " KB" << std::endl;
+		}
+		return 0;
+	}
+
+	// Video memory of the bricks2 maps under each format policy: the file's own channel count (as textures were
+	// originally loaded), the per-role compact formats, and block compression
+	static int textureFormats()
+	{
+		const char *paths[] = { "textures/bricks2.jpg", "textures/bricks2_normal.jpg", "textures/bricks2_disp.jpg" };
+		const TextureRole roles[] = { TEXTURE_ROLE_COLOR, TEXTURE_ROLE_NORMAL, TEXTURE_ROLE_HEIGHT };
+		const char *names[] = { "file channels", "compact formats", "block compressed" };
+		TextureCache &cache = TextureCache::instance();
+		const size_t baseline = cache.memoryUsage();
+		std::cout << "Texture memory, bricks2 diffuse/normal/height with mips, immutable storage " << (GLExtensions::get().textureStorage ? "on" : "off") << std::endl;
+		for (int policy = 0; policy < 3; policy++)
+		{
+			std::vector<TextureRequest> requests(3);
+			for (int i = 0; i < 3; i++)
+			{
+				requests[i].path = paths[i];
+				requests[i].settings = TextureSettings::forRole(roles[i]);
+				requests[i].settings.baked = false;
+				requests[i].settings.compactFormat = policy > 0;
+				if (policy == 2)
+					requests[i].settings.compression = TEXTURE_COMPRESSION_BC;
+			}
+			std::vector<unsigned int> ids = cache.acquireBatch(requests);
+			if (glGetError() != GL_NO_ERROR)
+			{
+				std::cout << "  " << names[policy] << ": GL error during upload" << std::endl;
+				releaseAll(ids);
+				return 1;
+			}
+			std::cout << "  " << names[policy] << ": " << (cache.memoryUsage() - baseline) / 1024 << " KB" << std::endl;
+			releaseAll(ids);
+		}
+		return 0;
+	}
+
+	// A quad filling clip space with the vertex layout of vert.vs: position, normal, uv, tangent, bitangent
+	static unsigned int createQuad(unsigned int &vbo)
+	{
+		const float vertices[] = {
+			-1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+			-1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+			1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+			-1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+			1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+			1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f
+		};
+		unsigned int vao;
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+		const int sizes[] = { 3, 3, 2, 3, 3 };
+		size_t offset = 0;
+		for (unsigned int i = 0; i < 5; i++)
+		{
+			glEnableVertexAttribArray(i);
+			glVertexAttribPointer(i, sizes[i], GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(offset * sizeof(float)));
+			offset += sizes[i];
+		}
+		glBindVertexArray(0);
+		return vao;
+	}
+
+	// Parallax shading with the height map in its own texture against packed into the normal map's alpha. frag.fs
+	// draws a full screen quad ten times per frame into an offscreen 1080p target, timed on the GPU with
+	// GL_TIME_ELAPSED queries and averaged over "frames" frames, both uncompressed and block compressed.
+	static int packedHeight(int frames)
+	{
+		const int width = 1920, height = 1080, drawsPerFrame = 10;
+		unsigned int framebuffer, colour, depth;
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glGenTextures(1, &colour);
+		glBindTexture(GL_TEXTURE_2D, colour);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colour, 0);
+		glGenRenderbuffers(1, &depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "Couldn't create the benchmark framebuffer" << std::endl;
+			return 1;
+		}
+		glViewport(0, 0, width, height);
+		// Every draw covers the whole target, so depth testing would reject all but the first
+		glDisable(GL_DEPTH_TEST);
+
+		unsigned int vbo;
+		const unsigned int quad = createQuad(vbo);
+		// The default offset mapping, read from the height map's own texture or from the normal map's alpha
+		ShaderVariants variants("shaders/vert.vs", "shaders/frag.fs", ParallaxVariant::features());
+		for (int packed = 0; packed < 2; packed++)
+		{
+			ParallaxVariant variant;
+			variant.packedHeight = packed != 0;
+			Shader &shader = variants.get(variant.key());
+			shader.use();
+			shader.setInt("diffuseMap", 0);
+			shader.setInt("normalMap", 1);
+			shader.setInt("depthMap", 2);
+			shader.setMat4("projection", glm::mat4(1.0f));
+			shader.setMat4("view", glm::mat4(1.0f));
+			shader.setMat4("model", glm::mat4(1.0f));
+			// A grazing view direction, so the parallax offset is large
+			shader.setVec3("viewPos", glm::vec3(0.6f, 0.4f, 1.0f));
+			shader.setVec3("lightPos", glm::vec3(0.5f, 1.0f, 0.3f));
+			shader.setFloat("heightScale", 0.1f);
+		}
+		unsigned int query;
+		glGenQueries(1, &query);
+
+		TextureCache &cache = TextureCache::instance();
+		std::cout << "Parallax shading, " << width << "x" << height << ", " << drawsPerFrame << " full screen draws per frame, " << frames << " frames" << std::endl;
+		for (int compressed = 0; compressed < 2; compressed++)
+		{
+			for (int packed = 0; packed < 2; packed++)
+			{
+				std::vector<TextureRequest> requests(packed ? 2 : 3);
+				requests[0].path = "textures/bricks2.jpg";
+				requests[1].path = "textures/bricks2_normal.jpg";
+				if (packed)
+				{
+					requests[1].settings = TextureSettings::forRole(TEXTURE_ROLE_NORMAL_HEIGHT);
+					requests[1].heightPath = "textures/bricks2_disp.jpg";
+				}
+				else
+				{
+					requests[1].settings = TextureSettings::forRole(TEXTURE_ROLE_NORMAL);
+					requests[2].path = "textures/bricks2_disp.jpg";
+					requests[2].settings = TextureSettings::forRole(TEXTURE_ROLE_HEIGHT);
+				}
+				for (TextureRequest &request : requests)
+				{
+					request.settings.baked = false;
+					if (compressed)
+						request.settings.compression = TEXTURE_COMPRESSION_BC;
+				}
+				const size_t memoryBefore = cache.memoryUsage();
+				std::vector<unsigned int> ids = cache.acquireBatch(requests);
+				const size_t memory = cache.memoryUsage() - memoryBefore;
+				ParallaxVariant variant;
+				variant.packedHeight = packed != 0;
+				variants.get(variant.key()).use();
+				glBindVertexArray(quad);
+
+				double total = 0.0;
+				for (int frame = -5; frame < frames; frame++)
+				{
+					glBeginQuery(GL_TIME_ELAPSED, query);
+					for (int draw = 0; draw < drawsPerFrame; draw++)
+					{
+						// Binding per draw, as a scene of separate materials would
+						for (size_t t = 0; t < ids.size(); t++)
+						{
+							glActiveTexture(GL_TEXTURE0 + (GLenum)t);
+							glBindTexture(GL_TEXTURE_2D, ids[t]);
+						}
+						glDrawArrays(GL_TRIANGLES, 0, 6);
+					}
+					glEndQuery(GL_TIME_ELAPSED);
+					GLuint64 elapsed = 0;
+					glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+					// The first few frames warm up the caches and the driver
+					if (frame >= 0)
+						total += elapsed / 1e6;
+				}
+				std::cout << "  " << (compressed ? "compressed" : "uncompressed") << ", " << (packed ? "packed:  " : "separate:") << " " << total / frames << " ms per frame, "
+					<< ids.size() << " textures, " << memory / 1024 << " KB" << std::endl;
+				releaseAll(ids);
+			}
+		}
+
+		glBindVertexArray(0);
+		glDeleteQueries(1, &query);
+		glDeleteVertexArrays(1, &quad);
+		glDeleteBuffers(1, &vbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &colour);
+		glDeleteRenderbuffers(1, &depth);
+		return 0;
+	}
+
+	// Time the render thread spends in texture uploads with and without the pixel unpack buffer ring. The bricks2
+	// set is copied "copies" times and batch loaded unbaked: without mipmaps the images are decoded straight into
+	// the ring, with CPU mipmaps they are copied into it by the workers.
+	static int uploadStalls(int copies)
+	{
+		const char *sources[] = { "textures/bricks2.jpg", "textures/bricks2_normal.jpg", "textures/bricks2_disp.jpg" };
+		std::vector<std::string> paths;
+		for (int c = 0; c < copies; c++)
+		{
+			for (int s = 0; s < 3; s++)
+			{
+				std::string path = "textures/bench_" + std::to_string(c) + "_" + std::to_string(s) + ".jpg";
+				if (!copyFile(sources[s], path))
+				{
+					std::cout << "Couldn't create benchmark texture " << path << std::endl;
+					return 1;
+				}
+				paths.push_back(path);
+			}
+		}
+
+		TextureCache &cache = TextureCache::instance();
+		std::cout << "Texture uploads, " << paths.size() << " textures, ring " << (GLExtensions::get().persistentMapping ? "persistently mapped" : "mapped per upload") << std::endl;
+		for (int mipmaps = 0; mipmaps < 2; mipmaps++)
+		{
+			std::vector<TextureRequest> requests(paths.size());
+			for (size_t i = 0; i < paths.size(); i++)
+			{
+				requests[i].path = paths[i];
+				requests[i].settings.baked = false;
+				requests[i].settings.mipmaps = mipmaps != 0;
+			}
+			for (int ring = 0; ring < 2; ring++)
+			{
+				if (ring)
+					cache.enableUploadRing(64 << 20);
+				const UploadStats before = cache.uploadStats();
+				Clock::time_point start = Clock::now();
+				std::vector<unsigned int> ids = cache.acquireBatch(requests);
+				glFinish();
+				const double total = millisecondsSince(start);
+				const UploadStats &after = cache.uploadStats();
+				const double uploading = after.milliseconds - before.milliseconds;
+				const size_t uploads = after.uploads - before.uploads;
+				std::cout << "  " << (mipmaps ? "mipmapped, " : "level 0,   ") << (ring ? "ring:   " : "direct: ")
+					<< uploading / uploads << " ms per upload, " << uploading << " ms uploading, " << total << " ms total";
+				if (ring)
+					std::cout << ", " << cache.ring()->stallMilliseconds() << " ms waiting on fences";
+				std::cout << std::endl;
+				releaseAll(ids);
+				if (ring)
+					cache.disableUploadRing();
+			}
+		}
+
+		for (size_t i = 0; i < paths.size(); i++)
+			std::remove(paths[i].c_str());
+		return 0;
+	}
+
+	// Streaming a scene of "materials" bricks2 materials in while frames keep coming at 60 Hz, against loading
+	// them all in one go. Reports the render thread's time in UploadQueue::drain() per frame: the longest frame
+	// and how many went over 1 ms.
+	static int streaming(int materials)
+	{
+		const char *sources[] = { "textures/bricks2.jpg", "textures/bricks2_normal.jpg", "textures/bricks2_disp.jpg" };
+		const TextureRole roles[] = { TEXTURE_ROLE_COLOR, TEXTURE_ROLE_NORMAL, TEXTURE_ROLE_HEIGHT };
+		std::vector<TextureRequest> requests;
+		for (int m = 0; m < materials; m++)
+		{
+			for (int s = 0; s < 3; s++)
+			{
+				TextureRequest request;
+				request.path = "textures/bench_" + std::to_string(m) + "_" + std::to_string(s) + ".jpg";
+				request.settings = TextureSettings::forRole(roles[s]);
+				request.settings.baked = false;
+				if (!copyFile(sources[s], request.path))
+				{
+					std::cout << "Couldn't create benchmark texture " << request.path << std::endl;
+					return 1;
+				}
+				requests.push_back(request);
+			}
+		}
+
+		TextureCache &cache = TextureCache::instance();
+		// Loading everything up front stalls a single frame for the whole load
+		Clock::time_point start = Clock::now();
+		std::vector<unsigned int> ids = cache.acquireBatch(requests);
+		glFinish();
+		const double blocking = millisecondsSince(start);
+		releaseAll(ids);
+
+		// Streaming: the frames keep coming while the workers decode, each uploading within its budget
+		const double budget = 0.5;
+		const std::chrono::microseconds frameTime(16667);
+		UploadQueue uploads;
+		ids.assign(requests.size(), 0);
+		start = Clock::now();
+		for (size_t i = 0; i < requests.size(); i++)
+			cache.stream(requests[i], uploads, 0, [&ids, i](unsigned int id) { ids[i] = id; });
+		const double requesting = millisecondsSince(start);
+		size_t frames = 0, spikes = 0;
+		double longest = 0.0;
+		Clock::time_point frame = Clock::now();
+		while (!uploads.idle())
+		{
+			glClear(GL_COLOR_BUFFER_BIT);
+			const double spent = uploads.drain(budget);
+			glFlush();
+			frames++;
+			longest = std::max(longest, spent);
+			if (spent > 1.0)
+				spikes++;
+			frame += frameTime;
+			std::this_thread::sleep_until(frame);
+		}
+		const double streamed = millisecondsSince(start);
+		glFinish();
+		releaseAll(ids);
+
+		for (size_t i = 0; i < requests.size(); i++)
+			std::remove(requests[i].path.c_str());
+
+		std::cout << "Streaming " << materials << " materials (" << requests.size() << " textures), " << budget << " ms upload budget" << std::endl;
+		std::cout << "  loaded up front: one " << blocking << " ms frame" << std::endl;
+		std::cout << "  streamed:        " << streamed << " ms over " << frames << " frames, " << requesting << " ms to request" << std::endl;
+		std::cout << "  longest frame upload: " << longest << " ms, frames over 1 ms: " << spikes << std::endl;
+		return 0;
+	}
+
+	// CPU cost of setting a draw's uniforms: "objects" tiny quads per frame, each setting its model matrix, the
+	// view and light positions, the height scale and its three samplers, then drawing. The uniforms are set by
+	// looking each location up with glGetUniformLocation (as Shader used to), by name through the shader's hashed
+	// table, and by handle. Only the submission is timed; each frame is finished outside the timer.
+	static int uniformCost(int objects)
+	{
+		const int frames = 50;
+		unsigned int vbo;
+		const unsigned int quad = createQuad(vbo);
+		Shader shader("shaders/vert.vs", "shaders/frag.fs");
+		shader.use();
+		shader.setMat4("projection", glm::mat4(1.0f));
+		shader.setMat4("view", glm::mat4(1.0f));
+		glBindVertexArray(quad);
+		glDisable(GL_DEPTH_TEST);
+		// Each object is scaled down to a few pixels, so the GPU isn't what's measured
+		std::vector<glm::mat4> models(objects);
+		for (int i = 0; i < objects; i++)
+			models[i] = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3((i % 64) / 32.0f - 1.0f, (i / 64 % 64) / 32.0f - 1.0f, 0.0f)), glm::vec3(0.01f));
+
+		const UniformHandle model = shader.uniform("model"), viewPos = shader.uniform("viewPos"), lightPos = shader.uniform("lightPos"), heightScale = shader.uniform("heightScale");
+		const UniformHandle diffuseMap = shader.uniform("diffuseMap"), normalMap = shader.uniform("normalMap"), depthMap = shader.uniform("depthMap");
+		const char *modes[] = { "glGetUniformLocation", "hashed names", "handles" };
+		std::cout << "Uniform setting, " << objects << " draws per frame, 7 uniforms per draw, " << frames << " frames" << std::endl;
+		for (int mode = 0; mode < 3; mode++)
+		{
+			double total = 0.0;
+			for (int frame = -5; frame < frames; frame++)
+			{
+				Clock::time_point start = Clock::now();
+				for (int i = 0; i < objects; i++)
+				{
+					const glm::vec3 eye(0.6f, 0.4f, 1.0f), light(0.5f, 1.0f, 0.3f);
+					if (mode == 0)
+					{
+						glUniformMatrix4fv(glGetUniformLocation(shader.ID, "model"), 1, GL_FALSE, &models[i][0][0]);
+						glUniform3fv(glGetUniformLocation(shader.ID, "viewPos"), 1, &eye[0]);
+						glUniform3fv(glGetUniformLocation(shader.ID, "lightPos"), 1, &light[0]);
+						glUniform1f(glGetUniformLocation(shader.ID, "heightScale"), 0.1f);
+						glUniform1i(glGetUniformLocation(shader.ID, "diffuseMap"), 0);
+						glUniform1i(glGetUniformLocation(shader.ID, "normalMap"), 1);
+						glUniform1i(glGetUniformLocation(shader.ID, "depthMap"), 2);
+					}
+					else if (mode == 1)
+					{
+						shader.setMat4("model", models[i]);
+						shader.setVec3("viewPos", eye);
+						shader.setVec3("lightPos", light);
+						shader.setFloat("heightScale", 0.1f);
+						shader.setInt("diffuseMap", 0);
+						shader.setInt("normalMap", 1);
+						shader.setInt("depthMap", 2);
+					}
+					else
+					{
+						shader.setMat4(model, models[i]);
+						shader.setVec3(viewPos, eye);
+						shader.setVec3(lightPos, light);
+						shader.setFloat(heightScale, 0.1f);
+						shader.setInt(diffuseMap, 0);
+						shader.setInt(normalMap, 1);
+						shader.setInt(depthMap, 2);
+					}
+					glDrawArrays(GL_TRIANGLES, 0, 6);
+				}
+				const double submitted = millisecondsSince(start);
+				glFinish();
+				// The first few frames warm up the driver
+				if (frame >= 0)
+					total += submitted;
+			}
+			std::cout << "  " << modes[mode] << ": " << total / frames << " ms per frame, " << total / frames / objects * 1000.0 << " us per draw" << std::endl;
+		}
+
+		glBindVertexArray(0);
+		glDeleteVertexArrays(1, &quad);
+		glDeleteBuffers(1, &vbo);
+		return 0;
+	}
+
+	// Time to build the vert.vs/frag.fs program: compiled from source with the cache off, a cold start that
+	// compiles and saves the binary, and a warm start that loads it. Averaged over "runs" runs, each finished with
+	// glFinish so deferred driver work is counted.
+	static int programStartup(int runs)
+	{
+		if (!GLExtensions::get().programBinaries)
+			std::cout << "The context has no program binary formats; every build below compiles from source" << std::endl;
+		// The sources as Shader hashes them, with frag.fs's includes expanded
+		std::vector<std::string> sources = { ShaderSource::load("shaders/vert.vs"), ShaderSource::load("shaders/frag.fs"), std::string() };
+		const std::string cached = ProgramCache::cachePath("shaders/vert.vs", ProgramCache::key(sources));
+
+		double times[3] = {};
+		for (int run = 0; run < runs; run++)
+		{
+			for (int mode = 0; mode < 3; mode++)
+			{
+				// Source only, then cold (no binary yet), then warm (the binary the cold build saved)
+				ProgramCache::enabled() = mode != 0;
+				if (mode == 1)
+					std::remove(cached.c_str());
+				Clock::time_point start = Clock::now();
+				Shader shader("shaders/vert.vs", "shaders/frag.fs");
+				glFinish();
+				times[mode] += millisecondsSince(start);
+				glDeleteProgram(shader.ID);
+			}
+		}
+		ProgramCache::enabled() = true;
+		const ProgramCacheStats &stats = ProgramCache::stats();
+		std::cout << "Program startup, vert.vs + frag.fs, " << runs << " runs" << std::endl;
+		std::cout << "  from source: " << times[0] / runs << " ms" << std::endl;
+		std::cout << "  cold cache:  " << times[1] / runs << " ms (compiles and saves the binary)" << std::endl;
+		std::cout << "  warm cache:  " << times[2] / runs << " ms (" << times[0] / times[2] << "x)" << std::endl;
+		std::cout << "  " << stats.hits << " loaded, " << stats.misses << " missed, " << stats.rejected << " rejected by the driver" << std::endl;
+		return 0;
+	}
+
+	// Cost and quality of every parallax mode and step count, head on and at a grazing angle. Each configuration
+	// draws the wall over an offscreen 1080p target, timed on the GPU over "frames" frames, and the image is read
+	// back and compared with a reference (relief mapping at 64 layers whatever the angle, with a long binary
+	// search): the RMSE is in 8-bit colour levels. Adaptive rows take 8 layers head on and the step count edge on;
+	// fixed rows always take the step count.
+	static int parallaxSweep(int frames)
+	{
+		const int width = 1920, height = 1080;
+		unsigned int framebuffer, colour;
+		if (!createTarget(width, height, framebuffer, colour))
+			return 1;
+		const std::vector<unsigned int> ids = bindParallaxMaps();
+		unsigned int vbo;
+		const unsigned int quad = createQuad(vbo);
+		glBindVertexArray(quad);
+		unsigned int query;
+		glGenQueries(1, &query);
+
+		ShaderVariants variants(ParallaxVariant::stages(false), ParallaxVariant::features());
+		Shader reference("shaders/vert.vs", "shaders/frag.fs", nullptr, variants.defines(referenceVariant().key()) + "#define PARALLAX_REFINE_STEPS 10\n");
+		// Draws the wall with a program and returns the GPU milliseconds per frame, leaving the image in pixels
+		std::vector<unsigned char> pixels((size_t)width * height * 4);
+		auto draw = [&](Shader &shader, const glm::vec3 &eye, int layers, int count)
+		{
+			shader.use();
+			shader.setInt("diffuseMap", 0);
+			shader.setInt("normalMap", 1);
+			shader.setInt("depthMap", 2);
+			shader.setInt("coneMap", 3);
+			shader.setInt("heightPyramid", 4);
+			shader.setInt("minLayers", layers);
+			shader.setMat4("projection", glm::mat4(1.0f));
+			shader.setMat4("view", glm::mat4(1.0f));
+			shader.setMat4("model", glm::mat4(1.0f));
+			shader.setVec3("viewPos", eye);
+			shader.setVec3("lightPos", glm::vec3(0.5f, 1.0f, 0.3f));
+			shader.setFloat("heightScale", 0.1f);
+			double total = 0.0;
+			for (int frame = -3; frame < count; frame++)
+			{
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+				glEndQuery(GL_TIME_ELAPSED);
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+				if (frame >= 0)
+					total += elapsed / 1e6;
+			}
+			glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+			return total / count;
+		};
+
+		const glm::vec3 eyes[] = { glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(2.5f, 1.5f, 0.4f) };
+		const char *eyeNames[] = { "head on", "grazing" };
+		const char *modeNames[] = { "none", "offset", "steep", "occlusion", "relief", "cone", "pyramid" };
+		std::cout << "Parallax sweep, " << width << "x" << height << ", " << frames << " frames per configuration, RMSE against relief mapping at 64 layers" << std::endl;
+		for (int e = 0; e < 2; e++)
+		{
+			draw(reference, eyes[e], 64, 1);
+			const std::vector<unsigned char> expected = pixels;
+			std::cout << "  " << eyeNames[e] << ":" << std::endl;
+			for (int mode = PARALLAX_NONE; mode <= PARALLAX_PYRAMID; mode++)
+			{
+				// The layer searches are the only modes with a step count
+				const bool searches = mode >= PARALLAX_STEEP && mode <= PARALLAX_RELIEF;
+				const size_t stepCounts = searches ? ParallaxVariant::stepCounts().size() : 1;
+				for (size_t s = 0; s < stepCounts; s++)
+				{
+					for (int adaptive = searches ? 1 : 0; adaptive >= 0; adaptive--)
+					{
+						ParallaxVariant variant;
+						variant.mode = (ParallaxMode)mode;
+						variant.packedHeight = true;
+						variant.steps = ParallaxVariant::stepCounts()[s];
+						const double milliseconds = draw(variants.get(variant.key()), eyes[e], adaptive ? 8 : variant.steps, frames);
+						std::cout << "    " << modeNames[mode];
+						if (searches)
+							std::cout << ", " << variant.steps << " layers " << (adaptive ? "adaptive" : "fixed   ");
+						std::cout << ": " << milliseconds << " ms, RMSE " << rmse(pixels, expected) << std::endl;
+					}
+				}
+			}
+		}
+
+		glDeleteProgram(reference.ID);
+		releaseAll(ids);
+		glBindVertexArray(0);
+		glDeleteQueries(1, &query);
+		glDeleteVertexArrays(1, &quad);
+		glDeleteBuffers(1, &vbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &colour);
+		return 0;
+	}
+
+	// Cone step map baking of the bricks2 height map: the pruned, SIMD, multithreaded baker against the same cones
+	// one texel at a time, averaged over "runs" runs
+	static int coneBaking(int runs)
+	{
+		DecodedImage height = loadImage("textures/bricks2_disp.jpg", 1);
+		if (!height.valid())
+		{
+			std::cout << "Couldn't load textures/bricks2_disp.jpg" << std::endl;
+			return 1;
+		}
+		std::cout << "Cone step baking, " << height.levels[0].width << "x" << height.levels[0].height << ", " << runs << " runs, "
+			<< ThreadPool::shared().size() << " worker threads, AVX2 " << (CpuFeatures::get().avx2 ? "on" : "off") << std::endl;
+		DecodedImage fast, reference;
+		Clock::time_point start = Clock::now();
+		for (int r = 0; r < runs; r++)
+			fast = ConeStepBaker::bake(height);
+		const double fastTime = millisecondsSince(start) / runs;
+		start = Clock::now();
+		for (int r = 0; r < runs; r++)
+			reference = ConeStepBaker::bakeReference(height);
+		const double referenceTime = millisecondsSince(start) / runs;
+		std::cout << "  fast: " << fastTime << " ms, reference " << referenceTime << " ms (" << referenceTime / fastTime
+			<< "x), max difference " << maxDifference(fast, reference) << std::endl;
+		return 0;
+	}
+
+	// Tessellated displacement against parallax alone, for every parallax mode, with the wall near, at a grazing
+	// angle and far away, drawn over an offscreen 1080p target for "frames" frames. Each configuration is timed
+	// whole and again with GL_RASTERIZER_DISCARD, which ends the pipeline after the vertex and tessellation stages,
+	// so the difference is what the fragment stage costs. The triangle count is what reaches the rasteriser.
+	static int tessellationCost(int frames)
+	{
+		if (!GLExtensions::get().tessellation)
+		{
+			std::cout << "The context has no tessellation shaders" << std::endl;
+			return 1;
+		}
+		const int width = 1920, height = 1080;
+		unsigned int framebuffer, colour;
+		if (!createTarget(width, height, framebuffer, colour))
+			return 1;
+		const std::vector<unsigned int> ids = bindParallaxMaps();
+		unsigned int vbo;
+		const unsigned int quad = createQuad(vbo);
+		glBindVertexArray(quad);
+		GLExtensions::get().patchParameteri(GL_PATCH_VERTICES, 3);
+		unsigned int queries[2];
+		glGenQueries(2, queries);
+
+		ShaderVariants plain(ParallaxVariant::stages(false), ParallaxVariant::features());
+		ShaderVariants tessellated(ParallaxVariant::stages(true), ParallaxVariant::features());
+		const glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 100.0f);
+		// Draws the wall "count" times and returns the GPU milliseconds per frame, and the triangles per frame
+		auto draw = [&](Shader &shader, const glm::vec3 &eye, bool patches, bool discard, int count, GLuint &triangles)
+		{
+			shader.use();
+			shader.setInt("diffuseMap", 0);
+			shader.setInt("normalMap", 1);
+			shader.setInt("depthMap", 2);
+			shader.setInt("coneMap", 3);
+			shader.setInt("heightPyramid", 4);
+			shader.setInt("minLayers", 8);
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+			shader.setMat4("model", glm::mat4(1.0f));
+			shader.setVec3("viewPos", eye);
+			shader.setVec3("lightPos", glm::vec3(0.5f, 1.0f, 0.3f));
+			shader.setFloat("heightScale", 0.1f);
+			shader.setFloat("viewportHeight", (float)height);
+			shader.setFloat("tessEdgePixels", 8.0f);
+			shader.setFloat("worldPerTexCoord", 2.0f);
+			shader.setFloat("displacementNear", 2.0f);
+			shader.setFloat("displacementFar", 6.0f);
+			if (discard)
+				glEnable(GL_RASTERIZER_DISCARD);
+			double total = 0.0;
+			for (int frame = -3; frame < count; frame++)
+			{
+				glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+				glBeginQuery(GL_PRIMITIVES_GENERATED, queries[1]);
+				glDrawArrays(patches ? GL_PATCHES : GL_TRIANGLES, 0, 6);
+				glEndQuery(GL_PRIMITIVES_GENERATED);
+				glEndQuery(GL_TIME_ELAPSED);
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &elapsed);
+				glGetQueryObjectuiv(queries[1], GL_QUERY_RESULT, &triangles);
+				if (frame >= 0)
+					total += elapsed / 1e6;
+			}
+			glDisable(GL_RASTERIZER_DISCARD);
+			return total / count;
+		};
+
+		const glm::vec3 eyes[] = { glm::vec3(0.0f, 0.0f, 1.5f), glm::vec3(2.0f, 0.5f, 0.4f), glm::vec3(0.0f, 0.0f, 8.0f) };
+		const char *eyeNames[] = { "near", "grazing", "far" };
+		const char *modeNames[] = { "none", "offset", "steep", "occlusion", "relief", "cone", "pyramid" };
+		std::cout << "Tessellation cost, " << width << "x" << height << ", " << frames << " frames per configuration, vertex (and tessellation) time from a rasteriser discard pass" << std::endl;
+		for (int e = 0; e < 3; e++)
+		{
+			std::cout << "  " << eyeNames[e] << ":" << std::endl;
+			for (int mode = PARALLAX_NONE; mode <= PARALLAX_PYRAMID; mode++)
+			{
+				for (int tessellate = 0; tessellate < 2; tessellate++)
+				{
+					ParallaxVariant variant;
+					variant.mode = (ParallaxMode)mode;
+					variant.packedHeight = true;
+					variant.tessellated = tessellate != 0;
+					Shader &shader = (tessellate ? tessellated : plain).get(variant.key());
+					GLuint triangles = 0;
+					const double whole = draw(shader, eyes[e], variant.tessellated, false, frames, triangles);
+					const double vertex = draw(shader, eyes[e], variant.tessellated, true, frames, triangles);
+					std::cout << "    " << modeNames[mode] << (tessellate ? ", tessellated" : "") << ": " << whole << " ms (vertex "
+						<< vertex << ", fragment " << std::max(0.0, whole - vertex) << "), " << triangles << " triangles" << std::endl;
+				}
+			}
+		}
+
+		plain.clear();
+		tessellated.clear();
+		releaseAll(ids);
+		glBindVertexArray(0);
+		glDeleteQueries(2, queries);
+		glDeleteVertexArrays(1, &quad);
+		glDeleteBuffers(1, &vbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &colour);
+		return 0;
+	}
+
+	// The full Vertex format against QTangentVertex, and both again in quantized streams, on a wavy grid of
+	// side x side vertices (see waveGrid) with its texture coordinates mirrored on one half. Each is drawn 20 times
+	// a frame over a 1080p target, whole and with GL_RASTERIZER_DISCARD so the vertex stage is timed alone, and the
+	// frames are also packed and unpacked on the CPU as the vertex shader does to find the worst angle any
+	// tangent, bitangent or normal is off by. The quantized streams report their worst position and texture
+	// coordinate errors too.
+	static int vertexFormats(int side)
+	{
+		side = std::max(side, 2);
+		const int width = 1920, height = 1080;
+		unsigned int framebuffer, colour;
+		if (!createTarget(width, height, framebuffer, colour))
+			return 1;
+		unsigned int query;
+		glGenQueries(1, &query);
+
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		waveGrid(side, 1.0f, vertices, indices);
+		std::vector<QTangentVertex> compact(vertices.size());
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < vertices.size(); i++)
+			compact[i] = QTangentVertex(vertices[i]);
+		const double encodeTime = millisecondsSince(start);
+		float worstAngle = 0.0f;
+		int flipped = 0;
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			glm::vec3 tangent, bitangent, normal;
+			QTangent::decode(compact[i].QTangent, tangent, bitangent, normal);
+			const glm::vec3 expected[] = { vertices[i].Tangent, vertices[i].Bitangent, vertices[i].Normal };
+			const glm::vec3 decoded[] = { tangent, bitangent, normal };
+			for (int v = 0; v < 3; v++)
+			{
+				const float cosine = glm::dot(glm::normalize(expected[v]), glm::normalize(decoded[v]));
+				if (cosine < 0.0f)
+					flipped++;
+				worstAngle = std::max(worstAngle, std::acos(std::min(std::abs(cosine), 1.0f)));
+			}
+		}
+
+		QuantizedVertices quantized[2];
+		start = Clock::now();
+		for (int q = 0; q < 2; q++)
+			quantized[q] = VertexQuantizer::quantize(vertices, VertexEncoding(), q == 1 ? TANGENT_FRAME_QTANGENT : TANGENT_FRAME_VECTORS);
+		const double quantizeTime = millisecondsSince(start) / 2.0;
+
+		unsigned int VAO[4], VBO[4], EBO[4];
+		Mesh::createBuffers(TANGENT_FRAME_VECTORS, vertices.size() * sizeof(Vertex), vertices.data(), indices.size(), indices.data(), VAO[0], VBO[0], EBO[0]);
+		Mesh::createBuffers(TANGENT_FRAME_QTANGENT, compact.size() * sizeof(QTangentVertex), compact.data(), indices.size(), indices.data(), VAO[1], VBO[1], EBO[1]);
+		for (int q = 0; q < 2; q++)
+			Mesh::createBuffers(quantized[q], quantized[q].data.size(), quantized[q].data.data(), indices.size(), indices.data(), VAO[2 + q], VBO[2 + q], EBO[2 + q]);
+		ShaderVariants variants(ParallaxVariant::stages(false), ParallaxVariant::features());
+		const glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 100.0f);
+		const glm::vec3 eye(0.0f, -1.0f, 2.5f);
+		// Draws a format "count" frames of 20 draws and returns the GPU milliseconds per frame
+		auto draw = [&](int format, bool discard, int count)
+		{
+			ParallaxVariant variant;
+			variant.mode = PARALLAX_NONE;
+			variant.qtangents = format % 2 != 0;
+			variant.quantized = format >= 2;
+			Shader &shader = variants.get(variant.key());
+			shader.use();
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+			shader.setMat4("model", glm::mat4(1.0f));
+			shader.setVec3("viewPos", eye);
+			shader.setVec3("lightPos", glm::vec3(0.5f, 1.0f, 0.3f));
+			if (format >= 2)
+			{
+				shader.setVec3("positionOffset", quantized[format - 2].positionOffset);
+				shader.setVec3("positionScale", quantized[format - 2].positionScale);
+			}
+			glBindVertexArray(VAO[format]);
+			if (discard)
+				glEnable(GL_RASTERIZER_DISCARD);
+			double total = 0.0;
+			for (int frame = -3; frame < count; frame++)
+			{
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				for (int d = 0; d < 20; d++)
+					glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
+				glEndQuery(GL_TIME_ELAPSED);
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+				if (frame >= 0)
+					total += elapsed / 1e6;
+			}
+			glDisable(GL_RASTERIZER_DISCARD);
+			return total / count;
+		};
+
+		std::cout << "Vertex formats, " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, 20 draws per frame over 20 frames" << std::endl;
+		const char *formatNames[] = { "Vertex", "QTangentVertex", "Quantized, octahedral", "Quantized, QTangent" };
+		const size_t strides[] = { sizeof(Vertex), sizeof(QTangentVertex), quantized[0].stride, quantized[1].stride };
+		for (int format = 0; format < 4; format++)
+		{
+			const double whole = draw(format, false, 20);
+			const double vertex = draw(format, true, 20);
+			std::cout << "  " << formatNames[format] << ": " << strides[format] << " bytes per vertex, " << vertices.size() * strides[format] / 1024
+				<< " KB of vertices, " << whole << " ms (vertex " << vertex << ")" << std::endl;
+		}
+		std::cout << "  QTangent encoding: " << encodeTime << " ms, worst frame error " << glm::degrees(worstAngle) << " degrees, "
+			<< flipped << " flipped vectors" << std::endl;
+		for (int q = 0; q < 2; q++)
+			std::cout << "  " << formatNames[2 + q] << ": " << quantized[q].ratio() << "x smaller than Vertex, worst errors: position "
+				<< quantized[q].positionError << ", texture coordinates " << quantized[q].texCoordError << ", directions "
+				<< quantized[q].directionError << " degrees" << std::endl;
+		std::cout << "  Quantizing: " << quantizeTime << " ms" << std::endl;
+
+		variants.clear();
+		glBindVertexArray(0);
+		for (int format = 0; format < 4; format++)
+			Mesh::deleteBuffers(VAO[format], VBO[format], EBO[format]);
+		glDeleteQueries(1, &query);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &colour);
+		return 0;
+	}
+
+	// A wavy grid of side x side vertices over [-1, 1] in x and y, z = 0.05 sin(40u) cos(40v), as indexed
+	// triangles. The texture coordinates run to "repeat" across the left half and mirror back across the right, as
+	// mirrored UVs are laid out, so the tangent flips there and the frame changes handedness. Its frames are the
+	// exact ones from the surface's slopes.
+	static void waveGrid(int side, float repeat, std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+	{
+		vertices.resize((size_t)side * side);
+		for (int y = 0; y < side; y++)
+		{
+			for (int x = 0; x < side; x++)
+			{
+				const float u = (float)x / (side - 1), v = (float)y / (side - 1);
+				const float a = u * 40.0f, b = v * 40.0f;
+				const bool mirrored = u > 0.5f;
+				// z's slopes along u and v, and the frame they give
+				const float dzdu = 2.0f * std::cos(a) * std::cos(b), dzdv = -2.0f * std::sin(a) * std::sin(b);
+				Vertex &vertex = vertices[(size_t)y * side + x];
+				vertex.Position = glm::vec3(u * 2.0f - 1.0f, v * 2.0f - 1.0f, 0.05f * std::sin(a) * std::cos(b));
+				vertex.TexCoords = glm::vec2(mirrored ? 2.0f - 2.0f * u : 2.0f * u, v) * repeat;
+				vertex.Normal = glm::normalize(glm::vec3(-dzdu, -dzdv, 2.0f));
+				vertex.Tangent = glm::normalize(glm::vec3(2.0f, 0.0f, dzdu)) * (mirrored ? -1.0f : 1.0f);
+				vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * (mirrored ? -1.0f : 1.0f);
+			}
+		}
+		indices.clear();
+		indices.reserve((size_t)(side - 1) * (side - 1) * 6);
+		for (int y = 0; y + 1 < side; y++)
+		{
+			for (int x = 0; x + 1 < side; x++)
+			{
+				const unsigned int corner = y * side + x;
+				const unsigned int quad[] = { corner, corner + 1, corner + side + 1, corner, corner + side + 1, corner + side };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+	}
+
+	// Stored tangent frames (Vertex and QTangentVertex) against derivative frames rebuilt per pixel
+	// (TangentlessVertex), each as floats and in quantized streams. A 256 x 256 wave grid with mirrored bricks2
+	// texture coordinates is drawn with occlusion parallax over a 1080p target, head on and at a grazing angle,
+	// timed on the GPU over "frames" frames: whole, and 20 draws with GL_RASTERIZER_DISCARD for the vertex stage
+	// alone. The RMSE is against the float Vertex image, in 8-bit colour levels; the triangles straddling the
+	// mirror line blend T and -T in the stored frames, so some of it is theirs.
+	static int tangentFrames(int frames)
+	{
+		const int width = 1920, height = 1080;
+		unsigned int framebuffer, colour;
+		if (!createTarget(width, height, framebuffer, colour))
+			return 1;
+		const std::vector<unsigned int> ids = bindParallaxMaps();
+		unsigned int query;
+		glGenQueries(1, &query);
+
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		waveGrid(256, 4.0f, vertices, indices);
+		std::vector<QTangentVertex> compact(vertices.size());
+		std::vector<TangentlessVertex> tangentless(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			compact[i] = QTangentVertex(vertices[i]);
+			tangentless[i] = TangentlessVertex(vertices[i]);
+		}
+		QuantizedVertices quantized[3];
+		for (int f = 0; f < 3; f++)
+			quantized[f] = VertexQuantizer::quantize(vertices, VertexEncoding(), (TangentFrame)f);
+
+		// Formats 0-2 are the float ones by TangentFrame, 3-5 the quantized ones
+		unsigned int VAO[6], VBO[6], EBO[6];
+		Mesh::createBuffers(TANGENT_FRAME_VECTORS, vertices.size() * sizeof(Vertex), vertices.data(), indices.size(), indices.data(), VAO[0], VBO[0], EBO[0]);
+		Mesh::createBuffers(TANGENT_FRAME_QTANGENT, compact.size() * sizeof(QTangentVertex), compact.data(), indices.size(), indices.data(), VAO[1], VBO[1], EBO[1]);
+		Mesh::createBuffers(TANGENT_FRAME_DERIVATIVES, tangentless.size() * sizeof(TangentlessVertex), tangentless.data(), indices.size(), indices.data(), VAO[2], VBO[2], EBO[2]);
+		for (int f = 0; f < 3; f++)
+			Mesh::createBuffers(quantized[f], quantized[f].data.size(), quantized[f].data.data(), indices.size(), indices.data(), VAO[3 + f], VBO[3 + f], EBO[3 + f]);
+
+		ShaderVariants variants(ParallaxVariant::stages(false), ParallaxVariant::features());
+		const glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 100.0f);
+		std::vector<unsigned char> pixels((size_t)width * height * 4);
+		// Draws a format from eye and returns the GPU milliseconds per frame, leaving the image in pixels unless
+		// only the vertex stage is drawn
+		auto draw = [&](int format, const glm::vec3 &eye, bool discard, int count)
+		{
+			const TangentFrame frame = (TangentFrame)(format % 3);
+			ParallaxVariant variant;
+			variant.mode = PARALLAX_OCCLUSION;
+			variant.packedHeight = true;
+			variant.qtangents = frame == TANGENT_FRAME_QTANGENT;
+			variant.derivativeFrame = frame == TANGENT_FRAME_DERIVATIVES;
+			variant.quantized = format >= 3;
+			Shader &shader = variants.get(variant.key());
+			shader.use();
+			shader.setInt("diffuseMap", 0);
+			shader.setInt("normalMap", 1);
+			shader.setInt("depthMap", 2);
+			shader.setInt("minLayers", 8);
+			shader.setMat4("projection", projection);
+			shader.setMat4("view", glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+			shader.setMat4("model", glm::mat4(1.0f));
+			shader.setVec3("viewPos", eye);
+			shader.setVec3("lightPos", glm::vec3(0.5f, 1.0f, 0.3f));
+			shader.setFloat("heightScale", 0.1f);
+			if (format >= 3)
+			{
+				shader.setVec3("positionOffset", quantized[frame].positionOffset);
+				shader.setVec3("positionScale", quantized[frame].positionScale);
+			}
+			glBindVertexArray(VAO[format]);
+			if (discard)
+				glEnable(GL_RASTERIZER_DISCARD);
+			double total = 0.0;
+			for (int f = -3; f < count; f++)
+			{
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				for (int d = 0; d < (discard ? 20 : 1); d++)
+					glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
+				glEndQuery(GL_TIME_ELAPSED);
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+				if (f >= 0)
+					total += elapsed / 1e6;
+			}
+			glDisable(GL_RASTERIZER_DISCARD);
+			if (!discard)
+				glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+			return total / count;
+		};
+
+		const glm::vec3 eyes[] = { glm::vec3(0.0f, 0.0f, 2.6f), glm::vec3(2.6f, 0.3f, 0.5f) };
+		const char *eyeNames[] = { "head on", "grazing" };
+		const char *formatNames[] = { "Vertex", "QTangentVertex", "TangentlessVertex", "Quantized, octahedral", "Quantized, QTangent", "Quantized, normal only" };
+		const size_t strides[] = { sizeof(Vertex), sizeof(QTangentVertex), sizeof(TangentlessVertex), quantized[0].stride, quantized[1].stride, quantized[2].stride };
+		std::cout << "Tangent frames, " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles, " << width << "x" << height
+			<< ", occlusion parallax over " << frames << " frames, RMSE against Vertex" << std::endl;
+		for (int format = 0; format < 6; format++)
+		{
+			const double vertex = draw(format, eyes[0], true, frames);
+			std::cout << "  " << formatNames[format] << ": " << strides[format] << " bytes per vertex, "
+				<< vertices.size() * strides[format] / (1024.0 * 1024.0) << " MB of vertices, vertex stage " << vertex << " ms for 20 draws" << std::endl;
+		}
+		for (int e = 0; e < 2; e++)
+		{
+			draw(0, eyes[e], false, 1);
+			const std::vector<unsigned char> expected = pixels;
+			std::cout << "  " << eyeNames[e] << ":" << std::endl;
+			for (int format = 0; format < 6; format++)
+			{
+				const double milliseconds = draw(format, eyes[e], false, frames);
+				std::cout << "    " << formatNames[format] << ": " << milliseconds << " ms, RMSE " << rmse(pixels, expected) << std::endl;
+			}
+		}
+
+		variants.clear();
+		releaseAll(ids);
+		glBindVertexArray(0);
+		for (int format = 0; format < 6; format++)
+			Mesh::deleteBuffers(VAO[format], VBO[format], EBO[format]);
+		glDeleteQueries(1, &query);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &colour);
+		return 0;
+	}
+
+	// Model loading with and without the mesh cache. A wave grid of about "triangles" triangles is written out as an
+	// OBJ and loaded by a Model with the cache off (ASSIMP every time), cold (ASSIMP, then cooking the file) and
+	// warm (mapping the cooked file), in the Vertex format and in quantized streams. Each load ends with glFinish,
+	// so the uploads are counted.
+	static int meshImport(int triangles)
+	{
+		const int side = std::max(2, (int)std::sqrt(triangles / 2.0) + 1);
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		waveGrid(side, 4.0f, vertices, indices);
+		const std::string path = "meshcache_benchmark.obj";
+		{
+			std::ofstream out(path);
+			if (!out)
+			{
+				std::cout << "Couldn't write " << path << std::endl;
+				return 1;
+			}
+			for (size_t i = 0; i < vertices.size(); i++)
+				out << "v " << vertices[i].Position.x << ' ' << vertices[i].Position.y << ' ' << vertices[i].Position.z << '\n';
+			// Written flipped, as the importer flips them back
+			for (size_t i = 0; i < vertices.size(); i++)
+				out << "vt " << vertices[i].TexCoords.x << ' ' << 1.0f - vertices[i].TexCoords.y << '\n';
+			for (size_t i = 0; i < vertices.size(); i++)
+				out << "vn " << vertices[i].Normal.x << ' ' << vertices[i].Normal.y << ' ' << vertices[i].Normal.z << '\n';
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				out << 'f';
+				for (size_t c = 0; c < 3; c++)
+					out << ' ' << indices[i + c] + 1 << '/' << indices[i + c] + 1 << '/' << indices[i + c] + 1;
+				out << '\n';
+			}
+		}
+
+		// Loads the model and returns the milliseconds it took, with the indices it ended up drawing
+		auto load = [&](bool quantize, bool cache, size_t &indexCount)
+		{
+			Clock::time_point start = Clock::now();
+			ModelSettings settings;
+			settings.quantize = quantize;
+			settings.cache = cache;
+			Model model(path, settings);
+			glFinish();
+			const double milliseconds = millisecondsSince(start);
+			indexCount = 0;
+			for (size_t i = 0; i < model.meshes.size(); i++)
+				indexCount += model.meshes[i].indexCount;
+			return milliseconds;
+		};
+
+		std::cout << "Mesh import, " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles" << std::endl;
+		int result = 0;
+		for (int q = 0; q < 2; q++)
+		{
+			ModelSettings settings;
+			settings.quantize = q == 1;
+			const std::string cached = MeshCache::cachePath(path, Model::cacheHash(settings));
+			std::remove(cached.c_str());
+			size_t imported = 0, cold = 0, warm = 0;
+			const double importTime = load(q == 1, false, imported);
+			const double coldTime = load(q == 1, true, cold);
+			const double warmTime = load(q == 1, true, warm);
+			const FileStamp stamp = MappedFile::stamp(cached);
+			std::cout << "  " << (q == 1 ? "Quantized" : "Vertex") << ": ASSIMP " << importTime << " ms, cold " << coldTime << " ms, warm "
+				<< warmTime << " ms (" << importTime / std::max(warmTime, 1e-3) << "x faster), " << stamp.size / (1024 * 1024) << " MB cooked" << std::endl;
+			if (!stamp.exists || warm != imported || cold != imported)
+			{
+				std::cout << "  The cooked model doesn't match the imported one" << std::endl;
+				result = 1;
+			}
+			std::remove(cached.c_str());
+		}
+		std::remove(path.c_str());
+		return result;
+	}
+
+	// Converting a model of "meshes" meshes, each a 64 x 64 wave grid: ASSIMP imports an OBJ of them once, then
+	// Model::buildPayloads converts every mesh (without MeshOptimizer) serially and across pools of 1, 2, 4...
+	// workers up to one per hardware thread (the calling thread takes meshes too), in the Vertex format and
+	// quantized, best of 3 runs. Every parallel result is checked against the serial one, mesh by mesh.
+	static int meshConversion(int meshes)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		waveGrid(64, 4.0f, vertices, indices);
+		const std::string path = "meshes_benchmark.obj";
+		{
+			std::ofstream out(path);
+			if (!out)
+			{
+				std::cout << "Couldn't write " << path << std::endl;
+				return 1;
+			}
+			for (int m = 0; m < meshes; m++)
+			{
+				// Each mesh is offset, so they differ
+				const float offset = (float)m * 2.5f;
+				out << "o mesh" << m << '\n';
+				for (size_t i = 0; i < vertices.size(); i++)
+					out << "v " << vertices[i].Position.x + offset << ' ' << vertices[i].Position.y << ' ' << vertices[i].Position.z << '\n';
+				for (size_t i = 0; i < vertices.size(); i++)
+					out << "vt " << vertices[i].TexCoords.x << ' ' << 1.0f - vertices[i].TexCoords.y << '\n';
+				for (size_t i = 0; i < vertices.size(); i++)
+					out << "vn " << vertices[i].Normal.x << ' ' << vertices[i].Normal.y << ' ' << vertices[i].Normal.z << '\n';
+				const size_t base = (size_t)m * vertices.size() + 1;
+				for (size_t i = 0; i < indices.size(); i += 3)
+				{
+					out << 'f';
+					for (size_t c = 0; c < 3; c++)
+						out << ' ' << indices[i + c] + base << '/' << indices[i + c] + base << '/' << indices[i + c] + base;
+					out << '\n';
+				}
+			}
+		}
+		Assimp::Importer importer;
+		Clock::time_point start = Clock::now();
+		const aiScene *scene = importer.ReadFile(path, Model::importFlags(TANGENT_FRAME_VECTORS));
+		const double importTime = millisecondsSince(start);
+		std::remove(path.c_str());
+		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+		{
+			std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+			return 1;
+		}
+		std::vector<aiMesh*> sceneMeshes;
+		Model::listMeshes(scene->mRootNode, scene, sceneMeshes);
+
+		std::vector<unsigned int> workerCounts;
+		const unsigned int hardware = std::max(std::thread::hardware_concurrency(), 1u);
+		for (unsigned int workers = 1; workers < hardware; workers *= 2)
+			workerCounts.push_back(workers);
+		workerCounts.push_back(hardware);
+		std::cout << "Mesh conversion, " << sceneMeshes.size() << " meshes of " << vertices.size() << " vertices, ASSIMP import "
+			<< importTime << " ms, best of 3" << std::endl;
+		int result = 0;
+		for (int q = 0; q < 2; q++)
+		{
+			ModelSettings settings;
+			settings.quantize = q == 1;
+			settings.optimize = false;
+			// Quantized meshes print a line each, which would swamp the timings
+			std::streambuf *console = std::cout.rdbuf();
+			auto convert = [&](ThreadPool *pool, std::vector<std::shared_ptr<MeshPayload>> &payloads)
+			{
+				double best = 1e30;
+				for (int run = 0; run < 3; run++)
+				{
+					std::ostringstream quiet;
+					std::cout.rdbuf(quiet.rdbuf());
+					Clock::time_point begin = Clock::now();
+					payloads = Model::buildPayloads(sceneMeshes, scene, settings, pool);
+					best = std::min(best, millisecondsSince(begin));
+					std::cout.rdbuf(console);
+				}
+				return best;
+			};
+			std::vector<std::shared_ptr<MeshPayload>> serial, parallel;
+			const double serialTime = convert(nullptr, serial);
+			std::cout << "  " << (q == 1 ? "Quantized" : "Vertex") << ": serial " << serialTime << " ms" << std::endl;
+			for (size_t w = 0; w < workerCounts.size(); w++)
+			{
+				ThreadPool pool(workerCounts[w]);
+				const double time = convert(&pool, parallel);
+				bool same = parallel.size() == serial.size();
+				for (size_t i = 0; same && i < serial.size(); i++)
+					same = parallel[i]->vertexBytes() == serial[i]->vertexBytes() && parallel[i]->indices == serial[i]->indices
+						&& std::memcmp(parallel[i]->vertexData(), serial[i]->vertexData(), serial[i]->vertexBytes()) == 0;
+				std::cout << "    " << workerCounts[w] << " workers: " << time << " ms (" << serialTime / time << "x)" << (same ? "" : ", DIFFERENT") << std::endl;
+				if (!same)
+					result = 1;
+			}
+		}
+		return result;
+	}
+
+	// MeshOptimizer on eight 256 x 256 wave grids stacked along z and written back to front, as authored and with
+	// their triangles shuffled: the time each pass takes on the shuffled mesh, the ACMR, ATVR and overdraw of each
+	// order before and after, and the GPU time to draw each one head on over a 1080p target with a depth buffer,
+	// with occlusion parallax and with GL_RASTERIZER_DISCARD (20 draws) for the vertex stage alone, over "frames"
+	// frames.
+	static int meshOptimization(int frames)
+	{
+		const int width = 1920, height = 1080;
+		unsigned int framebuffer, colour;
+		if (!createTarget(width, height, framebuffer, colour))
+			return 1;
+		unsigned int depthBuffer;
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		glEnable(GL_DEPTH_TEST);
+		const std::vector<unsigned int> ids = bindParallaxMaps();
+		unsigned int query;
+		glGenQueries(1, &query);
+
+		std::vector<Vertex> layer, authored;
+		std::vector<unsigned int> layerIndices, authoredIndices;
+		waveGrid(256, 4.0f, layer, layerIndices);
+		for (int l = 0; l < 8; l++)
+		{
+			const unsigned int base = (unsigned int)authored.size();
+			for (size_t i = 0; i < layer.size(); i++)
+			{
+				authored.push_back(layer[i]);
+				authored.back().Position.z += l * 0.15f - 0.6f;
+			}
+			for (size_t i = 0; i < layerIndices.size(); i++)
+				authoredIndices.push_back(layerIndices[i] + base);
+		}
+		std::vector<unsigned int> shuffledIndices = authoredIndices;
+		uint32_t seed = 1;
+		for (size_t t = shuffledIndices.size() / 3 - 1; t > 0; t--)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			const size_t other = seed % (t + 1);
+			for (int c = 0; c < 3; c++)
+				std::swap(shuffledIndices[t * 3 + c], shuffledIndices[other * 3 + c]);
+		}
+
+		// The passes one at a time on the shuffled order, then the whole optimizer on both
+		std::vector<Vertex> optimizedShuffled = authored, optimizedAuthored = authored;
+		std::vector<unsigned int> optimizedShuffledIndices = shuffledIndices, optimizedAuthoredIndices = authoredIndices;
+		Clock::time_point start = Clock::now();
+		MeshOptimizer::optimizeVertexCache(optimizedShuffledIndices, optimizedShuffled.size());
+		const double cacheTime = millisecondsSince(start);
+		start = Clock::now();
+		MeshOptimizer::optimizeOverdraw(optimizedShuffledIndices, optimizedShuffled, 1.05f);
+		const double overdrawTime = millisecondsSince(start);
+		start = Clock::now();
+		MeshOptimizer::optimizeVertexFetch(optimizedShuffled, optimizedShuffledIndices);
+		const double fetchTime = millisecondsSince(start);
+		MeshOptimizer::optimize(optimizedAuthored, optimizedAuthoredIndices);
+
+		const std::vector<Vertex> *orderVertices[] = { &authored, &authored, &optimizedAuthored, &optimizedShuffled };
+		const std::vector<unsigned int> *orderIndices[] = { &authoredIndices, &shuffledIndices, &optimizedAuthoredIndices, &optimizedShuffledIndices };
+		const char *orderNames[] = { "Authored", "Shuffled", "Authored, optimized", "Shuffled, optimized" };
+		unsigned int VAO[4], VBO[4], EBO[4];
+		for (int o = 0; o < 4; o++)
+			Mesh::createBuffers(TANGENT_FRAME_VECTORS, orderVertices[o]->size() * sizeof(Vertex), orderVertices[o]->data(), orderIndices[o]->size(), orderIndices[o]->data(), VAO[o], VBO[o], EBO[o]);
+
+		ShaderVariants variants(ParallaxVariant::stages(false), ParallaxVariant::features());
+		ParallaxVariant variant;
+		variant.mode = PARALLAX_OCCLUSION;
+		variant.packedHeight = true;
+		Shader &shader = variants.get(variant.key());
+		const glm::vec3 eye(0.0f, 0.0f, 3.0f);
+		shader.use();
+		shader.setInt("diffuseMap", 0);
+		shader.setInt("normalMap", 1);
+		shader.setInt("depthMap", 2);
+		shader.setInt("minLayers", 8);
+		shader.setMat4("projection", glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 100.0f));
+		shader.setMat4("view", glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+		shader.setMat4("model", glm::mat4(1.0f));
+		shader.setVec3("viewPos", eye);
+		shader.setVec3("lightPos", glm::vec3(0.5f, 1.0f, 0.3f));
+		shader.setFloat("heightScale", 0.1f);
+		// Draws an order and returns the GPU milliseconds per frame
+		auto draw = [&](int order, bool discard)
+		{
+			glBindVertexArray(VAO[order]);
+			if (discard)
+				glEnable(GL_RASTERIZER_DISCARD);
+			double total = 0.0;
+			for (int frame = -3; frame < frames; frame++)
+			{
+				glClear(GL_DEPTH_BUFFER_BIT);
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				for (int d = 0; d < (discard ? 20 : 1); d++)
+					glDrawElements(GL_TRIANGLES, (GLsizei)orderIndices[order]->size(), GL_UNSIGNED_INT, 0);
+				glEndQuery(GL_TIME_ELAPSED);
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+				if (frame >= 0)
+					total += elapsed / 1e6;
+			}
+			glDisable(GL_RASTERIZER_DISCARD);
+			return total / frames;
+		};
+
+		std::cout << "Mesh optimization, " << authored.size() << " vertices, " << authoredIndices.size() / 3 << " triangles in 8 layers, FIFO cache of "
+			<< MeshOptimizer::CacheSize << std::endl;
+		std::cout << "  Passes on the shuffled order: vertex cache " << cacheTime << " ms, overdraw " << overdrawTime << " ms, vertex fetch " << fetchTime << " ms" << std::endl;
+		for (int o = 0; o < 4; o++)
+		{
+			const VertexCacheStats stats = MeshOptimizer::analyzeVertexCache(*orderIndices[o], orderVertices[o]->size());
+			const float overdraw = MeshOptimizer::analyzeOverdraw(*orderVertices[o], *orderIndices[o]);
+			const double whole = draw(o, false);
+			const double vertex = draw(o, true);
+			std::cout << "  " << orderNames[o] << ": ACMR " << stats.acmr << ", ATVR " << stats.atvr << ", overdraw " << overdraw << ", "
+				<< whole << " ms with parallax, vertex stage " << vertex << " ms for 20 draws" << std::endl;
+		}
+
+		variants.clear();
+		releaseAll(ids);
+		glBindVertexArray(0);
+		for (int o = 0; o < 4; o++)
+			Mesh::deleteBuffers(VAO[o], VBO[o], EBO[o]);
+		glDeleteQueries(1, &query);
+		glDisable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteRenderbuffers(1, &depthBuffer);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &colour);
+		return 0;
+	}
+
+	// Levels of detail from MeshSimplifier on a 512 x 512 wave grid whose mirrored half has its own vertices along
+	// the mirror line, as importers split them where the tangent frame flips. The chain of 6 is built one level at
+	// a time and across the pool, and each level checked for triangles straddling the mirror (which would blend T
+	// and -T) and for cracks, as the length of open edges by position: only the grid's wavy border, which shortens a
+	// little as it's straightened but would grow if the mirror line opened up. The
+	// camera then moves away head on: at each distance the level Mesh::selectLod picks for 1 pixel of error is
+	// drawn with occlusion parallax and timed on the GPU over "frames" frames against the full mesh, with the RMSE
+	// between them in 8-bit colour levels. Last, the distances the level switches at moving out and back in.
+	static int lodChain(int frames)
+	{
+		const int width = 1920, height = 1080;
+		const float fovy = glm::radians(45.0f);
+		unsigned int framebuffer, colour;
+		if (!createTarget(width, height, framebuffer, colour))
+			return 1;
+		const std::vector<unsigned int> ids = bindParallaxMaps();
+		unsigned int query;
+		glGenQueries(1, &query);
+
+		// The mirror line is the middle column; the mirrored triangles get a copy of it with their frame
+		const int side = 513, middle = side / 2;
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		waveGrid(side, 4.0f, vertices, indices);
+		std::vector<unsigned int> twin(vertices.size());
+		for (unsigned int v = 0; v < vertices.size(); v++)
+		{
+			twin[v] = v;
+			if ((int)(v % side) == middle)
+			{
+				twin[v] = (unsigned int)vertices.size();
+				Vertex copy = vertices[v];
+				copy.Tangent = -copy.Tangent;
+				vertices.push_back(copy);
+			}
+		}
+		for (size_t t = 0; t < indices.size(); t += 3)
+		{
+			bool mirrored = false;
+			for (int c = 0; c < 3; c++)
+				mirrored = mirrored || (int)(indices[t + c] % side) > middle;
+			if (mirrored)
+				for (int c = 0; c < 3; c++)
+					if (indices[t + c] < twin.size())
+						indices[t + c] = twin[indices[t + c]];
+		}
+
+		std::vector<MeshLod> lods;
+		std::vector<unsigned int> chain = indices;
+		Clock::time_point start = Clock::now();
+		Model::buildLods(vertices, chain, 6, true, nullptr, lods);
+		const double serialTime = millisecondsSince(start);
+		chain = indices;
+		start = Clock::now();
+		Model::buildLods(vertices, chain, 6, true, &ThreadPool::shared(), lods);
+		const double poolTime = millisecondsSince(start);
+		if (lods.empty())
+		{
+			std::cout << "The grid couldn't be simplified" << std::endl;
+			return 1;
+		}
+		std::cout << "Levels of detail, " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles: built in " << serialTime << " ms one at a time, "
+			<< poolTime << " ms across " << ThreadPool::shared().size() << " workers" << std::endl;
+
+		// Vertices by position, to find edges with no neighbour across them
+		std::map<std::tuple<float, float, float>, unsigned int> positions;
+		std::vector<unsigned int> position(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++)
+			position[v] = positions.insert(std::make_pair(std::make_tuple(vertices[v].Position.x, vertices[v].Position.y, vertices[v].Position.z), (unsigned int)positions.size())).first->second;
+		for (size_t l = 0; l < lods.size(); l++)
+		{
+			std::set<std::pair<unsigned int, unsigned int>> edges;
+			size_t straddling = 0;
+			for (unsigned int i = lods[l].firstIndex; i < lods[l].firstIndex + lods[l].indexCount; i += 3)
+			{
+				bool flipped = false, unflipped = false;
+				for (int c = 0; c < 3; c++)
+				{
+					edges.insert(std::make_pair(position[chain[i + c]], position[chain[i + (c + 1) % 3]]));
+					const bool mirrored = glm::dot(glm::cross(vertices[chain[i + c]].Normal, vertices[chain[i + c]].Tangent), vertices[chain[i + c]].Bitangent) < 0.0f;
+					flipped = flipped || mirrored;
+					unflipped = unflipped || !mirrored;
+				}
+				if (flipped && unflipped)
+					straddling++;
+			}
+			double openLength = 0.0;
+			for (size_t i = lods[l].firstIndex; i < lods[l].firstIndex + lods[l].indexCount; i += 3)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					const unsigned int a = chain[i + c], b = chain[i + (c + 1) % 3];
+					if (!edges.count(std::make_pair(position[b], position[a])))
+						openLength += glm::length(vertices[a].Position - vertices[b].Position);
+				}
+			}
+			std::cout << "  Level " << l << ": " << lods[l].indexCount / 3 << " triangles, error " << lods[l].error << ", " << straddling
+				<< " triangles straddling the mirror, open edge length " << openLength << std::endl;
+		}
+
+		std::vector<Texture> noTextures;
+		Mesh mesh(vertices, chain, noTextures);
+		mesh.lods = lods;
+		Model::boundingSphere(vertices, mesh.boundsCenter, mesh.boundsRadius);
+
+		ShaderVariants variants(ParallaxVariant::stages(false), ParallaxVariant::features());
+		ParallaxVariant variant;
+		variant.mode = PARALLAX_OCCLUSION;
+		variant.packedHeight = true;
+		Shader &shader = variants.get(variant.key());
+		shader.use();
+		shader.setInt("diffuseMap", 0);
+		shader.setInt("normalMap", 1);
+		shader.setInt("depthMap", 2);
+		shader.setInt("minLayers", 8);
+		shader.setMat4("projection", glm::perspective(fovy, (float)width / height, 0.1f, 100.0f));
+		shader.setMat4("model", glm::mat4(1.0f));
+		shader.setVec3("lightPos", glm::vec3(0.5f, 1.0f, 0.3f));
+		shader.setFloat("heightScale", 0.1f);
+		// Draws the mesh at its current level and returns the GPU milliseconds per frame
+		auto draw = [&]()
+		{
+			double total = 0.0;
+			for (int frame = -3; frame < frames; frame++)
+			{
+				glClear(GL_COLOR_BUFFER_BIT);
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				mesh.Draw(shader);
+				glEndQuery(GL_TIME_ELAPSED);
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+				if (frame >= 0)
+					total += elapsed / 1e6;
+			}
+			return total / frames;
+		};
+		// Pixels a model unit covers at a distance of one, as Model::selectLods works it out
+		const float pixelsPerUnit = height / (2.0f * std::tan(fovy * 0.5f));
+		auto distanceTo = [&](float eyeDistance)
+		{
+			return std::max(eyeDistance - mesh.boundsRadius, 1e-3f);
+		};
+
+		std::vector<unsigned char> full((size_t)width * height * 4), selected(full.size());
+		const float distances[] = { 1.5f, 3.0f, 6.0f, 12.0f, 24.0f, 48.0f };
+		for (float distance : distances)
+		{
+			const glm::vec3 eye(0.0f, 0.0f, distance);
+			shader.setMat4("view", glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+			shader.setVec3("viewPos", eye);
+			mesh.lod = 0;
+			const double fullTime = draw();
+			glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, full.data());
+			mesh.lod = 0;
+			mesh.selectLod(pixelsPerUnit / distanceTo(distance), 1.0f, 0.25f);
+			const double selectedTime = draw();
+			glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, selected.data());
+			std::cout << "  At " << distance << ": level " << mesh.lod << ", " << mesh.drawnIndexCount() / 3 << " triangles, " << selectedTime << " ms against "
+				<< fullTime << " ms for the full mesh, RMSE " << rmse(full, selected) << std::endl;
+		}
+
+		// Out from 1.5 to 64 and back, in 2% steps
+		std::cout << "  Switches moving out:";
+		mesh.lod = 0;
+		float distance = 1.5f;
+		for (; distance < 64.0f; distance *= 1.02f)
+		{
+			const unsigned int before = mesh.lod;
+			mesh.selectLod(pixelsPerUnit / distanceTo(distance), 1.0f, 0.25f);
+			if (mesh.lod != before)
+				std::cout << " " << before << "->" << mesh.lod << " at " << distance;
+		}
+		std::cout << std::endl << "  Switches moving in:";
+		for (; distance > 1.5f; distance /= 1.02f)
+		{
+			const unsigned int before = mesh.lod;
+			mesh.selectLod(pixelsPerUnit / distanceTo(distance), 1.0f, 0.25f);
+			if (mesh.lod != before)
+				std::cout << " " << before << "->" << mesh.lod << " at " << distance;
+		}
+		std::cout << std::endl;
+
+		variants.clear();
+		releaseAll(ids);
+		mesh.release();
+		glDeleteQueries(1, &query);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &colour);
+		return 0;
+	}
+
+	// Meshlet culling on a closed box of six 256 x 256 wave grids (786K triangles), optimized for the vertex cache
+	// and split into meshlets one piece at a time and across the pool. The camera orbits the box over "frames"
+	// frames, closing in halfway so most of it leaves the frustum. Each frame prints what culling rejected and its
+	// CPU time, and the GPU time of occlusion parallax drawn from the ranges left against the whole mesh, with
+	// depth testing; every tenth frame also compares the two images, which should match exactly.
+	static int meshletCulling(int frames)
+	{
+		const int width = 1920, height = 1080;
+		unsigned int framebuffer, colour;
+		if (!createTarget(width, height, framebuffer, colour))
+			return 1;
+		unsigned int depthBuffer;
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		glEnable(GL_DEPTH_TEST);
+		const std::vector<unsigned int> ids = bindParallaxMaps();
+		unsigned int query;
+		glGenQueries(1, &query);
+
+		// The grid faces +z; each face turns it to its side of the box and moves it out to it
+		std::vector<Vertex> face, vertices;
+		std::vector<unsigned int> faceIndices, indices;
+		waveGrid(257, 4.0f, face, faceIndices);
+		const glm::mat4 turns[] = {
+			glm::mat4(1.0f),
+			glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0f, 1.0f, 0.0f)),
+			glm::rotate(glm::mat4(1.0f), glm::half_pi<float>(), glm::vec3(0.0f, 1.0f, 0.0f)),
+			glm::rotate(glm::mat4(1.0f), -glm::half_pi<float>(), glm::vec3(0.0f, 1.0f, 0.0f)),
+			glm::rotate(glm::mat4(1.0f), -glm::half_pi<float>(), glm::vec3(1.0f, 0.0f, 0.0f)),
+			glm::rotate(glm::mat4(1.0f), glm::half_pi<float>(), glm::vec3(1.0f, 0.0f, 0.0f))
+		};
+		for (int f = 0; f < 6; f++)
+		{
+			const glm::mat3 turn(turns[f]);
+			const unsigned int base = (unsigned int)vertices.size();
+			for (size_t i = 0; i < face.size(); i++)
+			{
+				Vertex vertex = face[i];
+				vertex.Position = turn * (vertex.Position + glm::vec3(0.0f, 0.0f, 1.0f));
+				vertex.Normal = turn * vertex.Normal;
+				vertex.Tangent = turn * vertex.Tangent;
+				vertex.Bitangent = turn * vertex.Bitangent;
+				vertices.push_back(vertex);
+			}
+			for (size_t i = 0; i < faceIndices.size(); i++)
+				indices.push_back(faceIndices[i] + base);
+		}
+		MeshOptimizer::optimizeVertexCache(indices, vertices.size());
+
+		std::vector<unsigned int> serialIndices = indices;
+		Clock::time_point start = Clock::now();
+		MeshletBuilder::build(vertices, serialIndices, 0, serialIndices.size(), nullptr);
+		const double serialTime = millisecondsSince(start);
+		start = Clock::now();
+		const std::vector<Meshlet> meshlets = MeshletBuilder::build(vertices, indices, 0, indices.size(), &ThreadPool::shared());
+		const double poolTime = millisecondsSince(start);
+		size_t meshletVertices = 0;
+		for (size_t i = 0; i < meshlets.size(); i++)
+			meshletVertices += meshlets[i].vertexCount;
+		std::cout << "Meshlet culling, " << vertices.size() << " vertices, " << indices.size() / 3 << " triangles in " << meshlets.size() << " meshlets of "
+			<< indices.size() / 3.0 / meshlets.size() << " triangles and " << (double)meshletVertices / meshlets.size() << " vertices on average" << std::endl;
+		std::cout << "  Built in " << serialTime << " ms one piece at a time, " << poolTime << " ms across " << ThreadPool::shared().size() << " workers" << std::endl;
+
+		std::vector<Texture> noTextures;
+		Mesh mesh(vertices, indices, noTextures);
+		mesh.meshlets = meshlets;
+		Model::boundingSphere(vertices, mesh.boundsCenter, mesh.boundsRadius);
+
+		ShaderVariants variants(ParallaxVariant::stages(false), ParallaxVariant::features());
+		ParallaxVariant variant;
+		variant.mode = PARALLAX_OCCLUSION;
+		variant.packedHeight = true;
+		Shader &shader = variants.get(variant.key());
+		const glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 100.0f);
+		shader.use();
+		shader.setInt("diffuseMap", 0);
+		shader.setInt("normalMap", 1);
+		shader.setInt("depthMap", 2);
+		shader.setInt("minLayers", 8);
+		shader.setMat4("projection", projection);
+		shader.setMat4("model", glm::mat4(1.0f));
+		shader.setVec3("lightPos", glm::vec3(0.5f, 1.0f, 0.3f));
+		shader.setFloat("heightScale", 0.1f);
+		// Draws the mesh as it's culled and returns the GPU milliseconds, after 3 untimed frames
+		auto draw = [&]()
+		{
+			double elapsedMs = 0.0;
+			for (int warmup = 0; warmup < 4; warmup++)
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				mesh.Draw(shader);
+				glEndQuery(GL_TIME_ELAPSED);
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+				elapsedMs = elapsed / 1e6;
+			}
+			return elapsedMs;
+		};
+
+		std::vector<unsigned char> culledImage((size_t)width * height * 4), fullImage(culledImage.size());
+		MeshletCullStats total;
+		double totalCull = 0.0, totalCulled = 0.0, totalFull = 0.0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			const float angle = glm::two_pi<float>() * frame / frames;
+			const float distance = frame < frames / 2 ? 4.0f : 1.8f;
+			const glm::vec3 eye(distance * std::sin(angle), 0.6f * std::sin(angle * 2.0f), distance * std::cos(angle));
+			const glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			shader.setMat4("view", view);
+			shader.setVec3("viewPos", eye);
+
+			MeshletCullStats stats;
+			start = Clock::now();
+			mesh.cullMeshlets(Frustum(projection * view), eye, true, stats);
+			const double cullTime = millisecondsSince(start);
+			const double culledTime = draw();
+			const bool compare = frame % 10 == 0;
+			if (compare)
+				glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, culledImage.data());
+			mesh.resetCulling();
+			const double fullTime = draw();
+			std::cout << "  Frame " << frame << ": cull " << cullTime << " ms, " << culledTime << " ms against " << fullTime << " ms";
+			if (compare)
+			{
+				glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, fullImage.data());
+				std::cout << ", RMSE " << rmse(culledImage, fullImage);
+			}
+			std::cout << ". ";
+			stats.print();
+			total += stats;
+			totalCull += cullTime;
+			totalCulled += culledTime;
+			totalFull += fullTime;
+		}
+		std::cout << "  Average: cull " << totalCull / frames << " ms, " << totalCulled / frames << " ms against " << totalFull / frames << " ms. ";
+		total.print();
+
+		variants.clear();
+		releaseAll(ids);
+		mesh.release();
+		glDeleteQueries(1, &query);
+		glDisable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteRenderbuffers(1, &depthBuffer);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &colour);
+		return 0;
+	}
+
+	// Creates an offscreen RGBA8 target of the given size, binds it and sets the viewport to it
+	static bool createTarget(int width, int height, unsigned int &framebuffer, unsigned int &colour)
+	{
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glGenTextures(1, &colour);
+		glBindTexture(GL_TEXTURE_2D, colour);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colour, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "Couldn't create the benchmark framebuffer" << std::endl;
+			return false;
+		}
+		glViewport(0, 0, width, height);
+		glDisable(GL_DEPTH_TEST);
+		return true;
+	}
+
+	// Loads the bricks2 maps every parallax mode reads and binds them to the units frag.fs samples them on:
+	// diffuse on 0, normal with packed height on 1, cones on 3 and the min depth pyramid on 4
+	static std::vector<unsigned int> bindParallaxMaps()
+	{
+		std::vector<TextureRequest> requests(4);
+		requests[0].path = "textures/bricks2.jpg";
+		requests[1].path = "textures/bricks2_normal.jpg";
+		requests[1].settings = TextureSettings::forRole(TEXTURE_ROLE_NORMAL_HEIGHT);
+		requests[1].heightPath = "textures/bricks2_disp.jpg";
+		requests[2].path = "textures/bricks2_disp.jpg";
+		requests[2].settings = TextureSettings::forRole(TEXTURE_ROLE_CONE);
+		requests[3].path = "textures/bricks2_disp.jpg";
+		requests[3].settings = TextureSettings::forRole(TEXTURE_ROLE_HEIGHT_PYRAMID);
+		std::vector<unsigned int> ids = TextureCache::instance().acquireBatch(requests);
+		const GLenum units[] = { GL_TEXTURE0, GL_TEXTURE1, GL_TEXTURE3, GL_TEXTURE4 };
+		for (size_t t = 0; t < ids.size(); t++)
+		{
+			glActiveTexture(units[t]);
+			glBindTexture(GL_TEXTURE_2D, ids[t]);
+		}
+		return ids;
+	}
+
+	// The sweep's reference: relief mapping at the most layers
+	static ParallaxVariant referenceVariant()
+	{
+		ParallaxVariant variant;
+		variant.mode = PARALLAX_RELIEF;
+		variant.steps = 64;
+		variant.packedHeight = true;
+		return variant;
+	}
+
+	// Root mean square difference of two RGBA8 images' colour channels
+	static double rmse(const std::vector<unsigned char> &a, const std::vector<unsigned char> &b)
+	{
+		double sum = 0.0;
+		size_t count = 0;
+		for (size_t i = 0; i < a.size(); i += 4)
+		{
+			for (size_t c = 0; c < 3; c++)
+			{
+				const double difference = (double)a[i + c] - (double)b[i + c];
+				sum += difference * difference;
+			}
+			count += 3;
+		}
+		return count ? std::sqrt(sum / count) : 0.0;
+	}
+
+	// Time to first frame with "variants" shader variants to build, compiling each one before the first frame
+	// against submitting them all to ShaderCompiler and drawing the first frame with one fallback program. The
+	// program cache is off, and every variant gets a define unique to the run, so neither the cache nor the
+	// driver's own shader cache can skip a compile.
+	static int shaderCompilation(int variants)
+	{
+		const char *modes[] = { "driver threads (KHR_parallel_shader_compile)", "worker context", "one per poll on the render thread" };
+		std::cout << "Shader compilation, " << variants << " variants, async builds use " << modes[ShaderCompiler::instance().mode()] << std::endl;
+		ProgramCache::enabled() = false;
+		const std::vector<ShaderFeature> features = ParallaxVariant::features();
+		ShaderVariants table("shaders/vert.vs", "shaders/frag.fs", features);
+		const long long run = (long long)Clock::now().time_since_epoch().count();
+		// Variant i's defines: the parallax features cycled through, plus the unique define
+		auto defines = [&](int i)
+		{
+			ParallaxVariant variant;
+			variant.mode = (ParallaxMode)(i % 7);
+			variant.steps = ParallaxVariant::stepCounts()[(i / 7) % 4];
+			variant.shadows = (i / 28) % 2 != 0;
+			variant.packedHeight = (i / 56) % 2 != 0;
+			std::ostringstream block;
+			block << table.defines(variant.key()) << "#define BENCHMARK_RUN " << run << '_' << i << "\n";
+			return block.str();
+		};
+		unsigned int vbo;
+		const unsigned int quad = createQuad(vbo);
+		glBindVertexArray(quad);
+
+		// Blocking: every variant is compiled and linked, and checked, before anything is drawn
+		Clock::time_point start = Clock::now();
+		std::vector<std::unique_ptr<Shader>> blocking;
+		for (int i = 0; i < variants; i++)
+			blocking.emplace_back(new Shader("shaders/vert.vs", "shaders/frag.fs", nullptr, defines(i)));
+		blocking[0]->use();
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+		glFinish();
+		const double blockingFirstFrame = millisecondsSince(start);
+		for (size_t i = 0; i < blocking.size(); i++)
+			glDeleteProgram(blocking[i]->ID);
+
+		// Async: one fallback program is built, everything else is submitted, and the first frame is drawn at once
+		ShaderCompiler &compiler = ShaderCompiler::instance();
+		start = Clock::now();
+		Shader fallback("shaders/vert.vs", "shaders/frag.fs", nullptr, defines(variants));
+		std::vector<std::unique_ptr<Shader>> async;
+		for (int i = 0; i < variants; i++)
+		{
+			async.emplace_back(new Shader());
+			compiler.submit(*async.back(), "shaders/vert.vs", "shaders/frag.fs", std::string(), defines(variants + 1 + i));
+		}
+		compiler.poll();
+		fallback.use();
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+		glFinish();
+		const double asyncFirstFrame = millisecondsSince(start);
+		// Then frames keep being drawn, with each variant once it's ready, until they all are
+		int frames = 1;
+		double longestFrame = 0.0;
+		while (compiler.pending() > 0)
+		{
+			const Clock::time_point frameStart = Clock::now();
+			compiler.poll();
+			for (size_t i = 0; i < async.size(); i++)
+			{
+				if (!compiler.ready(*async[i]))
+					continue;
+				async[i]->use();
+				glDrawArrays(GL_TRIANGLES, 0, 6);
+			}
+			glFinish();
+			longestFrame = std::max(longestFrame, millisecondsSince(frameStart));
+			frames++;
+		}
+		const double asyncAllReady = millisecondsSince(start);
+		glDeleteProgram(fallback.ID);
+		for (size_t i = 0; i < async.size(); i++)
+			glDeleteProgram(async[i]->ID);
+		ProgramCache::enabled() = true;
+
+		std::cout << "  blocking:  first frame after " << blockingFirstFrame << " ms" << std::endl;
+		std::cout << "  async:     first frame after " << asyncFirstFrame << " ms (" << blockingFirstFrame / asyncFirstFrame << "x sooner), all ready after "
+			<< asyncAllReady << " ms, " << frames << " frames drawn, longest " << longestFrame << " ms" << std::endl;
+		glBindVertexArray(0);
+		glDeleteVertexArrays(1, &quad);
+		glDeleteBuffers(1, &vbo);
+		return 0;
+	}
+};
+#endif
@@ -0,0 +1,719 @@
+#ifndef BLOCK_COMPRESSOR_H
+#define BLOCK_COMPRESSOR_H
+
+#include "DecodedImage.h"
+#include "GLExtensions.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Block compressed formats, each storing a 4x4 texel block in a fixed number of bytes
+enum BlockFormat {
+	// RGB at 4 bits per texel, for colour maps
+	BLOCK_BC1,
+	// One channel at 4 bits per texel, for height maps
+	BLOCK_BC4,
+	// Two channels at 8 bits per texel, for the xy of normal maps
+	BLOCK_BC5,
+	// RGBA at 8 bits per texel with much lower error than BC1, for colour maps
+	BLOCK_BC7
+};
+
+// Encodes 8-bit images into BC1/BC4/BC5/BC7 so textures stay compressed in VRAM and in the texture cache, and decodes
+// them again to measure the quality. Blocks are independent, so every level is split by block row across the
+// thread pool; the index search inside BC1 and BC4 blocks uses SSE2.
+// BC7 is encoded with mode 6 only (one subset, RGBA endpoints), which is fast and a large step up from BC1.
+class BlockCompressor
+{
+public:
+	// Bytes per 4x4 block
+	static size_t blockSize(BlockFormat format)
+	{
+		return (format == BLOCK_BC1 || format == BLOCK_BC4) ? 8 : 16;
+	}
+
+	// The GL internal format for a block format
+	static GLenum glFormat(BlockFormat format, bool srgb)
+	{
+		switch (format)
+		{
+		case BLOCK_BC1:
+			return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case BLOCK_BC4:
+			return GL_COMPRESSED_RED_RGTC1;
+		case BLOCK_BC5:
+			return GL_COMPRESSED_RG_RGTC2;
+		default:
+			return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+		}
+	}
+
+	// Compresses every level of an uncompressed 8-bit image. BC4 takes the first channel and BC5 the first two.
+	// The compressed levels are placed in one heap buffer, which the image takes ownership of.
+	static bool compress(DecodedImage &image, BlockFormat format, bool srgb)
+	{
+		if (!image.valid() || image.compressed || image.type != GL_UNSIGNED_BYTE)
+			return false;
+		if (format == BLOCK_BC5 && image.components < 2)
+			return false;
+
+		const size_t bytesPerBlock = blockSize(format);
+		std::vector<TextureLevel> levels(image.levels.size());
+		std::vector<size_t> offsets(levels.size());
+		size_t total = 0;
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			levels[i].width = image.levels[i].width;
+			levels[i].height = image.levels[i].height;
+			levels[i].size = blocksAcross(levels[i].width) * blocksAcross(levels[i].height) * bytesPerBlock;
+			offsets[i] = total;
+			total += levels[i].size;
+		}
+		std::shared_ptr<std::vector<unsigned char>> storage = std::make_shared<std::vector<unsigned char>>(total);
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			levels[i].pixels = storage->data() + offsets[i];
+			const TextureLevel &source = image.levels[i];
+			unsigned char *dest = storage->data() + offsets[i];
+			const size_t rows = blocksAcross(source.height);
+			ThreadPool::shared().parallelFor(rows, [&](size_t by)
+			{
+				compressRow(source, image.components, format, (int)by, dest + by * blocksAcross(source.width) * bytesPerBlock);
+			});
+		}
+
+		image.levels = levels;
+		image.owner = storage;
+		image.compressed = true;
+		image.internalFormat = (GLint)glFormat(format, srgb);
+		return true;
+	}
+
+	// Decodes a compressed level into RGBA8 texels (width * height * 4 bytes). Channels the format doesn't store
+	// are 0, with alpha 255. BC7 blocks in modes other than 6 decode as black, as this encoder never writes them.
+	static void decompress(const TextureLevel &level, BlockFormat format, unsigned char *rgba)
+	{
+		const size_t bytesPerBlock = blockSize(format);
+		const int across = (int)blocksAcross(level.width);
+		for (int by = 0; by < (int)blocksAcross(level.height); by++)
+		{
+			for (int bx = 0; bx < across; bx++)
+			{
+				const uint8_t *block = level.pixels + ((size_t)by * across + bx) * bytesPerBlock;
+				uint8_t texels[16][4] = {};
+				for (int i = 0; i < 16; i++)
+					texels[i][3] = 255;
+				if (format == BLOCK_BC1)
+					decodeBC1(block, texels);
+				else if (format == BLOCK_BC4)
+					decodeBC4(block, texels, 0);
+				else if (format == BLOCK_BC5)
+				{
+					decodeBC4(block, texels, 0);
+					decodeBC4(block + 8, texels, 1);
+				}
+				else
+					decodeBC7(block, texels);
+				for (int y = 0; y < 4 && by * 4 + y < level.height; y++)
+					for (int x = 0; x < 4 && bx * 4 + x < level.width; x++)
+						std::memcpy(rgba + ((size_t)(by * 4 + y) * level.width + bx * 4 + x) * 4, texels[y * 4 + x], 4);
+			}
+		}
+	}
+
+	// ---- Single block encoders ----
+
+	static void encodeBC1(const uint8_t texels[16][4], uint8_t out[8])
+	{
+		float colors[16][3];
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 3; c++)
+				colors[i][c] = texels[i][c];
+
+		float axis[4], mean[4];
+		principalAxis(colors[0], 3, 3, axis, mean);
+		float lowest = 1e30f, highest = -1e30f;
+		int low = 0, high = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = (colors[i][0] - mean[0]) * axis[0] + (colors[i][1] - mean[1]) * axis[1] + (colors[i][2] - mean[2]) * axis[2];
+			if (t < lowest) { lowest = t; low = i; }
+			if (t > highest) { highest = t; high = i; }
+		}
+		// Pull the endpoints in slightly from the extremes, as the interpolated colours cover the middle better
+		float endpoints[2][3];
+		for (int c = 0; c < 3; c++)
+		{
+			float inset = (colors[high][c] - colors[low][c]) / 16.0f;
+			endpoints[0][c] = colors[high][c] - inset;
+			endpoints[1][c] = colors[low][c] + inset;
+		}
+
+		uint16_t best0 = to565(endpoints[0]), best1 = to565(endpoints[1]);
+		uint8_t bestIndices[16];
+		float bestError = fitBC1(colors, best0, best1, bestIndices);
+		// Least squares refinement: solve for the endpoints that best fit the chosen indices, then reselect indices
+		for (int iteration = 0; iteration < 2 && bestError > 0.0f; iteration++)
+		{
+			static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			float aa = 0, ab = 0, bb = 0, ax[3] = {}, bx[3] = {};
+			for (int i = 0; i < 16; i++)
+			{
+				const float a = weights[bestIndices[i]], b = 1.0f - a;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (int c = 0; c < 3; c++)
+				{
+					ax[c] += a * colors[i][c];
+					bx[c] += b * colors[i][c];
+				}
+			}
+			const float det = aa * bb - ab * ab;
+			if (std::fabs(det) < 1e-6f)
+				break;
+			for (int c = 0; c < 3; c++)
+			{
+				endpoints[0][c] = (ax[c] * bb - bx[c] * ab) / det;
+				endpoints[1][c] = (bx[c] * aa - ax[c] * ab) / det;
+			}
+			uint16_t c0 = to565(endpoints[0]), c1 = to565(endpoints[1]);
+			uint8_t indices[16];
+			float error = fitBC1(colors, c0, c1, indices);
+			if (error >= bestError)
+				break;
+			best0 = c0;
+			best1 = c1;
+			bestError = error;
+			std::memcpy(bestIndices, indices, 16);
+		}
+
+		// The four colour mode needs color0 > color1
+		if (best0 < best1)
+		{
+			std::swap(best0, best1);
+			static const uint8_t swapped[4] = { 1, 0, 3, 2 };
+			for (int i = 0; i < 16; i++)
+				bestIndices[i] = swapped[bestIndices[i]];
+		}
+		else if (best0 == best1)
+			std::memset(bestIndices, 0, 16);
+
+		uint32_t bits = 0;
+		for (int i = 0; i < 16; i++)
+			bits |= (uint32_t)bestIndices[i] << (i * 2);
+		out[0] = (uint8_t)(best0 & 0xFF);
+		out[1] = (uint8_t)(best0 >> 8);
+		out[2] = (uint8_t)(best1 & 0xFF);
+		out[3] = (uint8_t)(best1 >> 8);
+		for (int i = 0; i < 4; i++)
+			out[4 + i] = (uint8_t)(bits >> (i * 8));
+	}
+
+	static void encodeBC4(const uint8_t values[16], uint8_t out[8])
+	{
+		uint8_t lowest = values[0], highest = values[0];
+		for (int i = 1; i < 16; i++)
+		{
+			lowest = std::min(lowest, values[i]);
+			highest = std::max(highest, values[i]);
+		}
+		// Eight value mode: red0 = highest, red1 = lowest and six values between them
+		out[0] = highest;
+		out[1] = lowest;
+		uint8_t indices[16] = {};
+		if (highest != lowest)
+			selectBC4(values, lowest, highest, indices);
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; i++)
+			bits |= (uint64_t)indices[i] << (i * 3);
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = (uint8_t)(bits >> (i * 8));
+	}
+
+	static void encodeBC7(const uint8_t texels[16][4], uint8_t out[16])
+	{
+		float colors[16][4];
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 4; c++)
+				colors[i][c] = texels[i][c];
+
+		float axis[4], mean[4];
+		principalAxis(colors[0], 4, 4, axis, mean);
+		float lowest = 1e30f, highest = -1e30f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < 4; c++)
+				t += (colors[i][c] - mean[c]) * axis[c];
+			lowest = std::min(lowest, t);
+			highest = std::max(highest, t);
+		}
+		float endpoints[2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = mean[c] + axis[c] * lowest;
+			endpoints[1][c] = mean[c] + axis[c] * highest;
+		}
+
+		Bc7Fit best;
+		fitBC7(colors, endpoints, best);
+		// One least squares pass over the chosen indices
+		{
+			float aa = 0, ab = 0, bb = 0, ax[4] = {}, bx[4] = {};
+			for (int i = 0; i < 16; i++)
+			{
+				const float b = Bc7Weights()[best.indices[i]] / 64.0f, a = 1.0f - b;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (int c = 0; c < 4; c++)
+				{
+					ax[c] += a * colors[i][c];
+					bx[c] += b * colors[i][c];
+				}
+			}
+			const float det = aa * bb - ab * ab;
+			if (std::fabs(det) > 1e-6f)
+			{
+				for (int c = 0; c < 4; c++)
+				{
+					endpoints[0][c] = (ax[c] * bb - bx[c] * ab) / det;
+					endpoints[1][c] = (bx[c] * aa - ax[c] * ab) / det;
+				}
+				Bc7Fit refined;
+				fitBC7(colors, endpoints, refined);
+				if (refined.error < best.error)
+					best = refined;
+			}
+		}
+
+		// The first index's top bit isn't stored, so it must be below 8
+		if (best.indices[0] >= 8)
+		{
+			for (int c = 0; c < 4; c++)
+				std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+			std::swap(best.pbits[0], best.pbits[1]);
+			for (int i = 0; i < 16; i++)
+				best.indices[i] = (uint8_t)(15 - best.indices[i]);
+		}
+
+		BitWriter writer(out);
+		writer.write(1 << 6, 7);	// Mode 6
+		for (int c = 0; c < 4; c++)
+		{
+			writer.write(best.endpoints[0][c], 7);
+			writer.write(best.endpoints[1][c], 7);
+		}
+		writer.write(best.pbits[0], 1);
+		writer.write(best.pbits[1], 1);
+		writer.write(best.indices[0], 3);
+		for (int i = 1; i < 16; i++)
+			writer.write(best.indices[i], 4);
+	}
+
+private:
+	static size_t blocksAcross(int texels)
+	{
+		return (size_t)(texels + 3) / 4;
+	}
+
+	// Compresses one row of blocks, repeating the last row/column for blocks that overhang the edge
+	static void compressRow(const TextureLevel &source, int components, BlockFormat format, int by, unsigned char *dest)
+	{
+		const size_t bytesPerBlock = blockSize(format);
+		for (int bx = 0; bx < (int)blocksAcross(source.width); bx++)
+		{
+			uint8_t texels[16][4];
+			for (int y = 0; y < 4; y++)
+			{
+				const int sy = std::min(by * 4 + y, source.height - 1);
+				for (int x = 0; x < 4; x++)
+				{
+					const int sx = std::min(bx * 4 + x, source.width - 1);
+					const uint8_t *texel = source.pixels + ((size_t)sy * source.width + sx) * components;
+					uint8_t *block = texels[y * 4 + x];
+					block[0] = texel[0];
+					block[1] = components > 1 ? texel[1] : texel[0];
+					block[2] = components > 2 ? texel[2] : texel[0];
+					block[3] = components > 3 ? texel[3] : 255;
+				}
+			}
+			uint8_t *out = dest + bx * bytesPerBlock;
+			if (format == BLOCK_BC1)
+				encodeBC1(texels, out);
+			else if (format == BLOCK_BC7)
+				encodeBC7(texels, out);
+			else
+			{
+				const int channels = format == BLOCK_BC5 ? 2 : 1;
+				for (int c = 0; c < channels; c++)
+				{
+					uint8_t values[16];
+					for (int i = 0; i < 16; i++)
+						values[i] = texels[i][c];
+					encodeBC4(values, out + c * 8);
+				}
+			}
+		}
+	}
+
+	// Mean and dominant direction of a set of points with "dims" dimensions, found by power iteration
+	static void principalAxis(const float *points, int dims, int stride, float axis[4], float mean[4])
+	{
+		for (int c = 0; c < dims; c++)
+		{
+			mean[c] = 0.0f;
+			for (int i = 0; i < 16; i++)
+				mean[c] += points[i * stride + c];
+			mean[c] /= 16.0f;
+		}
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++)
+			for (int a = 0; a < dims; a++)
+				for (int b = 0; b < dims; b++)
+					covariance[a][b] += (points[i * stride + a] - mean[a]) * (points[i * stride + b] - mean[b]);
+		for (int c = 0; c < dims; c++)
+			axis[c] = 1.0f;
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			float length = 0.0f;
+			for (int a = 0; a < dims; a++)
+			{
+				for (int b = 0; b < dims; b++)
+					next[a] += covariance[a][b] * axis[b];
+				length += next[a] * next[a];
+			}
+			if (length < 1e-12f)
+				break;
+			length = 1.0f / std::sqrt(length);
+			for (int c = 0; c < dims; c++)
+				axis[c] = next[c] * length;
+		}
+	}
+
+	// ---- BC1 ----
+
+	static uint16_t to565(const float color[3])
+	{
+		int r = (int)std::floor(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+		int g = (int)std::floor(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+		int b = (int)std::floor(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	static void from565(uint16_t color, int out[3])
+	{
+		int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		out[0] = (r << 3) | (r >> 2);
+		out[1] = (g << 2) | (g >> 4);
+		out[2] = (b << 3) | (b >> 2);
+	}
+
+	// The four colour palette for a pair of endpoints, in index order
+	static void paletteBC1(uint16_t c0, uint16_t c1, int palette[4][3], bool fourColor)
+	{
+		from565(c0, palette[0]);
+		from565(c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			if (fourColor)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+	}
+
+	// Picks the closest palette entry for each texel, returning the total squared error.
+	// The palette is built for four colour mode whichever order the endpoints are in, as the encoder swaps them after.
+	static float fitBC1(const float colors[16][3], uint16_t c0, uint16_t c1, uint8_t indices[16])
+	{
+		int palette[4][3];
+		paletteBC1(c0, c1, palette, true);
+		float total = 0.0f;
+#ifdef SIMD_X86
+		// Four texels at a time: distance to each palette entry, keeping the smallest
+		for (int i = 0; i < 16; i += 4)
+		{
+			__m128 r = _mm_setr_ps(colors[i][0], colors[i + 1][0], colors[i + 2][0], colors[i + 3][0]);
+			__m128 g = _mm_setr_ps(colors[i][1], colors[i + 1][1], colors[i + 2][1], colors[i + 3][1]);
+			__m128 b = _mm_setr_ps(colors[i][2], colors[i + 1][2], colors[i + 2][2], colors[i + 3][2]);
+			__m128 best = _mm_set1_ps(1e30f);
+			__m128i bestIndex = _mm_setzero_si128();
+			for (int p = 0; p < 4; p++)
+			{
+				__m128 dr = _mm_sub_ps(r, _mm_set1_ps((float)palette[p][0]));
+				__m128 dg = _mm_sub_ps(g, _mm_set1_ps((float)palette[p][1]));
+				__m128 db = _mm_sub_ps(b, _mm_set1_ps((float)palette[p][2]));
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+				__m128 closer = _mm_cmplt_ps(d, best);
+				best = _mm_min_ps(d, best);
+				__m128i mask = _mm_castps_si128(closer);
+				bestIndex = _mm_or_si128(_mm_andnot_si128(mask, bestIndex), _mm_and_si128(mask, _mm_set1_epi32(p)));
+			}
+			alignas(16) int32_t chosen[4];
+			alignas(16) float errors[4];
+			_mm_store_si128((__m128i*)chosen, bestIndex);
+			_mm_store_ps(errors, best);
+			for (int k = 0; k < 4; k++)
+			{
+				indices[i + k] = (uint8_t)chosen[k];
+				total += errors[k];
+			}
+		}
+#else
+		for (int i = 0; i < 16; i++)
+		{
+			float best = 1e30f;
+			for (int p = 0; p < 4; p++)
+			{
+				float d = 0.0f;
+				for (int c = 0; c < 3; c++)
+					d += (colors[i][c] - palette[p][c]) * (colors[i][c] - palette[p][c]);
+				if (d < best)
+				{
+					best = d;
+					indices[i] = (uint8_t)p;
+				}
+			}
+			total += best;
+		}
+#endif
+		return total;
+	}
+
+	static void decodeBC1(const uint8_t *block, uint8_t texels[16][4])
+	{
+		const uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+		const uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+		int palette[4][3];
+		paletteBC1(c0, c1, palette, c0 > c1);
+		const uint32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+		for (int i = 0; i < 16; i++)
+		{
+			const int index = (bits >> (i * 2)) & 3;
+			for (int c = 0; c < 3; c++)
+				texels[i][c] = (uint8_t)palette[index][c];
+			texels[i][3] = (c0 <= c1 && index == 3) ? 0 : 255;
+		}
+	}
+
+	// ---- BC4 ----
+
+	// Eight value mode indices: the position of each value between lowest and highest, rounded to sevenths,
+	// then reordered because index 0 is red0 (highest) and index 1 is red1 (lowest)
+	static void selectBC4(const uint8_t values[16], uint8_t lowest, uint8_t highest, uint8_t indices[16])
+	{
+		static const uint8_t order[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+		const float scale = 7.0f / (highest - lowest);
+#ifdef SIMD_X86
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i bytes = _mm_loadu_si128((const __m128i*)values);
+		const __m128i low = _mm_set1_epi32(lowest);
+		const __m128 factor = _mm_set1_ps(scale);
+		const __m128i halves[2] = { _mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero) };
+		for (int h = 0; h < 2; h++)
+		{
+			const __m128i quads[2] = { _mm_unpacklo_epi16(halves[h], zero), _mm_unpackhi_epi16(halves[h], zero) };
+			for (int q = 0; q < 2; q++)
+			{
+				// _mm_cvtps_epi32 rounds to nearest
+				__m128i steps = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(quads[q], low)), factor));
+				alignas(16) int32_t position[4];
+				_mm_store_si128((__m128i*)position, steps);
+				for (int k = 0; k < 4; k++)
+					indices[h * 8 + q * 4 + k] = order[std::min(std::max(position[k], 0), 7)];
+			}
+		}
+#else
+		for (int i = 0; i < 16; i++)
+			indices[i] = order[std::min(std::max((int)std::floor((values[i] - lowest) * scale + 0.5f), 0), 7)];
+#endif
+	}
+
+	static void decodeBC4(const uint8_t *block, uint8_t texels[16][4], int channel)
+	{
+		int palette[8];
+		palette[0] = block[0];
+		palette[1] = block[1];
+		if (palette[0] > palette[1])
+		{
+			for (int i = 1; i < 7; i++)
+				palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+		}
+		else
+		{
+			for (int i = 1; i < 5; i++)
+				palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+		uint64_t bits = 0;
+		for (int i = 0; i < 6; i++)
+			bits |= (uint64_t)block[2 + i] << (i * 8);
+		for (int i = 0; i < 16; i++)
+			texels[i][channel] = (uint8_t)palette[(bits >> (i * 3)) & 7];
+	}
+
+	// ---- BC7 mode 6 ----
+
+	struct Bc7Fit {
+		int endpoints[2][4];
+		int pbits[2];
+		uint8_t indices[16];
+		float error = 1e30f;
+	};
+
+	static const int* Bc7Weights()
+	{
+		static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+		return weights;
+	}
+
+	// Quantises the endpoints to 7 bits plus a shared low bit per endpoint, trying all four low bit choices,
+	// and keeps whichever gives the lowest error once indices are picked
+	static float distanceSquared(const float a[4], const float b[4])
+	{
+#ifdef SIMD_X86
+		__m128 d = _mm_sub_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+		d = _mm_mul_ps(d, d);
+		d = _mm_add_ps(d, _mm_movehl_ps(d, d));
+		d = _mm_add_ss(d, _mm_shuffle_ps(d, d, 1));
+		return _mm_cvtss_f32(d);
+#else
+		return (a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]) + (a[3] - b[3]) * (a[3] - b[3]);
+#endif
+	}
+
+	static void fitBC7(const float colors[16][4], const float endpoints[2][4], Bc7Fit &best)
+	{
+		for (int p0 = 0; p0 < 2; p0++)
+		{
+			for (int p1 = 0; p1 < 2; p1++)
+			{
+				Bc7Fit fit;
+				fit.pbits[0] = p0;
+				fit.pbits[1] = p1;
+				alignas(16) float palette[16][4];
+				int expanded[2][4];
+				for (int c = 0; c < 4; c++)
+				{
+					for (int e = 0; e < 2; e++)
+					{
+						const int p = e == 0 ? p0 : p1;
+						const float value = std::min(std::max(endpoints[e][c], 0.0f), 255.0f);
+						fit.endpoints[e][c] = std::min(std::max((int)std::floor((value - p) / 2.0f + 0.5f), 0), 127);
+						expanded[e][c] = (fit.endpoints[e][c] << 1) | p;
+					}
+				}
+				for (int i = 0; i < 16; i++)
+					for (int c = 0; c < 4; c++)
+						palette[i][c] = (float)(((64 - Bc7Weights()[i]) * expanded[0][c] + Bc7Weights()[i] * expanded[1][c] + 32) >> 6);
+				// The palette runs along a line, so each texel's index is found by projecting onto it and
+				// checking the palette entries either side of the projected position
+				float line[4], lengthSquared = 0.0f;
+				for (int c = 0; c < 4; c++)
+				{
+					line[c] = (float)(expanded[1][c] - expanded[0][c]);
+					lengthSquared += line[c] * line[c];
+				}
+				const float scale = lengthSquared > 0.0f ? 64.0f / lengthSquared : 0.0f;
+				fit.error = 0.0f;
+				for (int i = 0; i < 16; i++)
+				{
+					float t = 0.0f;
+					for (int c = 0; c < 4; c++)
+						t += (colors[i][c] - expanded[0][c]) * line[c];
+					const float weight = std::min(std::max(t * scale, 0.0f), 64.0f);
+					const int guess = (int)(weight * (15.0f / 64.0f) + 0.5f);
+					float closest = 1e30f;
+					for (int p = std::max(guess - 1, 0); p <= std::min(guess + 1, 15); p++)
+					{
+						const float d = distanceSquared(colors[i], palette[p]);
+						if (d < closest)
+						{
+							closest = d;
+							fit.indices[i] = (uint8_t)p;
+						}
+					}
+					fit.error += closest;
+				}
+				if (fit.error < best.error)
+					best = fit;
+			}
+		}
+	}
+
+	static void decodeBC7(const uint8_t *block, uint8_t texels[16][4])
+	{
+		if ((block[0] & 0x7F) != (1 << 6))
+			return;
+		BitReader reader(block);
+		reader.read(7);
+		int endpoints[2][4];
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = reader.read(7);
+			endpoints[1][c] = reader.read(7);
+		}
+		const int p0 = reader.read(1), p1 = reader.read(1);
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = (endpoints[0][c] << 1) | p0;
+			endpoints[1][c] = (endpoints[1][c] << 1) | p1;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			const int index = reader.read(i == 0 ? 3 : 4);
+			for (int c = 0; c < 4; c++)
+				texels[i][c] = (uint8_t)(((64 - Bc7Weights()[index]) * endpoints[0][c] + Bc7Weights()[index] * endpoints[1][c] + 32) >> 6);
+		}
+	}
+
+	// Writes bit fields into a 16 byte block, least significant bit first
+	struct BitWriter {
+		uint8_t *out;
+		int position = 0;
+
+		explicit BitWriter(uint8_t *block) : out(block)
+		{
+			std::memset(out, 0, 16);
+		}
+
+		void write(int value, int bits)
+		{
+			for (int i = 0; i < bits; i++, position++)
+				if ((value >> i) & 1)
+					out[position >> 3] |= (uint8_t)(1 << (position & 7));
+		}
+	};
+
+	struct BitReader {
+		const uint8_t *in;
+		int position = 0;
+
+		explicit BitReader(const uint8_t *block) : in(block) {}
+
+		int read(int bits)
+		{
+			int value = 0;
+			for (int i = 0; i < bits; i++, position++)
+				value |= ((in[position >> 3] >> (position & 7)) & 1) << i;
+			return value;
+		}
+	};
+};
+#endif
@@ -0,0 +1,225 @@
+#ifndef CHANNEL_SWIZZLE_H
+#define CHANNEL_SWIZZLE_H
+
+#include "DecodedImage.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Changes the channel count of decoded images so each texture stores only what its shaders sample: the red
+// channel of a height map, the xy of a normal map, or RGB padded to RGBA (the layout GPUs store RGB8 in anyway).
+// Channels are kept from the front, and a new alpha channel is filled with the maximum value.
+// It also packs two images into one, such as a height map into the alpha of its normal map.
+// The common 8-bit conversions use SSSE3 byte shuffles when the CPU has them.
+class ChannelSwizzle
+{
+public:
+	// Repacks every level of an uncompressed image to the given channel count
+	static void repack(DecodedImage &image, int channels)
+	{
+		if (!image.valid() || image.compressed || channels < 1 || channels > 4 || channels == image.components)
+			return;
+		const size_t valueSize = image.type == GL_UNSIGNED_SHORT ? 2 : 1;
+		std::vector<size_t> offsets(image.levels.size());
+		size_t total = 0;
+		for (size_t i = 0; i < image.levels.size(); i++)
+		{
+			offsets[i] = total;
+			total += (size_t)image.levels[i].width * image.levels[i].height * channels * valueSize;
+		}
+		std::shared_ptr<std::vector<unsigned char>> storage = std::make_shared<std::vector<unsigned char>>(total);
+		for (size_t i = 0; i < image.levels.size(); i++)
+		{
+			TextureLevel &level = image.levels[i];
+			const size_t texels = (size_t)level.width * level.height;
+			unsigned char *dest = storage->data() + offsets[i];
+			if (valueSize == 2)
+				convertShorts((const uint16_t*)level.pixels, image.components, (uint16_t*)dest, channels, texels);
+			else
+				convert(level.pixels, image.components, dest, channels, texels);
+			level.pixels = dest;
+			level.size = texels * channels * valueSize;
+		}
+		image.owner = storage;
+		image.components = channels;
+	}
+
+	// Interleaves the first three channels of one image with the first channel of another as RGBA, level by level.
+	// Both must be 8-bit with the same size; the result has as many levels as the shorter chain.
+	static DecodedImage merge(const DecodedImage &colour, const DecodedImage &alpha)
+	{
+		DecodedImage image;
+		const size_t levelCount = std::min(colour.levels.size(), alpha.levels.size());
+		std::vector<size_t> offsets(levelCount);
+		size_t total = 0;
+		for (size_t i = 0; i < levelCount; i++)
+		{
+			offsets[i] = total;
+			total += (size_t)colour.levels[i].width * colour.levels[i].height * 4;
+		}
+		std::shared_ptr<std::vector<unsigned char>> storage = std::make_shared<std::vector<unsigned char>>(total);
+		for (size_t i = 0; i < levelCount; i++)
+		{
+			TextureLevel level = colour.levels[i];
+			const size_t texels = (size_t)level.width * level.height;
+			unsigned char *dest = storage->data() + offsets[i];
+			size_t done = 0;
+#ifdef SIMD_X86
+			if (colour.components == 3 && alpha.components == 1 && CpuFeatures::get().ssse3)
+				done = mergeSsse3(level.pixels, alpha.levels[i].pixels, dest, texels);
+#endif
+			for (size_t t = done; t < texels; t++)
+			{
+				for (int c = 0; c < 3; c++)
+					dest[t * 4 + c] = c < colour.components ? level.pixels[t * colour.components + c] : 0;
+				dest[t * 4 + 3] = alpha.levels[i].pixels[t * alpha.components];
+			}
+			level.pixels = dest;
+			level.size = texels * 4;
+			image.levels.push_back(level);
+		}
+		image.owner = storage;
+		image.components = 4;
+		image.format = GL_RGBA;
+		image.internalFormat = GL_RGBA8;
+		return image;
+	}
+
+	// Converts a 16-bit image to 8 bits by keeping the high byte of every value
+	static void narrow(DecodedImage &image)
+	{
+		if (!image.valid() || image.compressed || image.type != GL_UNSIGNED_SHORT)
+			return;
+		size_t total = 0;
+		for (size_t i = 0; i < image.levels.size(); i++)
+			total += image.levels[i].size / 2;
+		std::shared_ptr<std::vector<unsigned char>> storage = std::make_shared<std::vector<unsigned char>>(total);
+		unsigned char *dest = storage->data();
+		for (size_t i = 0; i < image.levels.size(); i++)
+		{
+			TextureLevel &level = image.levels[i];
+			const uint16_t *values = (const uint16_t*)level.pixels;
+			level.size /= 2;
+			for (size_t v = 0; v < level.size; v++)
+				dest[v] = (unsigned char)(values[v] >> 8);
+			level.pixels = dest;
+			dest += level.size;
+		}
+		image.owner = storage;
+		image.type = GL_UNSIGNED_BYTE;
+	}
+
+	// Converts 8-bit texels from one channel count to another
+	static void convert(const uint8_t *src, int srcChannels, uint8_t *dst, int dstChannels, size_t texels)
+	{
+		size_t done = 0;
+#ifdef SIMD_X86
+		if (CpuFeatures::get().ssse3)
+			done = convertSsse3(src, srcChannels, dst, dstChannels, texels);
+#endif
+		convertScalar(src + done * srcChannels, srcChannels, dst + done * dstChannels, dstChannels, texels - done);
+	}
+
+private:
+	static void convertScalar(const uint8_t *src, int srcChannels, uint8_t *dst, int dstChannels, size_t texels)
+	{
+		for (size_t i = 0; i < texels; i++)
+			for (int c = 0; c < dstChannels; c++)
+				dst[i * dstChannels + c] = c < srcChannels ? src[i * srcChannels + c] : 255;
+	}
+
+	static void convertShorts(const uint16_t *src, int srcChannels, uint16_t *dst, int dstChannels, size_t texels)
+	{
+		for (size_t i = 0; i < texels; i++)
+			for (int c = 0; c < dstChannels; c++)
+				dst[i * dstChannels + c] = c < srcChannels ? src[i * srcChannels + c] : 65535;
+	}
+
+#ifdef SIMD_X86
+	// Handles the conversions the texture policy uses, returning how many texels were done so the scalar
+	// loop can finish the tail. Loads never read past the end of the source.
+	SIMD_TARGET_SSSE3 static size_t convertSsse3(const uint8_t *src, int srcChannels, uint8_t *dst, int dstChannels, size_t texels)
+	{
+		size_t i = 0;
+		if (srcChannels == 3 && dstChannels == 4)
+		{
+			// Four texels per 12 bytes, with the alpha bytes zeroed by the shuffle and then set
+			const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+			for (; i + 6 <= texels; i += 4)
+			{
+				__m128i texel = _mm_loadu_si128((const __m128i*)(src + i * 3));
+				_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(texel, shuffle), alpha));
+			}
+		}
+		else if (srcChannels == 3 && dstChannels == 2)
+		{
+			// Eight texels per 24 bytes, the first five from one load and the last three from a second
+			const __m128i first = _mm_setr_epi8(0, 1, 3, 4, 6, 7, 9, 10, 12, 13, -1, -1, -1, -1, -1, -1);
+			const __m128i second = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 7, 8, 10, 11, 13, 14);
+			for (; i + 8 <= texels; i += 8)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(src + i * 3));
+				__m128i b = _mm_loadu_si128((const __m128i*)(src + i * 3 + 8));
+				_mm_storeu_si128((__m128i*)(dst + i * 2), _mm_or_si128(_mm_shuffle_epi8(a, first), _mm_shuffle_epi8(b, second)));
+			}
+		}
+		else if (srcChannels == 3 && dstChannels == 1)
+		{
+			// Sixteen texels per 48 bytes, picking every third byte out of three loads
+			const __m128i first = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+			const __m128i second = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+			const __m128i third = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+			for (; i + 16 <= texels; i += 16)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(src + i * 3));
+				__m128i b = _mm_loadu_si128((const __m128i*)(src + i * 3 + 16));
+				__m128i c = _mm_loadu_si128((const __m128i*)(src + i * 3 + 32));
+				__m128i result = _mm_or_si128(_mm_shuffle_epi8(a, first), _mm_or_si128(_mm_shuffle_epi8(b, second), _mm_shuffle_epi8(c, third)));
+				_mm_storeu_si128((__m128i*)(dst + i), result);
+			}
+		}
+		else if (srcChannels == 4 && (dstChannels == 2 || dstChannels == 1))
+		{
+			// Four texels per 16 bytes, writing 8 or 4 bytes
+			const __m128i shuffle = dstChannels == 2
+				? _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1)
+				: _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+			for (; i + 4 <= texels; i += 4)
+			{
+				__m128i packed = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * 4)), shuffle);
+				if (dstChannels == 2)
+					_mm_storel_epi64((__m128i*)(dst + i * 2), packed);
+				else
+				{
+					const int32_t value = _mm_cvtsi128_si32(packed);
+					std::memcpy(dst + i, &value, 4);
+				}
+			}
+		}
+		return i;
+	}
+
+	// RGB plus a separate alpha plane to RGBA, four texels at a time
+	SIMD_TARGET_SSSE3 static size_t mergeSsse3(const uint8_t *rgb, const uint8_t *alpha, uint8_t *rgba, size_t texels)
+	{
+		const __m128i colourShuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m128i alphaShuffle = _mm_setr_epi8(-1, -1, -1, 0, -1, -1, -1, 1, -1, -1, -1, 2, -1, -1, -1, 3);
+		size_t i = 0;
+		for (; i + 6 <= texels; i += 4)
+		{
+			int32_t alphas;
+			std::memcpy(&alphas, alpha + i, 4);
+			__m128i colour = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(rgb + i * 3)), colourShuffle);
+			__m128i opacity = _mm_shuffle_epi8(_mm_cvtsi32_si128(alphas), alphaShuffle);
+			_mm_storeu_si128((__m128i*)(rgba + i * 4), _mm_or_si128(colour, opacity));
+		}
+		return i;
+	}
+#endif
+};
+#endif
@@ -0,0 +1,248 @@
+#ifndef CONE_STEP_BAKER_H
+#define CONE_STEP_BAKER_H
+
+#include "DecodedImage.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Builds relaxed cone step maps (Policarpo and Oliveira, GPU Gems 3 chapter 18) from 8-bit height maps, where
+// heights are depths as frag.fs reads them. Each texel gets the widest cone, apex on the surface and opening
+// towards the viewer, that any ray entering through the top of the height field crosses the surface inside at
+// most once. frag.fs then sphere-traces with the cones, so a ray crosses empty space in a few steps instead of
+// one depth layer at a time, and a short binary search finds the crossing the last step overshot.
+// The result is RG8: R is the depth and G the square root of the cone ratio (texture coordinates per unit of
+// depth, capped at 1), which spends the precision on the narrow cones that matter. It's level 0 only, as
+// cones can't be filtered into mips.
+//
+// Done naively, every texel checks every other texel. Here each texel searches outward from itself, a row at a
+// time, and stops as soon as anything further away can't narrow its cone: a texel at distance d can't give a
+// ratio under d / depth. Only texels shallower than the centre can narrow it, and those are picked out of each
+// row 16 or 32 at a time with SSE2 or AVX2. Rows of the map are spread across the shared thread pool.
+class ConeStepBaker
+{
+public:
+	// Most texels a constraint ray is followed for. A ray still inside the surface after that is treated as if it
+	// left there, which only makes the cone narrower than it need be.
+	static const int maxRaySteps = 256;
+
+	// Bakes the first level of a single channel 8-bit height map, which wraps at its edges as the texture does
+	static DecodedImage bake(const DecodedImage &height)
+	{
+		return build(height, true);
+	}
+
+	// The same cones, one texel at a time on the calling thread, for checking and timing the fast path against
+	static DecodedImage bakeReference(const DecodedImage &height)
+	{
+		return build(height, false);
+	}
+
+private:
+	struct Job {
+		const uint8_t *depth;
+		// Each row three times over, so a span reaching past either edge reads the wrapped texels
+		const uint8_t *tiled;
+		uint8_t *out;
+		int width;
+		int height;
+		bool fast;
+	};
+
+	static DecodedImage build(const DecodedImage &source, bool fast)
+	{
+		DecodedImage image;
+		if (!source.valid() || source.compressed || source.type != GL_UNSIGNED_BYTE || source.components != 1)
+			return image;
+		const TextureLevel &level = source.levels[0];
+		const int width = level.width, height = level.height;
+		std::vector<uint8_t> tiled((size_t)width * 3 * height);
+		for (int y = 0; y < height; y++)
+			for (int copy = 0; copy < 3; copy++)
+				std::copy(level.pixels + (size_t)y * width, level.pixels + (size_t)(y + 1) * width, tiled.begin() + ((size_t)y * 3 + copy) * width);
+		std::shared_ptr<std::vector<unsigned char>> storage = std::make_shared<std::vector<unsigned char>>((size_t)width * height * 2);
+
+		Job job;
+		job.depth = level.pixels;
+		job.tiled = tiled.data();
+		job.out = storage->data();
+		job.width = width;
+		job.height = height;
+		job.fast = fast;
+		if (fast)
+			ThreadPool::shared().parallelFor((size_t)height, [&job](size_t y) { bakeRow(job, (int)y); });
+		else
+			for (int y = 0; y < height; y++)
+				bakeRow(job, y);
+
+		TextureLevel out;
+		out.pixels = storage->data();
+		out.size = storage->size();
+		out.width = width;
+		out.height = height;
+		image.levels.push_back(out);
+		image.owner = storage;
+		image.components = 2;
+		image.format = GL_RG;
+		image.internalFormat = GL_RG8;
+		return image;
+	}
+
+	static void bakeRow(const Job &job, int y)
+	{
+		std::vector<int> candidates((size_t)job.width + 32);
+		for (int x = 0; x < job.width; x++)
+		{
+			const uint8_t depth = job.depth[(size_t)y * job.width + x];
+			const float ratio = coneRatio(job, x, y, depth, candidates);
+			uint8_t *texel = job.out + ((size_t)y * job.width + x) * 2;
+			texel[0] = depth;
+			texel[1] = (uint8_t)std::lround(std::sqrt(std::min(ratio, 1.0f)) * 255.0f);
+		}
+	}
+
+	// The cone ratio of one texel. Rows are searched in order of distance from it (0, +1, -1, +2, ...), and the
+	// search window shrinks as the cone narrows.
+	static float coneRatio(const Job &job, int x, int y, uint8_t depth, std::vector<int> &candidates)
+	{
+		// Nothing is above the top of the height field
+		if (depth == 0)
+			return 1.0f;
+		const float apex = depth / 255.0f;
+		const int halfWidth = job.width / 2, halfHeight = job.height / 2;
+		float best = 1.0f;
+		int rangeX = std::min(halfWidth, (int)std::ceil(best * apex * job.width));
+		int rangeY = std::min(halfHeight, (int)std::ceil(best * apex * job.height));
+		for (int k = 0;; k++)
+		{
+			const int dy = k == 0 ? 0 : (k % 2 ? (k + 1) / 2 : -(k / 2));
+			if (std::abs(dy) > rangeY)
+				break;
+			const int row = wrap(y + dy, job.height);
+			const uint8_t *span = job.tiled + (size_t)row * 3 * job.width + job.width + x - rangeX;
+			const size_t found = shallower(span, (size_t)(rangeX * 2 + 1), depth, candidates.data(), job.fast);
+			const float rowDistance = (float)dy / job.height;
+			// Nearest first, working outwards from the centre column in both directions, so the cone narrows as
+			// early as it can and prunes more of the rest
+			size_t right = std::lower_bound(candidates.begin(), candidates.begin() + found, rangeX) - candidates.begin();
+			size_t left = right;
+			while (left > 0 || right < found)
+			{
+				size_t i;
+				if (right == found || (left > 0 && rangeX - candidates[left - 1] < candidates[right] - rangeX))
+					i = --left;
+				else
+					i = right++;
+				const int dx = candidates[i] - rangeX;
+				const float columnDistance = (float)dx / job.width;
+				// The ray leaves no nearer than this texel and no higher than its surface, so it can't narrow the
+				// cone if the texel itself couldn't
+				const float through = span[candidates[i]] / 255.0f;
+				if (std::sqrt(rowDistance * rowDistance + columnDistance * columnDistance) >= best * (apex - through))
+					continue;
+				best = std::min(best, constraint(job, x, y, dx, dy, apex, best));
+			}
+			rangeX = std::min(halfWidth, (int)std::ceil(best * apex * job.width));
+			rangeY = std::min(halfHeight, (int)std::ceil(best * apex * job.height));
+		}
+		return best;
+	}
+
+	// The cone ratio a texel shallower than the apex allows. A ray enters the top of the height field above the
+	// apex texel and passes through the other texel's surface point; the cone may hold the surface the ray goes
+	// into there, but not the point where the ray comes back out, or the ray would cross the surface twice
+	// inside it. A ray that only comes out below the apex doesn't constrain it.
+	// The ratio an exit point gives only grows along the ray, so the ray is only followed while it could still
+	// narrow the cone below best.
+	static float constraint(const Job &job, int x, int y, int dx, int dy, float apex, float best)
+	{
+		const float through = job.depth[(size_t)wrap(y + dy, job.height) * job.width + wrap(x + dx, job.width)] / 255.0f;
+		const float u1 = (float)dx / job.width, v1 = (float)dy / job.height;
+		const float distance = std::sqrt(u1 * u1 + v1 * v1);
+		// Past t = last, an exit at t would give a ratio of at least best
+		const float last = best * apex / (distance + best * through);
+		// Steps of one texel along the longer axis, from the surface point onwards. The position is kept in
+		// texels relative to the apex, offset by half a texel so truncating it rounds.
+		const float step = 1.0f / std::max(std::abs(dx), std::abs(dy));
+		const float stepX = dx * step, stepY = dy * step;
+		float t = 1.0f, rayDepth = through, px = dx + 0.5f, py = dy + 0.5f;
+		for (int i = 0; i < maxRaySteps; i++)
+		{
+			t += step;
+			px += stepX;
+			py += stepY;
+			rayDepth = t * through;
+			if (rayDepth >= apex || t >= last)
+				return best;
+			const int sx = wrap(x + (int)std::floor(px), job.width), sy = wrap(y + (int)std::floor(py), job.height);
+			// Out once the surface is deeper than the ray
+			if (job.depth[(size_t)sy * job.width + sx] > rayDepth * 255.0f)
+				break;
+		}
+		return t * distance / (apex - rayDepth);
+	}
+
+	static int wrap(int i, int size)
+	{
+		// Almost always within one size of the range, so a division is rarely needed
+		if (i >= size)
+			i = i < 2 * size ? i - size : i % size;
+		else if (i < 0)
+			i = i >= -size ? i + size : (i % size + size) % size;
+		return i;
+	}
+
+	// Writes the indices of the texels in span shallower than depth (which is above zero) to out, returning how
+	// many there are
+	static size_t shallower(const uint8_t *span, size_t count, uint8_t depth, int *out, bool fast)
+	{
+		size_t found = 0, i = 0;
+#ifdef SIMD_X86
+		if (fast)
+		{
+			if (CpuFeatures::get().avx2)
+				i = shallowerAvx2(span, count, depth, out, found);
+			// v < depth exactly when min(v, depth - 1) == v
+			const __m128i limit = _mm_set1_epi8((char)(depth - 1));
+			for (; i + 16 <= count; i += 16)
+			{
+				const __m128i v = _mm_loadu_si128((const __m128i*)(span + i));
+				const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, limit), v));
+				if (mask)
+					for (int bit = 0; bit < 16; bit++)
+						if (mask & (1 << bit))
+							out[found++] = (int)(i + bit);
+			}
+		}
+#endif
+		for (; i < count; i++)
+			if (span[i] < depth)
+				out[found++] = (int)i;
+		return found;
+	}
+
+#ifdef SIMD_X86
+	SIMD_TARGET_AVX2
+	static size_t shallowerAvx2(const uint8_t *span, size_t count, uint8_t depth, int *out, size_t &found)
+	{
+		const __m256i limit = _mm256_set1_epi8((char)(depth - 1));
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const __m256i v = _mm256_loadu_si256((const __m256i*)(span + i));
+			const unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(v, limit), v));
+			if (mask)
+				for (int bit = 0; bit < 32; bit++)
+					if (mask & (1u << bit))
+						out[found++] = (int)(i + bit);
+		}
+		return i;
+	}
+#endif
+};
+#endif
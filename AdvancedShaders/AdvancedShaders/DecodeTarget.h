@@ -0,0 +1,29 @@
+#ifndef DECODE_TARGET_H
+#define DECODE_TARGET_H
+
+#include <cstddef>
+
+// Lets stb_image write its output pixels into memory the caller provides, such as a mapped pixel buffer, so
+// a decoded image lands where it will be uploaded from instead of being copied there afterwards.
+// stb_image allocates through the functions below (see stb_image.cpp). While a target is set on a thread, the
+// first allocation on that thread of the target's size (or one byte more, which the JPEG decoder asks for) is
+// served from the target and every other allocation goes to the heap. stb_image's output is the only buffer of
+// that size in the common decoders, but callers must still check with holds() where the pixels landed, and copy
+// them if they missed.
+class DecodeTarget
+{
+public:
+	// Sets the memory the next decode on this thread should write its pixels to. size is the size of the decoded
+	// image, and memory must hold size + 1 bytes.
+	static void set(void *memory, size_t size);
+	// Stops redirecting allocations on this thread
+	static void clear();
+	// Whether p is the target and stb_image is currently using it
+	static bool holds(const void *p);
+
+	// stb_image's STBI_MALLOC, STBI_REALLOC and STBI_FREE
+	static void* allocate(size_t size);
+	static void* reallocate(void *p, size_t size);
+	static void release(void *p);
+};
+#endif
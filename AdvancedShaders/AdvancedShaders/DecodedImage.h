@@ -0,0 +1,36 @@
+#ifndef DECODED_IMAGE_H
+#define DECODED_IMAGE_H
+
+#include <glad/glad.h>
+
+#include <memory>
+#include <vector>
+
+// One mip level of a texture, pointing into memory owned by the DecodedImage it belongs to
+struct TextureLevel {
+	const unsigned char *pixels = nullptr;
+	size_t size = 0;
+	int width = 0;
+	int height = 0;
+};
+
+// Texture data that is ready to upload: the GL formats to use and the pixels for each mip level.
+// The pixels may live in an stb_image buffer, a heap buffer or a memory mapped cache file; whichever it is,
+// owner keeps it alive for as long as the DecodedImage is.
+struct DecodedImage {
+	GLint internalFormat = GL_RGB;
+	GLenum format = GL_RGB;
+	GLenum type = GL_UNSIGNED_BYTE;
+	// Compressed levels are uploaded with glCompressedTexImage2D
+	bool compressed = false;
+	int components = 0;
+	// Level 0 first. A single level means GL should generate the rest of the chain if mipmaps are wanted
+	std::vector<TextureLevel> levels;
+	std::shared_ptr<void> owner;
+
+	bool valid() const
+	{
+		return !levels.empty() && levels[0].pixels != nullptr;
+	}
+};
+#endif
@@ -0,0 +1,167 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad was generated for the 3.3 core profile without extensions, so the enums and entry points of the optional
+// features used here are declared by hand
+// EXT_texture_compression_s3tc / EXT_texture_sRGB
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+// ARB_texture_compression_bptc (core in 4.2)
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+// ARB_buffer_storage (core in 4.4)
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP GLBufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+// ARB_get_program_binary (core in 4.1)
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (APIENTRYP GLGetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP GLProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP GLProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+// KHR_parallel_shader_compile / ARB_parallel_shader_compile
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP GLMaxShaderCompilerThreadsProc)(GLuint count);
+
+// ARB_tessellation_shader (core in 4.0)
+#ifndef GL_PATCHES
+#define GL_PATCHES 0x000E
+#endif
+#ifndef GL_PATCH_VERTICES
+#define GL_PATCH_VERTICES 0x8E72
+#endif
+#ifndef GL_TESS_EVALUATION_SHADER
+#define GL_TESS_EVALUATION_SHADER 0x8E87
+#endif
+#ifndef GL_TESS_CONTROL_SHADER
+#define GL_TESS_CONTROL_SHADER 0x8E88
+#endif
+typedef void (APIENTRYP GLPatchParameteriProc)(GLenum pname, GLint value);
+
+// ARB_texture_storage (core in 4.2)
+typedef void (APIENTRYP GLTexStorage2DProc)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+
+// Optional OpenGL features beyond the 3.3 core. load() must be called once the context is current;
+// after that the flags can be read from any thread.
+class GLExtensions
+{
+public:
+	// BC1 textures, and their sRGB variant
+	bool s3tc = false;
+	bool s3tcSrgb = false;
+	// BC6H/BC7 textures
+	bool bptc = false;
+	// Immutable texture allocation with glTexStorage2D
+	bool textureStorage = false;
+	GLTexStorage2DProc texStorage2D = nullptr;
+	// Immutable buffers that can stay mapped while the GPU reads them, with glBufferStorage
+	bool persistentMapping = false;
+	GLBufferStorageProc bufferStorage = nullptr;
+	// Saving linked programs and loading them back on later runs, with glGetProgramBinary and glProgramBinary.
+	// Only set when the driver offers at least one binary format.
+	bool programBinaries = false;
+	GLGetProgramBinaryProc getProgramBinary = nullptr;
+	GLProgramBinaryProc programBinary = nullptr;
+	GLProgramParameteriProc programParameteri = nullptr;
+	// Compiling and linking on driver threads, with GL_COMPLETION_STATUS_KHR saying when a shader or program is
+	// done without waiting for it
+	bool parallelShaderCompile = false;
+	GLMaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+	// Tessellation control and evaluation shaders, drawing GL_PATCHES sized with glPatchParameteri. Needs 4.0, as
+	// the shaders/tess.* stages are GLSL 4.00.
+	bool tessellation = false;
+	GLPatchParameteriProc patchParameteri = nullptr;
+
+	static GLExtensions& get()
+	{
+		static GLExtensions extensions;
+		return extensions;
+	}
+
+	// Queries the context's version and extension list, and loads the entry points of the features it has
+	// through the same loader glad used
+	static void load(GLADloadproc loader)
+	{
+		GLExtensions &ext = get();
+		GLint major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		const int version = major * 10 + minor;
+		ext.s3tc = has("GL_EXT_texture_compression_s3tc");
+		ext.s3tcSrgb = ext.s3tc && (has("GL_EXT_texture_sRGB") || has("GL_EXT_texture_compression_s3tc_srgb"));
+		ext.bptc = version >= 42 || has("GL_ARB_texture_compression_bptc");
+		if (version >= 42 || has("GL_ARB_texture_storage"))
+			ext.texStorage2D = (GLTexStorage2DProc)loader("glTexStorage2D");
+		ext.textureStorage = ext.texStorage2D != nullptr;
+		if (version >= 44 || has("GL_ARB_buffer_storage"))
+			ext.bufferStorage = (GLBufferStorageProc)loader("glBufferStorage");
+		ext.persistentMapping = ext.bufferStorage != nullptr;
+		if (version >= 41 || has("GL_ARB_get_program_binary"))
+		{
+			ext.getProgramBinary = (GLGetProgramBinaryProc)loader("glGetProgramBinary");
+			ext.programBinary = (GLProgramBinaryProc)loader("glProgramBinary");
+			ext.programParameteri = (GLProgramParameteriProc)loader("glProgramParameteri");
+			GLint formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			ext.programBinaries = ext.getProgramBinary && ext.programBinary && ext.programParameteri && formats > 0;
+		}
+		if (has("GL_KHR_parallel_shader_compile"))
+			ext.maxShaderCompilerThreads = (GLMaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsKHR");
+		else if (has("GL_ARB_parallel_shader_compile"))
+			ext.maxShaderCompilerThreads = (GLMaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsARB");
+		ext.parallelShaderCompile = ext.maxShaderCompilerThreads != nullptr;
+		// The stages are written as #version 400, so a 3.3 context with only the extension can't compile them
+		if (version >= 40)
+			ext.patchParameteri = (GLPatchParameteriProc)loader("glPatchParameteri");
+		ext.tessellation = ext.patchParameteri != nullptr;
+		//Lets the driver use as many compiler threads as it wants
+		if (ext.parallelShaderCompile)
+			ext.maxShaderCompilerThreads(0xFFFFFFFFu);
+	}
+
+	// Whether the context lists the named extension
+	static bool has(const char *name)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (extension && std::strcmp(extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+
+private:
+	GLExtensions() {}
+};
+#endif
@@ -0,0 +1,218 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Size and modification time of a file, used to tell whether a cooked cache is older than its source
+struct FileStamp {
+	bool exists = false;
+	uint64_t size = 0;
+	int64_t modified = 0;
+};
+
+// A read-only memory mapping of a whole file. Pointers into data() stay valid until the MappedFile is destroyed,
+// so cached assets can be handed straight to GL without reading them into an intermediate buffer.
+class MappedFile
+{
+public:
+	MappedFile() {}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Maps the file at path, returning false if it doesn't exist or is empty
+	bool open(const std::string &path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			close();
+			return false;
+		}
+		bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		length = (size_t)fileSize.QuadPart;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			::close(fd);
+			return false;
+		}
+		void *view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping keeps its own reference to the file, so the descriptor isn't needed any more
+		::close(fd);
+		if (view == MAP_FAILED)
+			return false;
+		bytes = (const unsigned char*)view;
+		length = (size_t)info.st_size;
+#endif
+		if (bytes == nullptr)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	// Unmaps the file
+	void close()
+	{
+#ifdef _WIN32
+		if (bytes)
+			UnmapViewOfFile(bytes);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes)
+			munmap((void*)bytes, length);
+#endif
+		bytes = nullptr;
+		length = 0;
+	}
+
+	const unsigned char *data() const
+	{
+		return bytes;
+	}
+
+	size_t size() const
+	{
+		return length;
+	}
+
+	// 64-bit FNV-1a hash of a block of memory
+	static uint64_t hash(const void *data, size_t size, uint64_t seed = 14695981039346656037ull)
+	{
+		const unsigned char *bytes = (const unsigned char*)data;
+		uint64_t result = seed;
+		for (size_t i = 0; i < size; i++)
+		{
+			result ^= bytes[i];
+			result *= 1099511628211ull;
+		}
+		return result;
+	}
+
+	// The hash of a whole file's contents, or 0 if it can't be read
+	static uint64_t hashFile(const std::string &path)
+	{
+		MappedFile file;
+		if (!file.open(path))
+			return 0;
+		return hash(file.data(), file.size());
+	}
+
+	// Looks up the size and modification time of a file without opening it
+	static FileStamp stamp(const std::string &path)
+	{
+		FileStamp result;
+#ifdef _WIN32
+		struct _stat64 info;
+		if (_stat64(path.c_str(), &info) != 0)
+			return result;
+#else
+		struct stat info;
+		if (::stat(path.c_str(), &info) != 0)
+			return result;
+#endif
+		result.exists = true;
+		result.size = (uint64_t)info.st_size;
+		result.modified = (int64_t)info.st_mtime;
+		return result;
+	}
+
+private:
+	const unsigned char *bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+};
+
+// What a cooked cache file was made from, kept in its header: the source's size, modification time and contents
+// hash. The file is stale if the size changed, or if the modification time changed and the contents did too.
+struct SourceStamp {
+	uint64_t size;
+	int64_t modified;
+	uint64_t hash;
+
+	// The stamp of the source as it is now
+	static SourceStamp of(const std::string &source)
+	{
+		const FileStamp stamp = MappedFile::stamp(source);
+		SourceStamp result;
+		result.size = stamp.size;
+		result.modified = stamp.modified;
+		result.hash = MappedFile::hashFile(source);
+		return result;
+	}
+
+	// Whether the cooked file mapped in cooked, holding this stamp offset bytes in, is still current for source.
+	// The size and mtime are checked first as they're free. Only when the mtime alone has changed (a checkout, a
+	// copy or a touch) is the source hashed; if its contents still match, the new mtime is written into the cooked
+	// file so later loads don't hash it again. That reopens cooked, so nothing may point into it yet.
+	bool current(const std::string &source, const std::string &cookedPath, MappedFile &cooked, size_t offset) const
+	{
+		const FileStamp stamp = MappedFile::stamp(source);
+		if (!stamp.exists)
+			return true;	// Only the cooked file was shipped
+		if (stamp.size != size)
+			return false;
+		if (stamp.modified == modified)
+			return true;
+		if (MappedFile::hashFile(source) != hash)
+			return false;
+		//The mapping is closed first, as Windows won't write to a file that's mapped
+		cooked.close();
+		{
+			std::fstream file(cookedPath, std::ios::in | std::ios::out | std::ios::binary);
+			file.seekp((std::streamoff)(offset + offsetof(SourceStamp, modified)));
+			file.write((const char*)&stamp.modified, sizeof(stamp.modified));
+		}
+		return cooked.open(cookedPath);
+	}
+};
+#endif
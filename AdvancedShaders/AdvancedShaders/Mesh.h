@@ -6,41 +6,105 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "Meshlet.h"
 #include "Shader.h"
+#include "UploadQueue.h"
+#include "Vertex.h"
+#include "VertexQuantizer.h"
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 using namespace std;
 
-struct Vertex {
-	// Position
-	glm::vec3 Position;
-	// Normal
-	glm::vec3 Normal;
-	// TexCoords
-	glm::vec2 TexCoords;
-	// Tangent
-	glm::vec3 Tangent;
-	// Bitangent
-	glm::vec3 Bitangent;
-};
-
 struct Texture {
 	unsigned int id;
 	string type;
 	string path;
 };
 
+// One level of detail of a mesh: a range of its index buffer, drawn with the mesh's own vertices, how far in
+// model units simplifying it moved the surface (see MeshSimplifier), and the range of the mesh's meshlets it's
+// split into, if it is
+struct MeshLod {
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float error;
+	unsigned int firstMeshlet;
+	unsigned int meshletCount;
+};
+
+// A mesh's vertices and indices loaded off the GL thread, waiting to be uploaded
+struct MeshPayload {
+	vector<Vertex> vertices;
+	// Set instead of vertices for meshes in the compact format
+	vector<QTangentVertex> compactVertices;
+	// Or for meshes with derivative tangent frames
+	vector<TangentlessVertex> tangentlessVertices;
+	// Or instead of any of them, for meshes in quantized streams
+	QuantizedVertices quantizedVertices;
+	vector<unsigned int> indices;
+	// The levels of detail in indices, finest first, or empty when all of indices is the one level
+	vector<MeshLod> lods;
+	// The meshlets every level is split into, in level order, or none
+	vector<Meshlet> meshlets;
+	// A sphere round the vertices, to measure their distance from the camera by
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+	// The mesh's textures by type and path; the ids are filled in when the mesh is built
+	vector<Texture> textures;
+
+	// The vertex data in whichever format the payload holds, as it goes into the vertex buffer
+	const void *vertexData() const
+	{
+		if (!quantizedVertices.empty())
+			return quantizedVertices.data.data();
+		if (!compactVertices.empty())
+			return compactVertices.data();
+		if (!tangentlessVertices.empty())
+			return tangentlessVertices.data();
+		return vertices.data();
+	}
+
+	size_t vertexBytes() const
+	{
+		if (!quantizedVertices.empty())
+			return quantizedVertices.data.size();
+		if (!compactVertices.empty())
+			return compactVertices.size() * sizeof(QTangentVertex);
+		if (!tangentlessVertices.empty())
+			return tangentlessVertices.size() * sizeof(TangentlessVertex);
+		return vertices.size() * sizeof(Vertex);
+	}
+};
+
 class Mesh {
 public:
-	//  Mesh Data
+	//  Mesh Data. A mesh holds either vertices or, in the compact format, compactVertices, with derivative tangent
+	//  frames tangentlessVertices, or in quantized streams quantizedVertices. Meshes read from a MeshCache file
+	//  keep none of them, nor their indices: their data went straight from the file into the buffers, and only a
+	//  quantized mesh's stream layout is kept, without its data.
 	vector<Vertex> vertices;
+	vector<QTangentVertex> compactVertices;
+	vector<TangentlessVertex> tangentlessVertices;
+	QuantizedVertices quantizedVertices;
 	vector<unsigned int> indices;
 	vector<Texture> textures;
 	unsigned int VAO;
+	// Number of indices in the index buffer, over all the levels of detail
+	size_t indexCount;
+	// The levels of detail in the index buffer, finest first, as in MeshPayload; empty when there's one
+	vector<MeshLod> lods;
+	// The meshlets of every level, as in MeshPayload
+	vector<Meshlet> meshlets;
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+	// The level of detail Draw() draws, set by selectLod()
+	unsigned int lod = 0;
 
 	/*  Functions  */
 	// Constructor
@@ -54,19 +118,331 @@ public:
 		setupMesh();
 	}
 
+	// Constructor for a mesh in the compact vertex format
+	Mesh(vector<QTangentVertex> compactVertices, vector<unsigned int> indices, vector<Texture> textures)
+	{
+		this->compactVertices = compactVertices;
+		this->indices = indices;
+		this->textures = textures;
+		setupMesh();
+	}
+
+	// Constructor for a mesh with derivative tangent frames
+	Mesh(vector<TangentlessVertex> tangentlessVertices, vector<unsigned int> indices, vector<Texture> textures)
+	{
+		this->tangentlessVertices = tangentlessVertices;
+		this->indices = indices;
+		this->textures = textures;
+		setupMesh();
+	}
+
+	// Constructor for a mesh in quantized streams, in any tangent frame format
+	Mesh(QuantizedVertices quantizedVertices, vector<unsigned int> indices, vector<Texture> textures)
+	{
+		this->quantizedVertices = quantizedVertices;
+		this->indices = indices;
+		this->textures = textures;
+		setupMesh();
+	}
+
+	// Constructor for a mesh built from a payload on the GL thread, taking its data
+	Mesh(MeshPayload &&payload, vector<Texture> textures)
+		: vertices(std::move(payload.vertices)), compactVertices(std::move(payload.compactVertices)), tangentlessVertices(std::move(payload.tangentlessVertices)), quantizedVertices(std::move(payload.quantizedVertices)), indices(std::move(payload.indices)), textures(textures),
+		lods(std::move(payload.lods)), meshlets(std::move(payload.meshlets)), boundsCenter(payload.boundsCenter), boundsRadius(payload.boundsRadius)
+	{
+		setupMesh();
+	}
+
+	// Constructor for a mesh whose buffers were already created and filled by uploadJob()
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, unsigned int VAO, unsigned int VBO, unsigned int EBO)
+		: vertices(vertices), indices(indices), textures(textures), VAO(VAO), indexCount(indices.size()), VBO(VBO), EBO(EBO)
+	{
+	}
+	// The same for a streamed mesh in any format
+	Mesh(const MeshPayload &payload, vector<Texture> textures, unsigned int VAO, unsigned int VBO, unsigned int EBO)
+		: vertices(payload.vertices), compactVertices(payload.compactVertices), tangentlessVertices(payload.tangentlessVertices), quantizedVertices(payload.quantizedVertices), indices(payload.indices), textures(textures), VAO(VAO), indexCount(payload.indices.size()),
+		lods(payload.lods), meshlets(payload.meshlets), boundsCenter(payload.boundsCenter), boundsRadius(payload.boundsRadius), VBO(VBO), EBO(EBO)
+	{
+	}
+	// The same for a mesh read from a MeshCache file, with no CPU copy of its data. streams is the layout of a
+	// quantized mesh's data, or empty for the other formats. The levels of detail, meshlets and bounds are set after.
+	Mesh(QuantizedVertices streams, size_t indexCount, vector<Texture> textures, unsigned int VAO, unsigned int VBO, unsigned int EBO)
+		: quantizedVertices(streams), textures(textures), VAO(VAO), indexCount(indexCount), VBO(VBO), EBO(EBO)
+	{
+	}
+
+	// Whether the mesh is in the compact (QTangentVertex) format
+	bool compact() const
+	{
+		return !compactVertices.empty();
+	}
+
+	// Whether the mesh only has normals, for shaders built with DERIVATIVE_FRAME
+	bool tangentless() const
+	{
+		return !tangentlessVertices.empty() || (quantized() && quantizedVertices.frame == TANGENT_FRAME_DERIVATIVES);
+	}
+
+	// Whether the mesh is in quantized streams, whose positions shaders built with QUANTIZED dequantize. Cached
+	// meshes only have the streams' layout, so it's that which is checked.
+	bool quantized() const
+	{
+		return quantizedVertices.stride > 0;
+	}
+
+	// Bytes of vertex data the mesh holds on the CPU, as it's laid out on the GPU
+	size_t vertexBytes() const
+	{
+		if (quantized())
+			return quantizedVertices.data.size();
+		if (!tangentlessVertices.empty())
+			return tangentlessVertices.size() * sizeof(TangentlessVertex);
+		return compact() ? compactVertices.size() * sizeof(QTangentVertex) : vertices.size() * sizeof(Vertex);
+	}
+
+	// The vertex data vertexBytes() counts
+	const void *vertexData() const
+	{
+		if (quantized())
+			return quantizedVertices.data.data();
+		if (!tangentlessVertices.empty())
+			return tangentlessVertices.data();
+		return compact() ? (const void*)compactVertices.data() : (const void*)vertices.data();
+	}
+
+	// Picks the level of detail to draw: the coarsest whose error, at pixelsPerUnit pixels per model unit (see
+	// Model::selectLods), is at most pixelError pixels. Moving to a coarser level also needs that level's error under
+	// (1 - hysteresis) of the limit, so a mesh near a switching distance doesn't flip back and forth every frame.
+	void selectLod(float pixelsPerUnit, float pixelError, float hysteresis)
+	{
+		if (lods.empty())
+			return;
+		unsigned int level = currentLod();
+		while (level > 0 && lods[level].error * pixelsPerUnit > pixelError)
+			level--;
+		while (level + 1 < lods.size() && lods[level + 1].error * pixelsPerUnit <= pixelError * (1.0f - hysteresis))
+			level++;
+		lod = level;
+	}
+
+	// Number of indices the current level of detail draws, before any culling
+	size_t drawnIndexCount() const
+	{
+		return lods.empty() ? indexCount : lods[currentLod()].indexCount;
+	}
+
+	// Culls the current level of detail's meshlets outside frustum and, with backfaces, those facing away from
+	// eye, both in model space, adding what it saw and rejected to stats. Until the next call, or a change of
+	// level, Draw() draws only the meshlets left, consecutive ones as one range of a single glMultiDrawElements.
+	// Meshes without meshlets are counted as drawn whole.
+	void cullMeshlets(const Frustum &frustum, const glm::vec3 &eye, bool backfaces, MeshletCullStats &stats)
+	{
+		runCounts.clear();
+		runOffsets.clear();
+		culled = !meshlets.empty();
+		culledLod = lod;
+		if (!culled)
+		{
+			stats.triangles += drawnIndexCount() / 3;
+			stats.draws++;
+			return;
+		}
+		unsigned int first = 0, count = (unsigned int)meshlets.size();
+		if (!lods.empty())
+		{
+			first = lods[currentLod()].firstMeshlet;
+			count = lods[currentLod()].meshletCount;
+		}
+		// A mesh entirely outside is rejected without looking at its meshlets
+		const bool visible = frustum.intersects(boundsCenter, boundsRadius);
+		size_t end = 0;
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			const Meshlet &meshlet = meshlets[i];
+			const size_t triangles = meshlet.indexCount / 3;
+			stats.meshlets++;
+			stats.triangles += triangles;
+			if (!visible || MeshletBuilder::outside(meshlet, frustum))
+			{
+				stats.frustumMeshlets++;
+				stats.frustumTriangles += triangles;
+				continue;
+			}
+			if (backfaces && MeshletBuilder::facesAway(meshlet, eye))
+			{
+				stats.backfaceMeshlets++;
+				stats.backfaceTriangles += triangles;
+				continue;
+			}
+			if (!runCounts.empty() && end == meshlet.firstIndex)
+				runCounts.back() += (GLsizei)meshlet.indexCount;
+			else
+			{
+				runCounts.push_back((GLsizei)meshlet.indexCount);
+				runOffsets.push_back((const void*)(meshlet.firstIndex * sizeof(unsigned int)));
+			}
+			end = meshlet.firstIndex + meshlet.indexCount;
+		}
+		stats.draws += runCounts.size();
+	}
+
+	// Draws the whole level again, as before any cullMeshlets()
+	void resetCulling()
+	{
+		culled = false;
+	}
+
+	// Builds the upload of a streamed mesh: one step creating the VAO and empty buffers, then a step per chunk of
+	// vertex and index data. ready is called with the VAO and buffers once the GPU has all of it.
+	static UploadJob uploadJob(shared_ptr<const MeshPayload> payload, int priority, std::function<void(unsigned int, unsigned int, unsigned int)> ready)
+	{
+		struct Buffers {
+			unsigned int VAO = 0, VBO = 0, EBO = 0;
+		};
+		shared_ptr<Buffers> buffers = make_shared<Buffers>();
+		UploadJob job;
+		job.priority = priority;
+
+		const bool quantized = !payload->quantizedVertices.empty();
+		TangentFrame frame = TANGENT_FRAME_VECTORS;
+		if (!payload->compactVertices.empty())
+			frame = TANGENT_FRAME_QTANGENT;
+		else if (!payload->tangentlessVertices.empty())
+			frame = TANGENT_FRAME_DERIVATIVES;
+		const size_t vertexBytes = payload->vertexBytes();
+		const char *vertexData = (const char*)payload->vertexData();
+		UploadStep create;
+		create.run = [payload, buffers, frame, quantized, vertexBytes]()
+		{
+			if (quantized)
+				createBuffers(payload->quantizedVertices, vertexBytes, nullptr, payload->indices.size(), nullptr, buffers->VAO, buffers->VBO, buffers->EBO);
+			else
+				createBuffers(frame, vertexBytes, nullptr, payload->indices.size(), nullptr, buffers->VAO, buffers->VBO, buffers->EBO);
+		};
+		job.steps.push_back(create);
+		// The vertex data, then the index data, in chunks the queue can fit into a frame
+		const size_t indexBytes = payload->indices.size() * sizeof(unsigned int);
+		const size_t chunkBytes = UploadQueue::stepBytes;
+		for (size_t offset = 0; offset < vertexBytes + indexBytes; offset += chunkBytes)
+		{
+			const size_t end = std::min(offset + chunkBytes, vertexBytes + indexBytes);
+			UploadStep chunk;
+			chunk.bytes = end - offset;
+			chunk.run = [payload, buffers, offset, end, vertexBytes, vertexData]()
+			{
+				if (offset < vertexBytes)
+				{
+					glBindBuffer(GL_ARRAY_BUFFER, buffers->VBO);
+					glBufferSubData(GL_ARRAY_BUFFER, offset, std::min(end, vertexBytes) - offset, vertexData + offset);
+					glBindBuffer(GL_ARRAY_BUFFER, 0);
+				}
+				if (end > vertexBytes)
+				{
+					// The element buffer binding is part of the VAO, so it's written through the mesh's own VAO
+					const size_t start = std::max(offset, vertexBytes) - vertexBytes;
+					glBindVertexArray(buffers->VAO);
+					glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, start, end - vertexBytes - start, (const char*)payload->indices.data() + start);
+					glBindVertexArray(0);
+				}
+			};
+			job.steps.push_back(chunk);
+		}
+		job.completed = [buffers, ready]()
+		{
+			ready(buffers->VAO, buffers->VBO, buffers->EBO);
+		};
+		job.abandoned = [buffers]()
+		{
+			deleteBuffers(buffers->VAO, buffers->VBO, buffers->EBO);
+		};
+		return job;
+	}
+
+	// Deletes a mesh's VAO and buffers
+	static void deleteBuffers(unsigned int VAO, unsigned int VBO, unsigned int EBO)
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+	}
+
+	// Deletes the mesh's VAO and buffers
+	void release()
+	{
+		deleteBuffers(VAO, VBO, EBO);
+	}
+
 	// render the mesh
-	void Draw(Shader shader)
+	void Draw(Shader &shader)
+	{
+		// The sampler handles are looked up the first time the mesh is drawn with a program
+		if (samplerProgram != shader.ID)
+			findUniforms(shader);
+		//Iterates through all of the textures in the vector
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			//Selects the current texture for subsequent calls
+			glActiveTexture(GL_TEXTURE0 + i);
+			// Send the texture unit to the sampler
+			shader.setInt(samplers[i], i);
+			// Bind the texture to GL_TEXTURE_2D
+			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+		}
+
+		// Quantized positions are fractions of the mesh's bounds, which the vertex shader scales back out
+		if (quantized())
+		{
+			shader.setVec3(positionOffsetUniform, quantizedVertices.positionOffset);
+			shader.setVec3(positionScaleUniform, quantizedVertices.positionScale);
+		}
+
+		// Bind the VAO, draw the current level of detail's range of the elements, or the ranges of it culling left,
+		// and then unbind the VAO
+		glBindVertexArray(VAO);
+		if (culled && culledLod == lod)
+		{
+			if (!runCounts.empty())
+				glMultiDrawElements(GL_TRIANGLES, runCounts.data(), GL_UNSIGNED_INT, runOffsets.data(), (GLsizei)runCounts.size());
+		}
+		else
+		{
+			const size_t firstIndex = lods.empty() ? 0 : lods[currentLod()].firstIndex;
+			glDrawElements(GL_TRIANGLES, (GLsizei)drawnIndexCount(), GL_UNSIGNED_INT, (void*)(firstIndex * sizeof(unsigned int)));
+		}
+		glBindVertexArray(0);
+	}
+
+private:
+	unsigned int VBO, EBO;
+	// The sampler each texture is bound to, for the program samplerProgram
+	vector<UniformHandle> samplers;
+	unsigned int samplerProgram = 0;
+	// The dequantization uniforms of quantized meshes, for the same program
+	UniformHandle positionOffsetUniform, positionScaleUniform;
+	// The index ranges the last cullMeshlets() left, for the level it culled
+	vector<GLsizei> runCounts;
+	vector<const void*> runOffsets;
+	bool culled = false;
+	unsigned int culledLod = 0;
+
+	// lod, within the levels there are
+	unsigned int currentLod() const
+	{
+		return lods.empty() ? 0 : std::min(lod, (unsigned int)lods.size() - 1);
+	}
+
+	// Names each texture's sampler by its type and number, such as texture_diffuse1, and looks the names up, along
+	// with the dequantization uniforms
+	void findUniforms(const Shader &shader)
 	{
-		// bind appropriate textures
 		unsigned int diffuseNr = 1;
 		unsigned int specularNr = 1;
 		unsigned int normalNr = 1;
 		unsigned int heightNr = 1;
-		//Iterates through all of the textures in the vector
+		unsigned int normalHeightNr = 1;
+		samplers.resize(textures.size());
 		for (unsigned int i = 0; i < textures.size(); i++)
 		{
-			//Selects the current texture for subsequent calls
-			glActiveTexture(GL_TEXTURE0 + i);
 			// Retrieve texture number
 			string number;
 			string name = textures[i].type;
@@ -78,43 +454,62 @@ public:
 				number = std::to_string(normalNr++);
 			else if (name == "texture_height")
 				number = std::to_string(heightNr++);
-
-			// Send the texture name + number to the shader
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-			// Bind the texture to GL_TEXTURE_2D
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			else if (name == "texture_normalHeight")
+				number = std::to_string(normalHeightNr++);
+			samplers[i] = shader.uniform(name + number);
 		}
-
-		// Bind the VAO, draw the elements, and then unbind the VAO
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		positionOffsetUniform = shader.uniform("positionOffset");
+		positionScaleUniform = shader.uniform("positionScale");
+		samplerProgram = shader.ID;
 	}
 
-private:
-	unsigned int VBO, EBO;
-
 	// Further detail on these processes in main.cpp
 	void setupMesh()
 	{
-		// Generate the a single VAO at "VAO"
-		glGenVertexArrays(1, &VAO);
-		// Generate the buffer object name in the VBO and the EBO
-		glGenBuffers(1, &VBO);
-		glGenBuffers(1, &EBO);
-		//Bind the VAO
-		glBindVertexArray(VAO);
-		// Bind the VBO into the array buffer
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		// Create a data store for the array buffer with the same size as the vertices and the vertex data type size, and the specified data
-		// before stating the drawing method to be used for the buffer
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-		//Bind the EBO buffer to the element array buffer
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		//Similair to above, but for the element array buffer
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		indexCount = indices.size();
+		if (quantized())
+			createBuffers(quantizedVertices, vertexBytes(), quantizedVertices.data.data(), indices.size(), &indices[0], VAO, VBO, EBO);
+		else if (compact())
+			createBuffers(TANGENT_FRAME_QTANGENT, vertexBytes(), compactVertices.data(), indices.size(), &indices[0], VAO, VBO, EBO);
+		else if (tangentless())
+			createBuffers(TANGENT_FRAME_DERIVATIVES, vertexBytes(), tangentlessVertices.data(), indices.size(), &indices[0], VAO, VBO, EBO);
+		else
+			createBuffers(TANGENT_FRAME_VECTORS, vertexBytes(), vertices.data(), indices.size(), &indices[0], VAO, VBO, EBO);
+	}
+
+public:
+	// Creates the VAO and its buffers and sets the attribute pointers for the vertex format holding the given kind
+	// of tangent frame (Vertex, QTangentVertex or TangentlessVertex). With null data the buffers are allocated
+	// empty, to be filled in later.
+	static void createBuffers(TangentFrame frame, size_t vertexBytes, const void *vertexData, size_t indexCount, const unsigned int *indexData, unsigned int &VAO, unsigned int &VBO, unsigned int &EBO)
+	{
+		allocateBuffers(vertexBytes, vertexData, indexCount, indexData, VAO, VBO, EBO);
 
 		//Set the vertex attribute pointers
+		if (frame == TANGENT_FRAME_QTANGENT)
+		{
+			//Positions, texture coords, and the tangent frame quaternion, which GL turns back into -1 to 1
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(QTangentVertex), (void*)offsetof(QTangentVertex, Position));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(QTangentVertex), (void*)offsetof(QTangentVertex, TexCoords));
+			glEnableVertexAttribArray(5);
+			glVertexAttribPointer(5, 4, GL_SHORT, GL_TRUE, sizeof(QTangentVertex), (void*)offsetof(QTangentVertex, QTangent));
+			glBindVertexArray(0);
+			return;
+		}
+		if (frame == TANGENT_FRAME_DERIVATIVES)
+		{
+			//Positions, normals and texture coords, with no tangent or bitangent
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TangentlessVertex), (void*)offsetof(TangentlessVertex, Position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TangentlessVertex), (void*)offsetof(TangentlessVertex, Normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TangentlessVertex), (void*)offsetof(TangentlessVertex, TexCoords));
+			glBindVertexArray(0);
+			return;
+		}
 		//Positions
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -133,5 +528,36 @@ private:
 		//Unbind the VAO
 		glBindVertexArray(0);
 	}
+
+	// The same for quantized streams, whose attribute pointers come with them. vertexData is vertexBytes of data in
+	// the stream's layout, or null to allocate the buffer empty.
+	static void createBuffers(const QuantizedVertices &quantized, size_t vertexBytes, const void *vertexData, size_t indexCount, const unsigned int *indexData, unsigned int &VAO, unsigned int &VBO, unsigned int &EBO)
+	{
+		allocateBuffers(vertexBytes, vertexData, indexCount, indexData, VAO, VBO, EBO);
+		VertexQuantizer::setAttributes(quantized);
+		glBindVertexArray(0);
+	}
+
+private:
+	// Creates the VAO and its buffers, leaving the VAO and the vertex buffer bound for the attribute pointers
+	static void allocateBuffers(size_t vertexBytes, const void *vertexData, size_t indexCount, const unsigned int *indexData, unsigned int &VAO, unsigned int &VBO, unsigned int &EBO)
+	{
+		// Generate the a single VAO at "VAO"
+		glGenVertexArrays(1, &VAO);
+		// Generate the buffer object name in the VBO and the EBO
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+		//Bind the VAO
+		glBindVertexArray(VAO);
+		// Bind the VBO into the array buffer
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		// Create a data store for the array buffer with the same size as the vertices and the vertex data type size, and the specified data
+		// before stating the drawing method to be used for the buffer
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
+		//Bind the EBO buffer to the element array buffer
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		//Similair to above, but for the element array buffer
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+	}
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,455 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "BakedTexture.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Header at the start of a cooked mesh file. It's followed by one MeshCacheTexture per texture the model's
+// materials load, one MeshCacheSlot per texture binding of every mesh, one MeshCacheLod per level of detail of every
+// mesh, one MeshCacheMeshlet per meshlet of every mesh, one MeshCacheMesh per mesh, the string table the texture
+// entries point into, and then each mesh's vertex and index data, ready to pass to glBufferData.
+struct MeshCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t meshCount;
+	uint32_t textureCount;
+	uint32_t slotCount;
+	uint32_t lodCount;
+	uint32_t meshletCount;
+	uint32_t stringBytes;
+	// What the file was cooked from, checked as BakedTexture checks its source
+	SourceStamp source;
+	// Hash of the Model settings that change the cooked data
+	uint64_t settingsHash;
+};
+
+// A texture the materials load. The strings are offsets into the string table: the sampler type name, the path
+// meshes refer to it by, and the file (and for packed normal and height maps, the height file) relative to the
+// model's directory.
+struct MeshCacheTexture {
+	uint32_t type;
+	uint32_t path;
+	uint32_t file;
+	uint32_t heightFile;
+};
+
+// One texture a mesh binds, by sampler type name and path
+struct MeshCacheSlot {
+	uint32_t type;
+	uint32_t path;
+};
+
+// One level of detail of a mesh, as a range of its indices and of its meshlets (see MeshLod)
+struct MeshCacheLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+// One meshlet of a mesh (see Meshlet)
+struct MeshCacheMeshlet {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t vertexCount;
+	float center[3];
+	float radius;
+	float coneAxis[3];
+	float coneCutoff;
+};
+
+struct MeshCacheAttribute {
+	uint32_t location;
+	uint32_t components;
+	uint32_t type;
+	uint32_t normalized;
+	uint32_t offset;
+};
+
+struct MeshCacheMesh {
+	uint64_t vertexOffset;
+	uint64_t vertexBytes;
+	uint64_t indexOffset;
+	uint64_t indexCount;
+	uint32_t frame;
+	uint32_t firstSlot;
+	uint32_t slotCount;
+	// No levels of detail when the indices are the one level
+	uint32_t firstLod;
+	uint32_t lodCount;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+	float boundsCenter[3];
+	float boundsRadius;
+	// The quantized stream layout, with a stride of 0 for the other formats
+	uint32_t stride;
+	uint32_t attributeCount;
+	MeshCacheAttribute attributes[5];
+	uint32_t encodedPositions;
+	uint32_t encodedTexCoords;
+	float positionOffset[3];
+	float positionScale[3];
+	float positionError;
+	float texCoordError;
+	float directionError;
+	uint64_t sourceBytes;
+};
+
+// A texture a cooked model's materials load
+struct CachedTexture {
+	std::string type;
+	std::string path;
+	std::string file;
+	std::string heightFile;
+};
+
+// A mesh of a cooked model. The data pointers point into the mapping when loaded, or at the Model's own copies when
+// written. streams is the layout of a quantized mesh's data, without the data.
+struct CachedMesh {
+	TangentFrame frame = TANGENT_FRAME_VECTORS;
+	QuantizedVertices streams;
+	const void *vertexData = nullptr;
+	size_t vertexBytes = 0;
+	const unsigned int *indexData = nullptr;
+	size_t indexCount = 0;
+	// The textures it binds, by type and path, with no ids
+	std::vector<Texture> textures;
+	std::vector<MeshLod> lods;
+	std::vector<Meshlet> meshlets;
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+};
+
+struct CachedModel {
+	std::vector<CachedTexture> textures;
+	std::vector<CachedMesh> meshes;
+	// Keeps the mapping the meshes point into alive
+	std::shared_ptr<MappedFile> owner;
+};
+
+// Reads and writes cooked mesh files. A model is cooked after its first import, and later runs map the file and
+// upload every mesh straight from the mapping, without ASSIMP, its post processing or building Vertex vectors.
+// Only the model file itself is checked for changes, not the material library it names.
+class MeshCache
+{
+public:
+	// Bump whenever the file layout or any vertex format changes, so old files are rebuilt
+	static const uint32_t Version = 3;
+
+	// The cooked file for a model and a set of settings, so loading one model two ways keeps two files
+	static std::string cachePath(const std::string &source, uint64_t settingsHash)
+	{
+		std::ostringstream name;
+		name << source << '.' << std::hex << settingsHash << ".mesh";
+		return name.str();
+	}
+
+	// Maps the cooked file for source and fills model with meshes pointing into the mapping. Returns false if there
+	// is no file, or it was made by another version, from other settings or from an older source.
+	static bool load(const std::string &source, uint64_t settingsHash, CachedModel &model)
+	{
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+		if (!file->open(cachePath(source, settingsHash)) || file->size() < sizeof(MeshCacheHeader))
+			return false;
+
+		MeshCacheHeader header;
+		std::memcpy(&header, file->data(), sizeof(header));
+		if (std::memcmp(header.magic, "BMSH", 4) != 0 || header.version != Version || header.settingsHash != settingsHash)
+			return false;
+		if (!header.source.current(source, cachePath(source, settingsHash), *file, offsetof(MeshCacheHeader, source)))
+			return false;
+
+		const uint64_t texturesStart = sizeof(header);
+		const uint64_t slotsStart = texturesStart + (uint64_t)header.textureCount * sizeof(MeshCacheTexture);
+		const uint64_t lodsStart = slotsStart + (uint64_t)header.slotCount * sizeof(MeshCacheSlot);
+		const uint64_t meshletsStart = lodsStart + (uint64_t)header.lodCount * sizeof(MeshCacheLod);
+		const uint64_t meshesStart = meshletsStart + (uint64_t)header.meshletCount * sizeof(MeshCacheMeshlet);
+		const uint64_t stringsStart = meshesStart + (uint64_t)header.meshCount * sizeof(MeshCacheMesh);
+		if (stringsStart + header.stringBytes > file->size())
+			return false;
+		const char *strings = (const char*)file->data() + stringsStart;
+		// Every string ends within the table
+		if (header.stringBytes == 0 || strings[header.stringBytes - 1] != '\0')
+			return false;
+		bool valid = true;
+		auto text = [&](uint32_t offset)
+		{
+			if (offset >= header.stringBytes)
+			{
+				valid = false;
+				return std::string();
+			}
+			return std::string(strings + offset);
+		};
+
+		std::vector<CachedTexture> textures(header.textureCount);
+		for (uint32_t i = 0; i < header.textureCount; i++)
+		{
+			MeshCacheTexture texture;
+			std::memcpy(&texture, file->data() + texturesStart + i * sizeof(texture), sizeof(texture));
+			textures[i].type = text(texture.type);
+			textures[i].path = text(texture.path);
+			textures[i].file = text(texture.file);
+			textures[i].heightFile = text(texture.heightFile);
+		}
+		std::vector<Texture> slots(header.slotCount);
+		for (uint32_t i = 0; i < header.slotCount; i++)
+		{
+			MeshCacheSlot slot;
+			std::memcpy(&slot, file->data() + slotsStart + i * sizeof(slot), sizeof(slot));
+			slots[i].id = 0;
+			slots[i].type = text(slot.type);
+			slots[i].path = text(slot.path);
+		}
+		std::vector<CachedMesh> meshes(header.meshCount);
+		for (uint32_t i = 0; i < header.meshCount; i++)
+		{
+			MeshCacheMesh mesh;
+			std::memcpy(&mesh, file->data() + meshesStart + i * sizeof(mesh), sizeof(mesh));
+			if (mesh.vertexOffset + mesh.vertexBytes > file->size() || mesh.indexOffset + mesh.indexCount * sizeof(unsigned int) > file->size())
+				return false;
+			if (mesh.frame > TANGENT_FRAME_DERIVATIVES || mesh.attributeCount > 5 || (uint64_t)mesh.firstSlot + mesh.slotCount > header.slotCount || (uint64_t)mesh.firstLod + mesh.lodCount > header.lodCount
+				|| (uint64_t)mesh.firstMeshlet + mesh.meshletCount > header.meshletCount)
+				return false;
+			CachedMesh &cached = meshes[i];
+			cached.frame = (TangentFrame)mesh.frame;
+			cached.vertexData = file->data() + mesh.vertexOffset;
+			cached.vertexBytes = (size_t)mesh.vertexBytes;
+			cached.indexData = (const unsigned int*)(file->data() + mesh.indexOffset);
+			cached.indexCount = (size_t)mesh.indexCount;
+			cached.textures.assign(slots.begin() + mesh.firstSlot, slots.begin() + mesh.firstSlot + mesh.slotCount);
+			for (uint32_t l = 0; l < mesh.lodCount; l++)
+			{
+				MeshCacheLod lod;
+				std::memcpy(&lod, file->data() + lodsStart + (uint64_t)(mesh.firstLod + l) * sizeof(lod), sizeof(lod));
+				if ((uint64_t)lod.firstIndex + lod.indexCount > mesh.indexCount || (uint64_t)lod.firstMeshlet + lod.meshletCount > mesh.meshletCount)
+					return false;
+				const MeshLod range = { lod.firstIndex, lod.indexCount, lod.error, lod.firstMeshlet, lod.meshletCount };
+				cached.lods.push_back(range);
+			}
+			for (uint32_t m = 0; m < mesh.meshletCount; m++)
+			{
+				MeshCacheMeshlet entry;
+				std::memcpy(&entry, file->data() + meshletsStart + (uint64_t)(mesh.firstMeshlet + m) * sizeof(entry), sizeof(entry));
+				if ((uint64_t)entry.firstIndex + entry.indexCount > mesh.indexCount)
+					return false;
+				Meshlet meshlet;
+				meshlet.firstIndex = entry.firstIndex;
+				meshlet.indexCount = entry.indexCount;
+				meshlet.vertexCount = entry.vertexCount;
+				meshlet.center = glm::vec3(entry.center[0], entry.center[1], entry.center[2]);
+				meshlet.radius = entry.radius;
+				meshlet.coneAxis = glm::vec3(entry.coneAxis[0], entry.coneAxis[1], entry.coneAxis[2]);
+				meshlet.coneCutoff = entry.coneCutoff;
+				cached.meshlets.push_back(meshlet);
+			}
+			cached.boundsCenter = glm::vec3(mesh.boundsCenter[0], mesh.boundsCenter[1], mesh.boundsCenter[2]);
+			cached.boundsRadius = mesh.boundsRadius;
+			if (mesh.stride > 0)
+			{
+				QuantizedVertices &streams = cached.streams;
+				streams.frame = cached.frame;
+				streams.stride = mesh.stride;
+				for (uint32_t a = 0; a < mesh.attributeCount; a++)
+				{
+					const VertexAttribute attribute = { mesh.attributes[a].location, (GLint)mesh.attributes[a].components, mesh.attributes[a].type, (GLboolean)mesh.attributes[a].normalized, mesh.attributes[a].offset };
+					streams.attributes.push_back(attribute);
+				}
+				streams.encoding.positions = mesh.encodedPositions != 0;
+				streams.encoding.texCoords = mesh.encodedTexCoords != 0;
+				streams.positionOffset = glm::vec3(mesh.positionOffset[0], mesh.positionOffset[1], mesh.positionOffset[2]);
+				streams.positionScale = glm::vec3(mesh.positionScale[0], mesh.positionScale[1], mesh.positionScale[2]);
+				streams.positionError = mesh.positionError;
+				streams.texCoordError = mesh.texCoordError;
+				streams.directionError = mesh.directionError;
+				streams.sourceBytes = (size_t)mesh.sourceBytes;
+			}
+		}
+		if (!valid)
+			return false;
+
+		model.textures = textures;
+		model.meshes = meshes;
+		model.owner = file;
+		return true;
+	}
+
+	// Writes model to the cooked file for source, under a temporary name renamed into place as BakedTexture::write
+	// does
+	static bool write(const std::string &source, uint64_t settingsHash, const CachedModel &model)
+	{
+		MeshCacheHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, "BMSH", 4);
+		header.version = Version;
+		header.meshCount = (uint32_t)model.meshes.size();
+		header.textureCount = (uint32_t)model.textures.size();
+		header.slotCount = 0;
+		header.source = SourceStamp::of(source);
+		header.settingsHash = settingsHash;
+
+		// The string table starts with the empty string, which files with no height map point at
+		std::string strings(1, '\0');
+		auto add = [&strings](const std::string &value)
+		{
+			const uint32_t offset = (uint32_t)strings.size();
+			strings += value;
+			strings += '\0';
+			return offset;
+		};
+		std::vector<MeshCacheTexture> textures(model.textures.size());
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			textures[i].type = add(model.textures[i].type);
+			textures[i].path = add(model.textures[i].path);
+			textures[i].file = add(model.textures[i].file);
+			textures[i].heightFile = model.textures[i].heightFile.empty() ? 0 : add(model.textures[i].heightFile);
+		}
+		std::vector<MeshCacheSlot> slots;
+		std::vector<MeshCacheLod> lods;
+		std::vector<MeshCacheMeshlet> meshlets;
+		std::vector<MeshCacheMesh> meshes(model.meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			const CachedMesh &cached = model.meshes[i];
+			MeshCacheMesh &mesh = meshes[i];
+			std::memset(&mesh, 0, sizeof(mesh));
+			mesh.frame = (uint32_t)cached.frame;
+			mesh.firstSlot = (uint32_t)slots.size();
+			mesh.slotCount = (uint32_t)cached.textures.size();
+			for (size_t t = 0; t < cached.textures.size(); t++)
+			{
+				MeshCacheSlot slot;
+				slot.type = add(cached.textures[t].type);
+				slot.path = add(cached.textures[t].path);
+				slots.push_back(slot);
+			}
+			mesh.firstLod = (uint32_t)lods.size();
+			mesh.lodCount = (uint32_t)cached.lods.size();
+			for (size_t l = 0; l < cached.lods.size(); l++)
+			{
+				const MeshCacheLod lod = { cached.lods[l].firstIndex, cached.lods[l].indexCount, cached.lods[l].error, cached.lods[l].firstMeshlet, cached.lods[l].meshletCount };
+				lods.push_back(lod);
+			}
+			mesh.firstMeshlet = (uint32_t)meshlets.size();
+			mesh.meshletCount = (uint32_t)cached.meshlets.size();
+			for (size_t m = 0; m < cached.meshlets.size(); m++)
+			{
+				const Meshlet &meshlet = cached.meshlets[m];
+				MeshCacheMeshlet entry;
+				entry.firstIndex = meshlet.firstIndex;
+				entry.indexCount = meshlet.indexCount;
+				entry.vertexCount = meshlet.vertexCount;
+				for (int c = 0; c < 3; c++)
+				{
+					entry.center[c] = meshlet.center[c];
+					entry.coneAxis[c] = meshlet.coneAxis[c];
+				}
+				entry.radius = meshlet.radius;
+				entry.coneCutoff = meshlet.coneCutoff;
+				meshlets.push_back(entry);
+			}
+			for (int c = 0; c < 3; c++)
+				mesh.boundsCenter[c] = cached.boundsCenter[c];
+			mesh.boundsRadius = cached.boundsRadius;
+			const QuantizedVertices &streams = cached.streams;
+			if (streams.attributes.size() > 5)
+				return false;
+			mesh.stride = streams.stride;
+			mesh.attributeCount = (uint32_t)streams.attributes.size();
+			for (size_t a = 0; a < streams.attributes.size(); a++)
+			{
+				mesh.attributes[a].location = streams.attributes[a].location;
+				mesh.attributes[a].components = (uint32_t)streams.attributes[a].components;
+				mesh.attributes[a].type = streams.attributes[a].type;
+				mesh.attributes[a].normalized = streams.attributes[a].normalized;
+				mesh.attributes[a].offset = streams.attributes[a].offset;
+			}
+			mesh.encodedPositions = streams.encoding.positions ? 1 : 0;
+			mesh.encodedTexCoords = streams.encoding.texCoords ? 1 : 0;
+			for (int c = 0; c < 3; c++)
+			{
+				mesh.positionOffset[c] = streams.positionOffset[c];
+				mesh.positionScale[c] = streams.positionScale[c];
+			}
+			mesh.positionError = streams.positionError;
+			mesh.texCoordError = streams.texCoordError;
+			mesh.directionError = streams.directionError;
+			mesh.sourceBytes = streams.sourceBytes;
+			mesh.vertexBytes = cached.vertexBytes;
+			mesh.indexCount = cached.indexCount;
+		}
+		header.slotCount = (uint32_t)slots.size();
+		header.lodCount = (uint32_t)lods.size();
+		header.meshletCount = (uint32_t)meshlets.size();
+		header.stringBytes = (uint32_t)strings.size();
+
+		// The data starts after the string table, with each blob aligned to 16 bytes
+		uint64_t offset = align(sizeof(header) + textures.size() * sizeof(MeshCacheTexture) + slots.size() * sizeof(MeshCacheSlot)
+			+ lods.size() * sizeof(MeshCacheLod) + meshlets.size() * sizeof(MeshCacheMeshlet) + meshes.size() * sizeof(MeshCacheMesh) + strings.size());
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			meshes[i].vertexOffset = offset;
+			offset = align(offset + meshes[i].vertexBytes);
+			meshes[i].indexOffset = offset;
+			offset = align(offset + meshes[i].indexCount * sizeof(unsigned int));
+		}
+
+		std::ostringstream tempName;
+		tempName << cachePath(source, settingsHash) << '.' << std::this_thread::get_id() << ".tmp";
+		const std::string temp = tempName.str();
+		{
+			std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+			if (!out)
+				return false;
+			out.write((const char*)&header, sizeof(header));
+			out.write((const char*)textures.data(), textures.size() * sizeof(MeshCacheTexture));
+			out.write((const char*)slots.data(), slots.size() * sizeof(MeshCacheSlot));
+			out.write((const char*)lods.data(), lods.size() * sizeof(MeshCacheLod));
+			out.write((const char*)meshlets.data(), meshlets.size() * sizeof(MeshCacheMeshlet));
+			out.write((const char*)meshes.data(), meshes.size() * sizeof(MeshCacheMesh));
+			out.write(strings.data(), (std::streamsize)strings.size());
+			static const char padding[16] = {};
+			for (size_t i = 0; i < meshes.size(); i++)
+			{
+				out.write(padding, (std::streamsize)(meshes[i].vertexOffset - (uint64_t)out.tellp()));
+				out.write((const char*)model.meshes[i].vertexData, (std::streamsize)meshes[i].vertexBytes);
+				out.write(padding, (std::streamsize)(meshes[i].indexOffset - (uint64_t)out.tellp()));
+				out.write((const char*)model.meshes[i].indexData, (std::streamsize)(meshes[i].indexCount * sizeof(unsigned int)));
+			}
+			if (!out)
+			{
+				out.close();
+				std::remove(temp.c_str());
+				return false;
+			}
+		}
+		const std::string target = cachePath(source, settingsHash);
+		std::remove(target.c_str());
+		if (std::rename(temp.c_str(), target.c_str()) != 0)
+		{
+			std::remove(temp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+private:
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + 15) & ~(uint64_t)15;
+	}
+};
+#endif
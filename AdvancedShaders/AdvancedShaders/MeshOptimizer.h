@@ -0,0 +1,400 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+// How well an index buffer uses the post-transform vertex cache, simulated as a FIFO of MeshOptimizer::CacheSize
+// entries. ACMR is the vertex shader runs per triangle (0.5 is ideal for a large grid, 3 the worst) and ATVR the runs
+// per vertex (1 is ideal).
+struct VertexCacheStats {
+	float acmr = 0.0f;
+	float atvr = 0.0f;
+};
+
+// A mesh's statistics before and after MeshOptimizer::optimize(). Overdraw is fragments shaded per covered pixel,
+// averaged over the six axis views (see MeshOptimizer::analyzeOverdraw).
+struct MeshOptimizationReport {
+	VertexCacheStats cacheBefore, cacheAfter;
+	float overdrawBefore = 0.0f, overdrawAfter = 0.0f;
+	size_t verticesBefore = 0, verticesAfter = 0;
+};
+
+// Reorders a mesh's triangles and vertices for the GPU, without changing what it draws:
+// - optimizeVertexCache: Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+//   Reduced Overdraw", SIGGRAPH 2007), fanning around recently used vertices so each is transformed about once
+// - optimizeOverdraw: the same paper's cluster sort. The cache optimized order is cut into clusters wherever it
+//   restarts with a cold cache, or wherever a cluster's ACMR is already within threshold of its whole run's, and the
+//   clusters are drawn outermost first (by how far their centre sits out along their normal from the mesh's centre),
+//   so more of the expensive parallax fragments behind them are rejected by the depth test
+// - optimizeVertexFetch: vertices renumbered in the order the indices first use them, so the vertex fetch walks the
+//   buffer forwards, and unused vertices are dropped
+// Everything is CPU work on one mesh, safe to run on the thread pool for many meshes at once.
+class MeshOptimizer
+{
+public:
+	// The FIFO size Tipsify targets and the statistics simulate
+	static const unsigned int CacheSize = 16;
+
+	// Runs all three passes on a triangle list, filling report with the statistics before and after when given
+	static void optimize(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, MeshOptimizationReport *report = nullptr, float threshold = 1.05f)
+	{
+		if (report)
+		{
+			report->cacheBefore = analyzeVertexCache(indices, vertices.size());
+			report->overdrawBefore = analyzeOverdraw(vertices, indices);
+			report->verticesBefore = vertices.size();
+		}
+		optimizeVertexCache(indices, vertices.size());
+		optimizeOverdraw(indices, vertices, threshold);
+		optimizeVertexFetch(vertices, indices);
+		if (report)
+		{
+			report->cacheAfter = analyzeVertexCache(indices, vertices.size());
+			report->overdrawAfter = analyzeOverdraw(vertices, indices);
+			report->verticesAfter = vertices.size();
+		}
+	}
+
+	// Tipsify. Triangles are emitted by fanning around one vertex at a time; the next fanning vertex is the one
+	// among the last triangles' vertices that will still be in the cache after its remaining triangles are emitted,
+	// preferring the oldest, or failing that the most recent vertex with triangles left (a dead end), or the next
+	// one in input order.
+	static void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0 || vertexCount == 0)
+			return;
+		// The triangles around each vertex, and how many of them are still to be emitted
+		std::vector<unsigned int> offsets, adjacency, live;
+		buildAdjacency(indices, vertexCount, offsets, adjacency);
+		live.resize(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+			live[v] = offsets[v + 1] - offsets[v];
+
+		std::vector<unsigned int> result;
+		result.reserve(triangleCount * 3);
+		std::vector<char> emitted(triangleCount, 0);
+		// Time each vertex last entered the cache; a vertex is cached while time - stamp <= CacheSize
+		std::vector<unsigned int> stamps(vertexCount, 0);
+		unsigned int time = CacheSize + 1;
+		std::vector<unsigned int> deadEnds, candidates;
+		size_t cursor = 0;
+		int64_t fan = 0;
+		while (fan >= 0)
+		{
+			candidates.clear();
+			for (unsigned int a = offsets[fan]; a < offsets[fan + 1]; a++)
+			{
+				const unsigned int triangle = adjacency[a];
+				if (emitted[triangle])
+					continue;
+				for (int c = 0; c < 3; c++)
+				{
+					const unsigned int v = indices[triangle * 3 + c];
+					result.push_back(v);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - stamps[v] > CacheSize)
+						stamps[v] = time++;
+				}
+				emitted[triangle] = 1;
+			}
+
+			// The candidate that stays cached through its own remaining triangles, oldest first
+			fan = -1;
+			int best = -1;
+			for (size_t i = 0; i < candidates.size(); i++)
+			{
+				const unsigned int v = candidates[i];
+				if (live[v] == 0)
+					continue;
+				int priority = 0;
+				if (time - stamps[v] + 2 * live[v] <= CacheSize)
+					priority = (int)(time - stamps[v]);
+				if (priority > best)
+				{
+					best = priority;
+					fan = v;
+				}
+			}
+			if (fan < 0)
+				fan = skipDeadEnd(deadEnds, live, cursor);
+		}
+		indices.swap(result);
+	}
+
+	// Sorts the clusters of a cache optimized index buffer so the outermost are drawn first. threshold is how much
+	// worse than its run's ACMR a cluster may leave the cache: 1 keeps the cache order, higher values cut smaller
+	// clusters that can be sorted more finely.
+	static void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices, float threshold)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+			return;
+		std::vector<unsigned int> stamps(vertices.size(), 0);
+		unsigned int time = CacheSize + 1;
+
+		// Hard boundaries: triangles missing on all three vertices, where the order moved on to a new patch
+		std::vector<size_t> hard;
+		for (size_t t = 0; t < triangleCount; t++)
+			if (cacheMisses(&indices[t * 3], stamps, time) == 3 || t == 0)
+				hard.push_back(t);
+		hard.push_back(triangleCount);
+
+		// Soft boundaries: each run is cut again wherever the triangles since the last cut, starting from a cold
+		// cache, have an ACMR within threshold of the whole run's
+		std::vector<size_t> clusters;
+		for (size_t h = 0; h + 1 < hard.size(); h++)
+		{
+			const size_t start = hard[h], end = hard[h + 1];
+			time += CacheSize + 1;
+			size_t runMisses = 0;
+			for (size_t t = start; t < end; t++)
+				runMisses += cacheMisses(&indices[t * 3], stamps, time);
+			const float target = threshold * (float)runMisses / (float)(end - start);
+			time += CacheSize + 1;
+			clusters.push_back(start);
+			size_t misses = 0, faces = 0;
+			for (size_t t = start; t < end; t++)
+			{
+				misses += cacheMisses(&indices[t * 3], stamps, time);
+				faces++;
+				if ((float)misses / (float)faces <= target && t + 1 < end)
+				{
+					clusters.push_back(t + 1);
+					time += CacheSize + 1;
+					misses = 0;
+					faces = 0;
+				}
+			}
+		}
+		clusters.push_back(triangleCount);
+
+		// Each cluster's area weighted centre and normal, against the mesh's centre
+		glm::dvec3 meshCentre(0.0);
+		for (size_t v = 0; v < vertices.size(); v++)
+			meshCentre += glm::dvec3(vertices[v].Position);
+		meshCentre /= (double)std::max<size_t>(vertices.size(), 1);
+		const size_t clusterCount = clusters.size() - 1;
+		std::vector<float> outward(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			glm::dvec3 centre(0.0), normal(0.0);
+			double area = 0.0;
+			for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+			{
+				const glm::dvec3 p0(vertices[indices[t * 3]].Position), p1(vertices[indices[t * 3 + 1]].Position), p2(vertices[indices[t * 3 + 2]].Position);
+				const glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+				const double triangleArea = glm::length(cross);
+				centre += (p0 + p1 + p2) * (triangleArea / 3.0);
+				normal += cross;
+				area += triangleArea;
+			}
+			centre = area > 0.0 ? centre / area : centre;
+			const double length = glm::length(normal);
+			outward[c] = length > 0.0 ? (float)glm::dot(centre - meshCentre, normal / length) : 0.0f;
+		}
+
+		std::vector<size_t> order(clusterCount);
+		std::iota(order.begin(), order.end(), (size_t)0);
+		std::stable_sort(order.begin(), order.end(), [&outward](size_t a, size_t b) { return outward[a] > outward[b]; });
+		std::vector<unsigned int> result;
+		result.reserve(indices.size());
+		for (size_t i = 0; i < clusterCount; i++)
+			result.insert(result.end(), indices.begin() + clusters[order[i]] * 3, indices.begin() + clusters[order[i] + 1] * 3);
+		indices.swap(result);
+	}
+
+	// Renumbers the vertices in the order the indices first reference them, dropping any that aren't
+	static void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+	{
+		const unsigned int unused = ~0u;
+		std::vector<unsigned int> remap(vertices.size(), unused);
+		std::vector<Vertex> result;
+		result.reserve(vertices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			unsigned int &target = remap[indices[i]];
+			if (target == unused)
+			{
+				target = (unsigned int)result.size();
+				result.push_back(vertices[indices[i]]);
+			}
+			indices[i] = target;
+		}
+		vertices.swap(result);
+	}
+
+	static VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount)
+	{
+		VertexCacheStats stats;
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+			return stats;
+		std::vector<unsigned int> stamps(vertexCount, 0);
+		std::vector<char> used(vertexCount, 0);
+		unsigned int time = CacheSize + 1;
+		size_t misses = 0, usedCount = 0;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			misses += cacheMisses(&indices[t * 3], stamps, time);
+			for (int c = 0; c < 3; c++)
+				if (!used[indices[t * 3 + c]])
+				{
+					used[indices[t * 3 + c]] = 1;
+					usedCount++;
+				}
+		}
+		stats.acmr = (float)misses / (float)triangleCount;
+		stats.atvr = usedCount > 0 ? (float)misses / (float)usedCount : 0.0f;
+		return stats;
+	}
+
+	// Fragments shaded per covered pixel, drawing the triangles in order with back face culling and a depth test
+	// into a 256 x 256 target looking along each axis both ways, with the mesh's bounds filling it. 1 means every
+	// fragment that was shaded is visible.
+	static float analyzeOverdraw(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+	{
+		const int size = 256;
+		if (vertices.empty() || indices.size() < 3)
+			return 0.0f;
+		glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+		for (size_t v = 0; v < vertices.size(); v++)
+		{
+			lo = glm::min(lo, vertices[v].Position);
+			hi = glm::max(hi, vertices[v].Position);
+		}
+		const glm::vec3 extent = hi - lo;
+		const float scale = std::max(std::max(extent.x, extent.y), std::max(extent.z, FLT_MIN));
+		// Right, up and towards the viewer for each view, with right x up = towards
+		const glm::vec3 axes[6][3] = {
+			{ glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) }, { glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, -1) },
+			{ glm::vec3(0, 1, 0), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0) }, { glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(-1, 0, 0) },
+			{ glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0) }, { glm::vec3(0, 0, -1), glm::vec3(1, 0, 0), glm::vec3(0, -1, 0) }
+		};
+		std::vector<float> depth((size_t)size * size);
+		std::vector<glm::vec3> projected(vertices.size());
+		size_t shaded = 0, covered = 0;
+		for (int view = 0; view < 6; view++)
+		{
+			for (size_t v = 0; v < vertices.size(); v++)
+			{
+				// Centred in the target, nearer is larger
+				const glm::vec3 p = (vertices[v].Position - (lo + hi) * 0.5f) / scale;
+				projected[v] = glm::vec3((glm::dot(p, axes[view][0]) + 0.5f) * size, (glm::dot(p, axes[view][1]) + 0.5f) * size, glm::dot(p, axes[view][2]));
+			}
+			std::fill(depth.begin(), depth.end(), -FLT_MAX);
+			for (size_t t = 0; t + 2 < indices.size(); t += 3)
+				shaded += rasterize(projected[indices[t]], projected[indices[t + 1]], projected[indices[t + 2]], size, depth);
+			for (size_t p = 0; p < depth.size(); p++)
+				if (depth[p] > -FLT_MAX)
+					covered++;
+		}
+		return covered > 0 ? (float)shaded / (float)covered : 0.0f;
+	}
+
+private:
+	// Vertex -> triangle lists, as offsets into adjacency
+	static void buildAdjacency(const std::vector<unsigned int> &indices, size_t vertexCount, std::vector<unsigned int> &offsets, std::vector<unsigned int> &adjacency)
+	{
+		offsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < indices.size() / 3 * 3; i++)
+			offsets[indices[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			offsets[v + 1] += offsets[v];
+		adjacency.resize(offsets[vertexCount]);
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size() / 3 * 3; i++)
+			adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	// The most recent dead end vertex with triangles left, or the next such vertex in input order, or -1 when every
+	// triangle is out
+	static int64_t skipDeadEnd(std::vector<unsigned int> &deadEnds, const std::vector<unsigned int> &live, size_t &cursor)
+	{
+		while (!deadEnds.empty())
+		{
+			const unsigned int v = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[v] > 0)
+				return v;
+		}
+		while (cursor < live.size())
+		{
+			if (live[cursor] > 0)
+				return (int64_t)cursor;
+			cursor++;
+		}
+		return -1;
+	}
+
+	// Runs a triangle through the FIFO cache simulation, returning how many of its vertices missed
+	static unsigned int cacheMisses(const unsigned int *triangle, std::vector<unsigned int> &stamps, unsigned int &time)
+	{
+		unsigned int misses = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			const unsigned int v = triangle[c];
+			if (time - stamps[v] > CacheSize)
+			{
+				stamps[v] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+	// Rasterizes one counter clockwise triangle at pixel centres with a top left fill rule and a greater or equal
+	// depth test, returning the fragments that passed. Clockwise (back facing) and degenerate triangles are culled.
+	static size_t rasterize(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, int size, std::vector<float> &depth)
+	{
+		const float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+		if (!(area > 0.0f))
+			return 0;
+		const int x0 = std::max((int)std::floor(std::min(a.x, std::min(b.x, c.x))), 0);
+		const int x1 = std::min((int)std::ceil(std::max(a.x, std::max(b.x, c.x))), size - 1);
+		const int y0 = std::max((int)std::floor(std::min(a.y, std::min(b.y, c.y))), 0);
+		const int y1 = std::min((int)std::ceil(std::max(a.y, std::max(b.y, c.y))), size - 1);
+		const glm::vec3 *corners[3] = { &a, &b, &c };
+		size_t passed = 0;
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				const float px = x + 0.5f, py = y + 0.5f;
+				float weights[3];
+				bool inside = true;
+				for (int e = 0; e < 3 && inside; e++)
+				{
+					// The edge opposite corner e
+					const glm::vec3 &from = *corners[(e + 1) % 3], &to = *corners[(e + 2) % 3];
+					const float dx = to.x - from.x, dy = to.y - from.y;
+					weights[e] = dx * (py - from.y) - dy * (px - from.x);
+					const bool topLeft = dy < 0.0f || (dy == 0.0f && dx > 0.0f);
+					inside = weights[e] > 0.0f || (weights[e] == 0.0f && topLeft);
+				}
+				if (!inside)
+					continue;
+				const float z = (weights[0] * a.z + weights[1] * b.z + weights[2] * c.z) / area;
+				float &stored = depth[(size_t)y * size + x];
+				if (z >= stored)
+				{
+					stored = z;
+					passed++;
+				}
+			}
+		}
+		return passed;
+	}
+};
+#endif
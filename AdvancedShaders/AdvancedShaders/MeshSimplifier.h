@@ -0,0 +1,428 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Quadric edge collapse simplification (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics",
+// SIGGRAPH 1997). Every collapse moves one vertex onto a neighbour, so the result only indexes the mesh's own
+// vertices and every level of detail can share its vertex buffer.
+//
+// Vertices at one position with different attributes (UV seams and tangent frame splits, which import keeps as
+// separate vertices) are collapsed together: a seam vertex only moves along its seam, taking its twin on the other
+// side with it, so the texture coordinates and tangent frames either side stay where they were and parallax keeps
+// its frame. Open borders only collapse along themselves, and vertices where more than two attribute sets meet, or
+// whose seams or borders branch, are never moved. Collapses that would flip a triangle are skipped.
+class MeshSimplifier
+{
+public:
+	// Collapses edges, cheapest first, until at most targetIndexCount indices are left, no collapse is allowed, or
+	// the next would move the surface further than maxError model units. error is set to the largest distance any
+	// collapse moved it (as the square root of the quadric error, averaged over the surface each quadric covers).
+	static std::vector<unsigned int> simplify(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, size_t targetIndexCount, float maxError, float &error)
+	{
+		error = 0.0f;
+		const size_t vertexCount = vertices.size();
+		std::vector<unsigned int> result(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+		if (result.size() <= targetIndexCount || vertexCount == 0)
+			return result;
+
+		// Vertices identical in every attribute are one vertex, as importers that don't join them write each
+		// triangle's corners out on their own. The result indexes the first of each.
+		std::vector<unsigned int> canonical(vertexCount);
+		{
+			std::unordered_map<VertexKey, unsigned int, KeyHash> first;
+			first.reserve(vertexCount);
+			for (unsigned int v = 0; v < vertexCount; v++)
+				canonical[v] = first.insert(std::make_pair(VertexKey(&vertices[v]), v)).first->second;
+		}
+		for (size_t i = 0; i < result.size(); i++)
+			result[i] = canonical[result[i]];
+
+		// Vertices sharing a position: remap is the first of them, wedge the next one round a circular list
+		std::vector<unsigned int> remap(vertexCount), wedge(vertexCount);
+		{
+			std::unordered_map<PositionKey, unsigned int, KeyHash> first;
+			first.reserve(vertexCount);
+			for (unsigned int v = 0; v < vertexCount; v++)
+			{
+				remap[v] = v;
+				wedge[v] = v;
+				if (canonical[v] != v)
+					continue;
+				auto inserted = first.insert(std::make_pair(PositionKey(&vertices[v].Position), v));
+				remap[v] = inserted.first->second;
+				if (!inserted.second)
+				{
+					const unsigned int head = remap[v];
+					wedge[v] = wedge[head];
+					wedge[head] = v;
+				}
+			}
+		}
+
+		std::vector<unsigned char> kinds;
+		std::vector<unsigned int> openOut, openIn;
+		classify(result, remap, wedge, vertexCount, kinds, openOut, openIn);
+
+		// Quadrics per position: the planes of the triangles around it, weighted by area, and for open edges
+		// (borders and seams) a plane through the edge at right angles to its triangle, so they hold their line
+		std::vector<Quadric> quadrics(vertexCount);
+		std::vector<unsigned int> offsets, adjacency;
+		buildAdjacency(result, vertexCount, offsets, adjacency);
+		for (size_t t = 0; t < result.size(); t += 3)
+		{
+			const glm::dvec3 p[3] = { glm::dvec3(vertices[result[t]].Position), glm::dvec3(vertices[result[t + 1]].Position), glm::dvec3(vertices[result[t + 2]].Position) };
+			const glm::dvec3 cross = glm::cross(p[1] - p[0], p[2] - p[0]);
+			const double area = glm::length(cross) * 0.5;
+			if (!(area > 0.0))
+				continue;
+			const glm::dvec3 normal = cross / (area * 2.0);
+			Quadric plane(normal, -glm::dot(normal, p[0]), area);
+			for (int c = 0; c < 3; c++)
+				quadrics[remap[result[t + c]]] += plane;
+			for (int c = 0; c < 3; c++)
+			{
+				const unsigned int a = result[t + c], b = result[t + (c + 1) % 3];
+				if (hasEdge(offsets, adjacency, result, b, a))
+					continue;
+				const glm::dvec3 edge = p[(c + 1) % 3] - p[c];
+				const double length = glm::length(edge);
+				if (!(length > 0.0))
+					continue;
+				const glm::dvec3 sideNormal = glm::normalize(glm::cross(edge, normal));
+				Quadric side(sideNormal, -glm::dot(sideNormal, p[c]), length * length * BorderWeight);
+				quadrics[remap[a]] += side;
+				quadrics[remap[b]] += side;
+			}
+		}
+
+		const double errorLimit = (double)maxError * maxError;
+		double worst = 0.0;
+		std::vector<unsigned int> collapseRemap(vertexCount);
+		std::vector<unsigned char> locked(vertexCount);
+		std::vector<unsigned int> previousOut, previousIn;
+		std::vector<Collapse> collapses;
+		while (result.size() > targetIndexCount)
+		{
+			buildAdjacency(result, vertexCount, offsets, adjacency);
+
+			// Every allowed collapse along every edge, in whichever direction is cheaper
+			collapses.clear();
+			for (size_t t = 0; t < result.size(); t += 3)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					const unsigned int a = result[t + c], b = result[t + (c + 1) % 3];
+					// Each edge once, from whichever of its triangles lists the lower vertex first
+					if (remap[a] > remap[b] && hasEdge(offsets, adjacency, result, b, a))
+						continue;
+					Collapse best;
+					best.cost = DBL_MAX;
+					for (int direction = 0; direction < 2; direction++)
+					{
+						const unsigned int from = direction ? b : a, to = direction ? a : b;
+						if (!canCollapse(from, to, kinds, openOut, openIn, remap, wedge))
+							continue;
+						Quadric sum = quadrics[remap[from]];
+						sum += quadrics[remap[to]];
+						const double cost = sum.error(glm::dvec3(vertices[to].Position));
+						if (cost < best.cost)
+						{
+							best.from = from;
+							best.to = to;
+							best.cost = cost;
+						}
+					}
+					if (best.cost < DBL_MAX)
+						collapses.push_back(best);
+				}
+			}
+			if (collapses.empty())
+				break;
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+
+			// Most collapses take two triangles with them. Only the cheapest are taken each pass, stopping short of
+			// ones well beyond what reaching the goal would cost (once half the goal is done, in case flips and
+			// neighbouring collapses held the cheap ones back), so cheap areas aren't skipped for expensive ones.
+			const size_t goal = std::max<size_t>((result.size() - targetIndexCount) / 6, 1);
+			const double costGoal = goal < collapses.size() ? collapses[goal].cost * 1.5 : DBL_MAX;
+			for (unsigned int v = 0; v < vertexCount; v++)
+				collapseRemap[v] = v;
+			std::fill(locked.begin(), locked.end(), 0);
+			size_t performed = 0;
+			for (size_t i = 0; i < collapses.size() && performed < goal; i++)
+			{
+				const Collapse &collapse = collapses[i];
+				if (collapse.cost > errorLimit || (collapse.cost > costGoal && performed >= goal / 2 + 1))
+					break;
+				const unsigned int from = collapse.from, to = collapse.to;
+				if (locked[remap[from]] || locked[remap[to]])
+					continue;
+				if (flips(vertices, result, offsets, adjacency, remap, wedge, from, to))
+					continue;
+				collapseRemap[from] = to;
+				if (kinds[from] == KindSeam)
+				{
+					// The twin follows along the other side of the seam
+					const unsigned int twin = wedge[from];
+					collapseRemap[twin] = openOut[from] == to ? openIn[twin] : openOut[twin];
+				}
+				quadrics[remap[to]] += quadrics[remap[from]];
+				locked[remap[from]] = 1;
+				locked[remap[to]] = 1;
+				worst = std::max(worst, collapse.cost);
+				performed++;
+			}
+			if (performed == 0)
+				break;
+
+			// Move the collapsed vertices' triangles over, dropping the ones that closed up
+			size_t write = 0;
+			for (size_t t = 0; t < result.size(); t += 3)
+			{
+				const unsigned int a = collapseRemap[result[t]], b = collapseRemap[result[t + 1]], c = collapseRemap[result[t + 2]];
+				if (a == b || b == c || c == a)
+					continue;
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+			result.resize(write);
+			// The open edge ends of the vertices that remain follow their collapses too. Where a vertex's neighbour
+			// along the edge collapsed onto it, its new neighbour is the one beyond.
+			previousOut = openOut;
+			previousIn = openIn;
+			for (unsigned int v = 0; v < vertexCount; v++)
+			{
+				openOut[v] = followCollapse(v, previousOut, collapseRemap);
+				openIn[v] = followCollapse(v, previousIn, collapseRemap);
+			}
+		}
+		error = (float)std::sqrt(worst);
+		return result;
+	}
+
+private:
+	enum {
+		// Inside the surface, with one set of attributes
+		KindManifold,
+		// On an open edge of the surface
+		KindBorder,
+		// One of two vertices at a position with different attributes, joined along a seam
+		KindSeam,
+		// Anything else, never moved
+		KindLocked
+	};
+	// openOut/openIn values beyond the vertex indices: none, or more than one
+	enum : unsigned int {
+		Unique = 0xfffffffdu,
+		None = 0xfffffffeu,
+		Many = 0xffffffffu
+	};
+	// How much the planes keeping borders and seams in place count against the surface's own
+	static constexpr double BorderWeight = 10.0;
+
+	struct Collapse {
+		unsigned int from, to;
+		double cost;
+	};
+
+	// A symmetric 4x4 quadric, with the total weight (area) of the planes in it
+	struct Quadric {
+		double a2 = 0, b2 = 0, c2 = 0, ab = 0, ac = 0, bc = 0, ad = 0, bd = 0, cd = 0, d2 = 0, weight = 0;
+
+		Quadric() {}
+		Quadric(const glm::dvec3 &n, double d, double w)
+			: a2(n.x * n.x * w), b2(n.y * n.y * w), c2(n.z * n.z * w), ab(n.x * n.y * w), ac(n.x * n.z * w), bc(n.y * n.z * w),
+			ad(n.x * d * w), bd(n.y * d * w), cd(n.z * d * w), d2(d * d * w), weight(w)
+		{
+		}
+
+		Quadric& operator+=(const Quadric &q)
+		{
+			a2 += q.a2; b2 += q.b2; c2 += q.c2; ab += q.ab; ac += q.ac; bc += q.bc;
+			ad += q.ad; bd += q.bd; cd += q.cd; d2 += q.d2; weight += q.weight;
+			return *this;
+		}
+
+		// The weighted mean squared distance from p to the planes
+		double error(const glm::dvec3 &p) const
+		{
+			const double value = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z + 2.0 * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z)
+				+ 2.0 * (ad * p.x + bd * p.y + cd * p.z) + d2;
+			return weight > 0.0 ? std::abs(value) / weight : 0.0;
+		}
+	};
+
+	// Vertices and positions are matched bit for bit, as import writes a split vertex's position out twice the same
+	template <size_t Words>
+	struct Key {
+		uint32_t bits[Words];
+		explicit Key(const void *data)
+		{
+			std::memcpy(bits, data, sizeof(bits));
+		}
+		bool operator==(const Key &other) const
+		{
+			return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
+		}
+	};
+	typedef Key<sizeof(Vertex) / 4> VertexKey;
+	typedef Key<3> PositionKey;
+	// FNV-1a over the words
+	struct KeyHash {
+		template <size_t Words>
+		size_t operator()(const Key<Words> &key) const
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < Words; i++)
+				hash = (hash ^ key.bits[i]) * 1099511628211ull;
+			return (size_t)hash;
+		}
+	};
+
+	// Vertex -> triangle lists, as offsets into adjacency
+	static void buildAdjacency(const std::vector<unsigned int> &indices, size_t vertexCount, std::vector<unsigned int> &offsets, std::vector<unsigned int> &adjacency)
+	{
+		offsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < indices.size(); i++)
+			offsets[indices[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			offsets[v + 1] += offsets[v];
+		adjacency.resize(offsets[vertexCount]);
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+			adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+
+	// Whether some triangle has the edge a -> b, in its winding order
+	static bool hasEdge(const std::vector<unsigned int> &offsets, const std::vector<unsigned int> &adjacency, const std::vector<unsigned int> &indices, unsigned int a, unsigned int b)
+	{
+		for (unsigned int i = offsets[a]; i < offsets[a + 1]; i++)
+		{
+			const unsigned int t = adjacency[i] * 3;
+			for (int c = 0; c < 3; c++)
+				if (indices[t + c] == a && indices[t + (c + 1) % 3] == b)
+					return true;
+		}
+		return false;
+	}
+
+	// Finds each vertex's open edges (ones whose triangle has no neighbour across them with the same vertices) and
+	// from them its kind
+	static void classify(const std::vector<unsigned int> &indices, const std::vector<unsigned int> &remap, const std::vector<unsigned int> &wedge, size_t vertexCount,
+		std::vector<unsigned char> &kinds, std::vector<unsigned int> &openOut, std::vector<unsigned int> &openIn)
+	{
+		std::vector<unsigned int> offsets, adjacency;
+		buildAdjacency(indices, vertexCount, offsets, adjacency);
+		openOut.assign(vertexCount, None);
+		openIn.assign(vertexCount, None);
+		for (size_t t = 0; t < indices.size(); t += 3)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				const unsigned int a = indices[t + c], b = indices[t + (c + 1) % 3];
+				if (hasEdge(offsets, adjacency, indices, b, a))
+					continue;
+				openOut[a] = openOut[a] == None ? b : Many;
+				openIn[b] = openIn[b] == None ? a : Many;
+			}
+		}
+		kinds.assign(vertexCount, KindLocked);
+		for (unsigned int v = 0; v < vertexCount; v++)
+		{
+			const bool closed = openOut[v] == None && openIn[v] == None;
+			const bool open = openOut[v] < Unique && openIn[v] < Unique;
+			if (wedge[v] == v)
+			{
+				if (closed)
+					kinds[v] = KindManifold;
+				else if (open)
+					kinds[v] = KindBorder;
+				continue;
+			}
+			const unsigned int twin = wedge[v];
+			if (wedge[twin] != v || !open || !(openOut[twin] < Unique && openIn[twin] < Unique))
+				continue;
+			// The two sides run opposite ways along the same seam
+			if (remap[openOut[v]] == remap[openIn[twin]] && remap[openIn[v]] == remap[openOut[twin]])
+				kinds[v] = KindSeam;
+		}
+	}
+
+	static bool canCollapse(unsigned int from, unsigned int to, const std::vector<unsigned char> &kinds, const std::vector<unsigned int> &openOut, const std::vector<unsigned int> &openIn,
+		const std::vector<unsigned int> &remap, const std::vector<unsigned int> &wedge)
+	{
+		switch (kinds[from])
+		{
+		case KindManifold:
+			return true;
+		case KindBorder:
+			return (kinds[to] == KindBorder || kinds[to] == KindLocked) && (openOut[from] == to || openIn[from] == to);
+		case KindSeam:
+		{
+			if (!(kinds[to] == KindSeam || kinds[to] == KindLocked) || !(openOut[from] == to || openIn[from] == to))
+				return false;
+			// The twin's edge along the seam runs the other way and has to end at the same position
+			const unsigned int twin = wedge[from];
+			const unsigned int twinTo = openOut[from] == to ? openIn[twin] : openOut[twin];
+			return twinTo < Unique && remap[twinTo] == remap[to] && twinTo != to;
+		}
+		default:
+			return false;
+		}
+	}
+
+	static unsigned int followCollapse(unsigned int v, const std::vector<unsigned int> &link, const std::vector<unsigned int> &collapseRemap)
+	{
+		const unsigned int next = link[v];
+		if (!(next < Unique))
+			return next;
+		if (collapseRemap[next] != v)
+			return collapseRemap[next];
+		return link[next] < Unique ? collapseRemap[link[next]] : link[next];
+	}
+
+	// Whether moving from (and its twins) onto to would turn any triangle that survives the collapse over
+	static bool flips(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, const std::vector<unsigned int> &offsets, const std::vector<unsigned int> &adjacency,
+		const std::vector<unsigned int> &remap, const std::vector<unsigned int> &wedge, unsigned int from, unsigned int to)
+	{
+		const glm::vec3 target = vertices[to].Position;
+		unsigned int v = from;
+		do
+		{
+			for (unsigned int i = offsets[v]; i < offsets[v + 1]; i++)
+			{
+				const unsigned int t = adjacency[i] * 3;
+				glm::vec3 before[3], after[3];
+				bool closes = false;
+				for (int c = 0; c < 3; c++)
+				{
+					const unsigned int corner = indices[t + c];
+					before[c] = vertices[corner].Position;
+					after[c] = corner == v ? target : before[c];
+					closes = closes || (corner != v && remap[corner] == remap[to]);
+				}
+				if (closes)
+					continue;
+				const glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+				const glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+				if (glm::dot(n0, n1) <= 0.0f)
+					return true;
+			}
+			v = wedge[v];
+		} while (v != from);
+		return false;
+	}
+};
+#endif
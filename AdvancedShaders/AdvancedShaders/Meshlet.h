@@ -0,0 +1,329 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+// A small cluster of a mesh's triangles: a range of its index buffer using at most MeshletBuilder::MaxVertices
+// vertices, with a bounding sphere and a cone holding every triangle's normal, all in model space. Meshlets are
+// culled on the CPU (see Mesh::cullMeshlets) and the ranges left drawn together.
+struct Meshlet {
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	unsigned int vertexCount;
+	glm::vec3 center;
+	float radius;
+	// Every triangle faces away from a camera at eye when
+	// dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius. coneCutoff is above 1 when the
+	// normals spread too far for that to ever hold.
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// The six planes of a view frustum, facing in, from a projection * view (* model) matrix (Gribb and Hartmann,
+// "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix"). Including the model matrix
+// puts the planes in model space.
+struct Frustum {
+	glm::vec4 planes[6];
+
+	explicit Frustum(const glm::mat4 &matrix)
+	{
+		const glm::vec4 row0(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]);
+		const glm::vec4 row1(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]);
+		const glm::vec4 row2(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]);
+		const glm::vec4 row3(matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]);
+		planes[0] = row3 + row0;
+		planes[1] = row3 - row0;
+		planes[2] = row3 + row1;
+		planes[3] = row3 - row1;
+		planes[4] = row3 + row2;
+		planes[5] = row3 - row2;
+		for (int p = 0; p < 6; p++)
+			planes[p] /= glm::length(glm::vec3(planes[p]));
+	}
+
+	// Whether any of the sphere is inside
+	bool intersects(const glm::vec3 &center, float radius) const
+	{
+		for (int p = 0; p < 6; p++)
+			if (glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -radius)
+				return false;
+		return true;
+	}
+};
+
+// What a frame's meshlet culling rejected, summed over the meshes it covered
+struct MeshletCullStats {
+	size_t meshlets = 0, triangles = 0;
+	// Rejected as outside the frustum
+	size_t frustumMeshlets = 0, frustumTriangles = 0;
+	// Rejected as facing away from the camera
+	size_t backfaceMeshlets = 0, backfaceTriangles = 0;
+	// Ranges of consecutive visible meshlets, each one draw
+	size_t draws = 0;
+
+	MeshletCullStats& operator+=(const MeshletCullStats &other)
+	{
+		meshlets += other.meshlets;
+		triangles += other.triangles;
+		frustumMeshlets += other.frustumMeshlets;
+		frustumTriangles += other.frustumTriangles;
+		backfaceMeshlets += other.backfaceMeshlets;
+		backfaceTriangles += other.backfaceTriangles;
+		draws += other.draws;
+		return *this;
+	}
+
+	// Percentage of the triangles culled, in total or for one reason
+	double culledPercent() const
+	{
+		return percent(frustumTriangles + backfaceTriangles);
+	}
+	double percent(size_t count) const
+	{
+		return triangles ? 100.0 * count / triangles : 0.0;
+	}
+
+	void print() const
+	{
+		std::cout << "Meshlets: " << frustumMeshlets + backfaceMeshlets << " of " << meshlets << " culled, " << culledPercent() << "% of "
+			<< triangles << " triangles (" << percent(frustumTriangles) << "% outside the frustum, " << percent(backfaceTriangles)
+			<< "% facing away), " << draws << " draws" << std::endl;
+	}
+};
+
+// Splits index buffer ranges into meshlets, reordering each range's triangles so every meshlet's are contiguous.
+// A meshlet grows from a seed triangle by adding, of the triangles sharing its vertices, the one needing the
+// fewest new vertices, then the one whose normal is closest to the meshlet's so far, keeping its cone narrow.
+// Seeds are taken in the existing triangle order, so an order already optimized for the vertex cache mostly
+// carries over.
+class MeshletBuilder
+{
+public:
+	enum {
+		MaxVertices = 64,
+		MaxTriangles = 124,
+		// Triangles per piece a range is split into to build across a pool; the pieces' meshlets are in the
+		// range's order, so the result only depends on the pool in how fast it comes
+		ChunkTriangles = 8192
+	};
+
+	// Builds the meshlets of indices[firstIndex, firstIndex + indexCount), reordering that range in place,
+	// spreading its pieces over pool when one is given
+	static std::vector<Meshlet> build(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, size_t firstIndex, size_t indexCount, ThreadPool *pool)
+	{
+		const size_t triangleCount = indexCount / 3;
+		const size_t chunkCount = (triangleCount + ChunkTriangles - 1) / ChunkTriangles;
+		std::vector<std::vector<Meshlet>> chunks(chunkCount);
+		auto buildChunk = [&](size_t chunk)
+		{
+			const size_t first = firstIndex + chunk * ChunkTriangles * 3;
+			const size_t count = std::min<size_t>(ChunkTriangles, triangleCount - chunk * ChunkTriangles) * 3;
+			chunks[chunk] = buildRange(vertices, indices, first, count);
+		};
+		if (pool)
+			pool->parallelFor(chunkCount, buildChunk);
+		else
+			for (size_t chunk = 0; chunk < chunkCount; chunk++)
+				buildChunk(chunk);
+		std::vector<Meshlet> meshlets;
+		for (size_t chunk = 0; chunk < chunkCount; chunk++)
+			meshlets.insert(meshlets.end(), chunks[chunk].begin(), chunks[chunk].end());
+		return meshlets;
+	}
+
+	// Whether a meshlet can be skipped when drawing from eye: all of it outside frustum, or with backfaces, all its
+	// triangles facing away. Both in model space.
+	static bool outside(const Meshlet &meshlet, const Frustum &frustum)
+	{
+		return !frustum.intersects(meshlet.center, meshlet.radius);
+	}
+	static bool facesAway(const Meshlet &meshlet, const glm::vec3 &eye)
+	{
+		const glm::vec3 toCenter = meshlet.center - eye;
+		return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+	}
+
+private:
+	// How much a triangle's normal turning from the meshlet's counts against it, next to each new vertex it needs
+	static constexpr float ConeWeight = 0.5f;
+
+	static glm::vec3 triangleNormal(const std::vector<Vertex> &vertices, const unsigned int *triangle)
+	{
+		const glm::vec3 a = vertices[triangle[0]].Position, b = vertices[triangle[1]].Position, c = vertices[triangle[2]].Position;
+		const glm::vec3 normal = glm::cross(b - a, c - a);
+		const float length = glm::length(normal);
+		return length > 0.0f ? normal / length : glm::vec3(0.0f);
+	}
+
+	static std::vector<Meshlet> buildRange(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, size_t firstIndex, size_t indexCount)
+	{
+		std::vector<Meshlet> meshlets;
+		const size_t triangleCount = indexCount / 3;
+		const unsigned int *source = indices.data() + firstIndex;
+		// The range's vertices numbered from 0, and local vertex -> triangle lists
+		std::unordered_map<unsigned int, unsigned int> localOf;
+		localOf.reserve(indexCount);
+		std::vector<unsigned int> local(indexCount);
+		for (size_t i = 0; i < indexCount; i++)
+			local[i] = localOf.insert(std::make_pair(source[i], (unsigned int)localOf.size())).first->second;
+		const size_t vertexCount = localOf.size();
+		std::vector<unsigned int> offsets(vertexCount + 1, 0), adjacency(indexCount);
+		for (size_t i = 0; i < indexCount; i++)
+			offsets[local[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			offsets[v + 1] += offsets[v];
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indexCount; i++)
+			adjacency[fill[local[i]]++] = (unsigned int)(i / 3);
+		std::vector<glm::vec3> normals(triangleCount);
+		for (size_t t = 0; t < triangleCount; t++)
+			normals[t] = triangleNormal(vertices, source + t * 3);
+
+		std::vector<unsigned int> ordered;
+		ordered.reserve(indexCount);
+		std::vector<unsigned char> emitted(triangleCount, 0);
+		// Which meshlet last took each local vertex, so membership of the current one is one compare
+		std::vector<unsigned int> owner(vertexCount, ~0u);
+		std::vector<unsigned int> members, candidates, triangles;
+		glm::vec3 normalSum(0.0f);
+		size_t cursor = 0;
+		unsigned int id = 0;
+
+		auto newVertices = [&](size_t t)
+		{
+			unsigned int count = 0;
+			for (int c = 0; c < 3; c++)
+				count += owner[local[t * 3 + c]] != id;
+			return count;
+		};
+		auto add = [&](size_t t)
+		{
+			emitted[t] = 1;
+			triangles.push_back((unsigned int)t);
+			normalSum += normals[t];
+			for (int c = 0; c < 3; c++)
+			{
+				const unsigned int v = local[t * 3 + c];
+				if (owner[v] == id)
+					continue;
+				owner[v] = id;
+				members.push_back(v);
+				for (unsigned int a = offsets[v]; a < offsets[v + 1]; a++)
+					if (!emitted[adjacency[a]])
+						candidates.push_back(adjacency[a]);
+			}
+		};
+		auto flush = [&]()
+		{
+			if (triangles.empty())
+				return;
+			Meshlet meshlet;
+			meshlet.firstIndex = (unsigned int)(firstIndex + ordered.size());
+			meshlet.indexCount = (unsigned int)triangles.size() * 3;
+			meshlet.vertexCount = (unsigned int)members.size();
+			for (size_t i = 0; i < triangles.size(); i++)
+				for (int c = 0; c < 3; c++)
+					ordered.push_back(source[triangles[i] * 3 + c]);
+			bounds(vertices, ordered.data() + (meshlet.firstIndex - firstIndex), meshlet.indexCount, meshlet);
+			cone(normals, triangles, normalSum, meshlet);
+			meshlets.push_back(meshlet);
+			members.clear();
+			candidates.clear();
+			triangles.clear();
+			normalSum = glm::vec3(0.0f);
+			id++;
+		};
+
+		while (true)
+		{
+			// The best triangle touching the meshlet, dropping the candidates that were taken
+			size_t best = triangleCount;
+			float bestScore = 0.0f;
+			const glm::vec3 axis = glm::length(normalSum) > 0.0f ? glm::normalize(normalSum) : glm::vec3(0.0f);
+			size_t write = 0;
+			for (size_t i = 0; i < candidates.size(); i++)
+			{
+				const unsigned int t = candidates[i];
+				if (emitted[t])
+					continue;
+				candidates[write++] = t;
+				const unsigned int extra = newVertices(t);
+				if (members.size() + extra > MaxVertices)
+					continue;
+				const float score = extra + (1.0f - glm::dot(normals[t], axis)) * ConeWeight;
+				if (best == triangleCount || score < bestScore)
+				{
+					best = t;
+					bestScore = score;
+				}
+			}
+			candidates.resize(write);
+			if (best == triangleCount)
+			{
+				// Nothing touching it fits: start the next meshlet from the next triangle in order, rather than
+				// loosen this one's bounds with a triangle from elsewhere
+				flush();
+				while (cursor < triangleCount && emitted[cursor])
+					cursor++;
+				if (cursor == triangleCount)
+					break;
+				best = cursor;
+			}
+			add(best);
+			if (triangles.size() == MaxTriangles)
+				flush();
+		}
+		flush();
+		std::copy(ordered.begin(), ordered.end(), indices.begin() + firstIndex);
+		return meshlets;
+	}
+
+	// The center of the meshlet's bounding box, and the distance from it to its furthest vertex
+	static void bounds(const std::vector<Vertex> &vertices, const unsigned int *indices, size_t indexCount, Meshlet &meshlet)
+	{
+		glm::vec3 low = vertices[indices[0]].Position, high = low;
+		for (size_t i = 1; i < indexCount; i++)
+		{
+			low = glm::min(low, vertices[indices[i]].Position);
+			high = glm::max(high, vertices[indices[i]].Position);
+		}
+		meshlet.center = (low + high) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (size_t i = 0; i < indexCount; i++)
+			meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+	}
+
+	// The mean normal as the axis, and the sine of the angle the normal furthest from it makes, as any view
+	// direction within that of the axis sees every triangle from behind. Normals spreading to 90 degrees or more
+	// leave no such direction.
+	static void cone(const std::vector<glm::vec3> &normals, const std::vector<unsigned int> &triangles, const glm::vec3 &normalSum, Meshlet &meshlet)
+	{
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 2.0f;
+		const float length = glm::length(normalSum);
+		if (!(length > 0.0f))
+			return;
+		const glm::vec3 axis = normalSum / length;
+		float minimum = 1.0f;
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			// Degenerate triangles have no normal and never show
+			if (normals[triangles[i]] != glm::vec3(0.0f))
+				minimum = std::min(minimum, glm::dot(normals[triangles[i]], axis));
+		}
+		if (minimum <= 0.0f)
+			return;
+		meshlet.coneAxis = axis;
+		meshlet.coneCutoff = std::sqrt(1.0f - minimum * minimum);
+	}
+};
+#endif
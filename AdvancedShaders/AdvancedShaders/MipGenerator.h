@@ -0,0 +1,746 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include "DecodedImage.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// How each texel of a mip level is made from the level above it
+enum MipFilter {
+	// Average of each 2x2 block, the same as glGenerateMipmap
+	MIP_FILTER_BOX,
+	// Kaiser windowed sinc over a 6x6 footprint. Keeps coarse levels sharper than the box filter
+	MIP_FILTER_KAISER,
+	// Largest/smallest value in each 2x2 block, so coarse levels of a height map stay conservative. When a level
+	// has an odd size, the last texel of a row or column takes in the 3rd source texel as well, so every source
+	// texel is covered by its block and each level stays a true bound of the one above.
+	MIP_FILTER_MAX,
+	MIP_FILTER_MIN
+};
+
+struct MipSettings {
+	MipFilter filter = MIP_FILTER_BOX;
+	// The colour channels are sRGB encoded, so filter them in linear space
+	bool srgb = false;
+	// The texels are unit vectors stored as rgb * 0.5 + 0.5, so renormalise them after filtering
+	bool normalMap = false;
+};
+
+// Builds mip chains on the CPU for 8-bit (R8/RG8/RGB8/RGBA8) and 16-bit (R16) images, so they can be filtered per
+// texture type and cooked into a cache file once instead of being generated by the driver on every run.
+// Each level depends on the one above it, so the levels are built in order, with the rows of a level split across
+// the shared thread pool. The inner loops use SSE2, or AVX2 when the CPU has it.
+class MipGenerator
+{
+public:
+	// Number of levels in a full chain down to 1x1
+	static int levelCount(int width, int height)
+	{
+		int levels = 1;
+		while (width > 1 || height > 1)
+		{
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			levels++;
+		}
+		return levels;
+	}
+
+	// Replaces the single level of an image with its full mip chain. All of the levels are placed in one
+	// tightly packed heap buffer, which the image takes ownership of.
+	static void generate(DecodedImage &image, const MipSettings &settings = MipSettings())
+	{
+		build(image, settings, true);
+	}
+
+	// Single threaded scalar version of generate(), used as the baseline in benchmarks and to check the fast path
+	static void generateReference(DecodedImage &image, const MipSettings &settings = MipSettings())
+	{
+		build(image, settings, false);
+	}
+
+private:
+	// Destination levels smaller than this many bytes are built on the calling thread
+	static const size_t ParallelThreshold = 64 * 1024;
+	static const int RowsPerTask = 8;
+	// The Kaiser filter reads source texels 2x-2 to 2x+3 for destination texel x
+	static const int KaiserTaps = 6;
+	static const int KaiserFirstTap = -2;
+
+	struct Job {
+		const TextureLevel *source;
+		TextureLevel *dest;
+		int components;
+		bool wide;
+		MipSettings settings;
+	};
+
+	static void build(DecodedImage &image, const MipSettings &settings, bool fast)
+	{
+		if (!image.valid() || image.compressed || image.components < 1 || image.components > 4)
+			return;
+		if (image.type != GL_UNSIGNED_BYTE && image.type != GL_UNSIGNED_SHORT)
+			return;
+		const bool wide = image.type == GL_UNSIGNED_SHORT;
+		const size_t texelSize = (size_t)image.components * (wide ? 2 : 1);
+		const TextureLevel base = image.levels[0];
+		const int count = levelCount(base.width, base.height);
+
+		std::vector<TextureLevel> levels(count);
+		std::vector<size_t> offsets(count);
+		size_t total = 0;
+		int width = base.width, height = base.height;
+		for (int i = 0; i < count; i++)
+		{
+			offsets[i] = total;
+			levels[i].width = width;
+			levels[i].height = height;
+			levels[i].size = (size_t)width * height * texelSize;
+			// Keep every level 16 byte aligned for the vector loads
+			total += (levels[i].size + 15) & ~(size_t)15;
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+
+		std::shared_ptr<std::vector<unsigned char>> storage = std::make_shared<std::vector<unsigned char>>(total);
+		unsigned char *pixels = storage->data();
+		std::memcpy(pixels, base.pixels, levels[0].size);
+		levels[0].pixels = pixels;
+		for (int i = 1; i < count; i++)
+		{
+			levels[i].pixels = pixels + offsets[i];
+			Job job = { &levels[i - 1], &levels[i], image.components, wide, settings };
+			const int rows = levels[i].height;
+			if (!fast)
+				downsampleReference(job);
+			else if (levels[i].size < ParallelThreshold)
+				downsampleRows(job, 0, rows);
+			else
+			{
+				const size_t tasks = (rows + RowsPerTask - 1) / RowsPerTask;
+				ThreadPool::shared().parallelFor(tasks, [&](size_t t)
+				{
+					downsampleRows(job, (int)t * RowsPerTask, std::min(rows, ((int)t + 1) * RowsPerTask));
+				});
+			}
+		}
+
+		image.levels = levels;
+		image.owner = storage;
+	}
+
+	// Filters that need the values converted to linear floats first
+	static bool usesFloat(const MipSettings &settings)
+	{
+		if (settings.filter == MIP_FILTER_MAX || settings.filter == MIP_FILTER_MIN)
+			return false;
+		return settings.filter == MIP_FILTER_KAISER || settings.srgb || settings.normalMap;
+	}
+
+	// Builds destination rows [rowBegin, rowEnd) of a level
+	static void downsampleRows(const Job &job, int rowBegin, int rowEnd)
+	{
+		if (usesFloat(job.settings))
+			floatRows(job, rowBegin, rowEnd);
+		else if (job.wide)
+			shortRows(job, rowBegin, rowEnd);
+		else
+			byteRows(job, rowBegin, rowEnd);
+	}
+
+	// ---- 8-bit box, max and min ----
+
+	static void byteRows(const Job &job, int rowBegin, int rowEnd)
+	{
+		const TextureLevel &src = *job.source;
+		const int c = job.components;
+		const size_t stride = (size_t)src.width * c;
+		const bool box = job.settings.filter == MIP_FILTER_BOX;
+		const bool takeMax = job.settings.filter == MIP_FILTER_MAX;
+		std::vector<uint16_t> sums(box ? stride : 0);
+		std::vector<uint8_t> picks(box ? 0 : stride);
+		for (int y = rowBegin; y < rowEnd; y++)
+		{
+			const uint8_t *row0 = src.pixels + (size_t)std::min(y * 2, src.height - 1) * stride;
+			const uint8_t *row1 = src.pixels + (size_t)std::min(y * 2 + 1, src.height - 1) * stride;
+			uint8_t *out = (uint8_t*)job.dest->pixels + (size_t)y * job.dest->width * c;
+			if (box)
+			{
+				size_t i = verticalSum(row0, row1, sums.data(), stride);
+				for (; i < stride; i++)
+					sums[i] = (uint16_t)(row0[i] + row1[i]);
+				horizontalAverage(sums.data(), out, src.width, job.dest->width, c);
+			}
+			else
+			{
+				size_t i = verticalPick(row0, row1, picks.data(), stride, takeMax);
+				for (; i < stride; i++)
+					picks[i] = takeMax ? std::max(row0[i], row1[i]) : std::min(row0[i], row1[i]);
+				if (foldsRow(src.height, job.dest->height, y))
+				{
+					const uint8_t *row2 = src.pixels + (size_t)(y * 2 + 2) * stride;
+					i = verticalPick(picks.data(), row2, picks.data(), stride, takeMax);
+					for (; i < stride; i++)
+						picks[i] = takeMax ? std::max(picks[i], row2[i]) : std::min(picks[i], row2[i]);
+				}
+				horizontalPick(picks.data(), out, src.width, job.dest->width, c, takeMax);
+				if (foldsRow(src.width, job.dest->width, job.dest->width - 1))
+				{
+					const int x = job.dest->width - 1;
+					for (int ch = 0; ch < c; ch++)
+						out[x * c + ch] = takeMax ? std::max(out[x * c + ch], picks[(x * 2 + 2) * c + ch]) : std::min(out[x * c + ch], picks[(x * 2 + 2) * c + ch]);
+				}
+			}
+		}
+	}
+
+	// Whether destination row (or column) y of an odd sized level also takes in source row 2y + 2, which the 2x2
+	// blocks would otherwise leave out
+	static bool foldsRow(int srcSize, int dstSize, int y)
+	{
+		return y == dstSize - 1 && srcSize > dstSize * 2;
+	}
+
+	// sums[i] = row0[i] + row1[i] for as much of the row as the vector loop covers; returns how far it got
+	static size_t verticalSum(const uint8_t *row0, const uint8_t *row1, uint16_t *sums, size_t count)
+	{
+		size_t i = 0;
+#ifdef SIMD_X86
+		if (CpuFeatures::get().avx2)
+			return verticalSumAvx2(row0, row1, sums, count);
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(row0 + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(row1 + i));
+			_mm_storeu_si128((__m128i*)(sums + i), _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+			_mm_storeu_si128((__m128i*)(sums + i + 8), _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+		}
+#endif
+		return i;
+	}
+
+#ifdef SIMD_X86
+	SIMD_TARGET_AVX2
+	static size_t verticalSumAvx2(const uint8_t *row0, const uint8_t *row1, uint16_t *sums, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row0 + i)));
+			__m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(row1 + i)));
+			_mm256_storeu_si256((__m256i*)(sums + i), _mm256_add_epi16(a, b));
+		}
+		return i;
+	}
+#endif
+
+	// out[x] = (sums[2x] + sums[2x + 1] + 2) / 4 for each channel
+	static void horizontalAverage(const uint16_t *sums, uint8_t *out, int srcWidth, int dstWidth, int c)
+	{
+		int x = 0;
+#ifdef SIMD_X86
+		if (srcWidth > 1)
+		{
+			const __m128i two = _mm_set1_epi16(2);
+			if (c == 1)
+			{
+				// madd against 1s adds each adjacent pair of 16-bit sums into one 32-bit lane
+				const __m128i ones = _mm_set1_epi16(1);
+				for (; x + 8 <= dstWidth; x += 8)
+				{
+					__m128i a = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sums + x * 2)), ones);
+					__m128i b = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sums + x * 2 + 8)), ones);
+					__m128i total = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(a, b), two), 2);
+					_mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(total, total));
+				}
+			}
+			else if (c == 4)
+			{
+				// Each 128-bit load holds two source texels; adding the high half onto the low half gives one output
+				for (; x + 2 <= dstWidth; x += 2)
+				{
+					__m128i a = _mm_loadu_si128((const __m128i*)(sums + x * 8));
+					__m128i b = _mm_loadu_si128((const __m128i*)(sums + x * 8 + 8));
+					a = _mm_add_epi16(a, _mm_srli_si128(a, 8));
+					b = _mm_add_epi16(b, _mm_srli_si128(b, 8));
+					__m128i total = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(a, b), two), 2);
+					_mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(total, total));
+				}
+			}
+		}
+#endif
+		for (; x < dstWidth; x++)
+		{
+			const int x0 = x * 2 * c;
+			const int x1 = std::min(x * 2 + 1, srcWidth - 1) * c;
+			for (int ch = 0; ch < c; ch++)
+				out[x * c + ch] = (uint8_t)((sums[x0 + ch] + sums[x1 + ch] + 2) >> 2);
+		}
+	}
+
+	static size_t verticalPick(const uint8_t *row0, const uint8_t *row1, uint8_t *picks, size_t count, bool takeMax)
+	{
+		size_t i = 0;
+#ifdef SIMD_X86
+		if (CpuFeatures::get().avx2)
+			return verticalPickAvx2(row0, row1, picks, count, takeMax);
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(row0 + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(row1 + i));
+			_mm_storeu_si128((__m128i*)(picks + i), takeMax ? _mm_max_epu8(a, b) : _mm_min_epu8(a, b));
+		}
+#endif
+		return i;
+	}
+
+#ifdef SIMD_X86
+	SIMD_TARGET_AVX2
+	static size_t verticalPickAvx2(const uint8_t *row0, const uint8_t *row1, uint8_t *picks, size_t count, bool takeMax)
+	{
+		size_t i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			__m256i a = _mm256_loadu_si256((const __m256i*)(row0 + i));
+			__m256i b = _mm256_loadu_si256((const __m256i*)(row1 + i));
+			_mm256_storeu_si256((__m256i*)(picks + i), takeMax ? _mm256_max_epu8(a, b) : _mm256_min_epu8(a, b));
+		}
+		return i;
+	}
+#endif
+
+	static void horizontalPick(const uint8_t *picks, uint8_t *out, int srcWidth, int dstWidth, int c, bool takeMax)
+	{
+		int x = 0;
+#ifdef SIMD_X86
+		if (srcWidth > 1)
+		{
+			if (c == 1)
+			{
+				// Split each 16-bit lane into its even and odd byte and pick between them
+				const __m128i low = _mm_set1_epi16(0xFF);
+				for (; x + 8 <= dstWidth; x += 8)
+				{
+					__m128i v = _mm_loadu_si128((const __m128i*)(picks + x * 2));
+					__m128i even = _mm_and_si128(v, low);
+					__m128i odd = _mm_srli_epi16(v, 8);
+					__m128i result = takeMax ? _mm_max_epi16(even, odd) : _mm_min_epi16(even, odd);
+					_mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(result, result));
+				}
+			}
+			else if (c == 4)
+			{
+				// Pick between the two texels in each 64-bit lane, then gather the two results into the low half
+				for (; x + 2 <= dstWidth; x += 2)
+				{
+					__m128i v = _mm_loadu_si128((const __m128i*)(picks + x * 8));
+					__m128i shifted = _mm_srli_epi64(v, 32);
+					__m128i result = takeMax ? _mm_max_epu8(v, shifted) : _mm_min_epu8(v, shifted);
+					_mm_storel_epi64((__m128i*)(out + x * 4), _mm_shuffle_epi32(result, _MM_SHUFFLE(3, 3, 2, 0)));
+				}
+			}
+		}
+#endif
+		for (; x < dstWidth; x++)
+		{
+			const int x0 = x * 2 * c;
+			const int x1 = std::min(x * 2 + 1, srcWidth - 1) * c;
+			for (int ch = 0; ch < c; ch++)
+				out[x * c + ch] = takeMax ? std::max(picks[x0 + ch], picks[x1 + ch]) : std::min(picks[x0 + ch], picks[x1 + ch]);
+		}
+	}
+
+	// ---- 16-bit box, max and min ----
+
+	static void shortRows(const Job &job, int rowBegin, int rowEnd)
+	{
+		const TextureLevel &src = *job.source;
+		const int c = job.components;
+		const size_t stride = (size_t)src.width * c;
+		const MipFilter filter = job.settings.filter;
+		std::vector<uint32_t> values(stride);
+		for (int y = rowBegin; y < rowEnd; y++)
+		{
+			const uint16_t *row0 = (const uint16_t*)src.pixels + (size_t)std::min(y * 2, src.height - 1) * stride;
+			const uint16_t *row1 = (const uint16_t*)src.pixels + (size_t)std::min(y * 2 + 1, src.height - 1) * stride;
+			uint16_t *out = (uint16_t*)job.dest->pixels + (size_t)y * job.dest->width * c;
+			size_t i = verticalShorts(row0, row1, values.data(), stride, filter);
+			for (; i < stride; i++)
+				values[i] = combine(row0[i], row1[i], filter);
+			const bool pick = filter != MIP_FILTER_BOX;
+			if (pick && foldsRow(src.height, job.dest->height, y))
+			{
+				const uint16_t *row2 = (const uint16_t*)src.pixels + (size_t)(y * 2 + 2) * stride;
+				for (i = 0; i < stride; i++)
+					values[i] = combine(values[i], row2[i], filter);
+			}
+			for (int x = 0; x < job.dest->width; x++)
+			{
+				const int x0 = x * 2 * c;
+				const int x1 = std::min(x * 2 + 1, src.width - 1) * c;
+				const bool fold = pick && foldsRow(src.width, job.dest->width, x);
+				for (int ch = 0; ch < c; ch++)
+				{
+					if (!pick)
+						out[x * c + ch] = (uint16_t)((values[x0 + ch] + values[x1 + ch] + 2) >> 2);
+					else if (fold)
+						out[x * c + ch] = (uint16_t)combine(combine(values[x0 + ch], values[x1 + ch], filter), values[x1 + c + ch], filter);
+					else
+						out[x * c + ch] = (uint16_t)combine(values[x0 + ch], values[x1 + ch], filter);
+				}
+			}
+		}
+	}
+
+	static uint32_t combine(uint32_t a, uint32_t b, MipFilter filter)
+	{
+		if (filter == MIP_FILTER_MAX)
+			return std::max(a, b);
+		if (filter == MIP_FILTER_MIN)
+			return std::min(a, b);
+		return a + b;
+	}
+
+	// values[i] = row0[i] + row1[i] (box) or the max/min of the two, widened to 32 bits
+	static size_t verticalShorts(const uint16_t *row0, const uint16_t *row1, uint32_t *values, size_t count, MipFilter filter)
+	{
+		size_t i = 0;
+#ifdef SIMD_X86
+		const __m128i zero = _mm_setzero_si128();
+		// SSE2 only has signed 16-bit max/min, so flip the sign bit on the way in and out
+		const __m128i flip = _mm_set1_epi16((short)0x8000);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(row0 + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(row1 + i));
+			__m128i lo, hi;
+			if (filter == MIP_FILTER_BOX)
+			{
+				lo = _mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpacklo_epi16(b, zero));
+				hi = _mm_add_epi32(_mm_unpackhi_epi16(a, zero), _mm_unpackhi_epi16(b, zero));
+			}
+			else
+			{
+				a = _mm_xor_si128(a, flip);
+				b = _mm_xor_si128(b, flip);
+				__m128i picked = _mm_xor_si128(filter == MIP_FILTER_MAX ? _mm_max_epi16(a, b) : _mm_min_epi16(a, b), flip);
+				lo = _mm_unpacklo_epi16(picked, zero);
+				hi = _mm_unpackhi_epi16(picked, zero);
+			}
+			_mm_storeu_si128((__m128i*)(values + i), lo);
+			_mm_storeu_si128((__m128i*)(values + i + 4), hi);
+		}
+#endif
+		return i;
+	}
+
+	// ---- Filtering in linear floating point: Kaiser, sRGB and normal maps ----
+
+	// Source offsets and weights of the separable filter, relative to texel 2x
+	struct Taps {
+		int count;
+		int first;
+		float weights[KaiserTaps];
+		bool wrap;
+	};
+
+	static const Taps& taps(MipFilter filter)
+	{
+		static const Taps box = { 2, 0, { 0.5f, 0.5f }, false };
+		static const Taps kaiser = kaiserTaps();
+		return filter == MIP_FILTER_KAISER ? kaiser : box;
+	}
+
+	// Kaiser windowed sinc for a 2:1 reduction, with a window half-width of 3 source texels and alpha of 4.
+	// Textures tile, so the taps wrap around the edges.
+	static Taps kaiserTaps()
+	{
+		const double pi = 3.14159265358979323846, alpha = 4.0, halfWidth = 3.0;
+		Taps result = { KaiserTaps, KaiserFirstTap, {}, true };
+		double total = 0.0;
+		double weights[KaiserTaps];
+		for (int i = 0; i < KaiserTaps; i++)
+		{
+			// Distance from the centre of the 2x2 block, in source texels
+			const double d = (KaiserFirstTap + i) - 0.5;
+			const double x = d * 0.5;
+			const double sinc = std::sin(pi * x) / (pi * x);
+			const double r = d / halfWidth;
+			const double window = bessel0(alpha * std::sqrt(std::max(0.0, 1.0 - r * r))) / bessel0(alpha);
+			weights[i] = sinc * window;
+			total += weights[i];
+		}
+		for (int i = 0; i < KaiserTaps; i++)
+			result.weights[i] = (float)(weights[i] / total);
+		return result;
+	}
+
+	// Modified Bessel function of the first kind, order zero
+	static double bessel0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 32; k++)
+		{
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	static int tapIndex(int index, int size, bool wrap)
+	{
+		if (wrap)
+			return ((index % size) + size) % size;
+		return std::min(std::max(index, 0), size - 1);
+	}
+
+	// Lookup tables for the sRGB transfer function
+	static const float* srgbToLinear()
+	{
+		static const std::vector<float> table = []
+		{
+			std::vector<float> values(256);
+			for (int i = 0; i < 256; i++)
+			{
+				double c = i / 255.0;
+				values[i] = (float)(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+			}
+			return values;
+		}();
+		return table.data();
+	}
+
+	static const uint8_t* linearToSrgb()
+	{
+		static const std::vector<uint8_t> table = []
+		{
+			std::vector<uint8_t> values(4096);
+			for (int i = 0; i < 4096; i++)
+			{
+				double l = i / 4095.0;
+				double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+				values[i] = (uint8_t)std::min(255.0, std::floor(c * 255.0 + 0.5));
+			}
+			return values;
+		}();
+		return table.data();
+	}
+
+	// Converts one stored value to the space it's filtered in
+	static float decodeValue(const Job &job, const unsigned char *pixels, size_t index, int channel)
+	{
+		if (job.wide)
+		{
+			float value = ((const uint16_t*)pixels)[index] / 65535.0f;
+			return job.settings.normalMap && channel < 3 ? value * 2.0f - 1.0f : value;
+		}
+		const uint8_t value = pixels[index];
+		if (job.settings.normalMap && channel < 3)
+			return value / 127.5f - 1.0f;
+		if (job.settings.srgb && channel < 3)
+			return srgbToLinear()[value];
+		return value / 255.0f;
+	}
+
+	// Converts filtered texels back to their stored form, renormalising normals first
+	static void encodeTexels(const Job &job, float *texels, unsigned char *out, int count)
+	{
+		const int c = job.components;
+		const bool normalMap = job.settings.normalMap && c >= 3;
+		const bool srgb = job.settings.srgb && !job.settings.normalMap;
+		const uint8_t *toSrgb = linearToSrgb();
+		for (int x = 0; x < count; x++)
+		{
+			float *texel = texels + x * c;
+			if (normalMap)
+			{
+				float length = std::sqrt(texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2]);
+				float scale = length > 1e-8f ? 0.5f / length : 0.5f;
+				texel[0] = texel[0] * scale + 0.5f;
+				texel[1] = texel[1] * scale + 0.5f;
+				texel[2] = texel[2] * scale + 0.5f;
+			}
+			for (int ch = 0; ch < c; ch++)
+			{
+				const float value = std::min(std::max(texel[ch], 0.0f), 1.0f);
+				if (job.wide)
+					((uint16_t*)out)[x * c + ch] = (uint16_t)(value * 65535.0f + 0.5f);
+				else if (srgb && ch < 3)
+					out[x * c + ch] = toSrgb[(int)(value * 4095.0f + 0.5f)];
+				else
+					out[x * c + ch] = (uint8_t)(value * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	static void floatRows(const Job &job, int rowBegin, int rowEnd)
+	{
+		const TextureLevel &src = *job.source;
+		const int c = job.components;
+		const size_t stride = (size_t)src.width * c;
+		const size_t texelSize = (size_t)c * (job.wide ? 2 : 1);
+		const Taps &filter = taps(job.settings.filter);
+		// 8-bit values are decoded through a table per channel rather than branching on every value
+		std::vector<float> decodeTable(job.wide ? 0 : 256 * c);
+		for (size_t i = 0; i < decodeTable.size(); i++)
+		{
+			const uint8_t value = (uint8_t)(i % 256);
+			decodeTable[i] = decodeValue(job, &value, 0, (int)(i / 256));
+		}
+		std::vector<float> row(stride), column(stride), texels((size_t)job.dest->width * c);
+		for (int y = rowBegin; y < rowEnd; y++)
+		{
+			// Vertical pass: weighted sum of the source rows under the filter
+			std::fill(column.begin(), column.end(), 0.0f);
+			for (int t = 0; t < filter.count; t++)
+			{
+				const int sy = tapIndex(y * 2 + filter.first + t, src.height, filter.wrap);
+				const unsigned char *source = src.pixels + (size_t)sy * src.width * texelSize;
+				if (job.wide)
+				{
+					for (size_t i = 0; i < stride; i++)
+						row[i] = decodeValue(job, source, i, (int)(i % c));
+				}
+				else
+				{
+					for (size_t i = 0; i < stride; i += c)
+						for (int ch = 0; ch < c; ch++)
+							row[i + ch] = decodeTable[ch * 256 + source[i + ch]];
+				}
+				accumulate(column.data(), row.data(), filter.weights[t], stride);
+			}
+			// Horizontal pass
+			for (int x = 0; x < job.dest->width; x++)
+			{
+				float *texel = texels.data() + (size_t)x * c;
+				for (int ch = 0; ch < c; ch++)
+					texel[ch] = 0.0f;
+				for (int t = 0; t < filter.count; t++)
+				{
+					const float *tap = column.data() + (size_t)tapIndex(x * 2 + filter.first + t, src.width, filter.wrap) * c;
+					for (int ch = 0; ch < c; ch++)
+						texel[ch] += filter.weights[t] * tap[ch];
+				}
+			}
+			encodeTexels(job, texels.data(), (unsigned char*)job.dest->pixels + (size_t)y * job.dest->width * texelSize, job.dest->width);
+		}
+	}
+
+	// sum[i] += weight * row[i]
+	static void accumulate(float *sum, const float *row, float weight, size_t count)
+	{
+		size_t i = 0;
+#ifdef SIMD_X86
+		if (CpuFeatures::get().avx2)
+		{
+			accumulateAvx2(sum, row, weight, count);
+			return;
+		}
+		const __m128 w = _mm_set1_ps(weight);
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), _mm_mul_ps(_mm_loadu_ps(row + i), w)));
+#endif
+		for (; i < count; i++)
+			sum[i] += weight * row[i];
+	}
+
+#ifdef SIMD_X86
+	SIMD_TARGET_AVX2
+	static void accumulateAvx2(float *sum, const float *row, float weight, size_t count)
+	{
+		size_t i = 0;
+		const __m256 w = _mm256_set1_ps(weight);
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(sum + i, _mm256_add_ps(_mm256_loadu_ps(sum + i), _mm256_mul_ps(_mm256_loadu_ps(row + i), w)));
+		for (; i < count; i++)
+			sum[i] += weight * row[i];
+	}
+#endif
+
+	// ---- Scalar reference ----
+
+	// Computes every destination texel directly from its source footprint
+	static void downsampleReference(const Job &job)
+	{
+		const TextureLevel &src = *job.source;
+		TextureLevel &dst = *job.dest;
+		const int c = job.components;
+		if (usesFloat(job.settings))
+		{
+			const Taps &filter = taps(job.settings.filter);
+			const size_t texelSize = (size_t)c * (job.wide ? 2 : 1);
+			std::vector<float> texel(c);
+			for (int y = 0; y < dst.height; y++)
+			{
+				for (int x = 0; x < dst.width; x++)
+				{
+					std::fill(texel.begin(), texel.end(), 0.0f);
+					for (int ty = 0; ty < filter.count; ty++)
+					{
+						const int sy = tapIndex(y * 2 + filter.first + ty, src.height, filter.wrap);
+						for (int tx = 0; tx < filter.count; tx++)
+						{
+							const int sx = tapIndex(x * 2 + filter.first + tx, src.width, filter.wrap);
+							const float weight = filter.weights[ty] * filter.weights[tx];
+							for (int ch = 0; ch < c; ch++)
+								texel[ch] += weight * decodeValue(job, src.pixels, ((size_t)sy * src.width + sx) * c + ch, ch);
+						}
+					}
+					encodeTexels(job, texel.data(), (unsigned char*)dst.pixels + ((size_t)y * dst.width + x) * texelSize, 1);
+				}
+			}
+			return;
+		}
+		const bool pick = job.settings.filter == MIP_FILTER_MAX || job.settings.filter == MIP_FILTER_MIN;
+		for (int y = 0; y < dst.height; y++)
+		{
+			const size_t y0 = (size_t)std::min(y * 2, src.height - 1) * src.width;
+			const size_t y1 = (size_t)std::min(y * 2 + 1, src.height - 1) * src.width;
+			const int rows = pick && foldsRow(src.height, dst.height, y) ? 3 : 2;
+			for (int x = 0; x < dst.width; x++)
+			{
+				const size_t x0 = (size_t)std::min(x * 2, src.width - 1);
+				const size_t x1 = (size_t)std::min(x * 2 + 1, src.width - 1);
+				const int columns = pick && foldsRow(src.width, dst.width, x) ? 3 : 2;
+				for (int ch = 0; ch < c; ch++)
+				{
+					const size_t corners[4] = { (y0 + x0) * c + ch, (y0 + x1) * c + ch, (y1 + x0) * c + ch, (y1 + x1) * c + ch };
+					uint32_t values[4];
+					for (int i = 0; i < 4; i++)
+						values[i] = job.wide ? ((const uint16_t*)src.pixels)[corners[i]] : src.pixels[corners[i]];
+					uint32_t result;
+					if (pick)
+					{
+						// Every texel of the block, which is 3 wide or high at the odd edges
+						result = values[0];
+						for (int by = 0; by < rows; by++)
+						{
+							for (int bx = 0; bx < columns; bx++)
+							{
+								const size_t index = ((size_t)std::min(y * 2 + by, src.height - 1) * src.width + std::min(x * 2 + bx, src.width - 1)) * c + ch;
+								const uint32_t value = job.wide ? ((const uint16_t*)src.pixels)[index] : src.pixels[index];
+								result = job.settings.filter == MIP_FILTER_MAX ? std::max(result, value) : std::min(result, value);
+							}
+						}
+					}
+					else	// Same rounding as the fast path, which adds the rows first
+						result = ((values[0] + values[2]) + (values[1] + values[3]) + 2) >> 2;
+					const size_t index = ((size_t)y * dst.width + x) * c + ch;
+					if (job.wide)
+						((uint16_t*)dst.pixels)[index] = (uint16_t)result;
+					else
+						((uint8_t*)dst.pixels)[index] = (uint8_t)result;
+				}
+			}
+		}
+	}
+};
+#endif
@@ -9,89 +9,633 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-#include "stb_image.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
 #include "Shader.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+#include "UploadQueue.h"
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// How a Model is loaded and what its meshes are built into. Fields other than gamma and cache change what a cooked
+// MeshCache file holds, so they're all part of its settings hash (see Model::cacheHash).
+struct ModelSettings {
+	// Colour maps are stored in an sRGB format, so sampling them returns linear values
+	bool gamma = false;
+	// Materials with both a normal and a height map load them as one texture_normalHeight texture, with the
+	// height in the normal map's alpha, instead of a texture_normal and a texture_height
+	bool packHeight = false;
+	// How meshes hold their tangent frames: as vectors (Vertex), in the compact QTangentVertex format for shaders
+	// built with QTANGENT, or not at all (TangentlessVertex) for shaders built with DERIVATIVE_FRAME, which also
+	// skips ASSIMP's tangent generation
+	TangentFrame frame = TANGENT_FRAME_VECTORS;
+	// Meshes are built in quantized streams, for shaders built with QUANTIZED, with the encodings encoding asks
+	// for. Each mesh's compression and worst errors are printed as it's built.
+	bool quantize = false;
+	VertexEncoding encoding;
+	// The meshes are cooked into a MeshCache file after the first import, and later loads map that file instead of
+	// importing with ASSIMP
+	bool cache = true;
+	// Each mesh's triangles and vertices are reordered by MeshOptimizer as it's imported (so cooked files hold the
+	// optimized order), printing its vertex cache and overdraw statistics before and after
+	bool optimize = true;
+	// How many levels of detail each mesh gets, counting itself: each coarser one aims for half the triangles of the
+	// one before, simplified by MeshSimplifier into a range of the same index buffer. Model::selectLods() picks
+	// which each mesh draws. 1 leaves meshes as they are.
+	unsigned int lods = 1;
+	// Each mesh's levels of detail are split into meshlets (reordering their triangles within each level), for
+	// Model::cullMeshlets() to cull before drawing
+	bool meshlets = false;
+};
+
 class Model
 {
 public:
+	// Textures this Model holds a cache reference to, one entry per unique path
 	vector<Texture> textures_loaded;
 	vector<Mesh> meshes;
 	string directory;
 	bool gammaCorrection;	
+	// How the model was loaded and its meshes built
+	ModelSettings settings;
 	// Fucntion to load the model from the given path
-	Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+	Model(string const &path, const ModelSettings &modelSettings = ModelSettings())
+		: gammaCorrection(modelSettings.gamma), settings(modelSettings)
 	{
 		loadModel(path);
 	}
 
+	// Streams the model in while the render loop runs instead of loading it up front. The file is read and its
+	// meshes built on the thread pool, then every mesh and texture is uploaded through uploads under its frame
+	// budget, at the given priority. Meshes are added to meshes as they arrive, drawn with the cache's placeholder
+	// textures until their own are ready. uploads must outlive the streaming; the Model itself can go at any time.
+	Model(string const &path, UploadQueue &uploads, int priority = 0, const ModelSettings &modelSettings = ModelSettings())
+		: gammaCorrection(modelSettings.gamma), settings(modelSettings)
+	{
+		directory = path.substr(0, path.find_last_of('/'));
+		const string folder = directory;
+		const ModelSettings built = settings;
+		const uint64_t settingsHash = cacheHash(built);
+		shared_ptr<bool> living = alive;
+		UploadQueue *queue = &uploads;
+		// The worker only sees copies, as the Model may be destroyed before it runs. The steps it queues run on the
+		// GL thread, where the Model is destroyed, so they check it's still alive before touching it.
+		uploads.submitAsync([this, path, folder, built, settingsHash, priority, living, queue]()
+		{
+			vector<TextureRequest> requests;
+			vector<Texture> textures;
+			vector<shared_ptr<MeshPayload>> payloads;
+			// A cooked file is copied into payloads, as the upload steps read them over several frames
+			CachedModel cached;
+			if (built.cache && MeshCache::load(path, settingsHash, cached))
+			{
+				cachedTextures(cached, folder, built.gamma, requests, textures);
+				for (size_t i = 0; i < cached.meshes.size(); i++)
+					payloads.push_back(cachedPayload(cached.meshes[i]));
+			}
+			else
+			{
+				Assimp::Importer importer;
+				const aiScene* scene = importer.ReadFile(path, importFlags(built.frame));
+				if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+					cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+				else
+				{
+					collectTextures(scene, folder, built.gamma, built.packHeight, requests, textures);
+					vector<aiMesh*> sceneMeshes;
+					listMeshes(scene->mRootNode, scene, sceneMeshes);
+					payloads = buildPayloads(sceneMeshes, scene, built, &ThreadPool::shared());
+					if (built.cache)
+					{
+						CachedModel cooked = cookTextures(folder, requests, textures);
+						for (size_t i = 0; i < payloads.size(); i++)
+							cooked.meshes.push_back(cookMesh(built.frame, *payloads[i]));
+						MeshCache::write(path, settingsHash, cooked);
+					}
+				}
+			}
+			// One small step per texture and mesh, so starting hundreds of them doesn't land in a single frame
+			UploadJob job;
+			job.priority = priority;
+			for (size_t i = 0; i < requests.size(); i++)
+			{
+				UploadStep start;
+				const TextureRequest request = requests[i];
+				const Texture texture = textures[i];
+				start.run = [this, living, queue, request, texture, priority]()
+				{
+					if (*living)
+						TextureCache::instance().stream(request, *queue, priority, [this, living, texture](unsigned int id)
+						{
+							if (*living)
+								textureArrived(texture, id);
+							else
+								TextureCache::instance().release(id);
+						});
+				};
+				job.steps.push_back(start);
+			}
+			for (size_t i = 0; i < payloads.size(); i++)
+			{
+				UploadStep start;
+				const shared_ptr<const MeshPayload> payload = payloads[i];
+				start.run = [this, living, queue, payload, priority]()
+				{
+					if (*living)
+						queue->submit(Mesh::uploadJob(payload, priority, [this, living, payload](unsigned int VAO, unsigned int VBO, unsigned int EBO)
+						{
+							if (*living)
+								meshes.push_back(Mesh(*payload, texturesFor(payload->textures), VAO, VBO, EBO));
+							else
+								Mesh::deleteBuffers(VAO, VBO, EBO);
+						}));
+				};
+				job.steps.push_back(start);
+			}
+			return job;
+		});
+	}
+
+	// Hands the Model's texture references back to the shared cache and deletes its meshes' buffers
+	~Model()
+	{
+		*alive = false;
+		for (unsigned int i = 0; i < textures_loaded.size(); i++)
+			TextureCache::instance().release(textures_loaded[i].id);
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].release();
+	}
+
+	// Models own cache references, so they can't be copied
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
 	// Draw the meshes for the shader passed in
-	void Draw(Shader shader)
+	void Draw(Shader &shader)
 	{
 		for (unsigned int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shader);
 	}
 
+	// Picks the level of detail each mesh draws (see Mesh::selectLod) for drawing with the model matrix model, from
+	// eye with a vertical field of view of fovy radians into a viewport viewportHeight pixels tall. A level's error
+	// is scaled by the matrix and projected at the distance to the nearest point of the mesh's bounding sphere, so
+	// it's never drawn bigger than pixelError pixels.
+	void selectLods(const glm::mat4 &model, const glm::vec3 &eye, float fovy, int viewportHeight, float pixelError = 1.0f, float hysteresis = 0.25f)
+	{
+		const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		// Pixels one unit at a distance of one covers
+		const float pixelsPerUnit = viewportHeight / (2.0f * tan(fovy * 0.5f));
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			Mesh &mesh = meshes[i];
+			const glm::vec3 center = glm::vec3(model * glm::vec4(mesh.boundsCenter, 1.0f));
+			const float distance = std::max(glm::length(center - eye) - mesh.boundsRadius * scale, 1e-3f);
+			mesh.selectLod(scale * pixelsPerUnit / distance, pixelError, hysteresis);
+		}
+	}
+
+	// Culls the meshlets of every mesh built with them (see Mesh::cullMeshlets) for drawing with the given matrices
+	// from eye, outside the frustum and, with backfaces, facing away from eye, and returns what it rejected. Call it
+	// each frame before Draw(), after selectLods(). The facing test takes eye into model space, so it assumes model
+	// only rotates, moves and scales evenly.
+	MeshletCullStats cullMeshlets(const glm::mat4 &projection, const glm::mat4 &view, const glm::mat4 &model, const glm::vec3 &eye, bool backfaces = true)
+	{
+		MeshletCullStats stats;
+		const Frustum frustum(projection * view * model);
+		const glm::vec3 localEye = glm::vec3(glm::inverse(model) * glm::vec4(eye, 1.0f));
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].cullMeshlets(frustum, localEye, backfaces, stats);
+		return stats;
+	}
+
+	// ASSIMP's post processing steps. Tangents are only generated for the formats that store them.
+	static unsigned int importFlags(TangentFrame frame)
+	{
+		unsigned int flags = aiProcess_Triangulate | aiProcess_FlipUVs;
+		if (frame != TANGENT_FRAME_DERIVATIVES)
+			flags |= aiProcess_CalcTangentSpace;
+		return flags;
+	}
+
+	// The meshes of a node and its children, in the order they're added to meshes
+	static void listMeshes(aiNode *node, const aiScene *scene, vector<aiMesh*> &sceneMeshes)
+	{
+		// Node object only contains indices to index the actual objects in the scene, while scene contains all the data.
+		// Node is primarily for organisation.
+		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+			sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+			listMeshes(node->mChildren[i], scene, sceneMeshes);
+	}
+
+	// The CPU half of building meshes: each mesh's vertices are read out of ASSIMP, optimized when asked, given
+	// its levels of detail, split into meshlets when asked, converted to the settings' frame format, quantized when
+	// asked, and its texture slots listed. The meshes are spread over pool, or converted one at a time on this thread without one,
+	// each into its own payload so the result is in sceneMeshes' order either way. Nothing here touches GL or the
+	// Model, so it also runs on streaming workers.
+	static vector<shared_ptr<MeshPayload>> buildPayloads(const vector<aiMesh*> &sceneMeshes, const aiScene *scene, const ModelSettings &settings, ThreadPool *pool)
+	{
+		const TangentFrame frame = settings.frame;
+		const VertexEncoding *encoding = settings.quantize ? &settings.encoding : nullptr;
+		const bool optimize = settings.optimize;
+		const bool meshlets = settings.meshlets;
+		vector<shared_ptr<MeshPayload>> payloads(sceneMeshes.size());
+		vector<MeshOptimizationReport> reports(optimize ? sceneMeshes.size() : 0);
+		auto build = [&](size_t i)
+		{
+			aiMesh *mesh = sceneMeshes[i];
+			shared_ptr<MeshPayload> payload = make_shared<MeshPayload>();
+			readGeometry(mesh, payload->vertices, payload->indices);
+			if (optimize)
+				MeshOptimizer::optimize(payload->vertices, payload->indices, &reports[i]);
+			boundingSphere(payload->vertices, payload->boundsCenter, payload->boundsRadius);
+			buildLods(payload->vertices, payload->indices, settings.lods, optimize, pool, payload->lods);
+			if (meshlets)
+				buildMeshlets(payload->vertices, payload->indices, payload->lods, pool, payload->meshlets);
+			if (encoding)
+				payload->quantizedVertices = VertexQuantizer::quantize(payload->vertices, *encoding, frame);
+			else if (frame == TANGENT_FRAME_QTANGENT)
+				payload->compactVertices = compactVertices(payload->vertices);
+			else if (frame == TANGENT_FRAME_DERIVATIVES)
+				payload->tangentlessVertices = tangentlessVertices(payload->vertices);
+			if (encoding || frame != TANGENT_FRAME_VECTORS)
+			{
+				payload->vertices.clear();
+				payload->vertices.shrink_to_fit();
+			}
+			payload->textures = textureSlots(scene->mMaterials[mesh->mMaterialIndex], settings.packHeight);
+			payloads[i] = payload;
+		};
+		if (pool)
+			pool->parallelFor(sceneMeshes.size(), build);
+		else
+			for (size_t i = 0; i < sceneMeshes.size(); i++)
+				build(i);
+		// Reported afterwards, so the lines come out in order
+		for (size_t i = 0; i < sceneMeshes.size(); i++)
+		{
+			if (optimize)
+				reportOptimization(sceneMeshes[i], reports[i]);
+			if (!payloads[i]->lods.empty())
+				reportLods(sceneMeshes[i], payloads[i]->lods);
+			if (meshlets)
+				reportMeshlets(sceneMeshes[i], payloads[i]->meshlets);
+			if (encoding)
+				reportQuantization(sceneMeshes[i], payloads[i]->quantizedVertices);
+		}
+		return payloads;
+	}
+
+	// Adds lodCount - 1 coarser levels of detail after a mesh's indices, each aiming for half the triangles of the
+	// one before. Every level is simplified from the full mesh, so they're built side by side across pool (which is
+	// safe from inside one of its tasks). The chain ends early at a level the simplifier couldn't take under 90% of
+	// the one before. Each level's error is at least the one before's, so coarser levels never measure finer.
+	static void buildLods(const vector<Vertex> &vertices, vector<unsigned int> &indices, unsigned int lodCount, bool optimize, ThreadPool *pool, vector<MeshLod> &lods)
+	{
+		lods.clear();
+		if (lodCount < 2 || indices.empty())
+			return;
+		vector<vector<unsigned int>> levels(lodCount - 1);
+		vector<float> errors(levels.size());
+		auto simplify = [&](size_t level)
+		{
+			const size_t target = (indices.size() / 3 >> (level + 1)) * 3;
+			levels[level] = MeshSimplifier::simplify(vertices, indices, target, FLT_MAX, errors[level]);
+			if (optimize)
+				MeshOptimizer::optimizeVertexCache(levels[level], vertices.size());
+		};
+		if (pool)
+			pool->parallelFor(levels.size(), simplify);
+		else
+			for (size_t level = 0; level < levels.size(); level++)
+				simplify(level);
+
+		const MeshLod full = { 0, (unsigned int)indices.size(), 0.0f, 0, 0 };
+		lods.push_back(full);
+		for (size_t level = 0; level < levels.size(); level++)
+		{
+			if (levels[level].size() > lods.back().indexCount / 10 * 9)
+				break;
+			const MeshLod lod = { (unsigned int)indices.size(), (unsigned int)levels[level].size(), std::max(errors[level], lods.back().error), 0, 0 };
+			indices.insert(indices.end(), levels[level].begin(), levels[level].end());
+			lods.push_back(lod);
+		}
+		if (lods.size() == 1)
+			lods.clear();
+	}
+
+	// Splits each level of detail of a mesh, or without any its whole index buffer, into meshlets, reordering the
+	// triangles within each level, and notes in each level which meshlets are its. Each level's meshlets are built
+	// in pieces across pool.
+	static void buildMeshlets(const vector<Vertex> &vertices, vector<unsigned int> &indices, vector<MeshLod> &lods, ThreadPool *pool, vector<Meshlet> &meshlets)
+	{
+		meshlets.clear();
+		if (lods.empty())
+		{
+			meshlets = MeshletBuilder::build(vertices, indices, 0, indices.size(), pool);
+			return;
+		}
+		for (size_t l = 0; l < lods.size(); l++)
+		{
+			const vector<Meshlet> level = MeshletBuilder::build(vertices, indices, lods[l].firstIndex, lods[l].indexCount, pool);
+			lods[l].firstMeshlet = (unsigned int)meshlets.size();
+			lods[l].meshletCount = (unsigned int)level.size();
+			meshlets.insert(meshlets.end(), level.begin(), level.end());
+		}
+	}
+
+	// The center of a mesh's bounding box, and the distance from it to the furthest vertex
+	static void boundingSphere(const vector<Vertex> &vertices, glm::vec3 &center, float &radius)
+	{
+		center = glm::vec3(0.0f);
+		radius = 0.0f;
+		if (vertices.empty())
+			return;
+		glm::vec3 low = vertices[0].Position, high = low;
+		for (size_t i = 1; i < vertices.size(); i++)
+		{
+			low = glm::min(low, vertices[i].Position);
+			high = glm::max(high, vertices[i].Position);
+		}
+		center = (low + high) * 0.5f;
+		for (size_t i = 0; i < vertices.size(); i++)
+			radius = std::max(radius, glm::length(vertices[i].Position - center));
+	}
+
+	// Hash of the settings that change a cooked MeshCache file: what import does and the vertex format it builds
+	static uint64_t cacheHash(const ModelSettings &settings)
+	{
+		const bool quantize = settings.quantize;
+		const VertexEncoding &encoding = settings.encoding;
+		const uint64_t fields[] = { importFlags(settings.frame), (uint64_t)settings.packHeight, (uint64_t)settings.frame, (uint64_t)quantize, (uint64_t)(quantize && encoding.positions), (uint64_t)(quantize && encoding.texCoords), (uint64_t)settings.optimize, (uint64_t)std::max(settings.lods, 1u), (uint64_t)settings.meshlets };
+		const float tolerances[] = { quantize ? encoding.positionTolerance : 0.0f, quantize ? encoding.texCoordTolerance : 0.0f };
+		return BakedTexture::hash(tolerances, sizeof(tolerances), BakedTexture::hash(fields, sizeof(fields)));
+	}
+
 private:
-	// Loads a model using ASSIMP
+	// Path -> index into textures_loaded, so materials reusing a texture find it without a linear scan
+	unordered_map<string, unsigned int> textureIndex;
+	// Cleared when the Model is destroyed, so uploads still streaming in for it let go of what they made
+	shared_ptr<bool> alive = make_shared<bool>(true);
+
+	// Loads a model from its cooked MeshCache file, or using ASSIMP
 	void loadModel(string const &path)
 	{
+		// Retrieve the directory path of the filepath
+		directory = path.substr(0, path.find_last_of('/'));
+		const uint64_t settingsHash = cacheHash(settings);
+		if (settings.cache)
+		{
+			CachedModel cached;
+			if (MeshCache::load(path, settingsHash, cached))
+			{
+				loadCached(cached);
+				return;
+			}
+		}
+
 		// Use the ASSIMP importer to read the file data
 		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+		const aiScene* scene = importer.ReadFile(path, importFlags(settings.frame));
 		// Error check
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
 		{
 			cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
 			return;
 		}
-		// Retrieve the directory path of the filepath
-		directory = path.substr(0, path.find_last_of('/'));
+
+		// Decode every texture the materials use up front, in parallel, before the meshes are built
+		vector<TextureRequest> requests;
+		vector<Texture> pending;
+		collectTextures(scene, directory, gammaCorrection, settings.packHeight, requests, pending);
+		acquireTextures(requests, pending);
 
 		// Process ASSIMP's root node recursively
 		processNode(scene->mRootNode, scene);
+		if (settings.quantize)
+			reportQuantizedTotal();
+
+		// Cook what was built for the next load
+		if (settings.cache)
+		{
+			CachedModel cooked = cookTextures(directory, requests, pending);
+			for (unsigned int i = 0; i < meshes.size(); i++)
+				cooked.meshes.push_back(cookMesh(settings.frame, meshes[i]));
+			MeshCache::write(path, settingsHash, cooked);
+		}
 	}
 
-	// Function to process a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes if there are any present.
-	void processNode(aiNode *node, const aiScene *scene)
+	// Builds the meshes of a cooked file, uploading their data straight from the mapping
+	void loadCached(const CachedModel &cached)
 	{
-		// Process each mesh located at the current node
-		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+		vector<TextureRequest> requests;
+		vector<Texture> pending;
+		cachedTextures(cached, directory, gammaCorrection, requests, pending);
+		acquireTextures(requests, pending);
+		for (size_t i = 0; i < cached.meshes.size(); i++)
 		{
-			// Node object only contains indices to index the actual objects in the scene, while scene contains all the data.
-			// Node is primarily for organisation.
-			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-			//Adds the mess the vector
-			meshes.push_back(processMesh(mesh, scene));
+			const CachedMesh &mesh = cached.meshes[i];
+			unsigned int VAO, VBO, EBO;
+			if (mesh.streams.stride > 0)
+				Mesh::createBuffers(mesh.streams, mesh.vertexBytes, mesh.vertexData, mesh.indexCount, mesh.indexData, VAO, VBO, EBO);
+			else
+				Mesh::createBuffers(mesh.frame, mesh.vertexBytes, mesh.vertexData, mesh.indexCount, mesh.indexData, VAO, VBO, EBO);
+			vector<Texture> textures = mesh.textures;
+			for (unsigned int t = 0; t < textures.size(); t++)
+			{
+				auto loaded = textureIndex.find(textures[t].path);
+				if (loaded != textureIndex.end())
+					textures[t].id = textures_loaded[loaded->second].id;
+			}
+			meshes.push_back(Mesh(mesh.streams, mesh.indexCount, textures, VAO, VBO, EBO));
+			meshes.back().lods = mesh.lods;
+			meshes.back().meshlets = mesh.meshlets;
+			meshes.back().boundsCenter = mesh.boundsCenter;
+			meshes.back().boundsRadius = mesh.boundsRadius;
 		}
-		// After we've processed all meshes, we then recursively process each of the children nodes
-		for (unsigned int i = 0; i < node->mNumChildren; i++)
+	}
+
+	// The texture requests of a cooked file's materials, with the textures_loaded entry each will become
+	static void cachedTextures(const CachedModel &cached, const string &directory, bool gamma, vector<TextureRequest> &requests, vector<Texture> &textures)
+	{
+		for (size_t i = 0; i < cached.textures.size(); i++)
+		{
+			const CachedTexture &entry = cached.textures[i];
+			TextureRequest request;
+			request.settings = settingsForType(entry.type, gamma);
+			request.path = directory + '/' + entry.file;
+			if (!entry.heightFile.empty())
+				request.heightPath = directory + '/' + entry.heightFile;
+			requests.push_back(request);
+			Texture texture;
+			texture.id = 0;
+			texture.type = entry.type;
+			texture.path = entry.path;
+			textures.push_back(texture);
+		}
+	}
+
+	// A streamed mesh's payload, copied out of a cooked file in its own format
+	static shared_ptr<MeshPayload> cachedPayload(const CachedMesh &mesh)
+	{
+		shared_ptr<MeshPayload> payload = make_shared<MeshPayload>();
+		const unsigned char *data = (const unsigned char*)mesh.vertexData;
+		if (mesh.streams.stride > 0)
+		{
+			payload->quantizedVertices = mesh.streams;
+			payload->quantizedVertices.data.assign(data, data + mesh.vertexBytes);
+		}
+		else if (mesh.frame == TANGENT_FRAME_QTANGENT)
+		{
+			payload->compactVertices.resize(mesh.vertexBytes / sizeof(QTangentVertex));
+			memcpy(payload->compactVertices.data(), data, payload->compactVertices.size() * sizeof(QTangentVertex));
+		}
+		else if (mesh.frame == TANGENT_FRAME_DERIVATIVES)
+		{
+			payload->tangentlessVertices.resize(mesh.vertexBytes / sizeof(TangentlessVertex));
+			memcpy(payload->tangentlessVertices.data(), data, payload->tangentlessVertices.size() * sizeof(TangentlessVertex));
+		}
+		else
 		{
-			processNode(node->mChildren[i], scene);
+			payload->vertices.resize(mesh.vertexBytes / sizeof(Vertex));
+			memcpy(payload->vertices.data(), data, payload->vertices.size() * sizeof(Vertex));
 		}
+		payload->indices.assign(mesh.indexData, mesh.indexData + mesh.indexCount);
+		payload->lods = mesh.lods;
+		payload->meshlets = mesh.meshlets;
+		payload->boundsCenter = mesh.boundsCenter;
+		payload->boundsRadius = mesh.boundsRadius;
+		payload->textures = mesh.textures;
+		return payload;
+	}
+
+	// The texture entries of a cooked file, with their files relative to the model's directory
+	static CachedModel cookTextures(const string &directory, const vector<TextureRequest> &requests, const vector<Texture> &textures)
+	{
+		CachedModel cooked;
+		for (size_t i = 0; i < requests.size(); i++)
+		{
+			CachedTexture entry;
+			entry.type = textures[i].type;
+			entry.path = textures[i].path;
+			entry.file = requests[i].path.substr(directory.size() + 1);
+			if (!requests[i].heightPath.empty())
+				entry.heightFile = requests[i].heightPath.substr(directory.size() + 1);
+			cooked.textures.push_back(entry);
+		}
+		return cooked;
+	}
 
+	// A mesh entry of a cooked file for a Mesh or MeshPayload, pointing at its data, which the caller keeps alive
+	// until it's written
+	template <class Source>
+	static CachedMesh cookMesh(TangentFrame frame, const Source &source)
+	{
+		CachedMesh mesh;
+		mesh.frame = frame;
+		if (!source.quantizedVertices.empty())
+			mesh.streams = source.quantizedVertices.layout();
+		mesh.vertexData = source.vertexData();
+		mesh.vertexBytes = source.vertexBytes();
+		mesh.indexData = source.indices.data();
+		mesh.indexCount = source.indices.size();
+		mesh.lods = source.lods;
+		mesh.meshlets = source.meshlets;
+		mesh.boundsCenter = source.boundsCenter;
+		mesh.boundsRadius = source.boundsRadius;
+		for (size_t i = 0; i < source.textures.size(); i++)
+		{
+			Texture slot = source.textures[i];
+			slot.id = 0;
+			mesh.textures.push_back(slot);
+		}
+		return mesh;
+	}
+
+	// Function to process a node and its children. The meshes are listed in node order first; their vertices are
+	// converted across the thread pool, and the buffers are then created here, on the GL thread, in that order.
+	void processNode(aiNode *node, const aiScene *scene)
+	{
+		vector<aiMesh*> sceneMeshes;
+		listMeshes(node, scene, sceneMeshes);
+		vector<shared_ptr<MeshPayload>> payloads = buildPayloads(sceneMeshes, scene, settings, &ThreadPool::shared());
+		meshes.reserve(meshes.size() + payloads.size());
+		for (unsigned int i = 0; i < payloads.size(); i++)
+		{
+			//Adds the mesh to the vector
+			meshes.push_back(processMesh(sceneMeshes[i], scene, std::move(*payloads[i])));
+			payloads[i].reset();
+		}
 	}
-	//Function process the mesh
-	Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+	//Function process the mesh: its textures, and the buffers of the vertices buildPayloads converted
+	Mesh processMesh(aiMesh *mesh, const aiScene *scene, MeshPayload &&payload)
 	{
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
 		vector<Texture> textures;
+		// Process materials
+		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+
+		// We assume a convention for sampler names in the shaders. Each diffuse texture should be named
+		// as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
+		// Same applies to other texture as the following list summarizes:
+		// diffuse: texture_diffuseN
+		// specular: texture_specularN
+		// normal: texture_normalN
+		// normal with height in alpha (settings.packHeight): texture_normalHeightN
+
+		//Creates a new vector of textures using the passed through material, the texture type, and the type's name
+		//Diffuse
+		vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+		//Specular
+		vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+		if (packsHeight(material, settings.packHeight))
+		{
+			//Normal and height in one texture
+			textures.push_back(loadPackedTexture(material));
+		}
+		else
+		{
+			//Normal
+			std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+			textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+			// height
+			std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+			textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+		}
+
+		//Return a mesh object with all the data
+		return Mesh(std::move(payload), textures);
+	}
+
+	// Copies a mesh's vertices and the indices of its faces out of ASSIMP's data, into buffers sized for them up front
+	static void readGeometry(aiMesh *mesh, vector<Vertex> &vertices, vector<unsigned int> &indices)
+	{
+		vertices.resize(mesh->mNumVertices);
+		size_t indexCount = 0;
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+			indexCount += mesh->mFaces[i].mNumIndices;
+		indices.resize(indexCount);
 		// Iterate through each of the mesh's vertices
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 		{
-			Vertex vertex;
+			Vertex &vertex = vertices[i];
 			glm::vec3 vector;
 			//Position
 			vector.x = mesh->mVertices[i].x;
@@ -116,53 +660,267 @@ private:
 			}
 			else      //If no texture coordinates
 				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-			// Tangent
-			vector.x = mesh->mTangents[i].x;
-			vector.y = mesh->mTangents[i].y;
-			vector.z = mesh->mTangents[i].z;
-			vertex.Tangent = vector;
-			// Bitangent
-			vector.x = mesh->mBitangents[i].x;
-			vector.y = mesh->mBitangents[i].y;
-			vector.z = mesh->mBitangents[i].z;
-			vertex.Bitangent = vector;
-			//Push back the vertex onto the vertices vector
-			vertices.push_back(vertex);
+			// Tangent and bitangent, unless they weren't generated (or the mesh has no texture coordinates to
+			// generate them from)
+			if (mesh->mTangents && mesh->mBitangents)
+			{
+				vector.x = mesh->mTangents[i].x;
+				vector.y = mesh->mTangents[i].y;
+				vector.z = mesh->mTangents[i].z;
+				vertex.Tangent = vector;
+				vector.x = mesh->mBitangents[i].x;
+				vector.y = mesh->mBitangents[i].y;
+				vector.z = mesh->mBitangents[i].z;
+				vertex.Bitangent = vector;
+			}
+			else
+			{
+				vertex.Tangent = glm::vec3(0.0f);
+				vertex.Bitangent = glm::vec3(0.0f);
+			}
 		}
 		// Iterate through the mesh's faces to get the indicies
+		size_t index = 0;
 		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 		{
-			aiFace face = mesh->mFaces[i];
+			const aiFace &face = mesh->mFaces[i];
 			// Store all indicies in the vector
 			for (unsigned int j = 0; j < face.mNumIndices; j++)
-				indices.push_back(face.mIndices[j]);
+				indices[index++] = face.mIndices[j];
 		}
-		// Process materials
-		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+	}
 
-		// We assume a convention for sampler names in the shaders. Each diffuse texture should be named
-		// as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-		// Same applies to other texture as the following list summarizes:
-		// diffuse: texture_diffuseN
-		// specular: texture_specularN
-		// normal: texture_normalN
+	// Vertices in the compact format, their tangent frames packed into quaternions
+	static vector<QTangentVertex> compactVertices(const vector<Vertex> &vertices)
+	{
+		vector<QTangentVertex> compact;
+		compact.reserve(vertices.size());
+		for (unsigned int i = 0; i < vertices.size(); i++)
+			compact.push_back(QTangentVertex(vertices[i]));
+		return compact;
+	}
 
-		//Creates a new vector of textures using the passed through material, the texture type, and the type's name
-		//Diffuse
-		vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		//Specular
-		vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-		//Normal
-		std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-		// height
-		std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+	// Vertices for derivative tangent frames, with only their normals
+	static vector<TangentlessVertex> tangentlessVertices(const vector<Vertex> &vertices)
+	{
+		vector<TangentlessVertex> tangentless;
+		tangentless.reserve(vertices.size());
+		for (unsigned int i = 0; i < vertices.size(); i++)
+			tangentless.push_back(TangentlessVertex(vertices[i]));
+		return tangentless;
+	}
 
-		//Return a mesh object with all the data
-		return Mesh(vertices, indices, textures);
+	// Prints a quantized mesh's compression and the worst errors it came out with
+	static void reportQuantization(const aiMesh *mesh, const QuantizedVertices &streams)
+	{
+		cout << "Mesh " << mesh->mName.C_Str() << ": " << streams.count() << " vertices, " << streams.stride << " bytes each against "
+			<< sizeof(Vertex) << " (" << streams.ratio() << "x smaller), worst errors: position " << streams.positionError
+			<< ", texture coordinates " << streams.texCoordError << ", directions " << streams.directionError << " degrees";
+		if (!streams.encoding.positions)
+			cout << " (float positions)";
+		if (!streams.encoding.texCoords)
+			cout << " (float texture coordinates)";
+		cout << endl;
+	}
+
+	// Prints how MeshOptimizer changed a mesh: its post-transform cache use and overdraw, before and after
+	static void reportOptimization(const aiMesh *mesh, const MeshOptimizationReport &report)
+	{
+		cout << "Mesh " << mesh->mName.C_Str() << ": ACMR " << report.cacheBefore.acmr << " -> " << report.cacheAfter.acmr << ", ATVR "
+			<< report.cacheBefore.atvr << " -> " << report.cacheAfter.atvr << ", overdraw " << report.overdrawBefore << " -> " << report.overdrawAfter;
+		if (report.verticesAfter < report.verticesBefore)
+			cout << ", " << report.verticesBefore - report.verticesAfter << " unused vertices dropped";
+		cout << endl;
+	}
+
+	// Prints a mesh's levels of detail: the triangles each draws and its error
+	static void reportLods(const aiMesh *mesh, const vector<MeshLod> &lods)
+	{
+		cout << "Mesh " << mesh->mName.C_Str() << ": levels of detail";
+		for (size_t i = 0; i < lods.size(); i++)
+			cout << (i ? ", " : " ") << lods[i].indexCount / 3 << " triangles (error " << lods[i].error << ")";
+		cout << endl;
+	}
+
+	// Prints how many meshlets a mesh was split into, over all its levels of detail, and how full they are
+	static void reportMeshlets(const aiMesh *mesh, const vector<Meshlet> &meshlets)
+	{
+		size_t triangles = 0, vertices = 0;
+		for (size_t i = 0; i < meshlets.size(); i++)
+		{
+			triangles += meshlets[i].indexCount / 3;
+			vertices += meshlets[i].vertexCount;
+		}
+		const double count = meshlets.empty() ? 1.0 : (double)meshlets.size();
+		cout << "Mesh " << mesh->mName.C_Str() << ": " << meshlets.size() << " meshlets, " << triangles / count << " triangles and "
+			<< vertices / count << " vertices each on average" << endl;
+	}
+
+	// Prints the vertex memory of all the Model's quantized meshes against what they'd take as Vertex
+	void reportQuantizedTotal() const
+	{
+		size_t sourceBytes = 0, bytes = 0;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			sourceBytes += meshes[i].quantizedVertices.sourceBytes;
+			bytes += meshes[i].quantizedVertices.data.size();
+		}
+		cout << "Quantized vertices: " << bytes / 1024 << " KB against " << sourceBytes / 1024 << " KB ("
+			<< (bytes > 0 ? (double)sourceBytes / bytes : 1.0) << "x smaller)" << endl;
+	}
+
+	// The texture role of a sampler type name
+	static TextureRole roleForType(const string &typeName)
+	{
+		if (typeName == "texture_normal")
+			return TEXTURE_ROLE_NORMAL;
+		if (typeName == "texture_height")
+			return TEXTURE_ROLE_HEIGHT;
+		if (typeName == "texture_normalHeight")
+			return TEXTURE_ROLE_NORMAL_HEIGHT;
+		return TEXTURE_ROLE_COLOR;
+	}
+
+	// Texture settings for a sampler type name. Only colour maps are gamma encoded, so sRGB storage is never
+	// used for normal or height data. The role also picks the mip filter and the stored format, so a
+	// texture_height map is kept as R8/R16 and a texture_normal map as RG8/RG16.
+	static TextureSettings settingsForType(const string &typeName, bool gamma)
+	{
+		return TextureSettings::forRole(roleForType(typeName), gamma && typeName == "texture_diffuse");
+	}
+
+	// Loads the texture paths of every material as one batch, gathered by collectTextures or from a cooked file, so
+	// the images are decoded across the thread pool instead of one at a time as processMesh reaches each material.
+	void acquireTextures(const vector<TextureRequest> &requests, vector<Texture> &pending)
+	{
+		vector<unsigned int> ids = TextureCache::instance().acquireBatch(requests);
+		for (unsigned int i = 0; i < pending.size(); i++)
+		{
+			pending[i].id = ids[i];
+			textureIndex[pending[i].path] = textures_loaded.size();
+			textures_loaded.push_back(pending[i]);
+		}
+	}
+
+	// One request per distinct texture the scene's materials use, with the textures_loaded entry each will become
+	static void collectTextures(const aiScene *scene, const string &directory, bool gamma, bool pack, vector<TextureRequest> &requests, vector<Texture> &textures)
+	{
+		unordered_set<string> seen;
+		for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+		{
+			aiMaterial *material = scene->mMaterials[m];
+			vector<Texture> slots = textureSlots(material, pack);
+			for (unsigned int i = 0; i < slots.size(); i++)
+			{
+				if (!seen.insert(slots[i].path).second)
+					continue;
+				TextureRequest request;
+				request.settings = settingsForType(slots[i].type, gamma);
+				if (slots[i].type == "texture_normalHeight")
+				{
+					aiString normalPath, heightPath;
+					material->GetTexture(aiTextureType_HEIGHT, 0, &normalPath);
+					material->GetTexture(aiTextureType_AMBIENT, 0, &heightPath);
+					request.path = directory + '/' + normalPath.C_Str();
+					request.heightPath = directory + '/' + heightPath.C_Str();
+				}
+				else
+					request.path = directory + '/' + slots[i].path;
+				requests.push_back(request);
+				textures.push_back(slots[i]);
+			}
+		}
+	}
+
+	// The textures a material gives its meshes, in the order processMesh binds them, by type and textures_loaded path
+	static vector<Texture> textureSlots(aiMaterial *material, bool pack)
+	{
+		// The texture types processMesh asks for, and the names they're given
+		const aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+		const char *typeNames[] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+		const bool packed = packsHeight(material, pack);
+		vector<Texture> slots;
+		// Packed materials swap their separate normal and height maps for one texture
+		for (unsigned int t = 0; t < (packed ? 2u : 4u); t++)
+		{
+			for (unsigned int i = 0; i < material->GetTextureCount(types[t]); i++)
+			{
+				aiString str;
+				material->GetTexture(types[t], i, &str);
+				Texture texture;
+				texture.id = 0;
+				texture.type = typeNames[t];
+				texture.path = str.C_Str();
+				slots.push_back(texture);
+			}
+		}
+		if (packed)
+		{
+			aiString normalPath, heightPath;
+			material->GetTexture(aiTextureType_HEIGHT, 0, &normalPath);
+			material->GetTexture(aiTextureType_AMBIENT, 0, &heightPath);
+			Texture texture;
+			texture.id = 0;
+			texture.type = "texture_normalHeight";
+			texture.path = packedPath(normalPath, heightPath);
+			slots.push_back(texture);
+		}
+		return slots;
+	}
+
+	// The textures for a streamed mesh: the ones that have arrived, and placeholders for the rest
+	vector<Texture> texturesFor(const vector<Texture> &slots)
+	{
+		vector<Texture> textures = slots;
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			auto loaded = textureIndex.find(textures[i].path);
+			textures[i].id = loaded != textureIndex.end() ? textures_loaded[loaded->second].id : TextureCache::instance().placeholder(roleForType(textures[i].type));
+		}
+		return textures;
+	}
+
+	// Takes ownership of a streamed texture and swaps it in for the placeholder in every mesh using it
+	void textureArrived(Texture texture, unsigned int id)
+	{
+		texture.id = id;
+		textureIndex[texture.path] = textures_loaded.size();
+		textures_loaded.push_back(texture);
+		for (unsigned int m = 0; m < meshes.size(); m++)
+			for (unsigned int i = 0; i < meshes[m].textures.size(); i++)
+				if (meshes[m].textures[i].path == texture.path)
+					meshes[m].textures[i].id = id;
+	}
+
+	// Whether a material's normal and height maps are loaded as one packed texture
+	static bool packsHeight(aiMaterial *material, bool pack)
+	{
+		return pack && material->GetTextureCount(aiTextureType_HEIGHT) > 0 && material->GetTextureCount(aiTextureType_AMBIENT) > 0;
+	}
+
+	// The textures_loaded path of a packed texture, naming both of its files
+	static string packedPath(const aiString &normalPath, const aiString &heightPath)
+	{
+		return string(normalPath.C_Str()) + '+' + heightPath.C_Str();
+	}
+
+	// Loads a material's first normal and height maps as one texture_normalHeight texture
+	Texture loadPackedTexture(aiMaterial *mat)
+	{
+		aiString normalPath, heightPath;
+		mat->GetTexture(aiTextureType_HEIGHT, 0, &normalPath);
+		mat->GetTexture(aiTextureType_AMBIENT, 0, &heightPath);
+		const string path = packedPath(normalPath, heightPath);
+		auto loaded = textureIndex.find(path);
+		if (loaded != textureIndex.end())
+			return textures_loaded[loaded->second];
+		Texture texture;
+		texture.id = TextureCache::instance().acquirePacked(directory + '/' + normalPath.C_Str(), directory + '/' + heightPath.C_Str());
+		texture.type = "texture_normalHeight";
+		texture.path = path;
+		textureIndex[texture.path] = textures_loaded.size();
+		textures_loaded.push_back(texture);
+		return texture;
 	}
 
 	// Checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -175,27 +933,24 @@ private:
 			aiString str;
 			//Gets the texture and stores it as an aiString
 			mat->GetTexture(type, i, &str);
-			// Check if texture was loaded before and if so, continue to next iteration
-			bool skip = false;
-			//For all the loaded textures
-			for (unsigned int j = 0; j < textures_loaded.size(); j++)
+			// Check if texture was loaded before and if so, reuse it
+			auto loaded = textureIndex.find(str.C_Str());
+			if (loaded != textureIndex.end())
 			{
-				if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-				{
-					textures.push_back(textures_loaded[j]);
-					skip = true;
-					break;
-				}
+				Texture texture = textures_loaded[loaded->second];
+				texture.type = typeName;
+				textures.push_back(texture);
 			}
-			if (!skip)
-			{   // If the texture hasn't been loaded already, load it
+			else
+			{   // If this Model hasn't used the texture yet, take a reference from the shared cache
 				Texture texture;
 				//Get the texture from the file, and set it's various values
-				texture.id = TextureFromFile(str.C_Str(), this->directory);
+				texture.id = TextureCache::instance().acquire(directory + '/' + str.C_Str(), settingsForType(typeName, gammaCorrection));
 				texture.type = typeName;
 				texture.path = str.C_Str();
 				textures.push_back(texture);	//Push it back to the textures
-				textures_loaded.push_back(texture);  // Push it back to the loaded textures so we don't load it again
+				textureIndex[texture.path] = textures_loaded.size();
+				textures_loaded.push_back(texture);  // Push it back to the loaded textures so it's released with the Model
 			}
 		}
 		//Return the vector of textures
@@ -203,53 +958,15 @@ private:
 	}
 };
 
-//Explained in greater detail in main.cpp
+// Loads a texture relative to the model's directory through the shared texture cache
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
 {
 	string filename = string(path);
 	//Add the filename to the directory to get the full path
 	filename = directory + '/' + filename;
 
-	unsigned int textureID;
-	//Generates a single texture name in textureID
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	//Loads the file at the path, storing the dimensions and the colour components
-	unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		//Checks for the loaded texture's format
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		//Bind the texture to GL_TEXTURE_2D
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		//Specifies a texture 2D image with the target texture first, then the image level, the colour componenets, the width, height,
-		//the border width, the pixel data format, the data type of pixel data, and then the image data itself
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		//Creates a mipmap for the GL_TEXTURE_2D texture
-		glGenerateMipmap(GL_TEXTURE_2D);
-		//Sets the parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		//Frees the laoded image
-		stbi_image_free(data);
-	}
-	//Error check
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-	//Returns the texture's ID
-	return textureID;
+	TextureSettings settings;
+	settings.gamma = gamma;
+	return TextureCache::instance().acquire(filename, settings);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,153 @@
+#ifndef PARALLAX_VARIANT_H
+#define PARALLAX_VARIANT_H
+
+#include "ShaderVariants.h"
+#include "Vertex.h"
+
+#include <cstdint>
+#include <vector>
+
+// How frag.fs offsets texture coordinates by the height map
+enum ParallaxMode {
+	PARALLAX_NONE,
+	// One height sample, offsetting along the view direction
+	PARALLAX_OFFSET,
+	// Marching the view ray through depth layers until it's below the surface
+	PARALLAX_STEEP,
+	// Steep parallax, then interpolating linearly between the layers either side of the surface (POM)
+	PARALLAX_OCCLUSION,
+	// Steep parallax, then a binary search between the layers either side of the surface
+	PARALLAX_RELIEF,
+	// Sphere tracing with a relaxed cone step map, then a binary search (needs the coneMap texture)
+	PARALLAX_CONE,
+	// Hierarchical empty space skipping down a min depth pyramid, then a binary search (needs heightPyramid)
+	PARALLAX_PYRAMID
+};
+
+// The features of the parallax shader (shaders/vert.vs and shaders/frag.fs) and their variant key. The key
+// layout is: the mode in bits 0-2, the step count in bits 3-4, shadowing in bit 5, height packing in bit 6,
+// tessellation in bit 7, the QTangent vertex format in bit 8, quantized vertex streams in bit 9 and derivative
+// tangent frames in bit 10. Tessellated variants are built from different stages (see stages()), so they go in a
+// ShaderVariants table of their own.
+struct ParallaxVariant {
+	// Where each feature sits in the key, and how many bits it takes
+	enum {
+		ModeShift = 0, ModeBits = 3,
+		StepsShift = 3, StepsBits = 2,
+		ShadowsShift = 5,
+		PackedHeightShift = 6,
+		TessellatedShift = 7,
+		QTangentsShift = 8,
+		QuantizedShift = 9,
+		DerivativeFrameShift = 10
+	};
+
+	ParallaxMode mode = PARALLAX_OFFSET;
+	// Most depth layers the searches take, at grazing angles: 8, 16, 32 or 64. Views closer to head on take
+	// fewer, down to the minLayers uniform.
+	int steps = 16;
+	// Shade the surface with the shadows its own height field casts
+	bool shadows = false;
+	// The height map is in the alpha of the normal map (TEXTURE_ROLE_NORMAL_HEIGHT) rather than its own texture
+	bool packedHeight = false;
+	// Displace the surface for real with the tessellation stages, near the camera, leaving the rest of the depth
+	// to the parallax mode (needs GLExtensions::tessellation)
+	bool tessellated = false;
+	// The meshes are in the compact QTangentVertex format, their tangent frames rebuilt from a quaternion
+	bool qtangents = false;
+	// The meshes are in quantized streams (QuantizedVertices): positions relative to each mesh's bounds, set with
+	// the positionOffset and positionScale uniforms, and octahedral directions unless qtangents is set too
+	bool quantized = false;
+	// The meshes have no tangents (TangentlessVertex), and frag.fs rebuilds the tangent frame from screen space
+	// derivatives. Takes the place of qtangents, which should be left unset.
+	bool derivativeFrame = false;
+
+	uint32_t key() const
+	{
+		uint32_t stepIndex = 0;
+		while (stepIndex < 3 && stepCounts()[stepIndex] < steps)
+			stepIndex++;
+		return (uint32_t)mode << ModeShift | stepIndex << StepsShift | (shadows ? 1u : 0u) << ShadowsShift | (packedHeight ? 1u : 0u) << PackedHeightShift
+			| (tessellated ? 1u : 0u) << TessellatedShift | (qtangents ? 1u : 0u) << QTangentsShift | (quantized ? 1u : 0u) << QuantizedShift
+			| (derivativeFrame ? 1u : 0u) << DerivativeFrameShift;
+	}
+
+	// The variant a key was made from, so whatever draws with a variant's program can set up to match it
+	static ParallaxVariant fromKey(uint32_t key)
+	{
+		ParallaxVariant variant;
+		variant.mode = (ParallaxMode)(key >> ModeShift & ((1u << ModeBits) - 1));
+		variant.steps = stepCounts()[key >> StepsShift & ((1u << StepsBits) - 1)];
+		variant.shadows = (key >> ShadowsShift & 1u) != 0;
+		variant.packedHeight = (key >> PackedHeightShift & 1u) != 0;
+		variant.tessellated = (key >> TessellatedShift & 1u) != 0;
+		variant.qtangents = (key >> QTangentsShift & 1u) != 0;
+		variant.quantized = (key >> QuantizedShift & 1u) != 0;
+		variant.derivativeFrame = (key >> DerivativeFrameShift & 1u) != 0;
+		return variant;
+	}
+
+	// How the variant's meshes hold their tangent frames
+	TangentFrame tangentFrame() const
+	{
+		if (derivativeFrame)
+			return TANGENT_FRAME_DERIVATIVES;
+		return qtangents ? TANGENT_FRAME_QTANGENT : TANGENT_FRAME_VECTORS;
+	}
+
+	// The shader files of plain or tessellated variants
+	static ShaderStagePaths stages(bool tessellated)
+	{
+		ShaderStagePaths paths;
+		paths.fragment = "shaders/frag.fs";
+		if (tessellated)
+		{
+			paths.vertex = "shaders/tess.vs";
+			paths.tessControl = "shaders/tess.tcs";
+			paths.tessEvaluation = "shaders/tess.tes";
+		}
+		else
+			paths.vertex = "shaders/vert.vs";
+		return paths;
+	}
+
+	// The step counts the steps field selects between
+	static const std::vector<int>& stepCounts()
+	{
+		static const std::vector<int> counts = { 8, 16, 32, 64 };
+		return counts;
+	}
+
+	// The #defines the stages read, in the key layout above
+	static std::vector<ShaderFeature> features()
+	{
+		std::vector<ShaderFeature> list(8);
+		list[0].define = "PARALLAX_MODE";
+		list[0].shift = ModeShift;
+		list[0].bits = ModeBits;
+		list[1].define = "PARALLAX_STEPS";
+		list[1].shift = StepsShift;
+		list[1].bits = StepsBits;
+		list[1].values = stepCounts();
+		list[2].define = "PARALLAX_SHADOWS";
+		list[2].shift = ShadowsShift;
+		list[2].bits = 1;
+		list[3].define = "PACKED_HEIGHT";
+		list[3].shift = PackedHeightShift;
+		list[3].bits = 1;
+		list[4].define = "TESSELLATION";
+		list[4].shift = TessellatedShift;
+		list[4].bits = 1;
+		list[5].define = "QTANGENT";
+		list[5].shift = QTangentsShift;
+		list[5].bits = 1;
+		list[6].define = "QUANTIZED";
+		list[6].shift = QuantizedShift;
+		list[6].bits = 1;
+		list[7].define = "DERIVATIVE_FRAME";
+		list[7].shift = DerivativeFrameShift;
+		list[7].bits = 1;
+		return list;
+	}
+};
+#endif
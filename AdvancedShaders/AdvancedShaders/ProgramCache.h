@@ -0,0 +1,189 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include "BakedTexture.h"
+#include "GLExtensions.h"
+#include "MappedFile.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Header at the start of a cached program binary, followed by the binary itself
+struct ProgramBinaryHeader {
+	char magic[4];
+	uint32_t version;
+	// The cache key the binary was saved under, checked again on load in case two keys share a file name
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+};
+
+// How often programs were loaded from the cache, compiled because there was no binary, or compiled because the
+// driver rejected the binary it was given. Atomic, as load() runs on the ShaderCompiler thread and the render thread.
+struct ProgramCacheStats {
+	std::atomic<size_t> hits{ 0 };
+	std::atomic<size_t> misses{ 0 };
+	std::atomic<size_t> rejected{ 0 };
+};
+
+// Saves linked shader programs to disk with glGetProgramBinary and loads them back with glProgramBinary on later
+// runs, so a program is only compiled from source the first time. The key hashes every stage's source, which
+// includes any #defines, along with the driver's vendor, renderer and version strings, as binaries only work on
+// the driver that made them. A binary the driver rejects anyway, after a driver update that kept its version
+// string for example, is deleted and the program compiled from source as if there were no binary.
+class ProgramCache
+{
+public:
+	// Bump whenever the file layout changes, so old files are ignored
+	static const uint32_t Version = 1;
+
+	// Whether programs are saved and loaded at all. Turned off, every program is compiled from source.
+	static bool& enabled()
+	{
+		static bool on = true;
+		return on;
+	}
+
+	static ProgramCacheStats& stats()
+	{
+		static ProgramCacheStats counts;
+		return counts;
+	}
+
+	// The key for a program built from the given stage sources on the current context's driver
+	static uint64_t key(const std::vector<std::string> &sources)
+	{
+		const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+		const uint32_t version = Version;
+		uint64_t result = BakedTexture::hash(&version, sizeof(version));
+		for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++)
+		{
+			const char *text = (const char*)glGetString(strings[i]);
+			if (text)
+				result = BakedTexture::hash(text, std::strlen(text) + 1, result);
+		}
+		// Each source is hashed with its length, so text can't move from one stage to the next without changing the key
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			const uint64_t length = sources[i].size();
+			result = BakedTexture::hash(&length, sizeof(length), result);
+			result = BakedTexture::hash(sources[i].data(), sources[i].size(), result);
+		}
+		return result;
+	}
+
+	// The cached binary for a program, stored beside one of its source files
+	static std::string cachePath(const std::string &source, uint64_t key)
+	{
+		std::ostringstream name;
+		name << source << '.' << std::hex << key << ".program";
+		return name.str();
+	}
+
+	// Whether programs can be cached on this context
+	static bool available()
+	{
+		return enabled() && GLExtensions::get().programBinaries;
+	}
+
+	// Loads the cached binary for key into program. Returns false if there's no binary, or the driver rejected it,
+	// in which case the program must be built from source.
+	static bool load(const std::string &source, uint64_t key, GLuint program)
+	{
+		if (!available())
+			return false;
+		const std::string path = cachePath(source, key);
+		MappedFile file;
+		if (!file.open(path) || file.size() < sizeof(ProgramBinaryHeader))
+		{
+			stats().misses++;
+			return false;
+		}
+		ProgramBinaryHeader header;
+		std::memcpy(&header, file.data(), sizeof(header));
+		if (std::memcmp(header.magic, "PBIN", 4) != 0 || header.version != Version || header.key != key || sizeof(header) + (size_t)header.length > file.size())
+		{
+			stats().misses++;
+			return false;
+		}
+		GLExtensions::get().programBinary(program, header.format, file.data() + sizeof(header), (GLsizei)header.length);
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked)
+		{
+			file.close();
+			std::remove(path.c_str());
+			stats().rejected++;
+			return false;
+		}
+		stats().hits++;
+		return true;
+	}
+
+	// Asks GL to keep the binary of a program that is about to be linked, so save() can read it back
+	static void prepare(GLuint program)
+	{
+		if (available())
+			GLExtensions::get().programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// Saves the binary of a linked program under key. The file is written under a temporary name and renamed into
+	// place, like baked textures, so another instance never loads half a binary.
+	static bool save(const std::string &source, uint64_t key, GLuint program)
+	{
+		if (!available())
+			return false;
+		GLint linked = GL_FALSE, length = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (!linked || length <= 0)
+			return false;
+		std::vector<char> binary((size_t)length);
+		GLenum format = 0;
+		GLsizei written = 0;
+		GLExtensions::get().getProgramBinary(program, length, &written, &format, binary.data());
+		if (written <= 0)
+			return false;
+
+		ProgramBinaryHeader header;
+		std::memcpy(header.magic, "PBIN", 4);
+		header.version = Version;
+		header.key = key;
+		header.format = format;
+		header.length = (uint32_t)written;
+		const std::string target = cachePath(source, key);
+		std::ostringstream tempName;
+		tempName << target << '.' << std::this_thread::get_id() << ".tmp";
+		const std::string temp = tempName.str();
+		{
+			std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+			if (!out)
+				return false;
+			out.write((const char*)&header, sizeof(header));
+			out.write(binary.data(), written);
+			if (!out)
+			{
+				out.close();
+				std::remove(temp.c_str());
+				return false;
+			}
+		}
+		std::remove(target.c_str());
+		if (std::rename(temp.c_str(), target.c_str()) != 0)
+		{
+			std::remove(temp.c_str());
+			return false;
+		}
+		return true;
+	}
+};
+#endif
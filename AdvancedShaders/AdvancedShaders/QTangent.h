@@ -0,0 +1,79 @@
+#ifndef QTANGENT_H
+#define QTANGENT_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Packs a tangent frame (tangent, bitangent and normal) into one unit quaternion of four 16-bit snorm values, the
+// QTangent format from Frey and Herzeg's "Spherical Skinning with Dual Quaternions and QTangents" (Crytek,
+// SIGGRAPH 2011). The frame is made orthonormal first; the quaternion is its rotation, and a mirrored frame
+// (bitangent pointing the other way, as mirrored UVs give) is stored as the negated quaternion, which is the
+// same rotation with w below zero. w is kept at least one snorm step from zero, so the sign survives even
+// when the rotation's own w is zero. shaders/qtangent.glsl decodes it again.
+class QTangent
+{
+public:
+	// The smallest |w| stored: one step of a 16-bit snorm value
+	static constexpr float bias = 1.0f / 32767.0f;
+
+	static glm::i16vec4 encode(const glm::vec3 &tangent, const glm::vec3 &bitangent, const glm::vec3 &normal)
+	{
+		const glm::vec3 n = safeNormalize(normal, glm::vec3(0.0f, 0.0f, 1.0f));
+		// Gram-Schmidt, falling back to any vector perpendicular to the normal for degenerate tangents
+		glm::vec3 t = tangent - n * glm::dot(n, tangent);
+		t = safeNormalize(t, perpendicular(n));
+		const glm::vec3 b = glm::cross(n, t);
+		const float handedness = glm::dot(b, bitangent) < 0.0f ? -1.0f : 1.0f;
+
+		glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, b, n)));
+		if (q.w < 0.0f)
+			q = -q;
+		if (q.w < bias)
+		{
+			// Moves w up to the bias, shrinking xyz to keep the quaternion unit length
+			const float scale = std::sqrt(1.0f - bias * bias) / std::max(std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z), 1e-20f);
+			q = glm::quat(bias, q.x * scale, q.y * scale, q.z * scale);
+		}
+		if (handedness < 0.0f)
+			q = -q;
+		return glm::i16vec4(snorm(q.x), snorm(q.y), snorm(q.z), snorm(q.w));
+	}
+
+	// The frame back from a packed quaternion, as the vertex shader rebuilds it
+	static void decode(const glm::i16vec4 &packed, glm::vec3 &tangent, glm::vec3 &bitangent, glm::vec3 &normal)
+	{
+		const glm::vec4 q = glm::normalize(glm::vec4(unsnorm(packed.x), unsnorm(packed.y), unsnorm(packed.z), unsnorm(packed.w)));
+		tangent = glm::vec3(1.0f - 2.0f * (q.y * q.y + q.z * q.z), 2.0f * (q.x * q.y + q.w * q.z), 2.0f * (q.x * q.z - q.w * q.y));
+		normal = glm::vec3(2.0f * (q.x * q.z + q.w * q.y), 2.0f * (q.y * q.z - q.w * q.x), 1.0f - 2.0f * (q.x * q.x + q.y * q.y));
+		bitangent = glm::cross(normal, tangent) * (q.w < 0.0f ? -1.0f : 1.0f);
+	}
+
+private:
+	static int16_t snorm(float value)
+	{
+		return (int16_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+	}
+
+	// GL's snorm conversion: -32768 and -32767 both give -1
+	static float unsnorm(int16_t value)
+	{
+		return std::max(value / 32767.0f, -1.0f);
+	}
+
+	static glm::vec3 safeNormalize(const glm::vec3 &v, const glm::vec3 &fallback)
+	{
+		const float length = glm::length(v);
+		return length > 1e-12f ? v / length : fallback;
+	}
+
+	static glm::vec3 perpendicular(const glm::vec3 &n)
+	{
+		return glm::normalize(std::abs(n.x) < 0.9f ? glm::cross(n, glm::vec3(1.0f, 0.0f, 0.0f)) : glm::cross(n, glm::vec3(0.0f, 1.0f, 0.0f)));
+	}
+};
+#endif
@@ -4,170 +4,363 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "GLExtensions.h"
+#include "ProgramCache.h"
+#include "ShaderSource.h"
+
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+
+// FNV-1a hash of a uniform name. It's constexpr, so names written in the code can be hashed by the compiler.
+constexpr uint32_t uniformHash(const char *text, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)text[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// The length of the text in a char array: up to its first NUL, or all of it if it has none
+constexpr size_t uniformNameLength(const char *text, size_t size)
+{
+	size_t length = 0;
+	while (length < size && text[length] != '\0')
+		length++;
+	return length;
+}
+
+// A uniform name as its hash. String literals are hashed at compile time, and strings built at run time when
+// they're converted, so looking a uniform up never hands a string to the driver. Char arrays filled at run time
+// are hashed up to their first NUL, like literals. The text is kept for the call it's passed to, for names whose
+// hash collides with another uniform's.
+struct UniformName {
+	uint32_t hash;
+	const char *text;
+	size_t length;
+
+	template<size_t N>
+	constexpr UniformName(const char (&literal)[N]) : hash(uniformHash(literal, uniformNameLength(literal, N))), text(literal), length(uniformNameLength(literal, N))
+	{
+	}
+	UniformName(const std::string &name) : hash(uniformHash(name.c_str(), name.size())), text(name.c_str()), length(name.size())
+	{
+	}
+};
+
+// A uniform's location, looked up once so setting it is a single glUniform call. Uniforms the program doesn't
+// use have location -1, which GL ignores.
+struct UniformHandle {
+	GLint location = -1;
+};
+
+// The files of each stage of a program. Stages left empty aren't part of it; the vertex and fragment stages are
+// always needed, and the tessellation stages come as a pair.
+struct ShaderStagePaths {
+	std::string vertex;
+	std::string tessControl;
+	std::string tessEvaluation;
+	std::string geometry;
+	std::string fragment;
+};
 
 class Shader
 {
 public:
 	unsigned int ID;
-	// Constructor for the shader with the vertex and fragment shader paths
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	// A shader with no program yet, for begin() to build later
+	Shader() : ID(0)
+	{
+	}
+	// Constructor for the shader with the vertex and fragment shader paths. Each file's #include lines are expanded,
+	// and defines, a block of #define lines, is inserted after each stage's #version line (see ShaderSource.h)
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string &defines = std::string())
+	{
+		begin(vertexPath, fragmentPath, geometryPath, defines);
+		finish();
+	}
+	// Constructor for a shader with any set of stages, such as one with tessellation
+	Shader(const ShaderStagePaths &paths, const std::string &defines = std::string())
 	{
-		
-		std::string vertexCode;
-		std::string fragmentCode;
+		begin(paths, defines);
+		finish();
+	}
+
+	//Building is split in two, so the compiler can work on several programs at once (see ShaderCompiler.h).
+	//begin() hands the stages to the driver without asking how they went, which is what makes GL wait for the
+	//compiler, and finish() checks the results once the driver is done.
+	void begin(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string &defines = std::string())
+	{
+		ShaderStagePaths paths;
+		paths.vertex = vertexPath;
+		paths.fragment = fragmentPath;
+		if (geometryPath != nullptr)
+			paths.geometry = geometryPath;
+		begin(paths, defines);
+	}
+	void begin(const ShaderStagePaths &paths, const std::string &defines = std::string())
+	{
+		//Read the shaders, printing an error for any file that can't be read
+		std::string vertexCode = ShaderSource::load(paths.vertex, defines);
+		std::string fragmentCode = ShaderSource::load(paths.fragment, defines);
 		std::string geometryCode;
-		std::ifstream vFile;
-		std::ifstream fFile;
-		std::ifstream gFile;
-		// Ensures ifstream objects can throw exceptions
-		vFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		gFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
-		{
-			//Open the shaders
-			vFile.open(vertexPath);
-			fFile.open(fragmentPath);
-			std::stringstream vStream, fStream;
-			// Store data in the read buffers in the stringstreams
-			vStream << vFile.rdbuf();
-			fStream << fFile.rdbuf();
-			//Close the files
-			vFile.close();
-			fFile.close();
-			// Convert the data in the stringstream to strings
-			vertexCode = vStream.str();
-			fragmentCode = fStream.str();
-			// If geometry shader path is present, also load the geometry shader
-			if (geometryPath != nullptr)
-			{
-				gFile.open(geometryPath);
-				std::stringstream gStream;
-				gStream << gFile.rdbuf();
-				gFile.close();
-				geometryCode = gStream.str();
-			}
-		}
-		//Error catch
-		catch (std::ifstream::failure e)
+		// If geometry shader path is present, also load the geometry shader
+		if (!paths.geometry.empty())
+			geometryCode = ShaderSource::load(paths.geometry, defines);
+		// Create a shader program
+		ID = glCreateProgram();
+		//A program linked on an earlier run is loaded from the program cache, which skips compiling and linking entirely.
+		//The tessellation stages only join the key when there are any, so the keys of other programs are unchanged.
+		std::vector<std::string> sources = { vertexCode, fragmentCode, geometryCode };
+		const bool tessellated = !paths.tessControl.empty() && !paths.tessEvaluation.empty();
+		if (tessellated)
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			sources.push_back(ShaderSource::load(paths.tessControl, defines));
+			sources.push_back(ShaderSource::load(paths.tessEvaluation, defines));
 		}
-		//Convert the strings to a char pointer
-		const char* vCode = vertexCode.c_str();
-		const char * fCode = fragmentCode.c_str();
-
-		unsigned int vertex, fragment;
-		//Create a shader of type GL_VERTEX_SHADER
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		//Set the shaders source: the first param is the shader itself, the second is the number of elements, the third the array of pointers,
-		//and the final param is if an array of string lengths, which if null each string is assumed to be null terminated
-		glShaderSource(vertex, 1, &vCode, NULL);
-		//Compile the specified shader
-		glCompileShader(vertex);
-		//Function to check for shader compilation erros
-		checkCompileErrors(vertex, "VERTEX");
-		//Create a shader of type GL_FRAGMENT_SHADER, and follow the above steps for the fragment code
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// If geometry shader is given, compile geometry shader
-		unsigned int geometry;
-		if (geometryPath != nullptr)
+		cacheKey = ProgramCache::key(sources);
+		cacheSource = paths.vertex;
+		if (ProgramCache::load(cacheSource, cacheKey, ID))
+			return;
+
+		//Create a shader of type GL_VERTEX_SHADER, one of type GL_FRAGMENT_SHADER and, if given, one of type
+		//GL_GEOMETRY_SHADER and the two tessellation stages, and start compiling each
+		addStage(GL_VERTEX_SHADER, "VERTEX", vertexCode);
+		addStage(GL_FRAGMENT_SHADER, "FRAGMENT", fragmentCode);
+		if (!paths.geometry.empty())
+			addStage(GL_GEOMETRY_SHADER, "GEOMETRY", geometryCode);
+		if (tessellated)
 		{
-			const char * gShaderCode = geometryCode.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, NULL);
-			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
+			addStage(GL_TESS_CONTROL_SHADER, "TESS_CONTROL", sources[3]);
+			addStage(GL_TESS_EVALUATION_SHADER, "TESS_EVALUATION", sources[4]);
 		}
-		// Create a shader program
-		ID = glCreateProgram();
-		//Attach the two above shaders to the specified program
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		//If there is a geometry shader, also attach that
-		if (geometryPath != nullptr)
-		glAttachShader(ID, geometry);
+		//Attach the shaders to the specified program
+		for (size_t i = 0; i < stages.size(); i++)
+			glAttachShader(ID, stages[i]);
 		//Links the program object. Any shader objects attached are then created as executables to run on their respective processors.
-		glLinkProgram(ID);		//
-		checkCompileErrors(ID, "PROGRAM");
-		//Delete the shaders now they've been linked to the program
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
-			glDeleteShader(geometry);
+		//The driver is asked to keep the linked binary, which is then saved for the next run.
+		ProgramCache::prepare(ID);
+		glLinkProgram(ID);
+	}
 
+	//Whether the driver has finished compiling and linking, without waiting for it. Drivers that can't say
+	//(no KHR_parallel_shader_compile) always report true, and finish() waits for them instead.
+	bool completed() const
+	{
+		if (stages.empty() || !GLExtensions::get().parallelShaderCompile)
+			return true;
+		GLint done = GL_FALSE;
+		glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+		return done == GL_TRUE;
+	}
+
+	//Finishes what begin() started: checks for errors, saves the binary and looks up the uniforms
+	void finish()
+	{
+		if (!stages.empty())
+		{
+			//Function to check for shader compilation erros
+			for (size_t i = 0; i < stages.size(); i++)
+				checkCompileErrors(stages[i], stageNames[i]);
+			checkCompileErrors(ID, "PROGRAM");
+			ProgramCache::save(cacheSource, cacheKey, ID);
+			//Delete the shaders now they've been linked to the program
+			for (size_t i = 0; i < stages.size(); i++)
+				glDeleteShader(stages[i]);
+			stages.clear();
+			stageNames.clear();
+		}
+		//Looks up every active uniform once, so setting one never asks the driver for its location
+		reflectUniforms();
 	}
 	//Function active the shader
 	void use()
 	{
 		glUseProgram(ID);
 	}
-	//Functions to set uniforms in the shader
-	void setBool(const std::string &name, bool value) const
+	//Returns the handle of a uniform, for uniforms set often enough that even the hashed lookup is worth skipping
+	UniformHandle uniform(UniformName name) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		UniformHandle handle;
+		handle.location = location(name);
+		return handle;
 	}
 
-	void setInt(const std::string &name, int value) const
+	//The location of a uniform from the table built after linking, or -1 if the program has no such uniform.
+	//Names sharing a hash with another of the program's uniforms are looked up by name instead.
+	GLint location(UniformName name) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		auto found = locations.find(name.hash);
+		if (found == locations.end())
+			return -1;
+		if (found->second == CollidingLocation)
+			return glGetUniformLocation(ID, std::string(name.text, name.length).c_str());
+		return found->second;
 	}
 
-	void setFloat(const std::string &name, float value) const
+	//Functions to set uniforms in the shader, by name or by handle
+	void setBool(UniformName name, bool value) const
+	{
+		glUniform1i(location(name), (int)value);
+	}
+	void setBool(UniformHandle uniform, bool value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(uniform.location, (int)value);
 	}
 
-	void setVec2(const std::string &name, const glm::vec2 &value) const
+	void setInt(UniformName name, int value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform1i(location(name), value);
 	}
-	void setVec2(const std::string &name, float x, float y) const
+	void setInt(UniformHandle uniform, int value) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		glUniform1i(uniform.location, value);
 	}
 
-	void setVec3(const std::string &name, const glm::vec3 &value) const
+	void setFloat(UniformName name, float value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform1f(location(name), value);
 	}
-	void setVec3(const std::string &name, float x, float y, float z) const
+	void setFloat(UniformHandle uniform, float value) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		glUniform1f(uniform.location, value);
 	}
 
-	void setVec4(const std::string &name, const glm::vec4 &value) const
+	void setVec2(UniformName name, const glm::vec2 &value) const
+	{
+		glUniform2fv(location(name), 1, &value[0]);
+	}
+	void setVec2(UniformHandle uniform, const glm::vec2 &value) const
+	{
+		glUniform2fv(uniform.location, 1, &value[0]);
+	}
+	void setVec2(UniformName name, float x, float y) const
+	{
+		glUniform2f(location(name), x, y);
+	}
+
+	void setVec3(UniformName name, const glm::vec3 &value) const
+	{
+		glUniform3fv(location(name), 1, &value[0]);
+	}
+	void setVec3(UniformHandle uniform, const glm::vec3 &value) const
+	{
+		glUniform3fv(uniform.location, 1, &value[0]);
+	}
+	void setVec3(UniformName name, float x, float y, float z) const
+	{
+		glUniform3f(location(name), x, y, z);
+	}
+
+	void setVec4(UniformName name, const glm::vec4 &value) const
+	{
+		glUniform4fv(location(name), 1, &value[0]);
+	}
+	void setVec4(UniformHandle uniform, const glm::vec4 &value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform4fv(uniform.location, 1, &value[0]);
 	}
-	void setVec4(const std::string &name, float x, float y, float z, float w)
+	void setVec4(UniformName name, float x, float y, float z, float w)
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		glUniform4f(location(name), x, y, z, w);
 	}
 
-	void setMat2(const std::string &name, const glm::mat2 &mat) const
+	void setMat2(UniformName name, const glm::mat2 &mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 
-	void setMat3(const std::string &name, const glm::mat3 &mat) const
+	void setMat3(UniformName name, const glm::mat3 &mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 
-	void setMat4(const std::string &name, const glm::mat4 &mat) const
+	void setMat4(UniformName name, const glm::mat4 &mat) const
+	{
+		glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
+	}
+	void setMat4(UniformHandle uniform, const glm::mat4 &mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
 	}
 
 private:
+	// Stands in the location table for a hash two of the program's uniforms share
+	static const GLint CollidingLocation = -2;
+
+	// Uniform name hash -> location, for every active uniform and every element of uniform arrays
+	std::unordered_map<uint32_t, GLint> locations;
+	// The stages begin() is compiling, and what finish() saves the program under
+	std::vector<GLuint> stages;
+	std::vector<const char*> stageNames;
+	uint64_t cacheKey = 0;
+	std::string cacheSource;
+
+	//Creates a shader of the given type and starts compiling the code. The first param of glShaderSource is the
+	//shader itself, the second is the number of elements, the third the array of pointers, and the final param is
+	//an array of string lengths, which if null each string is assumed to be null terminated
+	static GLuint compile(GLenum type, const std::string &code)
+	{
+		const GLuint shader = glCreateShader(type);
+		const char *text = code.c_str();
+		glShaderSource(shader, 1, &text, NULL);
+		glCompileShader(shader);
+		return shader;
+	}
+
+	void addStage(GLenum type, const char *name, const std::string &code)
+	{
+		stages.push_back(compile(type, code));
+		stageNames.push_back(name);
+	}
+
+	// Fills the location table from the linked program's active uniforms. Arrays are listed once, as "name[0]",
+	// so each element is added along with the bare array name.
+	void reflectUniforms()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<GLchar> buffer(maxLength + 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type;
+			glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+			std::string name(buffer.data(), length);
+			const GLint first = glGetUniformLocation(ID, name.c_str());
+			//Uniforms in blocks have no location of their own
+			if (first < 0)
+				continue;
+			addLocation(name, first);
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			{
+				const std::string array = name.substr(0, name.size() - 3);
+				addLocation(array, first);
+				for (GLint element = 1; element < size; element++)
+				{
+					const std::string elementName = array + '[' + std::to_string(element) + ']';
+					addLocation(elementName, glGetUniformLocation(ID, elementName.c_str()));
+				}
+			}
+		}
+	}
+
+	void addLocation(const std::string &name, GLint location)
+	{
+		auto added = locations.emplace(uniformHash(name.c_str(), name.size()), location);
+		if (!added.second && added.first->second != location)
+			added.first->second = CollidingLocation;
+	}
+
 	// Function to check for any compilation errors
 	void checkCompileErrors(GLuint shader, std::string type)
 	{
@@ -0,0 +1,337 @@
+#ifndef SHADER_COMPILER_H
+#define SHADER_COMPILER_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// How ShaderCompiler builds programs without blocking the render thread
+enum ShaderCompileMode {
+	// The driver compiles on its own threads (KHR_parallel_shader_compile), and GL_COMPLETION_STATUS_KHR says when
+	// each program is done
+	SHADER_COMPILE_PARALLEL,
+	// A worker thread builds programs on a second context that shares objects with the render context
+	SHADER_COMPILE_WORKER,
+	// Neither is available: poll() builds one program per call on the render thread, so the stall is spread out
+	SHADER_COMPILE_ON_POLL
+};
+
+// Builds shader programs in the background while the render loop keeps drawing. submit() returns at once, poll()
+// (called once a frame) finishes whatever has completed without waiting for anything, and ready() says whether a
+// program can be drawn with yet, so the render loop can use a fallback program until then. Submitting every
+// program up front lets the driver, or the worker, get through them while the first frames are drawn, instead of
+// each compile and link stalling the first frame in turn.
+class ShaderCompiler
+{
+public:
+	static ShaderCompiler& instance()
+	{
+		static ShaderCompiler compiler;
+		return compiler;
+	}
+
+	ShaderCompiler(const ShaderCompiler&) = delete;
+	ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+	~ShaderCompiler()
+	{
+		disableWorker();
+	}
+
+	// Builds programs on a worker thread when the driver can't compile in parallel itself. context(true) must make
+	// a context sharing objects with the render context current on the calling thread, and context(false) release
+	// it; both are called on the worker. Does nothing if the driver compiles in parallel.
+	void enableWorker(std::function<void(bool)> context)
+	{
+		if (GLExtensions::get().parallelShaderCompile || worker.joinable())
+			return;
+		stopping = false;
+		workerContext = context;
+		worker = std::thread([this] { workerLoop(); });
+	}
+
+	// Stops the worker after the program it's building. Programs it hadn't started are built by poll() instead.
+	// Must be called before the worker's context is destroyed.
+	void disableWorker()
+	{
+		if (!worker.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		worker.join();
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.insert(queued.end(), workerQueue.begin(), workerQueue.end());
+		workerQueue.clear();
+	}
+
+	ShaderCompileMode mode() const
+	{
+		if (GLExtensions::get().parallelShaderCompile)
+			return SHADER_COMPILE_PARALLEL;
+		return worker.joinable() ? SHADER_COMPILE_WORKER : SHADER_COMPILE_ON_POLL;
+	}
+
+	// Starts building shader from the given files, as Shader's constructor would. The shader must have been made
+	// with Shader(), stay where it is until the build is done, and not be used until ready() returns true.
+	// GL thread only, as are the rest of the functions.
+	void submit(Shader &shader, const std::string &vertexPath, const std::string &fragmentPath, const std::string &geometryPath = std::string(), const std::string &defines = std::string())
+	{
+		ShaderStagePaths paths;
+		paths.vertex = vertexPath;
+		paths.fragment = fragmentPath;
+		paths.geometry = geometryPath;
+		submit(shader, paths, defines);
+	}
+	// The same for a program with any set of stages
+	void submit(Shader &shader, const ShaderStagePaths &paths, const std::string &defines = std::string())
+	{
+		Request request;
+		request.shader = &shader;
+		request.paths = paths;
+		request.defines = defines;
+		waiting.insert(&shader);
+		switch (mode())
+		{
+		case SHADER_COMPILE_PARALLEL:
+			build(request, false);
+			compiling.push_back(&shader);
+			break;
+		case SHADER_COMPILE_WORKER:
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				workerQueue.push_back(request);
+			}
+			wake.notify_one();
+			break;
+		case SHADER_COMPILE_ON_POLL:
+			queued.push_back(request);
+			break;
+		}
+	}
+
+	// Finishes every build that has completed, without waiting on the compiler. Only when there's neither parallel
+	// compilation nor a worker does it build something itself, one program per call. Returns how many programs
+	// became ready.
+	size_t poll()
+	{
+		size_t finished = 0;
+		for (size_t i = 0; i < compiling.size();)
+		{
+			if (compiling[i]->completed())
+			{
+				compiling[i]->finish();
+				waiting.erase(compiling[i]);
+				compiling.erase(compiling.begin() + i);
+				finished++;
+			}
+			else
+				i++;
+		}
+		finished += collectBuilt(false);
+		if (!queued.empty())
+		{
+			Request request = queued.front();
+			queued.pop_front();
+			build(request, true);
+			waiting.erase(request.shader);
+			finished++;
+		}
+		return finished;
+	}
+
+	// Whether a submitted shader has finished building and can be drawn with. Shaders that were never submitted
+	// are ready.
+	bool ready(const Shader &shader) const
+	{
+		return waiting.find(&shader) == waiting.end();
+	}
+
+	// Blocks until a submitted shader is ready, for when the program is needed right now
+	void wait(Shader &shader)
+	{
+		if (ready(shader))
+			return;
+		for (size_t i = 0; i < compiling.size(); i++)
+		{
+			if (compiling[i] == &shader)
+			{
+				shader.finish();
+				compiling.erase(compiling.begin() + i);
+				waiting.erase(&shader);
+				return;
+			}
+		}
+		for (size_t i = 0; i < queued.size(); i++)
+		{
+			if (queued[i].shader == &shader)
+			{
+				Request request = queued[i];
+				queued.erase(queued.begin() + i);
+				build(request, true);
+				waiting.erase(&shader);
+				return;
+			}
+		}
+		// On the worker: built, or about to be
+		while (!ready(shader))
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				builtChanged.wait(lock, [this, &shader] { return std::find_if(built.begin(), built.end(), [&shader](const Built &b) { return b.shader == &shader; }) != built.end(); });
+			}
+			collectBuilt(true);
+		}
+	}
+
+	// Withdraws a shader that's about to be deleted. One that hasn't started building is dropped; one that has is
+	// waited for, as GL is still working on it.
+	void cancel(Shader &shader)
+	{
+		if (ready(shader))
+			return;
+		for (size_t i = 0; i < queued.size(); i++)
+		{
+			if (queued[i].shader == &shader)
+			{
+				queued.erase(queued.begin() + i);
+				waiting.erase(&shader);
+				return;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (size_t i = 0; i < workerQueue.size(); i++)
+			{
+				if (workerQueue[i].shader == &shader)
+				{
+					workerQueue.erase(workerQueue.begin() + i);
+					waiting.erase(&shader);
+					return;
+				}
+			}
+		}
+		wait(shader);
+	}
+
+	// Submitted shaders that aren't ready yet
+	size_t pending() const
+	{
+		return waiting.size();
+	}
+
+private:
+	struct Request {
+		Shader *shader = nullptr;
+		ShaderStagePaths paths;
+		std::string defines;
+	};
+
+	// A program the worker has built, and the fence that says when the render context can see it
+	struct Built {
+		Shader *shader = nullptr;
+		GLsync fence = nullptr;
+	};
+
+	// Shaders submitted and not yet ready. Only touched on the GL thread.
+	std::unordered_set<const Shader*> waiting;
+	// Parallel mode: shaders the driver is compiling
+	std::vector<Shader*> compiling;
+	// Shaders for poll() to build on the GL thread
+	std::deque<Request> queued;
+
+	// Shared with the worker
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable builtChanged;
+	std::deque<Request> workerQueue;
+	std::vector<Built> built;
+	bool stopping = false;
+	std::function<void(bool)> workerContext;
+	std::thread worker;
+
+	ShaderCompiler() {}
+
+	// Starts a request's build, and finishes it too if asked
+	static void build(const Request &request, bool finish)
+	{
+		request.shader->begin(request.paths, request.defines);
+		if (finish)
+			request.shader->finish();
+	}
+
+	// Marks the worker's programs ready once their fences have passed, waiting for them if asked
+	size_t collectBuilt(bool block)
+	{
+		std::vector<Built> done;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done.swap(built);
+		}
+		size_t finished = 0;
+		std::vector<Built> notYet;
+		for (size_t i = 0; i < done.size(); i++)
+		{
+			const GLenum status = glClientWaitSync(done[i].fence, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, block ? GL_TIMEOUT_IGNORED : 0);
+			if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+			{
+				glDeleteSync(done[i].fence);
+				waiting.erase(done[i].shader);
+				finished++;
+			}
+			else
+				notYet.push_back(done[i]);
+		}
+		if (!notYet.empty())
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			built.insert(built.begin(), notYet.begin(), notYet.end());
+		}
+		return finished;
+	}
+
+	// Builds queued programs start to finish on the worker's context. Checking the results waits for the compiler,
+	// but only this thread waits. Each program is fenced and flushed, so the render context can tell when the
+	// commands that built it have finished.
+	void workerLoop()
+	{
+		workerContext(true);
+		for (;;)
+		{
+			Request request;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return stopping || !workerQueue.empty(); });
+				if (stopping)
+					break;
+				request = workerQueue.front();
+				workerQueue.pop_front();
+			}
+			build(request, true);
+			Built result;
+			result.shader = request.shader;
+			result.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				built.push_back(result);
+			}
+			builtChanged.notify_all();
+		}
+		workerContext(false);
+	}
+};
+#endif
@@ -0,0 +1,104 @@
+#ifndef SHADER_SOURCE_H
+#define SHADER_SOURCE_H
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Reads GLSL source files for Shader, adding the two things GLSL itself lacks: #include "file" lines are replaced
+// by the named file (relative to the including file, and only once per file), and a block of #defines can be
+// inserted straight after the #version line, which is how shader variants are specialised.
+// #line directives are emitted around every insertion, so the line numbers in compile errors still match the
+// files. The second number in an error's location is the file: 0 for the top file, then each include in order.
+class ShaderSource
+{
+public:
+	// Returns the expanded source of path with defines inserted after its #version line. Prints the same error
+	// as Shader always has and returns an empty string if any file can't be read.
+	static std::string load(const std::string &path, const std::string &defines = std::string())
+	{
+		std::vector<std::string> files;
+		std::string source;
+		if (!expand(path, defines, files, source))
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+			return std::string();
+		}
+		return source;
+	}
+
+private:
+	// Appends the expanded text of path to out. files lists every file included so far, so a file included twice
+	// (or including itself) is only expanded the first time.
+	static bool expand(const std::string &path, const std::string &defines, std::vector<std::string> &files, std::string &out)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return false;
+		const size_t index = files.size();
+		files.push_back(path);
+		const std::string directory = path.find_last_of("/\\") == std::string::npos ? std::string() : path.substr(0, path.find_last_of("/\\") + 1);
+
+		std::string line;
+		int number = 0;
+		while (std::getline(file, line))
+		{
+			number++;
+			std::string include;
+			if (index == 0 && isDirective(line, "version"))
+			{
+				// The defines go after #version, which must stay the first line
+				out += line + '\n' + defines + lineDirective(number + 1, index);
+			}
+			else if (isDirective(line, "include") && quoted(line, include))
+			{
+				const std::string included = directory + include;
+				bool seen = false;
+				for (size_t i = 0; i < files.size(); i++)
+					seen = seen || files[i] == included;
+				if (!seen)
+				{
+					out += lineDirective(1, files.size());
+					if (!expand(included, defines, files, out))
+						return false;
+				}
+				out += lineDirective(number + 1, index);
+			}
+			else
+				out += line + '\n';
+		}
+		return true;
+	}
+
+	// Whether a line is the given preprocessor directive, allowing spaces around the '#'
+	static bool isDirective(const std::string &line, const char *name)
+	{
+		size_t i = line.find_first_not_of(" \t");
+		if (i == std::string::npos || line[i] != '#')
+			return false;
+		i = line.find_first_not_of(" \t", i + 1);
+		const std::string directive(name);
+		return i != std::string::npos && line.compare(i, directive.size(), directive) == 0;
+	}
+
+	// The text between the first pair of double quotes on a line
+	static bool quoted(const std::string &line, std::string &text)
+	{
+		const size_t open = line.find('"');
+		const size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+		if (close == std::string::npos)
+			return false;
+		text = line.substr(open + 1, close - open - 1);
+		return true;
+	}
+
+	static std::string lineDirective(int line, size_t file)
+	{
+		std::ostringstream directive;
+		directive << "#line " << line << ' ' << file << '\n';
+		return directive.str();
+	}
+};
+#endif
@@ -0,0 +1,138 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "Shader.h"
+#include "ShaderCompiler.h"
+
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One #define that variant keys control. The define's setting is a bit field of the key, and each value of the
+// field defines either the value itself or, if values is given, the matching entry of values.
+struct ShaderFeature {
+	std::string define;
+	uint32_t shift;
+	uint32_t bits;
+	std::vector<int> values;
+
+	uint32_t field(uint32_t key) const
+	{
+		return (key >> shift) & ((1u << bits) - 1);
+	}
+};
+
+// The programs built from one set of shader files under different sets of #defines. A variant key is a bitmask
+// of feature settings; each key is compiled into its own program the first time it's asked for (or up front with
+// precompile()), with the features' #defines inserted into the source, so branches on them are resolved by the
+// GLSL compiler instead of at run time. Switching variants afterwards is a hash table lookup.
+// request() builds variants in the background instead, through ShaderCompiler, and ready() says when one can be
+// drawn with, so the render loop can draw another variant until then.
+class ShaderVariants
+{
+public:
+	ShaderVariants(const std::string &vertexPath, const std::string &fragmentPath, const std::vector<ShaderFeature> &features)
+		: features(features)
+	{
+		paths.vertex = vertexPath;
+		paths.fragment = fragmentPath;
+	}
+	// Variants of a program with any set of stages, such as one with tessellation
+	ShaderVariants(const ShaderStagePaths &paths, const std::vector<ShaderFeature> &features)
+		: paths(paths), features(features)
+	{
+	}
+
+	ShaderVariants(const ShaderVariants&) = delete;
+	ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+	~ShaderVariants()
+	{
+		clear();
+	}
+
+	// The program for a variant key, compiling it if this is the first time it's been asked for, or waiting for it
+	// if it was requested and hasn't finished building
+	Shader& get(uint32_t key)
+	{
+		auto found = programs.find(key);
+		if (found != programs.end())
+		{
+			ShaderCompiler::instance().wait(*found->second);
+			return *found->second;
+		}
+		std::unique_ptr<Shader> shader(new Shader(paths, defines(key)));
+		Shader &result = *shader;
+		programs.emplace(key, std::move(shader));
+		return result;
+	}
+
+	// Builds the programs for the given keys now, so switching to them later never compiles
+	void precompile(const std::vector<uint32_t> &keys)
+	{
+		for (size_t i = 0; i < keys.size(); i++)
+			get(keys[i]);
+	}
+
+	// Starts building the programs for the given keys in the background, without waiting for any of them.
+	// ShaderCompiler::instance().poll() has to be called (once a frame) for them to become ready.
+	void request(const std::vector<uint32_t> &keys)
+	{
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			if (programs.find(keys[i]) != programs.end())
+				continue;
+			std::unique_ptr<Shader> shader(new Shader());
+			ShaderCompiler::instance().submit(*shader, paths, defines(keys[i]));
+			programs.emplace(keys[i], std::move(shader));
+		}
+	}
+
+	// Whether a key's program has been built and can be drawn with
+	bool ready(uint32_t key) const
+	{
+		auto found = programs.find(key);
+		return found != programs.end() && ShaderCompiler::instance().ready(*found->second);
+	}
+
+	size_t size() const
+	{
+		return programs.size();
+	}
+
+	// Deletes every program built. Must run while the context is alive, so anything that outlives it should call
+	// this before the context goes rather than relying on the destructor.
+	void clear()
+	{
+		for (auto &variant : programs)
+		{
+			ShaderCompiler::instance().cancel(*variant.second);
+			glDeleteProgram(variant.second->ID);
+		}
+		programs.clear();
+	}
+
+	// The #define block for a key, one line per feature
+	std::string defines(uint32_t key) const
+	{
+		std::ostringstream block;
+		for (size_t i = 0; i < features.size(); i++)
+		{
+			const ShaderFeature &feature = features[i];
+			const uint32_t field = feature.field(key);
+			const int value = field < feature.values.size() ? feature.values[field] : (int)field;
+			block << "#define " << feature.define << ' ' << value << '\n';
+		}
+		return block.str();
+	}
+
+private:
+	ShaderStagePaths paths;
+	std::vector<ShaderFeature> features;
+	// Key -> program. The Shaders are held by pointer so references handed out by get() stay valid.
+	std::unordered_map<uint32_t, std::unique_ptr<Shader>> programs;
+};
+#endif
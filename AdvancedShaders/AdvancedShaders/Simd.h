@@ -0,0 +1,87 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// x86 SIMD support shared by the CPU-side texture and mesh processing. SSE2 is part of every x64 CPU and is
+// always used there; AVX2 kernels are compiled alongside and picked at runtime when the CPU supports them.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC compiles any intrinsic without extra flags, GCC and Clang need the target enabled per function
+#if defined(SIMD_X86) && !defined(_MSC_VER)
+#define SIMD_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define SIMD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_SSSE3
+#define SIMD_TARGET_SSE41
+#define SIMD_TARGET_AVX2
+#endif
+
+// Instruction sets available on the running CPU
+struct CpuFeatures {
+	bool sse2 = false;
+	bool ssse3 = false;
+	bool sse41 = false;
+	bool avx2 = false;
+
+	// Detected once on first use
+	static const CpuFeatures& get()
+	{
+		static const CpuFeatures features = detect();
+		return features;
+	}
+
+private:
+	static CpuFeatures detect()
+	{
+		CpuFeatures features;
+#ifdef SIMD_X86
+		unsigned int regs[4] = {};
+		cpuid(0, regs);
+		const unsigned int maxLeaf = regs[0];
+		cpuid(1, regs);
+		features.sse2 = (regs[3] & (1u << 26)) != 0;
+		features.ssse3 = (regs[2] & (1u << 9)) != 0;
+		features.sse41 = (regs[2] & (1u << 19)) != 0;
+		// AVX2 also needs the OS to save the upper halves of the YMM registers
+		const bool osxsave = (regs[2] & (1u << 27)) != 0;
+		if (maxLeaf >= 7 && osxsave && (xgetbv() & 6) == 6)
+		{
+			cpuid(7, regs);
+			features.avx2 = (regs[1] & (1u << 5)) != 0;
+		}
+#endif
+		return features;
+	}
+
+#ifdef SIMD_X86
+	static void cpuid(unsigned int leaf, unsigned int regs[4])
+	{
+#ifdef _MSC_VER
+		__cpuidex((int*)regs, (int)leaf, 0);
+#else
+		__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	static unsigned long long xgetbv()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((unsigned long long)edx << 32) | eax;
+#endif
+	}
+#endif
+};
+#endif
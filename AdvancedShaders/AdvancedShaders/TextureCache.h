@@ -0,0 +1,1057 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "stb_image.h"
+#include "BakedTexture.h"
+#include "BlockCompressor.h"
+#include "ChannelSwizzle.h"
+#include "ConeStepBaker.h"
+#include "DecodedImage.h"
+#include "GLExtensions.h"
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+#include "DecodeTarget.h"
+#include "UploadRing.h"
+#include "UploadQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cctype>
+#include <iostream>
+
+// What a texture holds, which decides how it is filtered
+enum TextureRole {
+	TEXTURE_ROLE_COLOR,
+	TEXTURE_ROLE_NORMAL,
+	TEXTURE_ROLE_HEIGHT,
+	// A normal map in RGB with its height map packed into alpha, built from two files
+	TEXTURE_ROLE_NORMAL_HEIGHT,
+	// A relaxed cone step map baked from a height map: depth in R and the cone in G (see ConeStepBaker.h)
+	TEXTURE_ROLE_CONE,
+	// A height map whose mip chain is a quadtree of the shallowest depth under each texel, for frag.fs to skip
+	// empty space with. Sampled with texelFetch, so never compressed or filtered.
+	TEXTURE_ROLE_HEIGHT_PYRAMID
+};
+
+// Whether a texture is block compressed on the CPU before upload
+enum TextureCompression {
+	TEXTURE_COMPRESSION_NONE,
+	// BC1 for colour (BC7 when it has alpha), BC5 for normal maps and BC4 for height maps
+	TEXTURE_COMPRESSION_BC,
+	// As above, but BC7 for all colour maps
+	TEXTURE_COMPRESSION_BC_HIGH_QUALITY
+};
+
+// Settings that change how a texture is uploaded. Two requests for the same file only share a GL texture
+// if their settings match, so every field here is part of the cache key.
+struct TextureSettings {
+	// Store colour data in an sRGB internal format so sampling returns linear values
+	bool gamma = false;
+	// Wrap mode for both the S and T directions
+	GLint wrap = GL_REPEAT;
+	// Build a full mip chain and use trilinear minification
+	bool mipmaps = true;
+	// Cook the image and its mip chain into a baked file on first load, and map that file on later loads
+	bool baked = true;
+	TextureRole role = TEXTURE_ROLE_COLOR;
+	// Filter used to build the mip chain on the CPU
+	MipFilter mipFilter = MIP_FILTER_BOX;
+	// Block compression, which keeps the texture at 4-8 bits per texel in VRAM. Normal maps keep only x and y,
+	// so shaders sampling them must rebuild z.
+	TextureCompression compression = TEXTURE_COMPRESSION_NONE;
+	// Store only the channels the role samples, in the smallest sized format that keeps the source precision:
+	// RGBA8 (or SRGB8_ALPHA8) for colour, RG8/RG16 for normal maps and R8/R16 for height maps.
+	// Turned off, the texture keeps the channel count of the file, as textures were loaded originally.
+	bool compactFormat = true;
+
+	// Default settings for each kind of texture. frag.fs treats height maps as depth, so their mips keep the
+	// minimum of each block: a coarse level never puts the surface deeper than the texels it covers.
+	// Cone maps have no mips, as a cone can't be averaged with its neighbours.
+	static TextureSettings forRole(TextureRole role, bool gamma = false)
+	{
+		TextureSettings settings;
+		settings.role = role;
+		settings.gamma = gamma && role == TEXTURE_ROLE_COLOR;
+		if (role == TEXTURE_ROLE_HEIGHT || role == TEXTURE_ROLE_HEIGHT_PYRAMID)
+			settings.mipFilter = MIP_FILTER_MIN;
+		if (role == TEXTURE_ROLE_CONE)
+			settings.mipmaps = false;
+		return settings;
+	}
+};
+
+// One texture in a batch load
+struct TextureRequest {
+	std::string path;
+	TextureSettings settings;
+	// For TEXTURE_ROLE_NORMAL_HEIGHT, the height map packed into alpha (path is the normal map)
+	std::string heightPath;
+};
+
+// Time the GL thread has spent uploading textures
+struct UploadStats {
+	size_t uploads = 0;
+	double milliseconds = 0.0;
+};
+
+// Process-wide texture cache. Every texture load in the program goes through here, so an image referenced by
+// several materials, Models or the hand-built quad is decoded and uploaded exactly once. Entries are indexed
+// by a hash of the canonical path plus the load settings, and the GL handles are reference counted.
+class TextureCache
+{
+public:
+	// Returns the single cache instance shared by main.cpp and every Model
+	static TextureCache& instance()
+	{
+		static TextureCache cache;
+		return cache;
+	}
+
+	// Returns the texture for the given path and settings, loading it on the first request.
+	// Each successful acquire() must be paired with a release().
+	unsigned int acquire(const std::string &path, const TextureSettings &requested = TextureSettings())
+	{
+		const TextureSettings settings = resolve(requested);
+		std::string key = makeKey(canonicalPath(path), settings);
+		auto found = entries.find(key);
+		if (found != entries.end())
+		{
+			found->second.refCount++;
+			return found->second.id;
+		}
+		if (uploadRing)
+			uploadRing->reclaim();
+		DecodedImage image = decode(path, settings, uploadRing.get());
+		size_t bytes = 0;
+		unsigned int id = upload(path, image, settings, bytes);
+		return insert(key, id, bytes);
+	}
+
+	// Loads several textures at once. Images that aren't cached yet are decoded in parallel on the shared
+	// thread pool, and only the GL uploads happen on the calling (context) thread. Returns one texture id per
+	// request, in order, each of which must be released like an acquire().
+	std::vector<unsigned int> acquireBatch(std::vector<TextureRequest> requests)
+	{
+		for (size_t i = 0; i < requests.size(); i++)
+			requests[i].settings = resolve(requests[i].settings);
+		std::vector<unsigned int> ids(requests.size(), 0);
+		std::vector<std::string> keys(requests.size());
+		// Requests that need decoding, with duplicates within the batch folded onto the first one
+		std::vector<size_t> pending;
+		std::unordered_map<std::string, size_t> pendingByKey;
+		for (size_t i = 0; i < requests.size(); i++)
+		{
+			keys[i] = makeKey(sourceKey(requests[i]), requests[i].settings);
+			if (entries.find(keys[i]) == entries.end() && pendingByKey.find(keys[i]) == pendingByKey.end())
+			{
+				pendingByKey[keys[i]] = pending.size();
+				pending.push_back(i);
+			}
+		}
+
+		// Regions the GPU has finished with are handed back before the workers start allocating
+		UploadRing *ring = uploadRing.get();
+		if (ring)
+			ring->reclaim();
+		std::vector<DecodedImage> images(pending.size());
+		ThreadPool::shared().parallelFor(pending.size(), [&](size_t i)
+		{
+			const TextureRequest &request = requests[pending[i]];
+			images[i] = request.settings.role == TEXTURE_ROLE_NORMAL_HEIGHT ? decodePacked(request.path, request.heightPath, request.settings) : decode(request.path, request.settings, ring);
+			stage(images[i], ring);
+		});
+
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			const TextureRequest &request = requests[pending[i]];
+			size_t bytes = 0;
+			unsigned int id = upload(request.path, images[i], request.settings, bytes);
+			insert(keys[pending[i]], id, bytes);
+			// insert() takes the first reference, which belongs to the request that triggered the load
+			ids[pending[i]] = entries[keys[pending[i]]].id;
+		}
+		for (size_t i = 0; i < requests.size(); i++)
+		{
+			if (ids[i] == 0)
+			{
+				Entry &entry = entries[keys[i]];
+				entry.refCount++;
+				ids[i] = entry.id;
+			}
+		}
+		return ids;
+	}
+
+	// Returns a single RGBA texture holding a normal map and, in alpha, its height map, so a shader reads both
+	// from one sampler. Released like any other texture.
+	unsigned int acquirePacked(const std::string &normalPath, const std::string &heightPath, const TextureSettings &settings = TextureSettings::forRole(TEXTURE_ROLE_NORMAL_HEIGHT))
+	{
+		TextureRequest request;
+		request.path = normalPath;
+		request.heightPath = heightPath;
+		request.settings = settings;
+		request.settings.role = TEXTURE_ROLE_NORMAL_HEIGHT;
+		return acquireBatch(std::vector<TextureRequest>(1, request))[0];
+	}
+
+	// Streams a texture in while the render loop runs. The image is decoded on the thread pool and uploaded
+	// through uploads a strip at a time, so no frame waits for it; draw with placeholder() until ready is called
+	// on the GL thread with the texture, which holds a reference like acquire(). A cached texture is passed to
+	// ready before this returns, and requests for a texture that is already streaming share its upload.
+	// The upload ring must stay enabled until uploads is idle.
+	void stream(const TextureRequest &requested, UploadQueue &uploads, int priority, std::function<void(unsigned int)> ready)
+	{
+		TextureRequest request = requested;
+		request.settings = resolve(request.settings);
+		const std::string key = makeKey(sourceKey(request), request.settings);
+		auto found = entries.find(key);
+		if (found != entries.end())
+		{
+			found->second.refCount++;
+			ready(found->second.id);
+			return;
+		}
+		auto waiting = streaming.find(key);
+		if (waiting != streaming.end())
+		{
+			waiting->second.push_back(ready);
+			return;
+		}
+		streaming[key].push_back(ready);
+		UploadRing *ring = uploadRing.get();
+		if (ring)
+			ring->reclaim();
+		uploads.submitAsync([this, request, key, ring, priority]()
+		{
+			//A decode that throws, running out of memory for example, still has to let the waiting requests go
+			try
+			{
+				std::shared_ptr<DecodedImage> image = std::make_shared<DecodedImage>(request.settings.role == TEXTURE_ROLE_NORMAL_HEIGHT
+					? decodePacked(request.path, request.heightPath, request.settings) : decode(request.path, request.settings, ring));
+				stage(*image, ring);
+				return streamJob(key, request, image, ring, priority);
+			}
+			catch (const std::exception &e)
+			{
+				std::cout << "Texture failed to load at path: " << request.path << " (" << e.what() << ")" << std::endl;
+			}
+			catch (...)
+			{
+				std::cout << "Texture failed to load at path: " << request.path << std::endl;
+			}
+			return failedJob(key, request.settings.role, priority);
+		});
+	}
+
+	// A 1x1 texture to draw with while a texture of the given role streams in: mid grey for colour, a flat normal,
+	// and no depth for height maps and pyramids, or a flat surface under the widest cone for cone maps. Owned by
+	// the cache, so it's never released.
+	unsigned int placeholder(TextureRole role)
+	{
+		if (placeholders[role])
+			return placeholders[role];
+		const unsigned char texels[6][4] = { { 128, 128, 128, 255 }, { 128, 128, 255, 255 }, { 0, 0, 0, 0 }, { 128, 128, 255, 0 }, { 0, 255, 0, 0 }, { 0, 0, 0, 0 } };
+		glGenTextures(1, &placeholders[role]);
+		const GLuint previous = boundTexture();
+		glBindTexture(GL_TEXTURE_2D, placeholders[role]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels[role]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, previous);
+		return placeholders[role];
+	}
+
+	// Adds another reference to a texture already owned by the cache
+	void retain(unsigned int id)
+	{
+		auto key = keysById.find(id);
+		if (key != keysById.end())
+			entries[key->second].refCount++;
+	}
+
+	// Drops a reference, deleting the GL texture once nobody is using it
+	void release(unsigned int id)
+	{
+		auto key = keysById.find(id);
+		if (key == keysById.end())
+			return;
+		auto entry = entries.find(key->second);
+		if (--entry->second.refCount == 0)
+		{
+			glDeleteTextures(1, &entry->second.id);
+			totalBytes -= entry->second.bytes;
+			entries.erase(entry);
+			keysById.erase(key);
+		}
+	}
+
+	// Number of distinct textures currently alive
+	size_t size() const
+	{
+		return entries.size();
+	}
+
+	// Uploads pixels through a ring of pixel unpack buffer memory of the given size, so the GL thread doesn't wait
+	// for the driver to copy them. Must be called on the GL thread, after GLExtensions::load().
+	void enableUploadRing(size_t bytes)
+	{
+		uploadRing.reset(new UploadRing(bytes));
+	}
+
+	// Goes back to uploading from client memory. Waits for any uploads still reading the ring.
+	void disableUploadRing()
+	{
+		uploadRing.reset();
+	}
+
+	// The upload ring, or null when uploads come from client memory
+	UploadRing* ring() const
+	{
+		return uploadRing.get();
+	}
+
+	const UploadStats& uploadStats() const
+	{
+		return stats;
+	}
+
+	// Estimated video memory used by the live textures, in bytes
+	size_t memoryUsage() const
+	{
+		return totalBytes;
+	}
+
+	// Normalises a path so that different spellings of the same file share an entry:
+	// backslashes become forward slashes, "." segments are removed and "dir/.." pairs are collapsed.
+	// Windows paths are case insensitive, so they are also lower cased.
+	static std::string canonicalPath(const std::string &path)
+	{
+		std::vector<std::string> parts;
+		std::string part;
+		bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+		for (size_t i = 0; i <= path.size(); i++)
+		{
+			char c = i < path.size() ? path[i] : '/';
+			if (c != '/' && c != '\\')
+			{
+#ifdef _WIN32
+				c = (char)std::tolower((unsigned char)c);
+#endif
+				part += c;
+				continue;
+			}
+			if (part == "..")
+			{
+				if (!parts.empty() && parts.back() != "..")
+					parts.pop_back();
+				else if (!absolute)
+					parts.push_back(part);
+			}
+			else if (!part.empty() && part != ".")
+				parts.push_back(part);
+			part.clear();
+		}
+		std::string result = absolute ? "/" : "";
+		for (size_t i = 0; i < parts.size(); i++)
+		{
+			if (i > 0)
+				result += '/';
+			result += parts[i];
+		}
+		return result;
+	}
+
+	// Hash of the settings that change the cooked pixels, stored in baked files to detect stale ones.
+	// Sampler state such as the wrap mode isn't included as it doesn't change the data.
+	static uint64_t bakeHash(const TextureSettings &settings)
+	{
+		const uint32_t fields[] = { (uint32_t)settings.gamma, (uint32_t)settings.mipmaps, (uint32_t)settings.role, (uint32_t)settings.mipFilter, (uint32_t)settings.compression, (uint32_t)settings.compactFormat };
+		return BakedTexture::hash(fields, sizeof(fields));
+	}
+
+	// Produces the upload-ready data for an image. Baked textures are mapped from their cache file when it's up
+	// to date; otherwise the image is decoded with stb_image, its mip chain is built on the CPU and, for baked
+	// textures, the result is cooked to disk for next time. Only touches CPU memory, so it is safe to call from worker threads.
+	// Given a persistently mapped upload ring, JPEGs that go to the GPU exactly as stb_image produces them are
+	// decoded straight into the ring.
+	static DecodedImage decode(const std::string &path, const TextureSettings &settings, UploadRing *ring = nullptr)
+	{
+		DecodedImage image;
+		if (settings.baked && BakedTexture::load(path, bakeHash(settings), image))
+			return image;
+		if (settings.role == TEXTURE_ROLE_CONE)
+			return decodeCone(path, settings);
+
+		TextureLevel level;
+		void *data;
+		//16-bit height and normal maps keep their precision, as R16 and RG16 textures
+		if (settings.role != TEXTURE_ROLE_COLOR && stbi_is_16_bit(path.c_str()))
+		{
+			const bool height = settings.role == TEXTURE_ROLE_HEIGHT || settings.role == TEXTURE_ROLE_HEIGHT_PYRAMID;
+			data = stbi_load_16(path.c_str(), &level.width, &level.height, &image.components, height ? 1 : 0);
+			if (height)
+				image.components = 1;
+			image.type = GL_UNSIGNED_SHORT;
+		}
+		else
+		{
+			std::shared_ptr<void> target = decodeTarget(path, settings, ring);
+			/*stbi_load() loads an image and stores it as char pointer that points to the pixel data
+			The first parameter is the image path, the second and third the dimensions, the fourth the image components per pixel,
+			and the last forces a specific number of components*/
+			data = stbi_load(path.c_str(), &level.width, &level.height, &image.components, 0);
+			if (target)
+			{
+				//stb_image normally writes its output straight into the target, but copes if it didn't
+				const bool direct = DecodeTarget::holds(data);
+				DecodeTarget::clear();
+				if (data && !direct)
+				{
+					std::memcpy(target.get(), data, (size_t)level.width * level.height * image.components);
+					stbi_image_free(data);
+				}
+				if (data)
+				{
+					image.owner = target;
+					data = target.get();
+				}
+			}
+		}
+		if (!data)
+			return image;
+		//stb_image allocated the pixels, so it has to be the one to free them
+		if (!image.owner)
+			image.owner = std::shared_ptr<void>(data, stbi_image_free);
+		level.pixels = (const unsigned char*)data;
+		level.size = (size_t)level.width * level.height * image.components * (image.type == GL_UNSIGNED_SHORT ? 2 : 1);
+		image.levels.push_back(level);
+
+		//Block compressed textures pick their channels in the encoder; the others drop the channels their role
+		//doesn't sample. Normal maps are only cut down to xy after the mips, which renormalise using z.
+		BlockFormat blockFormat;
+		const bool compress = blockFormatFor(settings, image, blockFormat);
+		const int channels = storedChannels(settings, image);
+		if (!compress && settings.role != TEXTURE_ROLE_NORMAL)
+			ChannelSwizzle::repack(image, channels);
+
+		//Builds the mip chain here rather than with glGenerateMipmap, so each role gets the right filter
+		if (settings.mipmaps)
+			MipGenerator::generate(image, mipSettings(settings));
+		//Compresses after the mips are built, so every level is filtered from full precision data
+		if (compress)
+			BlockCompressor::compress(image, blockFormat, settings.gamma);
+		else
+			ChannelSwizzle::repack(image, channels);
+		if (!image.compressed)
+			describe(image, settings);
+		if (settings.baked)
+			BakedTexture::write(path, bakeHash(settings), image);
+		return image;
+	}
+
+	// Builds a normal map with its height map in alpha. Each map goes through decode() on its own, so it gets its
+	// own mip filter (renormalised normals, minimum depth) and its own baked file, and the two chains are then
+	// interleaved. Packed textures are always 8-bit; with compression they use BC7, the only format here with a
+	// fourth channel. The packed result is baked too, keyed on the height map as well as the normal map.
+	static DecodedImage decodePacked(const std::string &normalPath, const std::string &heightPath, const TextureSettings &settings)
+	{
+		DecodedImage image;
+		const uint64_t hash = packedHash(heightPath, settings);
+		if (settings.baked && BakedTexture::load(normalPath, hash, image))
+			return image;
+
+		TextureSettings normalSettings = TextureSettings::forRole(TEXTURE_ROLE_NORMAL);
+		normalSettings.mipmaps = settings.mipmaps;
+		normalSettings.baked = settings.baked;
+		normalSettings.compactFormat = false;	//Keeps z for the alpha to sit beside
+		TextureSettings heightSettings = TextureSettings::forRole(TEXTURE_ROLE_HEIGHT);
+		heightSettings.mipmaps = settings.mipmaps;
+		heightSettings.baked = settings.baked;
+		DecodedImage normal = decode(normalPath, normalSettings);
+		DecodedImage height = decode(heightPath, heightSettings);
+		if (!normal.valid() || !height.valid())
+			return image;
+		if (normal.levels[0].width != height.levels[0].width || normal.levels[0].height != height.levels[0].height)
+		{
+			std::cout << "Can't pack " << heightPath << " into " << normalPath << ": the maps are different sizes" << std::endl;
+			return image;
+		}
+		ChannelSwizzle::narrow(normal);
+		ChannelSwizzle::narrow(height);
+		image = ChannelSwizzle::merge(normal, height);
+		if (settings.compression != TEXTURE_COMPRESSION_NONE)
+			BlockCompressor::compress(image, BLOCK_BC7, false);
+		if (settings.baked)
+			BakedTexture::write(normalPath, hash, image);
+		return image;
+	}
+
+	// Bakes the cone step map of a height map. The height map is decoded at full size without mips, narrowed to
+	// 8 bits, and handed to ConeStepBaker, whose result is baked to disk like any other texture: the bake is slow
+	// enough that later runs should only ever map the file.
+	static DecodedImage decodeCone(const std::string &path, const TextureSettings &settings)
+	{
+		TextureSettings heightSettings = TextureSettings::forRole(TEXTURE_ROLE_HEIGHT);
+		heightSettings.mipmaps = false;
+		heightSettings.baked = false;
+		DecodedImage height = decode(path, heightSettings);
+		ChannelSwizzle::narrow(height);
+		DecodedImage image = ConeStepBaker::bake(height);
+		if (image.valid() && settings.baked)
+			BakedTexture::write(path, bakeHash(settings), image);
+		return image;
+	}
+
+	// Copies a decoded image into the upload ring from a worker thread, so the GL thread only has to issue the
+	// upload. Left where it is if the ring isn't persistently mapped or is full; upload() then stages it itself.
+	static void stage(DecodedImage &image, UploadRing *ring)
+	{
+		if (!ring || !ring->persistent() || !image.valid())
+			return;
+		size_t offset;
+		if (ring->offsetOf(image.levels[0].pixels, offset))
+			return;	// Decoded straight into the ring
+		std::shared_ptr<void> region = ring->tryAllocate(stagingSize(image));
+		if (region)
+			copyLevels(image, region);
+	}
+
+	// How the mip chain of a texture is filtered, from its role
+	static MipSettings mipSettings(const TextureSettings &settings)
+	{
+		MipSettings mips;
+		mips.filter = settings.mipFilter;
+		mips.srgb = settings.gamma;
+		mips.normalMap = settings.role == TEXTURE_ROLE_NORMAL;
+		return mips;
+	}
+
+	// Downgrades settings the current context can't honour: high quality colour falls back to BC1 without BPTC,
+	// and colour compression is turned off without S3TC. BC4/BC5 (RGTC) are core since GL 3.0.
+	// Settings are resolved before they form the cache key, so the key always describes what was uploaded.
+	static TextureSettings resolve(TextureSettings settings)
+	{
+		//Block compression or mips would wreck the cones, which have to stay exact to be safe to step by
+		if (settings.role == TEXTURE_ROLE_CONE)
+		{
+			settings.compression = TEXTURE_COMPRESSION_NONE;
+			settings.mipmaps = false;
+		}
+		//The pyramid's levels have to bound the ones above them exactly, which BC4 wouldn't keep, and it's nothing
+		//without them
+		if (settings.role == TEXTURE_ROLE_HEIGHT_PYRAMID)
+		{
+			settings.compression = TEXTURE_COMPRESSION_NONE;
+			settings.mipmaps = true;
+			settings.mipFilter = MIP_FILTER_MIN;
+		}
+		if (settings.compression == TEXTURE_COMPRESSION_NONE)
+			return settings;
+		const GLExtensions &ext = GLExtensions::get();
+		if (settings.role == TEXTURE_ROLE_NORMAL_HEIGHT && !ext.bptc)
+			settings.compression = TEXTURE_COMPRESSION_NONE;
+		if (settings.role != TEXTURE_ROLE_COLOR)
+			return settings;
+		const bool bc1 = settings.gamma ? ext.s3tcSrgb : ext.s3tc;
+		if (settings.compression == TEXTURE_COMPRESSION_BC_HIGH_QUALITY && !ext.bptc)
+			settings.compression = TEXTURE_COMPRESSION_BC;
+		if (settings.compression == TEXTURE_COMPRESSION_BC && !bc1 && !ext.bptc)
+			settings.compression = TEXTURE_COMPRESSION_NONE;
+		return settings;
+	}
+
+	// The number of channels an uncompressed texture keeps
+	static int storedChannels(const TextureSettings &settings, const DecodedImage &image)
+	{
+		if (!settings.compactFormat)
+			return image.components;
+		if (settings.role == TEXTURE_ROLE_NORMAL)
+			return std::min(image.components, 2);
+		if (settings.role == TEXTURE_ROLE_HEIGHT || settings.role == TEXTURE_ROLE_HEIGHT_PYRAMID)
+			return 1;
+		//RGB is padded to RGBA, which is how GPUs lay out RGB8 in memory anyway
+		return image.components == 3 ? 4 : image.components;
+	}
+
+	// Sets the upload formats of an uncompressed image from its channel count and value size. Colour textures can
+	// be stored as sRGB so the hardware linearises them when sampled.
+	static void describe(DecodedImage &image, const TextureSettings &settings)
+	{
+		static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+		static const GLint bytes[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+		static const GLint shorts[] = { GL_R16, GL_RG16, GL_RGB16, GL_RGBA16 };
+		const int index = std::min(std::max(image.components, 1), 4) - 1;
+		image.format = formats[index];
+		image.internalFormat = image.type == GL_UNSIGNED_SHORT ? shorts[index] : bytes[index];
+		if (settings.gamma && image.type == GL_UNSIGNED_BYTE && image.components == 3)
+			image.internalFormat = GL_SRGB8;
+		else if (settings.gamma && image.type == GL_UNSIGNED_BYTE && image.components == 4)
+			image.internalFormat = GL_SRGB8_ALPHA8;
+	}
+
+	// Bytes per texel of a sized uncompressed internal format. Three channel formats count as four, as drivers pad them.
+	static size_t bytesPerTexel(GLint internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_R8:
+			return 1;
+		case GL_R16:
+		case GL_RG8:
+			return 2;
+		case GL_RG16:
+		case GL_RGB8:
+		case GL_SRGB8:
+		case GL_RGBA8:
+		case GL_SRGB8_ALPHA8:
+			return 4;
+		default:
+			return 8;
+		}
+	}
+
+	// The block format for a decoded image, or false to leave it uncompressed. 16-bit height maps stay
+	// uncompressed, as BC4 would throw away the precision they were saved with.
+	static bool blockFormatFor(const TextureSettings &settings, const DecodedImage &image, BlockFormat &format)
+	{
+		if (settings.compression == TEXTURE_COMPRESSION_NONE || image.type != GL_UNSIGNED_BYTE)
+			return false;
+		if (settings.role == TEXTURE_ROLE_NORMAL)
+		{
+			format = BLOCK_BC5;
+			return image.components >= 2;
+		}
+		if (settings.role == TEXTURE_ROLE_HEIGHT)
+		{
+			format = BLOCK_BC4;
+			return true;
+		}
+		// BC1 has no useful alpha, so colour with alpha always goes to BC7, as does colour when S3TC is missing
+		const GLExtensions &ext = GLExtensions::get();
+		const bool bc1 = settings.gamma ? ext.s3tcSrgb : ext.s3tc;
+		const bool alpha = image.components == 2 || image.components == 4;
+		if (settings.compression == TEXTURE_COMPRESSION_BC_HIGH_QUALITY || alpha || !bc1)
+		{
+			format = BLOCK_BC7;
+			return ext.bptc;
+		}
+		format = BLOCK_BC1;
+		return true;
+	}
+
+private:
+	struct Entry {
+		unsigned int id;
+		unsigned int refCount;
+		size_t bytes;
+	};
+
+	// Cache key -> texture, and the reverse lookup used by retain()/release()
+	std::unordered_map<std::string, Entry> entries;
+	std::unordered_map<unsigned int, std::string> keysById;
+	// Sum of the entries' estimated sizes
+	size_t totalBytes = 0;
+	std::unique_ptr<UploadRing> uploadRing;
+	UploadStats stats;
+	// Callbacks waiting on the textures being streamed in, by cache key
+	std::unordered_map<std::string, std::vector<std::function<void(unsigned int)>>> streaming;
+	// Stand-ins for streaming textures, by role, created on first use
+	unsigned int placeholders[6] = {};
+
+	TextureCache() {}
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	// The ring region to decode an image straight into, or null. Only JPEGs uploaded exactly as decoded qualify:
+	// mapped buffer memory is write combined, so anything reading the pixels back out of it would be slow. That
+	// rules out the mip generator, the encoder and the baker, and stb_image's other decoders too, which read their
+	// own output (PNG unfiltering reads the row above, and low bit depths expand in place); those decode to the heap
+	// and stage() copies them in. The image size is read from its header first.
+	static std::shared_ptr<void> decodeTarget(const std::string &path, const TextureSettings &settings, UploadRing *ring)
+	{
+		if (!ring || !ring->persistent() || settings.mipmaps || settings.baked || settings.compression != TEXTURE_COMPRESSION_NONE || !isJpeg(path))
+			return std::shared_ptr<void>();
+		DecodedImage probe;
+		int width, height;
+		if (!stbi_info(path.c_str(), &width, &height, &probe.components) || storedChannels(settings, probe) != probe.components)
+			return std::shared_ptr<void>();
+		const size_t size = (size_t)width * height * probe.components;
+		std::shared_ptr<void> target = ring->tryAllocate(size + 1);
+		if (target)
+			DecodeTarget::set(target.get(), size);
+		return target;
+	}
+
+	// Whether a file starts with a JPEG start of image marker, whatever its extension
+	static bool isJpeg(const std::string &path)
+	{
+		unsigned char marker[3] = { 0, 0, 0 };
+		std::ifstream file(path, std::ios::binary);
+		file.read((char*)marker, sizeof(marker));
+		return file && marker[0] == 0xFF && marker[1] == 0xD8 && marker[2] == 0xFF;
+	}
+
+	// Bytes an image takes in the ring, with each level 16 byte aligned
+	static size_t stagingSize(const DecodedImage &image)
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < image.levels.size(); i++)
+			total += (image.levels[i].size + 15) & ~(size_t)15;
+		return total;
+	}
+
+	// Copies every level of an image into a ring region, which becomes the image's owner
+	static void copyLevels(DecodedImage &image, const std::shared_ptr<void> &region)
+	{
+		unsigned char *dest = (unsigned char*)region.get();
+		for (size_t i = 0; i < image.levels.size(); i++)
+		{
+			std::memcpy(dest, image.levels[i].pixels, image.levels[i].size);
+			image.levels[i].pixels = dest;
+			dest += (image.levels[i].size + 15) & ~(size_t)15;
+		}
+		image.owner = region;
+	}
+
+	// The cache key part naming the source files of a request
+	static std::string sourceKey(const TextureRequest &request)
+	{
+		if (request.settings.role == TEXTURE_ROLE_NORMAL_HEIGHT)
+			return canonicalPath(request.path) + '+' + canonicalPath(request.heightPath);
+		return canonicalPath(request.path);
+	}
+
+	// The bake hash of a packed texture. The baked file sits beside the normal map and only checks that source,
+	// so the height map's path and stamp are hashed in: a changed height map bakes to a new file.
+	static uint64_t packedHash(const std::string &heightPath, const TextureSettings &settings)
+	{
+		const std::string canonical = canonicalPath(heightPath);
+		const FileStamp stamp = MappedFile::stamp(heightPath);
+		const int64_t fields[] = { (int64_t)stamp.size, stamp.modified };
+		return BakedTexture::hash(fields, sizeof(fields), BakedTexture::hash(canonical.data(), canonical.size(), bakeHash(settings)));
+	}
+
+	static std::string makeKey(const std::string &canonical, const TextureSettings &settings)
+	{
+		return canonical + '|' + std::to_string((int)settings.gamma) + '|' + std::to_string(settings.wrap) + '|' + std::to_string((int)settings.mipmaps) + '|' + std::to_string((int)settings.baked)
+			+ '|' + std::to_string((int)settings.role) + '|' + std::to_string((int)settings.mipFilter)
+			+ '|' + std::to_string((int)settings.compression) + '|' + std::to_string((int)settings.compactFormat);
+	}
+
+	// Estimated video memory of a texture with levelCount levels
+	static size_t videoBytes(const DecodedImage &image, int levelCount)
+	{
+		size_t bytes = 0;
+		for (int i = 0; i < levelCount; i++)
+		{
+			const size_t width = (size_t)std::max(image.levels[0].width >> i, 1), height = (size_t)std::max(image.levels[0].height >> i, 1);
+			if (image.compressed)
+				bytes += image.levels[i].size;
+			else
+				bytes += width * height * bytesPerTexel(image.internalFormat);
+		}
+		return bytes;
+	}
+
+	// Sets the sampling parameters of the bound texture, and limits it to the uploaded levels unless GL generates the rest
+	static void setParameters(const DecodedImage &image, const TextureSettings &settings, bool generate)
+	{
+		if (!generate)
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+		//These specify rules/settings for the GL_TEXTURE_2D texture object, such as how it should wrap the texture in either direction
+		//if it extends beyond the texture's size, along with the texture filtering for how OpenGL chooses the texture pixel colour from.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, settings.wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, settings.wrap);
+		//A pyramid texel stands for every texel under it, so it's read as it is, never blended with its neighbours
+		const bool nearest = settings.role == TEXTURE_ROLE_HEIGHT_PYRAMID;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, nearest ? GL_NEAREST_MIPMAP_NEAREST : settings.mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, nearest ? GL_NEAREST : GL_LINEAR);
+	}
+
+	// Allocates every level of the bound texture without filling any of them in
+	static void allocateLevels(const DecodedImage &image, int levelCount)
+	{
+		const GLExtensions &ext = GLExtensions::get();
+		if (ext.textureStorage)
+		{
+			ext.texStorage2D(GL_TEXTURE_2D, levelCount, image.internalFormat, image.levels[0].width, image.levels[0].height);
+			return;
+		}
+		for (int i = 0; i < levelCount; i++)
+		{
+			const int width = std::max(image.levels[0].width >> i, 1), height = std::max(image.levels[0].height >> i, 1);
+			if (image.compressed)
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, image.internalFormat, width, height, 0, (GLsizei)image.levels[i].size, nullptr);
+			else
+				glTexImage2D(GL_TEXTURE_2D, i, image.internalFormat, width, height, 0, image.format, image.type, nullptr);
+		}
+	}
+
+	// The texture bound to GL_TEXTURE_2D on the active unit, which streaming steps put back after using the unit
+	static GLuint boundTexture()
+	{
+		GLint id = 0;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &id);
+		return (GLuint)id;
+	}
+
+	// Builds the upload of a streamed texture: one step creating the texture and its storage, a step per strip of
+	// rows of each level, and a last step generating the mipmaps GL makes itself. The steps read the pixels from
+	// the upload ring when the image was staged in it.
+	UploadJob streamJob(const std::string &key, const TextureRequest &request, const std::shared_ptr<DecodedImage> &image, UploadRing *ring, int priority)
+	{
+		struct Streamed {
+			unsigned int id = 0;
+			size_t bytes = 0;
+		};
+		std::shared_ptr<Streamed> texture = std::make_shared<Streamed>();
+		const TextureSettings settings = request.settings;
+		const std::string path = request.path;
+		const bool generate = image->valid() && settings.mipmaps && image->levels.size() == 1;
+		UploadJob job;
+		job.priority = priority;
+
+		UploadStep create;
+		create.run = [image, texture, settings, path, generate]()
+		{
+			glGenTextures(1, &texture->id);
+			if (!image->valid())
+			{
+				std::cout << "Texture failed to load at path: " << path << std::endl;
+				return;
+			}
+			const GLuint previous = boundTexture();
+			glBindTexture(GL_TEXTURE_2D, texture->id);
+			const int levelCount = generate ? MipGenerator::levelCount(image->levels[0].width, image->levels[0].height) : (int)image->levels.size();
+			allocateLevels(*image, levelCount);
+			setParameters(*image, settings, generate);
+			texture->bytes = videoBytes(*image, levelCount);
+			glBindTexture(GL_TEXTURE_2D, previous);
+		};
+		job.steps.push_back(create);
+
+		for (size_t i = 0; image->valid() && i < image->levels.size(); i++)
+		{
+			// Strips are whole rows of texels, or of 4x4 blocks for compressed levels
+			const TextureLevel &level = image->levels[i];
+			const int rowHeight = image->compressed ? 4 : 1;
+			const int rowCount = (level.height + rowHeight - 1) / rowHeight;
+			const size_t rowBytes = level.size / rowCount;
+			const int stripRows = std::max(1, (int)(UploadQueue::stepBytes / rowBytes));
+			for (int row = 0; row < rowCount; row += stripRows)
+			{
+				const int rows = std::min(stripRows, rowCount - row);
+				UploadStep strip;
+				strip.bytes = rows * rowBytes;
+				strip.run = [image, texture, ring, i, row, rows, rowHeight, rowBytes]()
+				{
+					const TextureLevel &level = image->levels[i];
+					const int y = row * rowHeight;
+					const int height = std::min(rows * rowHeight, level.height - y);
+					const unsigned char *pixels = level.pixels + row * rowBytes;
+					size_t offset;
+					const bool fromRing = ring && ring->offsetOf(pixels, offset);
+					if (fromRing)
+					{
+						glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->buffer());
+						pixels = (const unsigned char*)(uintptr_t)offset;
+					}
+					const GLuint previous = boundTexture();
+					glBindTexture(GL_TEXTURE_2D, texture->id);
+					glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+					if (image->compressed)
+						glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, y, level.width, height, image->internalFormat, (GLsizei)(rows * rowBytes), pixels);
+					else
+						glTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, y, level.width, height, image->format, image->type, pixels);
+					glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+					glBindTexture(GL_TEXTURE_2D, previous);
+					if (fromRing)
+						glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				};
+				job.steps.push_back(strip);
+			}
+		}
+
+		UploadStep finish;
+		finish.bytes = generate ? image->levels[0].size : 0;
+		finish.run = [image, texture, ring, generate]()
+		{
+			if (generate)
+			{
+				const GLuint previous = boundTexture();
+				glBindTexture(GL_TEXTURE_2D, texture->id);
+				glGenerateMipmap(GL_TEXTURE_2D);
+				glBindTexture(GL_TEXTURE_2D, previous);
+			}
+			//The ring region goes back once the GPU is past the strips that read it
+			if (ring && image->valid())
+				ring->fence(image->levels[0].pixels);
+		};
+		job.steps.push_back(finish);
+
+		//The texture joins the cache, with a reference for each request that was waiting on it. If acquire() loaded
+		//the same texture in the meantime, the waiting requests share that one instead.
+		job.completed = [this, key, texture]()
+		{
+			std::vector<std::function<void(unsigned int)>> waiting;
+			waiting.swap(streaming[key]);
+			streaming.erase(key);
+			unsigned int id = texture->id;
+			auto loaded = entries.find(key);
+			if (loaded != entries.end())
+			{
+				glDeleteTextures(1, &texture->id);
+				id = loaded->second.id;
+				loaded->second.refCount += (unsigned int)waiting.size();
+			}
+			else
+			{
+				insert(key, id, texture->bytes);
+				entries[key].refCount = (unsigned int)std::max<size_t>(waiting.size(), 1);
+			}
+			for (size_t i = 0; i < waiting.size(); i++)
+				waiting[i](id);
+		};
+		job.abandoned = [this, key, texture]()
+		{
+			if (texture->id)
+				glDeleteTextures(1, &texture->id);
+			streaming.erase(key);
+		};
+		return job;
+	}
+
+	// The job standing in for a streamed texture that couldn't be made: it has no steps, and passes the waiting
+	// requests the role's placeholder, which release() ignores, so a later stream() of the texture tries again
+	UploadJob failedJob(const std::string &key, TextureRole role, int priority)
+	{
+		UploadJob job;
+		job.priority = priority;
+		job.completed = [this, key, role]()
+		{
+			std::vector<std::function<void(unsigned int)>> waiting;
+			waiting.swap(streaming[key]);
+			streaming.erase(key);
+			const unsigned int id = placeholder(role);
+			for (size_t i = 0; i < waiting.size(); i++)
+				waiting[i](id);
+		};
+		job.abandoned = [this, key]()
+		{
+			streaming.erase(key);
+		};
+		return job;
+	}
+
+	// Adds a freshly uploaded texture to the cache with a single reference
+	unsigned int insert(const std::string &key, unsigned int id, size_t bytes)
+	{
+		Entry entry;
+		entry.id = id;
+		entry.refCount = 1;
+		entry.bytes = bytes;
+		totalBytes += bytes;
+		entries.emplace(key, entry);
+		keysById.emplace(id, key);
+		return id;
+	}
+
+	// Uploads decoded image data into a new GL texture, then lets go of the pixels. bytes is set to the estimated
+	// size of the texture in video memory.
+	unsigned int upload(const std::string &path, DecodedImage &image, const TextureSettings &settings, size_t &bytes)
+	{
+		const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		bytes = 0;
+		unsigned int textureID;
+		//GenTextures() generates a specified nunber of texture names in a specified array. This usage creates one texture name in textureID.
+		glGenTextures(1, &textureID);
+
+		if (image.valid())
+		{
+			//BindTexture() binds a named texture stated by the second parameter to the target specified by the first parameter.
+			//	In this case, it's binding the named texture textureID, generated above, to the TEXTURE_2D target.
+			glBindTexture(GL_TEXTURE_2D, textureID);
+			//Rows are tightly packed, which doesn't always meet the default 4 byte row alignment for RGB data
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			//With the upload ring, the pixels are read from the pixel unpack buffer and the "pointers" passed below are
+			//offsets into it. Images a worker couldn't stage are copied in here.
+			UploadRing *ring = uploadRing.get();
+			size_t offset = 0;
+			bool fromRing = ring && ring->offsetOf(image.levels[0].pixels, offset);
+			if (ring && !fromRing)
+			{
+				std::shared_ptr<void> region = ring->allocate(stagingSize(image));
+				if (region)
+				{
+					copyLevels(image, region);
+					ring->unmap();
+					fromRing = ring->offsetOf(image.levels[0].pixels, offset);
+				}
+			}
+			if (fromRing)
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring->buffer());
+			//Levels GL will hold: the uploaded ones, or the full chain if glGenerateMipmap is going to fill it in
+			const bool generate = settings.mipmaps && image.levels.size() == 1;
+			const int levelCount = generate ? MipGenerator::levelCount(image.levels[0].width, image.levels[0].height) : (int)image.levels.size();
+			//Immutable storage allocates every level up front in the final format, so the driver never has to
+			//check the levels for completeness or reallocate as they arrive
+			const GLExtensions &ext = GLExtensions::get();
+			if (ext.textureStorage)
+				ext.texStorage2D(GL_TEXTURE_2D, levelCount, image.internalFormat, image.levels[0].width, image.levels[0].height);
+			for (size_t i = 0; i < image.levels.size(); i++)
+			{
+				TextureLevel level = image.levels[i];
+				if (fromRing && ring->offsetOf(image.levels[i].pixels, offset))
+					level.pixels = (const unsigned char*)(uintptr_t)offset;
+				/*TexImage2D() specifies a 2D texture image. The first parameter in the function states the target texture.
+				The second parameter states the image level; the third parameter the number of colour components in the texture; the fourth parameter the width; the fifth parameter the height.
+				The next parameter is the width of the border which has to be 0, and the seventh parameter is the format of the pixel data.
+				The eighth parameter states the data type of the pixel data, and then the last parameter points to the image data itself.
+				With immutable storage the level already exists, so only its contents are replaced with TexSubImage2D().*/
+				if (image.compressed && ext.textureStorage)
+					glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height, image.internalFormat, (GLsizei)level.size, level.pixels);
+				else if (image.compressed)
+					glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, image.internalFormat, level.width, level.height, 0, (GLsizei)level.size, level.pixels);
+				else if (ext.textureStorage)
+					glTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height, image.format, image.type, level.pixels);
+				else
+					glTexImage2D(GL_TEXTURE_2D, (GLint)i, image.internalFormat, level.width, level.height, 0, image.format, image.type, level.pixels);
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			//The region goes back to the ring once the GPU has passed this fence
+			if (fromRing)
+			{
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				ring->fence(image.levels[0].pixels);
+			}
+			//Generates a mipmap for the GL_TEXTURE_2D texture object, unless the whole chain was built on the CPU
+			if (generate)
+				glGenerateMipmap(GL_TEXTURE_2D);
+			setParameters(image, settings, generate);
+			bytes = videoBytes(image, levelCount);
+		}
+		//Error catch
+		else
+		{
+			std::cout << "Texture failed to load at path: " << path << std::endl;
+		}
+		//Frees the loaded image, unmaps the baked file or releases the ring region
+		image = DecodedImage();
+		stats.uploads++;
+		stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		//Returns the texture's ID
+		return textureID;
+	}
+};
+#endif
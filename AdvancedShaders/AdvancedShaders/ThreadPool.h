@@ -0,0 +1,165 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// A fixed set of worker threads that run queued CPU work, such as image decoding, off the GL context thread.
+// None of the tasks may make GL calls, as the context is only current on the main thread.
+class ThreadPool
+{
+public:
+	// Starts the given number of workers, or one per hardware thread if zero
+	explicit ThreadPool(unsigned int threadCount = 0)
+	{
+		if (threadCount == 0)
+			threadCount = std::thread::hardware_concurrency();
+		if (threadCount == 0)
+			threadCount = 1;
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.emplace_back([this] { workerLoop(); });
+	}
+
+	// Finishes any queued work and joins the workers
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// The pool shared by all of the loaders in the program
+	static ThreadPool& shared()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	// Number of worker threads
+	unsigned int size() const
+	{
+		return (unsigned int)workers.size();
+	}
+
+	// Queues a task and returns a future for its result
+	template<class F>
+	std::future<decltype(std::declval<F&>()())> enqueue(F &&task)
+	{
+		typedef decltype(std::declval<F&>()()) Result;
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+		std::future<Result> result = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push([packaged] { (*packaged)(); });
+		}
+		wake.notify_one();
+		return result;
+	}
+
+	// Calls body(i) for every i in [0, count) across the workers and returns once all calls have finished.
+	// The calling thread takes indices too, so this is safe to use from inside another pool task. If body throws,
+	// the indices not yet started are skipped, and the first exception is rethrown here once every call already
+	// running has returned.
+	template<class F>
+	void parallelFor(size_t count, F &&body)
+	{
+		if (count == 0)
+			return;
+		struct Job {
+			std::atomic<size_t> next;
+			std::atomic<bool> failed;
+			size_t done;
+			std::exception_ptr error;
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+		auto job = std::make_shared<Job>();
+		job->next = 0;
+		job->failed = false;
+		job->done = 0;
+		// Helpers that start after every index has been claimed simply return, so nobody waits on them
+		std::function<void()> run = [job, count, &body]
+		{
+			size_t completed = 0;
+			for (size_t i = job->next++; i < count; i = job->next++)
+			{
+				// An index is done even when its call throws, so the wait below always ends
+				if (!job->failed)
+				{
+					try
+					{
+						body(i);
+					}
+					catch (...)
+					{
+						std::lock_guard<std::mutex> lock(job->mutex);
+						if (!job->error)
+							job->error = std::current_exception();
+						job->failed = true;
+					}
+				}
+				completed++;
+			}
+			if (completed > 0)
+			{
+				std::lock_guard<std::mutex> lock(job->mutex);
+				job->done += completed;
+				if (job->done == count)
+					job->finished.notify_all();
+			}
+		};
+		size_t helpers = count - 1 < workers.size() ? count - 1 : workers.size();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (size_t i = 0; i < helpers; i++)
+				tasks.push(run);
+		}
+		wake.notify_all();
+		run();
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->finished.wait(lock, [&] { return job->done == count; });
+		if (job->error)
+			std::rethrow_exception(job->error);
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void workerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+				if (stopping && tasks.empty())
+					return;
+				task = std::move(tasks.front());
+				tasks.pop();
+			}
+			task();
+		}
+	}
+};
+#endif
@@ -0,0 +1,292 @@
+#ifndef UPLOAD_QUEUE_H
+#define UPLOAD_QUEUE_H
+
+#include <glad/glad.h>
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+// One piece of an upload's GL work, kept small enough to fit inside a frame
+struct UploadStep {
+	// Bytes the step sends to the GPU, which its cost is predicted from
+	size_t bytes = 0;
+	std::function<void()> run;
+};
+
+// A texture or mesh on its way to the GPU. The steps run in order on the GL thread, spread over as many frames
+// as the budget needs.
+struct UploadJob {
+	// Higher priorities upload first, and equal priorities in the order they were submitted
+	int priority = 0;
+	std::vector<UploadStep> steps;
+	// Called on the GL thread once the GPU has finished every step, so the result can be drawn without stalling
+	std::function<void()> completed;
+	// Called on the GL thread instead of completed if the queue is cleared first, to delete what the steps that
+	// did run created
+	std::function<void()> abandoned;
+};
+
+// Streams assets onto the GPU while the render loop runs. Worker threads fill the queue with jobs holding decoded
+// texture and mesh data, and the render thread calls drain() once per frame, which runs as many steps as fit in
+// the frame's budget. Each step's cost is predicted from how fast earlier steps went, so a frame stops short of
+// its budget rather than running over it. A finished job is fenced, and its completion callback runs from a later
+// drain() once the GPU has passed the fence.
+class UploadQueue
+{
+public:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Most bytes a job should put in one step. A step is never split, so this bounds how far a frame can overrun
+	// its budget, at well under a millisecond on current drivers.
+	static const size_t stepBytes = 128 * 1024;
+
+	UploadQueue() = default;
+
+	// Waits for jobs still being produced, then abandons everything left. Must run while the context is alive.
+	~UploadQueue()
+	{
+		clear();
+	}
+
+	UploadQueue(const UploadQueue&) = delete;
+	UploadQueue& operator=(const UploadQueue&) = delete;
+
+	// Queues a job. Safe to call from any thread, including from a step or callback during drain().
+	void submit(UploadJob job)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Queued queued;
+		queued.job = std::move(job);
+		queued.sequence = nextSequence++;
+		queue.push_back(std::move(queued));
+		std::push_heap(queue.begin(), queue.end(), later);
+	}
+
+	// Runs make() on the shared thread pool and queues the UploadJob it returns, so decoding happens off the
+	// render thread. Jobs being made are waited for by clear(). If make() throws, the error is printed and nothing
+	// is queued; the job still stops being waited for.
+	template<class F>
+	void submitAsync(F make)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			producing++;
+		}
+		ThreadPool::shared().enqueue([this, make]()
+		{
+			// Counts the job as made however the task leaves, as the pool keeps any exception where no one looks
+			struct Produced {
+				UploadQueue &queue;
+				~Produced()
+				{
+					std::lock_guard<std::mutex> lock(queue.mutex);
+					queue.producing--;
+					queue.produced.notify_all();
+				}
+			} done{ *this };
+			try
+			{
+				submit(make());
+			}
+			catch (const std::exception &e)
+			{
+				std::cout << "ERROR::UPLOAD_QUEUE::JOB_FAILED " << e.what() << std::endl;
+			}
+			catch (...)
+			{
+				std::cout << "ERROR::UPLOAD_QUEUE::JOB_FAILED" << std::endl;
+			}
+		});
+	}
+
+	// Runs queued steps on the GL thread for up to budget milliseconds, then calls the completion callbacks of
+	// jobs the GPU has finished. A step predicted to overrun the budget waits for the next frame, unless nothing has
+	// run yet this frame, so the queue always moves. Returns the milliseconds spent.
+	double drain(double budget)
+	{
+		const Clock::time_point start = Clock::now();
+		bool ranStep = false;
+		for (;;)
+		{
+			Queued current;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (queue.empty())
+					break;
+				const Queued &front = queue.front();
+				const size_t bytes = front.next < front.job.steps.size() ? front.job.steps[front.next].bytes : 0;
+				if (ranStep && millisecondsSince(start) + predict(bytes) > budget)
+					break;
+				std::pop_heap(queue.begin(), queue.end(), later);
+				current = std::move(queue.back());
+				queue.pop_back();
+			}
+			// The job's steps run back to back while they fit, without going through the heap each time
+			while (current.next < current.job.steps.size())
+			{
+				const UploadStep &step = current.job.steps[current.next];
+				if (ranStep && millisecondsSince(start) + predict(step.bytes) > budget)
+					break;
+				const Clock::time_point stepStart = Clock::now();
+				step.run();
+				learn(step.bytes, millisecondsSince(stepStart));
+				current.next++;
+				ranStep = true;
+			}
+			if (current.next < current.job.steps.size())
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queue.push_back(std::move(current));
+				std::push_heap(queue.begin(), queue.end(), later);
+				break;
+			}
+			Fenced fenced;
+			fenced.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			fenced.job = std::move(current.job);
+			inFlight.push_back(std::move(fenced));
+		}
+		complete();
+		const double spent = millisecondsSince(start);
+		frames++;
+		longest = std::max(longest, spent);
+		return spent;
+	}
+
+	// Whether every job has been made, uploaded and completed
+	bool idle()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return producing == 0 && queue.empty() && inFlight.empty();
+	}
+
+	// Waits for the jobs being made on the thread pool, then drops every job that hasn't completed, calling its
+	// abandoned callback. GL thread only.
+	void clear()
+	{
+		std::vector<Queued> dropped;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			produced.wait(lock, [this] { return producing == 0; });
+			dropped.swap(queue);
+		}
+		for (size_t i = 0; i < inFlight.size(); i++)
+		{
+			glDeleteSync(inFlight[i].fence);
+			if (inFlight[i].job.abandoned)
+				inFlight[i].job.abandoned();
+		}
+		inFlight.clear();
+		for (size_t i = 0; i < dropped.size(); i++)
+			if (dropped[i].job.abandoned)
+				dropped[i].job.abandoned();
+	}
+
+	// The longest drain() so far, in milliseconds, and how many frames have drained
+	double longestDrain() const
+	{
+		return longest;
+	}
+
+	size_t drainedFrames() const
+	{
+		return frames;
+	}
+
+	void resetStats()
+	{
+		longest = 0.0;
+		frames = 0;
+	}
+
+private:
+	struct Queued {
+		UploadJob job;
+		uint64_t sequence = 0;
+		// Index of the next step to run
+		size_t next = 0;
+	};
+
+	struct Fenced {
+		GLsync fence = nullptr;
+		UploadJob job;
+	};
+
+	std::mutex mutex;
+	std::condition_variable produced;
+	// Heap of queued jobs, highest priority and then oldest at the front
+	std::vector<Queued> queue;
+	uint64_t nextSequence = 0;
+	// Jobs being made on the thread pool
+	size_t producing = 0;
+	// Jobs whose steps have all run, waiting for the GPU. Only touched on the GL thread.
+	std::vector<Fenced> inFlight;
+	// Cost model: a fixed cost per step plus a cost per byte, both learned from the steps that have run. The
+	// starting guesses are pessimistic, so the first frames undershoot rather than spike.
+	double stepMilliseconds = 0.05;
+	double millisecondsPerByte = 1.0 / (256.0 * 1024.0);
+	double longest = 0.0;
+	size_t frames = 0;
+
+	// Heap ordering: whether a should come out after b
+	static bool later(const Queued &a, const Queued &b)
+	{
+		if (a.job.priority != b.job.priority)
+			return a.job.priority < b.job.priority;
+		return a.sequence > b.sequence;
+	}
+
+	static double millisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	double predict(size_t bytes) const
+	{
+		return stepMilliseconds + bytes * millisecondsPerByte;
+	}
+
+	// Folds a step's measured time into the cost model. Small steps say little about throughput, so they only
+	// move the fixed cost.
+	void learn(size_t bytes, double milliseconds)
+	{
+		const double weight = 0.2;
+		if (bytes < 16 * 1024)
+			stepMilliseconds += (milliseconds - stepMilliseconds) * weight;
+		else
+			millisecondsPerByte += (std::max(milliseconds - stepMilliseconds, 0.0) / bytes - millisecondsPerByte) * weight;
+	}
+
+	// Runs the completion callbacks of the jobs the GPU has finished, oldest first
+	void complete()
+	{
+		size_t done = 0;
+		while (done < inFlight.size())
+		{
+			const GLenum status = glClientWaitSync(inFlight[done].fence, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+				break;
+			done++;
+		}
+		if (done == 0)
+			return;
+		// Moved out first, as a callback may submit more work or drain fences of its own
+		std::vector<Fenced> finished(std::make_move_iterator(inFlight.begin()), std::make_move_iterator(inFlight.begin() + done));
+		inFlight.erase(inFlight.begin(), inFlight.begin() + done);
+		for (size_t i = 0; i < finished.size(); i++)
+		{
+			glDeleteSync(finished[i].fence);
+			if (finished[i].job.completed)
+				finished[i].job.completed();
+		}
+	}
+};
+#endif
@@ -0,0 +1,276 @@
+#ifndef UPLOAD_RING_H
+#define UPLOAD_RING_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+// A ring of pixel unpack buffer memory that texture data is staged in before upload. glTexSubImage2D from a
+// bound GL_PIXEL_UNPACK_BUFFER returns once the copy is queued, where uploading from client memory makes the
+// driver copy the pixels before the call returns.
+//
+// With ARB_buffer_storage the whole buffer is mapped once, persistently, so worker threads can decode and copy
+// straight into it. Otherwise each region is mapped on the GL thread with GL_MAP_UNSYNCHRONIZED_BIT when it's
+// allocated. Either way, the regions a texture was uploaded from are fenced, and only reused once the GPU has
+// passed the fence.
+class UploadRing
+{
+public:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Creates the buffer. Must be called on the GL thread.
+	explicit UploadRing(size_t capacity) : capacity(capacity)
+	{
+		const GLExtensions &ext = GLExtensions::get();
+		glGenBuffers(1, &bufferID);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bufferID);
+		if (ext.persistentMapping)
+		{
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			ext.bufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)capacity, nullptr, flags);
+			mapping = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)capacity, flags);
+		}
+		else
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)capacity, nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	// Waits for the GPU to finish with every region, then deletes the buffer. Every region must have been released.
+	~UploadRing()
+	{
+		for (size_t i = 0; i < regions.size(); i++)
+		{
+			if (regions[i].fence)
+			{
+				glClientWaitSync(regions[i].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+				glDeleteSync(regions[i].fence);
+			}
+		}
+		if (mapping)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bufferID);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &bufferID);
+	}
+
+	UploadRing(const UploadRing&) = delete;
+	UploadRing& operator=(const UploadRing&) = delete;
+
+	// Whether the buffer is persistently mapped, so tryAllocate() can be used off the GL thread
+	bool persistent() const
+	{
+		return mapping != nullptr;
+	}
+
+	unsigned int buffer() const
+	{
+		return bufferID;
+	}
+
+	// Allocates a region without waiting, from any thread. Returns null if the buffer isn't persistently mapped or
+	// the ring is full. The region goes back to the ring once the last copy of the returned pointer is dropped and
+	// the GPU has passed the fence of the upload that read it.
+	std::shared_ptr<void> tryAllocate(size_t size)
+	{
+		if (!persistent())
+			return std::shared_ptr<void>();
+		std::lock_guard<std::mutex> lock(mutex);
+		return place(size);
+	}
+
+	// Allocates a region on the GL thread, waiting for the GPU to finish with older regions if the ring is full.
+	// Without persistent mapping the region is mapped here, and unmap() must be called once it's filled.
+	// Returns null if the request is larger than the ring, or the space is held by images that aren't uploaded yet.
+	std::shared_ptr<void> allocate(size_t size)
+	{
+		if (align(size) > capacity)
+			return std::shared_ptr<void>();
+		reclaim();
+		for (;;)
+		{
+			GLsync oldest = nullptr;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				std::shared_ptr<void> region = place(size);
+				if (region)
+					return region;
+				if (regions.empty() || !regions.front().released || !regions.front().fence)
+					return std::shared_ptr<void>();
+				oldest = regions.front().fence;
+			}
+			// The time spent here is the stall the ring couldn't hide
+			Clock::time_point start = Clock::now();
+			glClientWaitSync(oldest, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+			stalls += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			reclaim();
+		}
+	}
+
+	// Ends the mapping made by allocate() when the buffer isn't persistently mapped
+	void unmap()
+	{
+		if (persistent() || !mapped)
+			return;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bufferID);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		mapped = false;
+	}
+
+	// Finds the buffer offset of a pointer into a live region
+	bool offsetOf(const void *p, size_t &offset)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const Region *region = find(p);
+		if (!region)
+			return false;
+		offset = region->offset + (size_t)((const unsigned char*)p - region->pointer);
+		return true;
+	}
+
+	// Fences the region holding p once the GL commands reading it have been issued. GL thread only.
+	void fence(const void *p)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Region *region = find(p);
+		if (!region)
+			return;
+		if (region->fence)
+			glDeleteSync(region->fence);
+		region->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// Returns the oldest regions to the ring once they've been released and the GPU has passed their fences.
+	// GL thread only, as it checks the fences.
+	void reclaim()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		while (!regions.empty() && regions.front().released)
+		{
+			Region &region = regions.front();
+			if (region.fence)
+			{
+				GLenum status = glClientWaitSync(region.fence, 0, 0);
+				if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+					break;
+				glDeleteSync(region.fence);
+			}
+			regions.pop_front();
+		}
+		if (regions.empty())
+			head = 0;
+	}
+
+	// Total time allocate() has spent waiting for the GPU
+	double stallMilliseconds() const
+	{
+		return stalls;
+	}
+
+private:
+	struct Region {
+		uint64_t id;
+		size_t offset;
+		size_t size;
+		unsigned char *pointer;
+		GLsync fence;
+		bool released;
+	};
+
+	size_t capacity;
+	unsigned int bufferID = 0;
+	unsigned char *mapping = nullptr;
+	bool mapped = false;
+	// Live regions, oldest first. Space is handed out at head and comes back from the front.
+	std::deque<Region> regions;
+	size_t head = 0;
+	uint64_t nextID = 0;
+	double stalls = 0.0;
+	std::mutex mutex;
+
+	static size_t align(size_t size)
+	{
+		return (size + 255) & ~(size_t)255;
+	}
+
+	// Carves a region out of the free space, wrapping to the start of the buffer when the end is too small, and
+	// maps it if the buffer isn't persistently mapped. Called with the mutex held.
+	std::shared_ptr<void> place(size_t size)
+	{
+		const size_t bytes = align(size);
+		size_t offset;
+		if (regions.empty())
+		{
+			if (bytes > capacity)
+				return std::shared_ptr<void>();
+			offset = 0;
+		}
+		else
+		{
+			// In use is [tail, head) when head is past the tail, otherwise [tail, end) and [0, head)
+			const size_t tail = regions.front().offset;
+			if (head > tail)
+			{
+				if (head + bytes <= capacity)
+					offset = head;
+				else if (bytes <= tail)
+					offset = 0;
+				else
+					return std::shared_ptr<void>();
+			}
+			else if (head + bytes <= tail)
+				offset = head;
+			else
+				return std::shared_ptr<void>();
+		}
+		Region region = { nextID++, offset, bytes, mapping ? mapping + offset : nullptr, nullptr, false };
+		regions.push_back(region);
+		head = offset + bytes;
+		if (!persistent())
+			map(regions.back());
+		const uint64_t id = region.id;
+		return std::shared_ptr<void>(regions.back().pointer, [this, id](void*) { release(id); });
+	}
+
+	// Maps the newest region for writing. The fences already guarantee the GPU is done with it, so the driver
+	// doesn't need to synchronise.
+	void map(Region &region)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bufferID);
+		region.pointer = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, (GLintptr)region.offset, (GLsizeiptr)region.size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		mapped = true;
+	}
+
+	Region* find(const void *p)
+	{
+		const unsigned char *address = (const unsigned char*)p;
+		for (size_t i = 0; i < regions.size(); i++)
+			if (!regions[i].released && regions[i].pointer && address >= regions[i].pointer && address < regions[i].pointer + regions[i].size)
+				return &regions[i];
+		return nullptr;
+	}
+
+	void release(uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < regions.size(); i++)
+		{
+			if (regions[i].id == id)
+			{
+				regions[i].released = true;
+				return;
+			}
+		}
+	}
+};
+#endif
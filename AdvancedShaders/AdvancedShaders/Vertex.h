@@ -0,0 +1,61 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "QTangent.h"
+
+// How a vertex format holds its tangent frame
+enum TangentFrame {
+	// The normal, tangent and bitangent as vectors of their own (Vertex)
+	TANGENT_FRAME_VECTORS,
+	// One QTangent quaternion (QTangentVertex)
+	TANGENT_FRAME_QTANGENT,
+	// Only the normal: frag.fs rebuilds the tangent and bitangent per pixel from the screen space derivatives of
+	// the position and texture coordinates (TangentlessVertex)
+	TANGENT_FRAME_DERIVATIVES
+};
+
+struct Vertex {
+	// Position
+	glm::vec3 Position;
+	// Normal
+	glm::vec3 Normal;
+	// TexCoords
+	glm::vec2 TexCoords;
+	// Tangent
+	glm::vec3 Tangent;
+	// Bitangent
+	glm::vec3 Bitangent;
+};
+
+// The compact vertex: the normal, tangent and bitangent as one snorm16 quaternion (see QTangent.h), 28 bytes
+// against Vertex's 56. vert.vs rebuilds the frame when built with QTANGENT. Attribute 5 holds the quaternion;
+// 1, 3 and 4 are unused.
+struct QTangentVertex {
+	glm::vec3 Position;
+	glm::vec2 TexCoords;
+	glm::i16vec4 QTangent;
+
+	QTangentVertex() {}
+	explicit QTangentVertex(const Vertex &vertex)
+		: Position(vertex.Position), TexCoords(vertex.TexCoords), QTangent(QTangent::encode(vertex.Tangent, vertex.Bitangent, vertex.Normal))
+	{
+	}
+};
+
+// The vertex for derivative tangent frames: no tangent or bitangent at all, 32 bytes against Vertex's 56. vert.vs
+// passes the normal on when built with DERIVATIVE_FRAME, and attributes 3 and 4 are unused.
+struct TangentlessVertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::vec2 TexCoords;
+
+	TangentlessVertex() {}
+	explicit TangentlessVertex(const Vertex &vertex)
+		: Position(vertex.Position), Normal(vertex.Normal), TexCoords(vertex.TexCoords)
+	{
+	}
+};
+#endif
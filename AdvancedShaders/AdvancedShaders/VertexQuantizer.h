@@ -0,0 +1,315 @@
+#ifndef VERTEX_QUANTIZER_H
+#define VERTEX_QUANTIZER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "QTangent.h"
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Which of a mesh's attributes a quantized stream stores in fewer bits. Each is only a request: a mesh whose
+// attribute would come out less accurate than its tolerance keeps that attribute as float, so meshes of one Model
+// can differ. Either way the vertex shader reads them the same. Directions are always octahedral encoded, as
+// QUANTIZED shaders expect, unless the mesh keeps its frame as a QTangent.
+struct VertexEncoding {
+	// Positions as three unorm16 values spanning the mesh's bounding box
+	bool positions = true;
+	// Texture coordinates as half floats
+	bool texCoords = true;
+	// Largest distance, in model units, a quantized position may be from the original, or 0 for no limit
+	float positionTolerance = 0.0f;
+	// Largest error a half float texture coordinate may have. Halves are this accurate up to 2.0, so texture
+	// coordinates tiled further than that stay float.
+	float texCoordTolerance = 1.0f / 2048.0f;
+};
+
+// One attribute of an interleaved vertex stream, as glVertexAttribPointer takes it
+struct VertexAttribute {
+	GLuint location;
+	GLint components;
+	GLenum type;
+	GLboolean normalized;
+	unsigned int offset;
+};
+
+// A mesh's vertices interleaved in the encodings VertexQuantizer chose, with the attribute pointers that read them.
+// Attributes keep vert.vs's locations: position 0, normal 1, texture coordinates 2, tangent 3, bitangent 4, and
+// for QTangent meshes the quaternion on 5 in place of 1, 3 and 4. Meshes with derivative frames only have 0-2.
+struct QuantizedVertices {
+	// The encodings the mesh ended up with, after any fallbacks to float
+	VertexEncoding encoding;
+	TangentFrame frame = TANGENT_FRAME_VECTORS;
+	unsigned int stride = 0;
+	std::vector<VertexAttribute> attributes;
+	std::vector<unsigned char> data;
+	// The model space position is positionOffset + positionScale * the stored one, which GL reads as 0-1. Float
+	// positions have an identity transform.
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	glm::vec3 positionScale = glm::vec3(1.0f);
+	// Bytes the vertices took as Vertex, for the compression ratio
+	size_t sourceBytes = 0;
+	// The worst errors once decoded as the vertex shader does: position distance in model units, texture
+	// coordinate difference, and the angle in degrees of any normal, tangent or bitangent
+	float positionError = 0.0f;
+	float texCoordError = 0.0f;
+	float directionError = 0.0f;
+
+	bool empty() const
+	{
+		return data.empty();
+	}
+
+	size_t count() const
+	{
+		return stride > 0 ? data.size() / stride : 0;
+	}
+
+	// How many times smaller than Vertex the stream is
+	double ratio() const
+	{
+		return data.empty() ? 1.0 : (double)sourceBytes / data.size();
+	}
+
+	// Everything but the data: the layout and dequantization a mesh keeps once its data is on the GPU
+	QuantizedVertices layout() const
+	{
+		QuantizedVertices result;
+		result.encoding = encoding;
+		result.frame = frame;
+		result.stride = stride;
+		result.attributes = attributes;
+		result.positionOffset = positionOffset;
+		result.positionScale = positionScale;
+		result.sourceBytes = sourceBytes;
+		result.positionError = positionError;
+		result.texCoordError = texCoordError;
+		result.directionError = directionError;
+		return result;
+	}
+};
+
+// Packs vertices into QuantizedVertices streams, and decodes them again the way GL and shaders/quantized.glsl do
+// to measure the error. Everything is CPU work, safe on the thread pool, apart from setAttributes().
+class VertexQuantizer
+{
+public:
+	static QuantizedVertices quantize(const std::vector<Vertex> &vertices, VertexEncoding encoding, TangentFrame frame)
+	{
+		QuantizedVertices result;
+		result.frame = frame;
+		result.sourceBytes = vertices.size() * sizeof(Vertex);
+		const size_t count = vertices.size();
+
+		// Positions as fractions of the bounding box
+		std::vector<glm::u16vec3> positions;
+		if (encoding.positions && count > 0)
+		{
+			glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+			for (size_t i = 0; i < count; i++)
+			{
+				lo = glm::min(lo, vertices[i].Position);
+				hi = glm::max(hi, vertices[i].Position);
+			}
+			const glm::vec3 extent = hi - lo;
+			// A flat box has nothing to divide by along its flat axis, where every position is 0
+			const glm::vec3 divisor = glm::max(extent, glm::vec3(FLT_MIN));
+			positions.resize(count);
+			float error = 0.0f;
+			for (size_t i = 0; i < count; i++)
+			{
+				const glm::vec3 t = glm::clamp((vertices[i].Position - lo) / divisor, 0.0f, 1.0f);
+				positions[i] = glm::u16vec3(glm::round(t * 65535.0f));
+				const glm::vec3 decoded = lo + glm::vec3(positions[i]) / 65535.0f * extent;
+				error = std::max(error, glm::length(decoded - vertices[i].Position));
+			}
+			if (encoding.positionTolerance > 0.0f && error > encoding.positionTolerance)
+				encoding.positions = false;
+			else
+			{
+				result.positionOffset = lo;
+				result.positionScale = extent;
+				result.positionError = error;
+			}
+		}
+		else
+			encoding.positions = false;
+
+		// Texture coordinates as halves
+		std::vector<glm::u16vec2> texCoords;
+		if (encoding.texCoords)
+		{
+			texCoords.resize(count);
+			float error = 0.0f;
+			for (size_t i = 0; i < count; i++)
+			{
+				const glm::vec2 uv = vertices[i].TexCoords;
+				texCoords[i] = glm::u16vec2(glm::packHalf1x16(uv.x), glm::packHalf1x16(uv.y));
+				const glm::vec2 decoded(glm::unpackHalf1x16(texCoords[i].x), glm::unpackHalf1x16(texCoords[i].y));
+				error = std::max(error, std::max(std::abs(decoded.x - uv.x), std::abs(decoded.y - uv.y)));
+			}
+			if (encoding.texCoordTolerance > 0.0f && error > encoding.texCoordTolerance)
+				encoding.texCoords = false;
+			else
+				result.texCoordError = error;
+		}
+
+		// The layout, in vert.vs's attribute order, keeping every attribute 4 byte aligned
+		unsigned int stride = 0;
+		auto add = [&](GLuint location, GLint components, GLenum type, GLboolean normalized, unsigned int bytes)
+		{
+			VertexAttribute attribute = { location, components, type, normalized, stride };
+			result.attributes.push_back(attribute);
+			stride += bytes;
+		};
+		// Three unorm16 values padded to 8 bytes
+		if (encoding.positions)
+			add(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 8);
+		else
+			add(0, 3, GL_FLOAT, GL_FALSE, 12);
+		if (encoding.texCoords)
+			add(2, 2, GL_HALF_FLOAT, GL_FALSE, 4);
+		else
+			add(2, 2, GL_FLOAT, GL_FALSE, 8);
+		const GLuint directionLocations[3] = { 1, 3, 4 };
+		const int directionCount = frame == TANGENT_FRAME_DERIVATIVES ? 1 : 3;
+		if (frame == TANGENT_FRAME_QTANGENT)
+			add(5, 4, GL_SHORT, GL_TRUE, 8);
+		else
+			for (int d = 0; d < directionCount; d++)
+				add(directionLocations[d], 2, GL_SHORT, GL_TRUE, 4);
+		result.stride = stride;
+		result.encoding = encoding;
+
+		result.data.assign(count * stride, 0);
+		float directionError = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			const Vertex &vertex = vertices[i];
+			unsigned char *out = &result.data[i * stride];
+			size_t a = 0;
+			if (encoding.positions)
+				put(out + result.attributes[a++].offset, positions[i]);
+			else
+				put(out + result.attributes[a++].offset, vertex.Position);
+			if (encoding.texCoords)
+				put(out + result.attributes[a++].offset, texCoords[i]);
+			else
+				put(out + result.attributes[a++].offset, vertex.TexCoords);
+			if (frame == TANGENT_FRAME_QTANGENT)
+			{
+				const glm::i16vec4 packed = QTangent::encode(vertex.Tangent, vertex.Bitangent, vertex.Normal);
+				put(out + result.attributes[a++].offset, packed);
+				glm::vec3 tangent, bitangent, normal;
+				QTangent::decode(packed, tangent, bitangent, normal);
+				directionError = std::max(directionError, angle(vertex.Tangent, tangent));
+				directionError = std::max(directionError, angle(vertex.Bitangent, bitangent));
+				directionError = std::max(directionError, angle(vertex.Normal, normal));
+				continue;
+			}
+			const glm::vec3 directions[3] = { vertex.Normal, vertex.Tangent, vertex.Bitangent };
+			for (int d = 0; d < directionCount; d++)
+			{
+				const glm::i16vec2 packed = octahedral(directions[d]);
+				put(out + result.attributes[a++].offset, packed);
+				directionError = std::max(directionError, angle(directions[d], octahedralDirection(packed)));
+			}
+		}
+		result.directionError = directionError;
+		return result;
+	}
+
+	// Sets the attribute pointers of a stream on the bound VAO, reading from the bound array buffer
+	static void setAttributes(const QuantizedVertices &quantized)
+	{
+		for (size_t i = 0; i < quantized.attributes.size(); i++)
+		{
+			const VertexAttribute &attribute = quantized.attributes[i];
+			glEnableVertexAttribArray(attribute.location);
+			glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized, quantized.stride, (void*)(uintptr_t)attribute.offset);
+		}
+	}
+
+	// Octahedral encoding (Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors",
+	// JCGT 2014): the direction is projected onto the octahedron |x| + |y| + |z| = 1, whose lower half is folded
+	// over the upper, giving a point in the -1 to 1 square. Of the four ways of rounding it to snorm16, the one
+	// that decodes closest to the direction is kept. Zero vectors, as degenerate tangents give, come back as +z.
+	static glm::i16vec2 octahedral(const glm::vec3 &direction)
+	{
+		const float length = glm::length(direction);
+		if (!(length > 1e-12f))
+			return glm::i16vec2(0, 0);
+		const glm::vec3 target = direction / length;
+		const glm::vec3 n = direction / (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z));
+		glm::vec2 p(n.x, n.y);
+		if (n.z < 0.0f)
+			p = glm::vec2((1.0f - std::abs(n.y)) * signNotZero(n.x), (1.0f - std::abs(n.x)) * signNotZero(n.y));
+		glm::i16vec2 best(0, 0);
+		float bestCosine = -2.0f;
+		for (int i = 0; i < 4; i++)
+		{
+			const float x = (i & 1) ? std::ceil(p.x * 32767.0f) : std::floor(p.x * 32767.0f);
+			const float y = (i & 2) ? std::ceil(p.y * 32767.0f) : std::floor(p.y * 32767.0f);
+			const glm::i16vec2 candidate((int16_t)std::min(std::max(x, -32767.0f), 32767.0f), (int16_t)std::min(std::max(y, -32767.0f), 32767.0f));
+			const float cosine = glm::dot(octahedralDirection(candidate), target);
+			if (cosine > bestCosine)
+			{
+				bestCosine = cosine;
+				best = candidate;
+			}
+		}
+		return best;
+	}
+
+	// The direction back from its octahedral encoding, as OctahedralDirection() in quantized.glsl decodes it
+	static glm::vec3 octahedralDirection(const glm::i16vec2 &packed)
+	{
+		const glm::vec2 e(unsnorm(packed.x), unsnorm(packed.y));
+		glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+		if (n.z < 0.0f)
+		{
+			n.x = (1.0f - std::abs(e.y)) * signNotZero(e.x);
+			n.y = (1.0f - std::abs(e.x)) * signNotZero(e.y);
+		}
+		return glm::normalize(n);
+	}
+
+private:
+	template<class T>
+	static void put(unsigned char *out, const T &value)
+	{
+		std::memcpy(out, &value, sizeof(T));
+	}
+
+	static float signNotZero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	// GL's snorm conversion: -32768 and -32767 both give -1
+	static float unsnorm(int16_t value)
+	{
+		return std::max(value / 32767.0f, -1.0f);
+	}
+
+	// Angle in degrees between an original direction and its decoded one. Zero vectors have no direction to lose.
+	static float angle(const glm::vec3 &original, const glm::vec3 &decoded)
+	{
+		const float length = glm::length(original);
+		if (!(length > 1e-12f))
+			return 0.0f;
+		// atan2 rather than acos, which can't resolve angles this small in float
+		const glm::vec3 a = original / length, b = glm::normalize(decoded);
+		return glm::degrees(std::atan2(glm::length(glm::cross(a, b)), glm::dot(a, b)));
+	}
+};
+#endif
@@ -7,17 +7,25 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Shader.h"
+#include "ShaderCompiler.h"
+#include "ShaderVariants.h"
+#include "ParallaxVariant.h"
 #include "Camera.h"
 #include "Model.h"
+#include "TextureCache.h"
+#include "Benchmark.h"
 
 #include <iostream>
+#include <string>
+#include <cstdlib>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
-unsigned int loadTexture(const char *path);
-void renderQuad();
+void renderQuad(bool patches = false, TangentFrame frame = TANGENT_FRAME_VECTORS, const Shader *quantized = NULL);
+void releaseQuad();
+void requestVariants(const ParallaxVariant &selected, ShaderVariants &variants, ShaderVariants &tessellatedVariants, bool tessellation);
 
 //Paths for each of the maps used for the wall
 char const * diffuse = ("textures/bricks2.jpg");
@@ -28,6 +36,25 @@ char const * displacement = ("textures/bricks2_disp.jpg");
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
 float heightScale = 0.1;
+// The wall's material reads its height from the alpha of the normal map, rather than from its own texture
+bool packedHeight = true;
+// Milliseconds each frame may spend uploading textures that are streaming in. Kept under half the 1 ms
+// streaming target, as a step that runs over its prediction still has to finish.
+const double uploadBudget = 0.5;
+// The parallax variant drawn, switched with the number keys: 1-7 for none/offset/steep/occlusion/relief/cone/
+// pyramid, 8/9 for shadows off/on, T/Y for tessellated displacement on/off, G/V/H for QTangent, derivative or
+// stored tangent frames, and J/K for quantized vertex streams on/off
+ParallaxVariant parallax;
+// Depth layers the parallax searches take looking straight at the wall. Grazing views take up to the variant's
+// step count.
+int minLayers = 8;
+// Tessellated displacement: the on screen length of a tessellated edge, and the distances from the camera over
+// which the displacement fades out and leaves the depth to parallax
+const float tessEdgePixels = 8.0f;
+const float displacementNear = 2.0f;
+const float displacementFar = 6.0f;
+// renderQuad's wall is 2 units across for texture coordinates 0-1
+const float quadWorldPerTexCoord = 2.0f;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -39,8 +66,12 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-int main()
+int main(int argc, char **argv)
 {
+	// "--bench <name> [count]" runs one of the benchmarks in Benchmark.h instead of the demo
+	std::string benchmark = (argc > 2 && std::string(argv[1]) == "--bench") ? argv[2] : "";
+	int benchmarkCount = argc > 3 ? std::atoi(argv[3]) : 0;
+
 	// Initiates the GLFW library
 	glfwInit();
 	//Specifies the GLFW version (MAJOR.MINOR.0 = 3.3.0)
@@ -48,6 +79,9 @@ int main()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	//Specifies the core GLFW profile
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	//Benchmarks still need a context, but not a visible window
+	if (!benchmark.empty())
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 	// Creates a window pointer with set dimensions and a name, along with an error catch
 	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Advanced Shaders", NULL, NULL);
@@ -75,26 +109,98 @@ int main()
 		std::cout << "Failed to initialize GLAD" << std::endl;
 		return -1;
 	}
+	//Checks which optional features (compressed texture formats, immutable storage) the context supports
+	GLExtensions::load((GLADloadproc)glfwGetProcAddress);
 	
 	//Enables depth testing, which uses the depth buffer to compare the depth (z) values of fragements
 	//to see if they lie behind other fragments.
 	glEnable(GL_DEPTH_TEST);
 
-	// Creates a shader using the specified files
-	Shader shader("shaders/vert.vs", "shaders/frag.fs");
+	//Shader variants are compiled in the background. Drivers that can't compile in parallel themselves get a worker
+	//thread with a hidden context of its own, which shares its programs with the window's context
+	GLFWwindow* compilerContext = NULL;
+	if (!GLExtensions::get().parallelShaderCompile)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		compilerContext = glfwCreateWindow(1, 1, "Shader compiler", NULL, window);
+		if (compilerContext)
+			ShaderCompiler::instance().enableWorker([compilerContext](bool bind) { glfwMakeContextCurrent(bind ? compilerContext : NULL); });
+	}
 
-	//Loads the maps from the paths provided, and stores their texture ids.
-	unsigned int diffuseMap = loadTexture(diffuse);
-	unsigned int normalMap = loadTexture(normal);
-	unsigned int heightMap = loadTexture(displacement);
+	//Runs the requested benchmark and exits
+	if (!benchmark.empty())
+	{
+		int result = Benchmark::run(benchmark, benchmarkCount);
+		ShaderCompiler::instance().disableWorker();
+		glfwTerminate();
+		return result;
+	}
 
-	 // Call glUseProgram on the shader
-	shader.use();
-	//Sets a uniform of the active shader program, passing through the name of the uniform and the value
-	//Here it's setting ints for the maps
-	shader.setInt("diffuseMap", 0);
-	shader.setInt("normalMap", 1);
-	shader.setInt("depthMap", 2);
+	// Creates the shader variants using the specified files. Only the fallback, plain offset mapping, is compiled
+	// before the first frame. The selected variant, and every variant one key press away from it, are submitted to
+	// the compiler as the selection changes and built in the background (see requestVariants), and the fallback is
+	// drawn in place of any variant that isn't ready yet.
+	ShaderVariants variants(ParallaxVariant::stages(false), ParallaxVariant::features());
+	//Tessellated variants have stages of their own, so they're a table of their own. Only built when the driver
+	//can tessellate.
+	ShaderVariants tessellatedVariants(ParallaxVariant::stages(true), ParallaxVariant::features());
+	const bool tessellation = GLExtensions::get().tessellation;
+	parallax.packedHeight = packedHeight;
+	const uint32_t fallbackKey = parallax.key();
+	variants.get(fallbackKey);
+
+	//Texture pixels are staged in a pixel unpack buffer ring, so uploads don't stall on driver copies
+	TextureCache::instance().enableUploadRing(64 << 20);
+	//Streams the maps in from the paths provided: they're decoded on the thread pool and uploaded a little each frame,
+	//so the window opens straight away with placeholders that are swapped for the maps as they arrive.
+	//A packed material loads the normal and height maps as one RGBA texture instead of two.
+	std::vector<TextureRequest> mapRequests(packedHeight ? 2 : 3);
+	mapRequests[0].path = diffuse;
+	mapRequests[1].path = normal;
+	if (packedHeight)
+	{
+		mapRequests[1].settings = TextureSettings::forRole(TEXTURE_ROLE_NORMAL_HEIGHT);
+		mapRequests[1].heightPath = displacement;
+	}
+	else
+	{
+		mapRequests[1].settings = TextureSettings::forRole(TEXTURE_ROLE_NORMAL);
+		mapRequests[2].path = displacement;
+		mapRequests[2].settings = TextureSettings::forRole(TEXTURE_ROLE_HEIGHT);
+	}
+	//The maps are block compressed: BC1 diffuse, BC5 normal (frag.fs rebuilds z) and BC4 height, or BC7 when packed
+	for (TextureRequest &request : mapRequests)
+		request.settings.compression = TEXTURE_COMPRESSION_BC;
+	UploadQueue uploads;
+	TextureCache &textures = TextureCache::instance();
+	unsigned int maps[3] = { textures.placeholder(TEXTURE_ROLE_COLOR), textures.placeholder(packedHeight ? TEXTURE_ROLE_NORMAL_HEIGHT : TEXTURE_ROLE_NORMAL), textures.placeholder(TEXTURE_ROLE_HEIGHT) };
+	for (size_t i = 0; i < mapRequests.size(); i++)
+		textures.stream(mapRequests[i], uploads, 0, [&maps, i](unsigned int id) { maps[i] = id; });
+	unsigned int &diffuseMap = maps[0];
+	unsigned int &normalMap = maps[1];
+	unsigned int &heightMap = maps[2];
+	//The cone step map for cone stepping is baked from the height map the first time, which takes a while, so it
+	//streams in behind the other maps
+	TextureRequest coneRequest;
+	coneRequest.path = displacement;
+	coneRequest.settings = TextureSettings::forRole(TEXTURE_ROLE_CONE);
+	unsigned int coneMap = textures.placeholder(TEXTURE_ROLE_CONE);
+	textures.stream(coneRequest, uploads, -1, [&coneMap](unsigned int id) { coneMap = id; });
+	//The min depth pyramid for the pyramid march, built from the height map on the thread pool like any mip chain
+	TextureRequest pyramidRequest;
+	pyramidRequest.path = displacement;
+	pyramidRequest.settings = TextureSettings::forRole(TEXTURE_ROLE_HEIGHT_PYRAMID);
+	unsigned int heightPyramid = textures.placeholder(TEXTURE_ROLE_HEIGHT_PYRAMID);
+	textures.stream(pyramidRequest, uploads, -1, [&heightPyramid](unsigned int id) { heightPyramid = id; });
+	bool texturesReported = false;
+
+	//The variant being drawn, and handles for the uniforms set every frame, so each set is a single glUniform call
+	//with no name lookup. They're looked up again whenever the variant changes.
+	Shader *shader = nullptr;
+	uint32_t shaderKey = 0;
+	//The selected variant whose neighbours were last requested
+	uint32_t requestedKey = ~0u;
+	UniformHandle projectionUniform, viewUniform, modelUniform, viewPosUniform, lightPosUniform, heightScaleUniform, viewportHeightUniform;
 
 	// The light position
 	glm::vec3 lightPos(0.5f, 1.0f, 0.3f);
@@ -121,19 +227,61 @@ int main()
 		//Returns the camera's view matrix and stores it
 		glm::mat4 view = camera.GetViewMatrix();
 
-		shader.use();
+		//Finishes any variants the compiler is done with, then draws the chosen one if it's ready, or the fallback
+		//until it is. Switching variants is a table lookup.
+		ShaderCompiler::instance().poll();
+		if (!tessellation)
+			parallax.tessellated = false;
+		if (parallax.key() != requestedKey)
+		{
+			requestVariants(parallax, variants, tessellatedVariants, tessellation);
+			requestedKey = parallax.key();
+		}
+		ShaderVariants &table = parallax.tessellated ? tessellatedVariants : variants;
+		const bool chosenReady = table.ready(parallax.key());
+		const uint32_t drawnKey = chosenReady ? parallax.key() : fallbackKey;
+		if (!shader || drawnKey != shaderKey)
+		{
+			shaderKey = drawnKey;
+			shader = &(chosenReady ? table : variants).get(shaderKey);
+			// Call glUseProgram on the shader
+			shader->use();
+			//Sets a uniform of the active shader program, passing through the name of the uniform and the value
+			//Here it's setting ints for the maps
+			shader->setInt("diffuseMap", 0);
+			shader->setInt("normalMap", 1);
+			shader->setInt("depthMap", 2);
+			shader->setInt("coneMap", 3);
+			shader->setInt("heightPyramid", 4);
+			shader->setInt("minLayers", minLayers);
+			projectionUniform = shader->uniform("projection");
+			viewUniform = shader->uniform("view");
+			modelUniform = shader->uniform("model");
+			viewPosUniform = shader->uniform("viewPos");
+			lightPosUniform = shader->uniform("lightPos");
+			heightScaleUniform = shader->uniform("heightScale");
+			shader->setFloat("tessEdgePixels", tessEdgePixels);
+			shader->setFloat("worldPerTexCoord", quadWorldPerTexCoord);
+			shader->setFloat("displacementNear", displacementNear);
+			shader->setFloat("displacementFar", displacementFar);
+			viewportHeightUniform = shader->uniform("viewportHeight");
+		}
+		shader->use();
 		//Setting 4x4 matrices in the shaders for the projection and view
-		shader.setMat4("projection", projection);
-		shader.setMat4("view", view);
+		shader->setMat4(projectionUniform, projection);
+		shader->setMat4(viewUniform, view);
 		//Create a quad
 		glm::mat4 model = glm::mat4(1.0f);
 		//Rotatest the model
 		model = glm::rotate(model, glm::radians((float)glfwGetTime() * -10.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
 		//Setting the model, the position of the camera, the light posiiton, and the height scale to the shader
-		shader.setMat4("model", model);
-		shader.setVec3("viewPos", camera.Position);
-		shader.setVec3("lightPos", lightPos);
-		shader.setFloat("heightScale", heightScale);
+		shader->setMat4(modelUniform, model);
+		shader->setVec3(viewPosUniform, camera.Position);
+		shader->setVec3(lightPosUniform, lightPos);
+		shader->setFloat(heightScaleUniform, heightScale);
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		shader->setFloat(viewportHeightUniform, (float)framebufferHeight);
 		//Prints the current height scale, which can be altered by using Q and E
 		std::cout << heightScale << std::endl;
 		//Sets the texture to be effected by following references
@@ -142,25 +290,119 @@ int main()
 		glBindTexture(GL_TEXTURE_2D, diffuseMap);
 		glActiveTexture(GL_TEXTURE1);
 		glBindTexture(GL_TEXTURE_2D, normalMap);
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, heightMap);
-		//Renders the quad
-		renderQuad();
+		//A packed material has its height in the normal map, so there's no third texture to bind
+		if (!packedHeight)
+		{
+			glActiveTexture(GL_TEXTURE2);
+			glBindTexture(GL_TEXTURE_2D, heightMap);
+		}
+		if (parallax.mode == PARALLAX_CONE)
+		{
+			glActiveTexture(GL_TEXTURE3);
+			glBindTexture(GL_TEXTURE_2D, coneMap);
+		}
+		if (parallax.mode == PARALLAX_PYRAMID)
+		{
+			glActiveTexture(GL_TEXTURE4);
+			glBindTexture(GL_TEXTURE_2D, heightPyramid);
+		}
+		//Renders the quad, as patches for the tessellated variants, and in the vertex format the variant drawn reads
+		const ParallaxVariant drawn = ParallaxVariant::fromKey(shaderKey);
+		renderQuad(drawn.tessellated, drawn.tangentFrame(), drawn.quantized ? shader : NULL);
+
+		//Uploads a slice of whatever is streaming in, then reports the texture memory once it has all arrived
+		uploads.drain(uploadBudget);
+		if (!texturesReported && uploads.idle())
+		{
+			std::cout << "Texture memory: " << textures.memoryUsage() / 1024 << " KB" << std::endl;
+			texturesReported = true;
+		}
 
 		// Swaps between the currently displayed buffer and the buffer being drawn to
 		glfwSwapBuffers(window);
 		//Checks for input/events and calls the appropriate callback function
 		glfwPollEvents();
 	}
+	//Drops any uploads still in progress, then releases the maps back to the texture cache, which deletes them now
+	//nothing else uses them. Maps that never arrived are still placeholders, which the cache ignores.
+	uploads.clear();
+	textures.release(diffuseMap);
+	textures.release(normalMap);
+	if (!packedHeight)
+		textures.release(heightMap);
+	textures.release(coneMap);
+	textures.release(heightPyramid);
+	//The ring's buffer has to go while the context is still alive
+	textures.disableUploadRing();
+	//As do the programs, and the compiler's context
+	variants.clear();
+	tessellatedVariants.clear();
+	ShaderCompiler::instance().disableWorker();
+	//And the quad's buffers
+	releaseQuad();
 	//Cleans and deletes all the allocated GLFW resources
 	glfwTerminate();
 	return 0;
 }
 
-// Function to render a 1x1 quad
+// Submits the selected variant to the compiler, along with every variant one key press away from it: each other
+// mode, shadows toggled, each other vertex format, quantized streams toggled and tessellation toggled when the
+// driver can tessellate. Variants already built or submitted are skipped, so the rest of the permutations are only
+// compiled, and cached, once they're close to being drawn.
+void requestVariants(const ParallaxVariant &selected, ShaderVariants &variants, ShaderVariants &tessellatedVariants, bool tessellation)
+{
+	std::vector<ParallaxVariant> wanted(1, selected);
+	for (int mode = PARALLAX_NONE; mode <= PARALLAX_PYRAMID; mode++)
+	{
+		ParallaxVariant variant = selected;
+		variant.mode = (ParallaxMode)mode;
+		if (variant.mode != selected.mode)
+			wanted.push_back(variant);
+	}
+	ParallaxVariant shadowed = selected;
+	shadowed.shadows = !selected.shadows;
+	wanted.push_back(shadowed);
+	for (int frame = TANGENT_FRAME_VECTORS; frame <= TANGENT_FRAME_DERIVATIVES; frame++)
+	{
+		ParallaxVariant variant = selected;
+		variant.qtangents = frame == TANGENT_FRAME_QTANGENT;
+		variant.derivativeFrame = frame == TANGENT_FRAME_DERIVATIVES;
+		if (variant.tangentFrame() != selected.tangentFrame())
+			wanted.push_back(variant);
+	}
+	ParallaxVariant quantized = selected;
+	quantized.quantized = !selected.quantized;
+	wanted.push_back(quantized);
+	if (tessellation)
+	{
+		ParallaxVariant tessellated = selected;
+		tessellated.tessellated = !selected.tessellated;
+		wanted.push_back(tessellated);
+	}
+	std::vector<uint32_t> plainKeys, tessellatedKeys;
+	for (const ParallaxVariant &variant : wanted)
+		(variant.tessellated ? tessellatedKeys : plainKeys).push_back(variant.key());
+	variants.request(plainKeys);
+	if (!tessellatedKeys.empty())
+		tessellatedVariants.request(tessellatedKeys);
+}
+
+// Function to render a 1x1 quad, as triangles or as patches of 3 vertices for the tessellation stages. frame picks
+// the vertex format: Vertex, QTangentVertex for variants built with QTANGENT, or TangentlessVertex for variants
+// built with DERIVATIVE_FRAME. Given a shader built with QUANTIZED, it's drawn from quantized streams instead,
+// setting their dequantization uniforms on the shader.
 unsigned int quadVAO = 0;
 unsigned int quadVBO;
-void renderQuad()
+// The quad in the other formats, by TangentFrame. The first entry is quadVAO's, which draws without indices.
+unsigned int frameQuadVAOs[3];
+unsigned int frameQuadVBOs[3];
+unsigned int frameQuadEBOs[3];
+// The quantized quads, by TangentFrame
+QuantizedVertices quantizedQuads[3];
+unsigned int quantizedQuadVAOs[3];
+unsigned int quantizedQuadVBOs[3];
+unsigned int quantizedQuadEBOs[3];
+void renderQuad(bool patches, TangentFrame frame, const Shader *quantized)
 {
 	if (quadVAO == 0)
 	{
@@ -269,14 +511,75 @@ void renderQuad()
 		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(8 * sizeof(float)));
 		glEnableVertexAttribArray(4);
 		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(float), (void*)(11 * sizeof(float)));
+
+		//The compact copy: each vertex's position, texture coordinates and tangent frame quaternion, 28 bytes
+		//instead of 56, and the tangentless one, 32 bytes. Mesh::createBuffers sets up the attributes the same
+		//way it does for a Model.
+		QTangentVertex compactVertices[6];
+		TangentlessVertex tangentlessVertices[6];
+		std::vector<Vertex> vertices(6);
+		for (int i = 0; i < 6; i++)
+		{
+			const float *v = quadVertices + i * 14;
+			Vertex &vertex = vertices[i];
+			vertex.Position = glm::vec3(v[0], v[1], v[2]);
+			vertex.Normal = glm::vec3(v[3], v[4], v[5]);
+			vertex.TexCoords = glm::vec2(v[6], v[7]);
+			vertex.Tangent = glm::vec3(v[8], v[9], v[10]);
+			vertex.Bitangent = glm::vec3(v[11], v[12], v[13]);
+			compactVertices[i] = QTangentVertex(vertex);
+			tangentlessVertices[i] = TangentlessVertex(vertex);
+		}
+		const unsigned int quadIndices[6] = { 0, 1, 2, 3, 4, 5 };
+		frameQuadVAOs[TANGENT_FRAME_VECTORS] = quadVAO;
+		frameQuadVBOs[TANGENT_FRAME_VECTORS] = quadVBO;
+		frameQuadEBOs[TANGENT_FRAME_VECTORS] = 0;
+		Mesh::createBuffers(TANGENT_FRAME_QTANGENT, sizeof(compactVertices), compactVertices, 6, quadIndices, frameQuadVAOs[TANGENT_FRAME_QTANGENT], frameQuadVBOs[TANGENT_FRAME_QTANGENT], frameQuadEBOs[TANGENT_FRAME_QTANGENT]);
+		Mesh::createBuffers(TANGENT_FRAME_DERIVATIVES, sizeof(tangentlessVertices), tangentlessVertices, 6, quadIndices, frameQuadVAOs[TANGENT_FRAME_DERIVATIVES], frameQuadVBOs[TANGENT_FRAME_DERIVATIVES], frameQuadEBOs[TANGENT_FRAME_DERIVATIVES]);
+		//The quantized copies: 24 bytes a vertex with octahedral directions, 20 with a QTangent and 16 with only
+		//the normal
+		for (int f = 0; f < 3; f++)
+		{
+			quantizedQuads[f] = VertexQuantizer::quantize(vertices, VertexEncoding(), (TangentFrame)f);
+			Mesh::createBuffers(quantizedQuads[f], quantizedQuads[f].data.size(), quantizedQuads[f].data.data(), 6, quadIndices, quantizedQuadVAOs[f], quantizedQuadVBOs[f], quantizedQuadEBOs[f]);
+		}
+	}
+	if (quantized)
+	{
+		quantized->setVec3("positionOffset", quantizedQuads[frame].positionOffset);
+		quantized->setVec3("positionScale", quantizedQuads[frame].positionScale);
+		glBindVertexArray(quantizedQuadVAOs[frame]);
 	}
-	glBindVertexArray(quadVAO);
+	else
+		glBindVertexArray(frameQuadVAOs[frame]);
 	//Draws from the array data with primitive type of GL_TRIANGLEs, starting index of 0, and 6 indicies to be drawn.
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+	//Patches are drawn from the same vertices, each triangle becoming one patch.
+	if (patches)
+	{
+		GLExtensions::get().patchParameteri(GL_PATCH_VERTICES, 3);
+		glDrawArrays(GL_PATCHES, 0, 6);
+	}
+	else
+		glDrawArrays(GL_TRIANGLES, 0, 6);
 	//Unbinds the vertex array
 	glBindVertexArray(0);
 }
 
+// Deletes every format's quad renderQuad made, if it made them. Must run while the context is alive.
+void releaseQuad()
+{
+	if (quadVAO == 0)
+		return;
+	//quadVAO and quadVBO are the first entries of the format arrays, and deleting a 0 buffer is ignored
+	glDeleteVertexArrays(3, frameQuadVAOs);
+	glDeleteBuffers(3, frameQuadVBOs);
+	glDeleteBuffers(3, frameQuadEBOs);
+	glDeleteVertexArrays(3, quantizedQuadVAOs);
+	glDeleteBuffers(3, quantizedQuadVBOs);
+	glDeleteBuffers(3, quantizedQuadEBOs);
+	quadVAO = 0;
+}
+
 // Deals with the inputs through polling glfw if a key has been pressed
 void processInput(GLFWwindow *window)
 {
@@ -306,6 +609,48 @@ void processInput(GLFWwindow *window)
 		else
 			heightScale = 1.0f;
 	}
+	//The number keys pick the parallax variant
+	if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+		parallax.mode = PARALLAX_NONE;
+	else if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+		parallax.mode = PARALLAX_OFFSET;
+	else if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+		parallax.mode = PARALLAX_STEEP;
+	else if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
+		parallax.mode = PARALLAX_OCCLUSION;
+	else if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS)
+		parallax.mode = PARALLAX_RELIEF;
+	else if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS)
+		parallax.mode = PARALLAX_CONE;
+	else if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS)
+		parallax.mode = PARALLAX_PYRAMID;
+	if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS)
+		parallax.shadows = false;
+	else if (glfwGetKey(window, GLFW_KEY_9) == GLFW_PRESS)
+		parallax.shadows = true;
+	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
+		parallax.tessellated = true;
+	else if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS)
+		parallax.tessellated = false;
+	if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS)
+	{
+		parallax.qtangents = true;
+		parallax.derivativeFrame = false;
+	}
+	else if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS)
+	{
+		parallax.qtangents = false;
+		parallax.derivativeFrame = true;
+	}
+	else if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
+	{
+		parallax.qtangents = false;
+		parallax.derivativeFrame = false;
+	}
+	if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
+		parallax.quantized = true;
+	else if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
+		parallax.quantized = false;
 }
 
 //Callback for resizing the window
@@ -341,58 +686,4 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
 	//Sends event to camera to process zooming
 	camera.ProcessMouseScroll(yoffset);
-}
-
-// Function to load a texture from a file path
-unsigned int loadTexture(char const * path)
-{
-	unsigned int textureID;
-	//GenTextures() generates a specified nunber of texture names in a specified array. This usage creates one texture name in textureID.
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	/*stbi_load() loads an image and stores it as char pointer that points to the pixel data
-	The first parameter is the image path, the second and third the dimensions, the fourth the image components per pixel,
-	and the last forces a specific number of components*/
-	unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format;
-		//Gets the format of the image from the stbi_load()
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-		//BindTexture() binds a named texture stated by the second parameter to the target specified by the first parameter.
-		//	In this case, it's binding the named texture textureID, generated above, to the TEXTURE_2D target.
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		/*TexImage2D() specifies a 2D texture image. The first parameter in the function states the target texture.
-		The second parameter states the image level; the third parameter the number of colour components in the texture; the fourth parameter the width; the fifth parameter the height.
-		The next parameter is the width of the border which has to be 0, and the seventh parameter is the format of the pixel data.
-		The eighth parameter states the data type of the pixel data, and then the last parameter points to the image data itself.
-		So for this use, it uses the GL_TEXTURE_2D to get the target texture. It indicates the base image level of 0 and the format from above.
-		Then it inputs the width and height, then the required value of 0 for the border, followed by format again.
-		Finally, it states that data type of the pixel data is gl::UNSIGNED_BYTE and then points to the data attached loaded fromt the stbi_load().*/
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		//Generates a mipmap for the GL_TEXTURE_2D texture object
-		glGenerateMipmap(GL_TEXTURE_2D);
-		//These specify rules/settingsf for the GL_TEXTURE_2D texture object, such as here where it states it should repeat the texture in either direction
-		//if it extends beyond the texture's size, along with the texture filtering for how OpenGL chooses the texture pixel colour from.
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		//Frees the loaded image
-		stbi_image_free(data);
-	}
-	//Error catch
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-	//Returns the texture's ID
-	return textureID;
 }
\ No newline at end of file
@@ -0,0 +1,19 @@
+// Builds a tangent frame per pixel from the screen space derivatives of the position and texture coordinates,
+// after Schüler's "Normal Mapping without Precomputed Tangents" (ShaderX5, 2006). Solving the derivatives for the
+// gradients of u and v across the surface gives the directions the texture's axes run in, mirrored UVs included.
+// They're normalized on their own, as vert.vs normalizes stored tangents, so heightScale means the same on both
+// paths. The derivatives are constant over each triangle, so on curved meshes the frame can step slightly at
+// triangle edges where stored tangents would have been interpolated smoothly.
+mat3 CotangentFrame(vec3 N, vec3 position, vec2 texCoords)
+{
+    vec3 dp1 = dFdx(position);
+    vec3 dp2 = dFdy(position);
+    vec2 duv1 = dFdx(texCoords);
+    vec2 duv2 = dFdy(texCoords);
+    vec3 dp2perp = cross(dp2, N);
+    vec3 dp1perp = cross(N, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    // Triangles with no texture area have no gradients, and get a zero frame rather than NaNs
+    return mat3(T * inversesqrt(max(dot(T, T), 1e-20)), B * inversesqrt(max(dot(B, B), 1e-20)), N);
+}
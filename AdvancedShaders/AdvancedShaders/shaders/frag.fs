@@ -1,46 +1,116 @@
 #version 330 core
+// Variant defines, inserted by ShaderVariants after the #version line (see ParallaxVariant.h). The defaults
+// below give the original offset mapping when the shader is built without them.
+//   PARALLAX_MODE     0 none, 1 offset, 2 steep, 3 occlusion (POM), 4 relief, 5 relaxed cone stepping,
+//                     6 min depth pyramid
+//   PARALLAX_STEPS    most depth layers the searches and the shadow rays take, at grazing angles
+//   PARALLAX_REFINE_STEPS  binary search steps relief mapping takes after its linear search
+//   PARALLAX_CONE_STEPS, PARALLAX_CONE_REFINE_STEPS  cone steps and binary search steps of cone stepping
+//   PARALLAX_PYRAMID_STEPS  most cells the pyramid march visits, over all levels
+//   PARALLAX_SHADOWS  1 to shadow the surface by its own height field
+//   PACKED_HEIGHT     1 when the height map is in the alpha of normalMap
+//   TESSELLATION      1 when drawn through tess.tes, which displaces the surface and leaves parallax the rest
+//   DERIVATIVE_FRAME  1 to build the tangent frame here from derivatives, for meshes without tangents
+#ifndef PARALLAX_MODE
+#define PARALLAX_MODE 1
+#endif
+#ifndef PARALLAX_STEPS
+#define PARALLAX_STEPS 16
+#endif
+#ifndef PARALLAX_REFINE_STEPS
+#define PARALLAX_REFINE_STEPS 5
+#endif
+#ifndef PARALLAX_CONE_STEPS
+#define PARALLAX_CONE_STEPS 12
+#endif
+#ifndef PARALLAX_CONE_REFINE_STEPS
+#define PARALLAX_CONE_REFINE_STEPS 6
+#endif
+#ifndef PARALLAX_PYRAMID_STEPS
+#define PARALLAX_PYRAMID_STEPS 64
+#endif
+#ifndef PARALLAX_SHADOWS
+#define PARALLAX_SHADOWS 0
+#endif
+#ifndef PACKED_HEIGHT
+#define PACKED_HEIGHT 0
+#endif
+#ifndef TESSELLATION
+#define TESSELLATION 0
+#endif
+#ifndef DERIVATIVE_FRAME
+#define DERIVATIVE_FRAME 0
+#endif
+
 out vec4 FragColor;
 
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+#if DERIVATIVE_FRAME
+    // World space, for CotangentFrame()
+    vec3 Normal;
+#else
     vec3 TangentLightPos;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
+#endif
 } fs_in;
+#if TESSELLATION
+// How much of the depth tess.tes left for parallax to fake: none near the camera, all of it far away
+in float ParallaxWeight;
+#endif
 
 uniform sampler2D diffuseMap;
 uniform sampler2D normalMap;
 uniform sampler2D depthMap;
+// Depth and relaxed cones, for cone stepping (see ConeStepBaker.h)
+uniform sampler2D coneMap;
+// The height map with each mip texel the shallowest depth under it, for the pyramid march
+uniform sampler2D heightPyramid;
 
 uniform float heightScale;
 
-vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir)
-{ 
-    float height =  texture(depthMap, texCoords).r;     
-    return texCoords - viewDir.xy * (height * heightScale);        
-}
+#if DERIVATIVE_FRAME
+uniform vec3 lightPos;
+uniform vec3 viewPos;
+#include "cotangent.glsl"
+#endif
+#include "parallax.glsl"
 
 void main()
 {           
+#if DERIVATIVE_FRAME
+    // Into tangent space by a frame built from derivatives, which has to happen before anything can discard
+    mat3 TBN = transpose(CotangentFrame(normalize(fs_in.Normal), fs_in.FragPos, fs_in.TexCoords));
+    vec3 tangentLightPos = TBN * lightPos;
+    vec3 tangentViewPos = TBN * viewPos;
+    vec3 tangentFragPos = TBN * fs_in.FragPos;
+#else
+    vec3 tangentLightPos = fs_in.TangentLightPos;
+    vec3 tangentViewPos = fs_in.TangentViewPos;
+    vec3 tangentFragPos = fs_in.TangentFragPos;
+#endif
     // offset texture coordinates with Parallax Mapping
-    vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
+    vec3 viewDir = normalize(tangentViewPos - tangentFragPos);
     vec2 texCoords = fs_in.TexCoords;
+    vec2 dx = dFdx(texCoords);
+    vec2 dy = dFdy(texCoords);
     
-    texCoords = ParallaxMapping(fs_in.TexCoords,  viewDir);       
+    texCoords = ParallaxMapping(fs_in.TexCoords,  viewDir, dx, dy);       
     if(texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0)
         discard;
 
-    // obtain normal from normal map
-    vec3 normal = texture(normalMap, texCoords).rgb;
-    normal = normalize(normal * 2.0 - 1.0);   
+    // obtain normal from normal map. Only x and y are stored (BC5), z is rebuilt from the unit length
+    vec2 normalXY = texture(normalMap, texCoords).rg * 2.0 - 1.0;
+    vec3 normal = normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
    
     // get diffuse color
     vec3 color = texture(diffuseMap, texCoords).rgb;
     // ambient
     vec3 ambient = 0.1 * color;
     // diffuse
-    vec3 lightDir = normalize(fs_in.TangentLightPos - fs_in.TangentFragPos);
+    vec3 lightDir = normalize(tangentLightPos - tangentFragPos);
     float diff = max(dot(lightDir, normal), 0.0);
     vec3 diffuse = diff * color;
     // specular    
@@ -49,5 +119,11 @@ void main()
     float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
 
     vec3 specular = vec3(0.2) * spec;
+#if PARALLAX_SHADOWS
+    // Only the direct light is shadowed
+    float visibility = ParallaxShadow(texCoords, lightDir, SampleHeight(texCoords, dx, dy), dx, dy);
+    diffuse *= visibility;
+    specular *= visibility;
+#endif
     FragColor = vec4(ambient + diffuse + specular, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,213 @@
+// Height field sampling and parallax mapping for frag.fs, specialised at compile time by the variant defines.
+// Heights are depths: 0 is the top of the surface and 1 the deepest point.
+
+// Fewest depth layers the searches take, used when looking straight at the surface. PARALLAX_STEPS is the most,
+// used at grazing angles; the count in between follows how steeply the view meets the surface. Taken as at least
+// 1, so an unset uniform can't leave the searches with no layers to divide the depth between.
+uniform int minLayers;
+
+// The depth the parallax modes fake, less whatever tessellation has already displaced
+float ParallaxScale()
+{
+#if TESSELLATION
+    return heightScale * ParallaxWeight;
+#else
+    return heightScale;
+#endif
+}
+
+// Samples the height field with the gradients of the unoffset coordinates, so the mip level stays put inside
+// the marching loops, where implicit derivatives aren't defined
+float SampleHeight(vec2 texCoords, vec2 dx, vec2 dy)
+{
+#if PACKED_HEIGHT
+    return textureGrad(normalMap, texCoords, dx, dy).a;
+#else
+    return textureGrad(depthMap, texCoords, dx, dy).r;
+#endif
+}
+
+// The number of depth layers for a tangent space direction: minLayers head on, PARALLAX_STEPS edge on.
+// dot(N, dir) is just dir.z in tangent space.
+float LayerCount(vec3 dir)
+{
+    float fewest = float(clamp(minLayers, 1, PARALLAX_STEPS));
+    return max(floor(mix(float(PARALLAX_STEPS), fewest, abs(dir.z))), 1.0);
+}
+
+vec2 ParallaxMapping(vec2 texCoords, vec3 viewDir, vec2 dx, vec2 dy)
+{
+#if PARALLAX_MODE == 0
+    return texCoords;
+#elif PARALLAX_MODE == 1
+    float height = SampleHeight(texCoords, dx, dy);
+    return texCoords - viewDir.xy * (height * ParallaxScale());
+#elif PARALLAX_MODE == 5
+    // Relaxed cone stepping: every step jumps to where the ray leaves the empty cone above the texel it's over,
+    // so it crosses open space in a few steps. The ray is in texture coordinates and depth, one unit of depth
+    // moving it the depth scale along the view direction's slope.
+    vec3 rayDir = vec3(-viewDir.xy / viewDir.z * ParallaxScale(), 1.0);
+    float rayRatio = length(rayDir.xy);
+    vec3 ray = vec3(texCoords, 0.0);
+    for (int i = 0; i < PARALLAX_CONE_STEPS; i++)
+    {
+        vec2 cone = textureLod(coneMap, ray.xy, 0.0).rg;
+        float coneRatio = cone.g * cone.g;
+        float gap = max(cone.r - ray.z, 0.0);
+        ray += rayDir * (coneRatio * gap / (rayRatio + coneRatio));
+    }
+    // Relaxed cones let the last step go past the surface, but never through it twice, so the crossing is found
+    // with a binary search over the ray so far
+    vec3 range = 0.5 * rayDir * ray.z;
+    vec3 position = vec3(texCoords, 0.0) + range;
+    for (int i = 0; i < PARALLAX_CONE_REFINE_STEPS; i++)
+    {
+        range *= 0.5;
+        if (position.z < textureLod(coneMap, position.xy, 0.0).r)
+            position += range;
+        else
+            position -= range;
+    }
+    return position.xy;
+#elif PARALLAX_MODE == 6
+    // Min depth pyramid (maximum mipmap) tracing: each texel of level l is the shallowest depth of the 2^l x 2^l
+    // base texels under it, so a ray above it can skip the whole cell. The ray starts at the top level, drops
+    // to a finer level whenever it could meet the surface in its cell, and climbs back up after leaving a cell,
+    // so open space is crossed in big cells and only the texels near the surface are visited one by one.
+    // Cells are worked out in base texels, so the folded last texel of odd sized levels stays conservative.
+    // The ray's position wraps around the texture like the texture coordinates of a tiled surface do, and no cell
+    // reaches past the texture's edge, so the ray stops there to look again from the other side.
+    vec2 size = vec2(textureSize(heightPyramid, 0));
+    int top = int(floor(log2(max(size.x, size.y))));
+    vec3 rayDir = vec3(-viewDir.xy / viewDir.z * ParallaxScale(), 1.0);
+    // The ray's direction in base texels per unit of depth, kept off zero so the cell exits stay finite
+    vec2 texelDir = rayDir.xy * size;
+    texelDir = mix(texelDir, vec2(1e-6), lessThan(abs(texelDir), vec2(1e-6)));
+    vec2 stepDir = sign(texelDir);
+    vec3 ray = vec3(texCoords, 0.0);
+    int level = top;
+    for (int i = 0; i < PARALLAX_PYRAMID_STEPS; i++)
+    {
+        float extent = exp2(float(level));
+        // Nudged along the ray, so a ray sitting on a cell edge is in the cell it's heading into, then wrapped
+        // into the texture. texel is the ray's position in the wrapped copy it's heading into.
+        vec2 nudged = mod(ray.xy * size + stepDir * 0.001, size);
+        vec2 texel = nudged - stepDir * 0.001;
+        vec2 cell = floor(nudged / extent);
+        ivec2 levelSize = textureSize(heightPyramid, level);
+        float shallowest = texelFetch(heightPyramid, clamp(ivec2(cell), ivec2(0), levelSize - 1), level).r;
+        if (ray.z < shallowest)
+        {
+            // Above everything in the cell: go down to its shallowest depth, or to where the ray leaves the cell
+            vec2 exits = (mix(cell * extent, min((cell + 1.0) * extent, size), greaterThan(stepDir, vec2(0.0))) - texel) / texelDir;
+            float exit = min(exits.x, exits.y);
+            float down = shallowest - ray.z;
+            if (down < exit)
+            {
+                ray += rayDir * down;
+                if (level == 0)
+                    break;
+                level--;
+            }
+            else
+            {
+                ray += rayDir * exit;
+                level = min(level + 1, top);
+            }
+        }
+        else if (level == 0)
+            break;
+        else
+            level--;
+        if (ray.z >= 1.0)
+            break;
+    }
+    // The march finds the surface of the nearest texel; a binary search over the last texel of the ray finds
+    // where it meets the filtered height field between the texels
+    float back = min(ray.z, 1.0 / max(length(texelDir), 1.0));
+    vec3 above = ray - rayDir * back;
+    vec3 below = ray;
+    for (int i = 0; i < PARALLAX_REFINE_STEPS; i++)
+    {
+        vec3 middle = 0.5 * (above + below);
+        if (middle.z < SampleHeight(middle.xy, dx, dy))
+            above = middle;
+        else
+            below = middle;
+    }
+    return 0.5 * (above.xy + below.xy);
+#else
+    // Steep parallax: step along the view ray one depth layer at a time until it passes below the surface. The
+    // loop bound is the compile time maximum, and the adaptive count ends it early.
+    float layers = LayerCount(viewDir);
+    float layerDepth = 1.0 / layers;
+    vec2 deltaTexCoords = viewDir.xy / viewDir.z * ParallaxScale() * layerDepth;
+    float currentLayerDepth = 0.0;
+    float currentDepth = SampleHeight(texCoords, dx, dy);
+    for (int i = 0; i < PARALLAX_STEPS; i++)
+    {
+        if (float(i) >= layers || currentLayerDepth >= currentDepth)
+            break;
+        texCoords -= deltaTexCoords;
+        currentDepth = SampleHeight(texCoords, dx, dy);
+        currentLayerDepth += layerDepth;
+    }
+#if PARALLAX_MODE == 3
+    // Parallax occlusion mapping: the surface is taken as a straight line between the layers either side of the
+    // crossing, and the ray meets it where the two depth differences are in proportion
+    vec2 prevTexCoords = texCoords + deltaTexCoords;
+    float after = currentDepth - currentLayerDepth;
+    float before = SampleHeight(prevTexCoords, dx, dy) - currentLayerDepth + layerDepth;
+    float weight = abs(after - before) > 0.00001 ? after / (after - before) : 0.0;
+    return mix(texCoords, prevTexCoords, clamp(weight, 0.0, 1.0));
+#elif PARALLAX_MODE == 4
+    // Relief mapping: a binary search between the layers either side of the crossing, halving the interval each
+    // step towards whichever half the surface is in
+    for (int i = 0; i < PARALLAX_REFINE_STEPS; i++)
+    {
+        deltaTexCoords *= 0.5;
+        layerDepth *= 0.5;
+        if (currentDepth < currentLayerDepth)
+        {
+            texCoords += deltaTexCoords;
+            currentLayerDepth -= layerDepth;
+        }
+        else
+        {
+            texCoords -= deltaTexCoords;
+            currentLayerDepth += layerDepth;
+        }
+        currentDepth = SampleHeight(texCoords, dx, dy);
+    }
+    return texCoords;
+#else
+    return texCoords;
+#endif
+#endif
+}
+
+#if PARALLAX_SHADOWS
+// How much light reaches a point of the height field at the given depth: the ray towards the light is stepped
+// up through the layers above it, and the deepest the surface reaches over the ray, weighted towards nearby
+// occluders, darkens the point
+float ParallaxShadow(vec2 texCoords, vec3 lightDir, float depth, vec2 dx, vec2 dy)
+{
+    if (lightDir.z <= 0.0)
+        return 0.0;
+    float layers = LayerCount(lightDir);
+    float layerDepth = max(depth, 0.0001) / layers;
+    vec2 deltaTexCoords = lightDir.xy / lightDir.z * ParallaxScale() * layerDepth;
+    float rayDepth = depth;
+    float occlusion = 0.0;
+    for (int i = 1; i < PARALLAX_STEPS; i++)
+    {
+        if (float(i) >= layers || rayDepth <= 0.0)
+            break;
+        texCoords += deltaTexCoords;
+        rayDepth -= layerDepth;
+        float surface = SampleHeight(texCoords, dx, dy);
+        occlusion = max(occlusion, (rayDepth - surface) * (1.0 - float(i) / layers));
+    }
+    return 1.0 - clamp(occlusion * 8.0, 0.0, 1.0);
+}
+#endif
@@ -0,0 +1,10 @@
+// Rebuilds a tangent frame from a QTangent (see QTangent.h): the tangent, bitangent and normal are the columns of
+// the quaternion's rotation, and the sign of w says whether the bitangent is mirrored. The attribute is snorm16,
+// so GL hands it over already in -1 to 1.
+void QTangentFrame(vec4 packed, out vec3 tangent, out vec3 bitangent, out vec3 normal)
+{
+    vec4 q = normalize(packed);
+    tangent = vec3(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z), 2.0 * (q.x * q.z - q.w * q.y));
+    normal = vec3(2.0 * (q.x * q.z + q.w * q.y), 2.0 * (q.y * q.z - q.w * q.x), 1.0 - 2.0 * (q.x * q.x + q.y * q.y));
+    bitangent = cross(normal, tangent) * (q.w < 0.0 ? -1.0 : 1.0);
+}
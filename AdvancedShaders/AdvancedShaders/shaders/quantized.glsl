@@ -0,0 +1,18 @@
+// Decoding for quantized vertex streams (see VertexQuantizer.h). Positions arrive from unorm16 as fractions of the
+// mesh's bounding box, which positionOffset and positionScale map back to model space (float positions come with
+// an identity transform). Directions arrive from snorm16 as points on the folded octahedron.
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 QuantizedPosition(vec3 stored)
+{
+    return positionOffset + stored * positionScale;
+}
+
+vec3 OctahedralDirection(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
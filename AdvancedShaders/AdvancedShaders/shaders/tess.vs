@@ -0,0 +1,70 @@
+#version 400 core
+// The vertex stage of tessellated displacement: vertices only move to world space here, and tess.tes builds the
+// per vertex outputs of vert.vs for every vertex the tessellator makes
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoords;
+#if QUANTIZED
+// Positions relative to the mesh's bounds, texture coordinates as halves and directions octahedral encoded
+#include "quantized.glsl"
+#endif
+#if DERIVATIVE_FRAME
+// Only the normal: frag.fs builds the tangent and bitangent from derivatives (TangentlessVertex)
+#if QUANTIZED
+layout (location = 1) in vec2 aNormalOct;
+#else
+layout (location = 1) in vec3 aNormal;
+#endif
+#elif QTANGENT
+// The whole tangent frame as one quaternion (QTangentVertex)
+layout (location = 5) in vec4 aQTangent;
+#include "qtangent.glsl"
+#elif QUANTIZED
+// The normal, tangent and bitangent, each octahedral encoded
+layout (location = 1) in vec2 aNormalOct;
+layout (location = 3) in vec2 aTangentOct;
+layout (location = 4) in vec2 aBitangentOct;
+#else
+layout (location = 1) in vec3 aNormal;
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+#endif
+
+out PATCH_IN {
+    vec3 WorldPos;
+    vec2 TexCoords;
+#if !DERIVATIVE_FRAME
+    vec3 Tangent;
+    vec3 Bitangent;
+#endif
+    vec3 Normal;
+} vs_out;
+
+uniform mat4 model;
+
+void main()
+{
+#if QUANTIZED
+    vec3 position = QuantizedPosition(aPos);
+#else
+    vec3 position = aPos;
+#endif
+    vs_out.WorldPos = vec3(model * vec4(position, 1.0));
+    vs_out.TexCoords = aTexCoords;
+#if DERIVATIVE_FRAME
+#if QUANTIZED
+    vec3 aNormal = OctahedralDirection(aNormalOct);
+#endif
+#else
+#if QTANGENT
+    vec3 aTangent, aBitangent, aNormal;
+    QTangentFrame(aQTangent, aTangent, aBitangent, aNormal);
+#elif QUANTIZED
+    vec3 aTangent = OctahedralDirection(aTangentOct);
+    vec3 aBitangent = OctahedralDirection(aBitangentOct);
+    vec3 aNormal = OctahedralDirection(aNormalOct);
+#endif
+    vs_out.Tangent = mat3(model) * aTangent;
+    vs_out.Bitangent = mat3(model) * aBitangent;
+#endif
+    vs_out.Normal = mat3(model) * aNormal;
+}
@@ -1,16 +1,42 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#if QUANTIZED
+// Positions relative to the mesh's bounds, texture coordinates as halves and directions octahedral encoded
+#include "quantized.glsl"
+#endif
+#if DERIVATIVE_FRAME
+// Only the normal: frag.fs builds the tangent and bitangent from derivatives (TangentlessVertex)
+#if QUANTIZED
+layout (location = 1) in vec2 aNormalOct;
+#else
+layout (location = 1) in vec3 aNormal;
+#endif
+#elif QTANGENT
+// The whole tangent frame as one quaternion (QTangentVertex)
+layout (location = 5) in vec4 aQTangent;
+#include "qtangent.glsl"
+#elif QUANTIZED
+// The normal, tangent and bitangent, each octahedral encoded
+layout (location = 1) in vec2 aNormalOct;
+layout (location = 3) in vec2 aTangentOct;
+layout (location = 4) in vec2 aBitangentOct;
+#else
+layout (location = 1) in vec3 aNormal;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
+#endif
 
 out VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+#if DERIVATIVE_FRAME
+    vec3 Normal;
+#else
     vec3 TangentLightPos;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
+#endif
 } vs_out;
 
 uniform mat4 projection;
@@ -22,9 +48,28 @@ uniform vec3 viewPos;
 
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));   
+#if QUANTIZED
+    vec3 position = QuantizedPosition(aPos);
+#else
+    vec3 position = aPos;
+#endif
+    vs_out.FragPos = vec3(model * vec4(position, 1.0));   
     vs_out.TexCoords = aTexCoords;   
     
+#if DERIVATIVE_FRAME
+#if QUANTIZED
+    vec3 aNormal = OctahedralDirection(aNormalOct);
+#endif
+    vs_out.Normal = mat3(model) * aNormal;
+#else
+#if QTANGENT
+    vec3 aTangent, aBitangent, aNormal;
+    QTangentFrame(aQTangent, aTangent, aBitangent, aNormal);
+#elif QUANTIZED
+    vec3 aTangent = OctahedralDirection(aTangentOct);
+    vec3 aBitangent = OctahedralDirection(aBitangentOct);
+    vec3 aNormal = OctahedralDirection(aNormalOct);
+#endif
     vec3 T = normalize(mat3(model) * aTangent);
     vec3 B = normalize(mat3(model) * aBitangent);
     vec3 N = normalize(mat3(model) * aNormal);
@@ -33,6 +78,7 @@ void main()
     vs_out.TangentLightPos = TBN * lightPos;
     vs_out.TangentViewPos  = TBN * viewPos;
     vs_out.TangentFragPos  = TBN * vs_out.FragPos;
+#endif
     
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -1,2 +1,73 @@
+#include "DecodeTarget.h"
+
+#include <cstdlib>
+#include <cstring>
+
+//stb_image allocates through DecodeTarget, so decodes can be pointed at a mapped upload buffer
+#define STBI_MALLOC(size) DecodeTarget::allocate(size)
+#define STBI_REALLOC(p, size) DecodeTarget::reallocate(p, size)
+#define STBI_FREE(p) DecodeTarget::release(p)
 #define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
\ No newline at end of file
+#include "stb_image.h"
+
+namespace
+{
+	struct Target {
+		void *memory = nullptr;
+		size_t size = 0;
+		bool used = false;
+	};
+	//Each decoding thread has its own target
+	thread_local Target target;
+}
+
+void DecodeTarget::set(void *memory, size_t size)
+{
+	target.memory = memory;
+	target.size = size;
+	target.used = false;
+}
+
+void DecodeTarget::clear()
+{
+	target = Target();
+}
+
+bool DecodeTarget::holds(const void *p)
+{
+	return p != nullptr && p == target.memory && target.used;
+}
+
+void* DecodeTarget::allocate(size_t size)
+{
+	if (target.memory && !target.used && (size == target.size || size == target.size + 1))
+	{
+		target.used = true;
+		return target.memory;
+	}
+	return std::malloc(size);
+}
+
+void* DecodeTarget::reallocate(void *p, size_t size)
+{
+	if (p == nullptr)
+		return allocate(size);
+	//A buffer that grows can't stay in the target, so it moves to the heap and frees the target up again
+	if (holds(p))
+	{
+		void *moved = std::malloc(size);
+		if (moved)
+			std::memcpy(moved, p, size < target.size + 1 ? size : target.size + 1);
+		target.used = false;
+		return moved;
+	}
+	return std::realloc(p, size);
+}
+
+void DecodeTarget::release(void *p)
+{
+	if (holds(p))
+		target.used = false;
+	else
+		std::free(p);
+}